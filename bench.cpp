@@ -0,0 +1,320 @@
+/*
+ * bench.cpp
+ *
+ *  Created on: 18.10.2026
+ *      Author: misha
+ */
+
+#include "tools.h"
+#include "dxf.h"
+#include "dxfimport.h"
+#include "dxfwriter.h"
+#include "gcad.h"
+#include "gcadfile.h"
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+
+using namespace std;
+
+
+// This file is built only by Bench configuration, so counting operator new
+// below is in benchmark binary and not in application.
+
+// allocations of general heap made by whole program, benchmarks report
+// difference of it, array forms go through these too
+static volatile LONG g_heapAllocations = 0;
+
+
+void * operator new(size_t size) throw(bad_alloc)
+{
+	InterlockedIncrement(&g_heapAllocations);
+	void * result = malloc(size != 0 ? size : 1);
+	if (result == 0)
+		throw bad_alloc();
+	return result;
+}
+
+
+void operator delete(void * ptr) throw()
+{
+	free(ptr);
+}
+
+
+// returns time in milliseconds
+static double GetTimeMs()
+{
+	LARGE_INTEGER freq, counter;
+	if (!QueryPerformanceFrequency(&freq) || !QueryPerformanceCounter(&counter))
+		assert(0);
+	return counter.QuadPart * 1000.0 / freq.QuadPart;
+}
+
+
+// clones objects on general heap, the way those were allocated before pooling
+struct HeapCloner : IConstCadObjVisitor
+{
+	CadObject * m_result;
+	template <class T>
+	void Clone(const T & obj) { m_result = new (::operator new(sizeof(T))) T(obj); }
+	virtual void Visit(const CadLine & obj) { Clone(obj); }
+	virtual void Visit(const CadCircle & obj) { Clone(obj); }
+	virtual void Visit(const CadArc & obj) { Clone(obj); }
+	virtual void Visit(const CadPolyline & obj) { Clone(obj); }
+	virtual void Visit(const CadInsert & obj) { Clone(obj); }
+};
+
+
+static void HeapDelete(CadObject * obj)
+{
+	// with virtual bases CadObject is not necessarily at start of allocated block
+	void * mem = dynamic_cast<void *>(obj);
+	obj->~CadObject();
+	::operator delete(mem);
+}
+
+
+static void GenerateObjects(vector<CadObject *> & result, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		Point<double> pt(static_cast<double>(i % 100), static_cast<double>(i / 100));
+		switch (i % 4)
+		{
+		case 0:
+			result.push_back(new CadLine(pt, pt + Point<double>(1, 0.5)));
+			break;
+		case 1:
+			{
+				auto_ptr<CadCircle> circle(new CadCircle);
+				circle->Center = pt;
+				circle->Radius = 0.5;
+				result.push_back(circle.release());
+			}
+			break;
+		case 2:
+			{
+				Circle circle;
+				circle.Center = pt;
+				circle.Radius = 0.5;
+				result.push_back(new CadArc(circle, pt + Point<double>(0.5, 0), pt + Point<double>(0, 0.5), true));
+			}
+			break;
+		case 3:
+			{
+				// fragment, same as trim makes
+				CadLine line(pt, pt + Point<double>(1, 1));
+				CadLine * fragment = line.CutBegin(pt + Point<double>(0.5, 0.5));
+				assert(fragment != 0);
+				result.push_back(fragment);
+			}
+			break;
+		}
+	}
+}
+
+
+REGISTER_TOOL(L"benchalloc", AllocBenchTool);
+
+
+void AllocBenchTool::Start()
+{
+	const int drags = 100;
+	vector<CadObject *> generated;
+	vector<CadObject *> sources;
+	if (g_selected.empty())
+	{
+		GenerateObjects(generated, 10000);
+		sources = generated;
+	}
+	else
+	{
+		sources.assign(g_selected.begin(), g_selected.end());
+	}
+	vector<CadObject *> clones(sources.size());
+	Matrix3<double> displace = DisplaceMatrix(Point<double>(1, 1));
+
+	// each drag clones all objects, moves them and throws them away, like move tool does
+	LONG allocs = g_heapAllocations;
+	double start = GetTimeMs();
+	for (int drag = 0; drag < drags; drag++)
+	{
+		for (size_t i = 0; i < sources.size(); i++)
+		{
+			HeapCloner cloner;
+			sources[i]->Accept(cloner);
+			clones[i] = cloner.m_result;
+			clones[i]->Transform(displace);
+		}
+		for (size_t i = 0; i < clones.size(); i++)
+			HeapDelete(clones[i]);
+	}
+	double heapTime = GetTimeMs() - start;
+	unsigned long heapAllocs = static_cast<unsigned long>(g_heapAllocations - allocs);
+
+	allocs = g_heapAllocations;
+	start = GetTimeMs();
+	for (int drag = 0; drag < drags; drag++)
+	{
+		for (size_t i = 0; i < sources.size(); i++)
+		{
+			clones[i] = sources[i]->Clone();
+			clones[i]->Transform(displace);
+		}
+		for (size_t i = 0; i < clones.size(); i++)
+			delete clones[i];
+	}
+	double poolTime = GetTimeMs() - start;
+	// objects themselves come from pool, nodes of polylines still go to heap
+	unsigned long poolAllocs = static_cast<unsigned long>(g_heapAllocations - allocs);
+
+	for (vector<CadObject *>::iterator i = generated.begin(); i != generated.end(); i++)
+		delete *i;
+
+	wchar_t buffer[256];
+	int len = swprintf(buffer, sizeof(buffer) / sizeof(buffer[0]),
+			L"%lu objects, %d drags: heap %.2f ms (%.3f ms per drag, %lu heap allocations), "
+			L"pool %.2f ms (%.3f ms per drag, %lu heap allocations)",
+			static_cast<unsigned long>(sources.size()), drags,
+			heapTime, heapTime / drags, heapAllocs, poolTime, poolTime / drags, poolAllocs);
+	assert(len > 0);
+	g_console.Log(buffer);
+	ExitTool();
+}
+
+
+REGISTER_TOOL(L"benchdxf", DxfBenchTool);
+
+
+// writes objects to memory in given format and reads them back
+static void BenchDxfFormat(const vector<const CadObject *> & objects, DxfFormat format, const wchar_t * name)
+{
+	double start = GetTimeMs();
+	DxfWriter writer(format);
+	WriteDxfObjects(writer, objects);
+	writer.Finish();
+	double writeTime = GetTimeMs() - start;
+
+	const vector<char> & data = writer.GetData();
+	start = GetTimeMs();
+	DxfImporter importer;
+	importer.ImportBuffer(&data[0], &data[0] + data.size());
+	double readTime = GetTimeMs() - start;
+	assert(importer.GetError() == DxfOk);
+	assert(importer.GetFormat() == format);
+	assert(importer.GetEntityCount() == objects.size());
+
+	double mb = data.size() / (1024.0 * 1024.0);
+	wchar_t buffer[256];
+	int len = swprintf(buffer, sizeof(buffer) / sizeof(buffer[0]),
+			L"%ls: %lu objects, %.1f MB: write %.2f ms (%.1f MB/s), read %.2f ms (%.1f MB/s)",
+			name, static_cast<unsigned long>(objects.size()), mb,
+			writeTime, mb * 1000 / writeTime, readTime, mb * 1000 / readTime);
+	assert(len > 0);
+	g_console.Log(buffer);
+}
+
+
+void DxfBenchTool::Start()
+{
+	vector<CadObject *> generated;
+	vector<const CadObject *> sources;
+	if (g_selected.empty())
+	{
+		GenerateObjects(generated, 1000000);
+		sources.assign(generated.begin(), generated.end());
+	}
+	else
+	{
+		sources.assign(g_selected.begin(), g_selected.end());
+	}
+
+	// same drawing is written in both formats
+	BenchDxfFormat(sources, DxfFormatAscii, L"ascii");
+	BenchDxfFormat(sources, DxfFormatBinary, L"binary");
+
+	for (vector<CadObject *>::iterator i = generated.begin(); i != generated.end(); i++)
+		delete *i;
+	ExitTool();
+}
+
+
+REGISTER_TOOL(L"benchclip", ClipBenchTool);
+
+
+void ClipBenchTool::Start()
+{
+	vector<CadObject *> generated;
+	vector<const CadObject *> sources;
+	if (g_selected.empty())
+	{
+		GenerateObjects(generated, 100000);
+		sources.assign(generated.begin(), generated.end());
+	}
+	else
+	{
+		sources.assign(g_selected.begin(), g_selected.end());
+	}
+
+	// objects one by one, sized in first pass and written in second
+	double start = GetTimeMs();
+	size_t size = 0;
+	for (size_t i = 0; i < sources.size(); i++)
+		size += sources[i]->Serialize(0);
+	vector<unsigned char> serialized(size);
+	unsigned char * out = serialized.empty() ? 0 : &serialized[0];
+	for (size_t i = 0; i < sources.size(); i++)
+		out += sources[i]->Serialize(out);
+	double objectCopyTime = GetTimeMs() - start;
+
+	start = GetTimeMs();
+	vector<CadObject *> pasted;
+	const unsigned char * in = serialized.empty() ? 0 : &serialized[0];
+	Point<double> basePoint(numeric_limits<double>::max(), numeric_limits<double>::max());
+	while (size != 0)
+	{
+		int id;
+		ReadPtr(in, id, size);
+		CadObject * obj = CreateObjectById(id);
+		obj->Load(in, size);
+		pasted.push_back(obj);
+		basePoint = Point<double>(min(basePoint.X, obj->GetBoundingRect().Pt1.X),
+				min(basePoint.Y, obj->GetBoundingRect().Pt1.Y));
+	}
+	double objectPasteTime = GetTimeMs() - start;
+	for (vector<CadObject *>::iterator i = pasted.begin(); i != pasted.end(); i++)
+		delete *i;
+	pasted.clear();
+
+	start = GetTimeMs();
+	GcadArrays arrays;
+	MakeGcadArrays(sources, arrays);
+	vector<char> image;
+	WriteGcadMemory(arrays, image);
+	double bulkCopyTime = GetTimeMs() - start;
+
+	start = GetTimeMs();
+	GcadFile file(&image[0], image.size());
+	LoadGcadObjects(file, pasted);
+	basePoint = file.GetBounds().Pt1;
+	double bulkPasteTime = GetTimeMs() - start;
+	assert(pasted.size() == sources.size());
+	for (vector<CadObject *>::iterator i = pasted.begin(); i != pasted.end(); i++)
+		delete *i;
+
+	for (vector<CadObject *>::iterator i = generated.begin(); i != generated.end(); i++)
+		delete *i;
+
+	wchar_t buffer[256];
+	int len = swprintf(buffer, sizeof(buffer) / sizeof(buffer[0]),
+			L"%lu objects: by object copy %.2f ms, paste %.2f ms (%.1f MB); "
+			L"bulk copy %.2f ms, paste %.2f ms (%.1f MB)",
+			static_cast<unsigned long>(sources.size()), objectCopyTime, objectPasteTime,
+			serialized.size() / (1024.0 * 1024.0), bulkCopyTime, bulkPasteTime,
+			image.size() / (1024.0 * 1024.0));
+	assert(len > 0);
+	g_console.Log(buffer);
+	ExitTool();
+}
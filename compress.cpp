@@ -0,0 +1,169 @@
+/*
+ * compress.cpp
+ *
+ *  Created on: 18.10.2026
+ *      Author: misha
+ */
+#include "compress.h"
+#include <stdint.h>
+#include <cstring>
+
+
+using namespace std;
+
+
+static const size_t MIN_MATCH = 4;
+static const size_t MAX_OFFSET = 0xffff;
+// as in LZ4, last bytes of data are always literals
+static const size_t LAST_LITERALS = 5;
+static const size_t MF_LIMIT = 12;
+static const int HASH_BITS = 16;
+
+
+static uint32_t Read32(const char * p)
+{
+	uint32_t result;
+	memcpy(&result, p, sizeof(result));
+	return result;
+}
+
+
+static size_t Hash(uint32_t value)
+{
+	return (value * 2654435761u) >> (32 - HASH_BITS);
+}
+
+
+static void WriteLength(size_t length, vector<char> & result)
+{
+	for (; length >= 255; length -= 255)
+		result.push_back(static_cast<char>(255));
+	result.push_back(static_cast<char>(length));
+}
+
+
+static void WriteSequence(const char * literals, size_t literalCount, size_t offset, size_t matchLength,
+		vector<char> & result)
+{
+	size_t token = (literalCount < 15 ? literalCount : 15) << 4;
+	if (matchLength != 0)
+		token |= matchLength - MIN_MATCH < 15 ? matchLength - MIN_MATCH : 15;
+	result.push_back(static_cast<char>(token));
+	if (literalCount >= 15)
+		WriteLength(literalCount - 15, result);
+	result.insert(result.end(), literals, literals + literalCount);
+	if (matchLength == 0)
+		return;
+	result.push_back(static_cast<char>(offset & 0xff));
+	result.push_back(static_cast<char>(offset >> 8));
+	if (matchLength - MIN_MATCH >= 15)
+		WriteLength(matchLength - MIN_MATCH - 15, result);
+}
+
+
+void CompressBlock(const char * data, size_t size, vector<char> & result)
+{
+	result.reserve(result.size() + size / 2 + 16);
+	const char * anchor = data;
+	if (size > MF_LIMIT)
+	{
+		// positions of last occurrences of 4 byte sequences
+		vector<uint32_t> table(1 << HASH_BITS, 0);
+		const char * end = data + size;
+		const char * matchLimit = end - LAST_LITERALS;
+		const char * pos = data + 1;
+		while (pos < end - MF_LIMIT)
+		{
+			uint32_t value = Read32(pos);
+			size_t hash = Hash(value);
+			const char * candidate = data + table[hash];
+			table[hash] = static_cast<uint32_t>(pos - data);
+			if (candidate >= pos || static_cast<size_t>(pos - candidate) > MAX_OFFSET || Read32(candidate) != value)
+			{
+				// skipping faster through data which doesn't compress
+				pos += 1 + ((pos - anchor) >> 6);
+				continue;
+			}
+			const char * matchEnd = pos + MIN_MATCH;
+			const char * ref = candidate + MIN_MATCH;
+			while (matchEnd < matchLimit && *matchEnd == *ref)
+			{
+				matchEnd++;
+				ref++;
+			}
+			// extending match back over literals
+			while (pos > anchor && candidate > data && pos[-1] == candidate[-1])
+			{
+				pos--;
+				candidate--;
+			}
+			WriteSequence(anchor, pos - anchor, pos - candidate, matchEnd - pos, result);
+			anchor = pos = matchEnd;
+		}
+	}
+	WriteSequence(anchor, data + size - anchor, 0, 0, result);
+}
+
+
+// reads length continued in 255 bytes, returns false at end of data
+static bool ReadLength(const unsigned char *& pos, const unsigned char * end, size_t & length)
+{
+	for (;;)
+	{
+		if (pos == end)
+			return false;
+		unsigned char byte = *pos++;
+		length += byte;
+		if (byte != 255)
+			return true;
+	}
+}
+
+
+bool DecompressBlock(const char * data, size_t size, char * dest, size_t destSize)
+{
+	const unsigned char * pos = reinterpret_cast<const unsigned char *>(data);
+	const unsigned char * end = pos + size;
+	char * out = dest;
+	char * outEnd = dest + destSize;
+	while (pos != end)
+	{
+		unsigned token = *pos++;
+		size_t literals = token >> 4;
+		if (literals == 15 && !ReadLength(pos, end, literals))
+			return false;
+		if (literals > static_cast<size_t>(end - pos) || literals > static_cast<size_t>(outEnd - out))
+			return false;
+		memcpy(out, pos, literals);
+		out += literals;
+		pos += literals;
+		// last sequence has only literals
+		if (pos == end)
+			break;
+		if (end - pos < 2)
+			return false;
+		size_t offset = pos[0] | (pos[1] << 8);
+		pos += 2;
+		if (offset == 0 || offset > static_cast<size_t>(out - dest))
+			return false;
+		size_t length = token & 15;
+		if (length == 15 && !ReadLength(pos, end, length))
+			return false;
+		length += MIN_MATCH;
+		if (length > static_cast<size_t>(outEnd - out))
+			return false;
+		// match can overlap output it copies, so it goes byte by byte then
+		const char * ref = out - offset;
+		if (offset >= length)
+		{
+			memcpy(out, ref, length);
+			out += length;
+		}
+		else
+		{
+			for (size_t i = 0; i < length; i++)
+				*out++ = *ref++;
+		}
+	}
+	return out == outEnd;
+}
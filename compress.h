@@ -0,0 +1,28 @@
+/*
+ * compress.h
+ *
+ *  Created on: 18.10.2026
+ *      Author: misha
+ */
+
+#ifndef COMPRESS_H_
+#define COMPRESS_H_
+
+
+#include <cstddef>
+#include <vector>
+
+
+// Fast compression in format of LZ4 blocks: sequences of literals followed
+// by match of at least 4 bytes within previous 64 KB. It is meant for data
+// which is compressed once and read once, like clipboard, where speed
+// matters more than ratio.
+
+// appends compressed data to result, size should be less than 4 GB
+void CompressBlock(const char * data, size_t size, std::vector<char> & result);
+// decompresses data into dest of exactly destSize bytes,
+// returns false if data is damaged or doesn't give destSize bytes
+bool DecompressBlock(const char * data, size_t size, char * dest, size_t destSize);
+
+
+#endif /* COMPRESS_H_ */
@@ -5,119 +5,493 @@
  *      Author: misha
  */
 #include "dxf.h"
-#include "globals.h" // for LocalAllocStr and GetWinErrorStr
+#include "dxfimport.h"
+#include "dxfwriter.h"
+#include "gcad.h"
+#include "gcadfile.h"
+#include "globals.h"
+#include <process.h>
 #include <cstdio>
+#include <map>
 #include <string>
-#include <limits>
+#include <vector>
 
 
-class DxfReader
+using namespace std;
+
+
+enum DxfImportNotify
 {
-public:
-	explicit DxfReader(HANDLE hfile) : m_hfile(hfile), m_lastPos(0), m_bufSize(0)
+	DxfImportBlocks,
+	DxfImportBatch,
+	DxfImportProgress,
+	DxfImportDone,
+};
+
+
+namespace
+{
+	// makes shared blocks from dxf definitions when those are inserted first time,
+	// blocks which are not inserted are not made
+	class DxfBlockTable
 	{
-		assert(hfile != 0 && hfile != INVALID_HANDLE_VALUE);
+	public:
+		explicit DxfBlockTable(const vector<DxfBlock> & defs);
+		~DxfBlockTable();
+		// returns 0 if there is no such block or it inserts itself
+		CadBlock * GetBlock(const string & name);
+	private:
+		DxfBlockTable(const DxfBlockTable &);
+		DxfBlockTable & operator=(const DxfBlockTable &);
+		vector<DxfBlock> m_defs;
+		map<string, size_t> m_index;
+		// 0 for blocks which are not made yet
+		vector<CadBlock *> m_blocks;
+		vector<char> m_making;
+	};
+}
+
+
+// returns 0 for insert of unknown block
+static CadObject * CreateCadObject(const DxfEntity & entity, const DxfEntities & entities, DxfBlockTable & blocks)
+{
+	switch (entity.Type)
+	{
+	case DxfEntityLine:
+		return new CadLine(entity.Pt1, entity.Pt2);
+	case DxfEntityCircle:
+		{
+			auto_ptr<CadCircle> circle(new CadCircle);
+			circle->Center = entity.Center;
+			circle->Radius = entity.Radius;
+			return circle.release();
+		}
+	case DxfEntityArc:
+		{
+			Circle circle;
+			circle.Center = entity.Center;
+			circle.Radius = entity.Radius;
+			return new CadArc(circle, entity.Pt1, entity.Pt2, true);
+		}
+	case DxfEntityPolyline:
+		{
+			auto_ptr<CadPolyline> polyline(new CadPolyline);
+			polyline->Closed = entity.Closed;
+			polyline->Nodes.resize(entity.NodeCount);
+			for (size_t i = 0; i < entity.NodeCount; i++)
+			{
+				polyline->Nodes[i].point = entities.Nodes[entity.FirstNode + i].Pt;
+				polyline->Nodes[i].Bulge = entities.Nodes[entity.FirstNode + i].Bulge;
+			}
+			return polyline.release();
+		}
+	case DxfEntityInsert:
+		{
+			CadBlock * block = blocks.GetBlock(entities.Names[entity.Name]);
+			if (block == 0)
+				return 0;
+			Matrix3<double> scale(entity.Pt2.X, 0, 0, 0, entity.Pt2.Y, 0, 0, 0, 1);
+			double angle = entity.Radius * M_PI / 180;
+			return new CadInsert(block, DisplaceMatrix(entity.Pt1) * RotationMatrix(angle) * scale);
+		}
+	default:
+		assert(0);
+		return 0;
 	}
-	std::string ReadLine();
-	bool ReadItem(std::pair<int, std::string> & result);
-private:
-	HANDLE m_hfile;
-	char m_buffer[4096];
-	unsigned int m_lastPos;
-	unsigned int m_bufSize;
-};
+}
 
 
-class DxfIOError
+DxfBlockTable::DxfBlockTable(const vector<DxfBlock> & defs) :
+	m_defs(defs), m_blocks(defs.size()), m_making(defs.size())
 {
-public:
-	DxfIOError() : m_err(GetLastError()) {}
-	LocalAllocStr GetStr() { return GetWinErrorStr(m_err); }
-private:
-	unsigned long m_err;
-};
+	// first definition wins if names repeat
+	for (size_t i = 0; i < m_defs.size(); i++)
+		m_index.insert(make_pair(m_defs[i].Name, i));
+}
 
 
-double DxfStrToDouble(const char * str);
+DxfBlockTable::~DxfBlockTable()
+{
+	for (vector<CadBlock *>::iterator i = m_blocks.begin(); i != m_blocks.end(); i++)
+	{
+		if (*i != 0)
+			(*i)->Release();
+	}
+}
 
 
-using namespace std;
+CadBlock * DxfBlockTable::GetBlock(const string & name)
+{
+	map<string, size_t>::const_iterator pos = m_index.find(name);
+	if (pos == m_index.end())
+		return 0;
+	size_t index = pos->second;
+	if (m_blocks[index] != 0)
+		return m_blocks[index];
+	if (m_making[index])
+		return 0;
+	m_making[index] = true;
+	const DxfBlock & def = m_defs[index];
+	auto_ptr<CadBlock> block(new CadBlock(def.Name));
+	Matrix3<double> toOrigin = DisplaceMatrix(Point<double>(-def.Base.X, -def.Base.Y));
+	const vector<DxfEntity> & entities = def.Entities.Entities;
+	for (vector<DxfEntity>::const_iterator i = entities.begin(); i != entities.end(); i++)
+	{
+		auto_ptr<CadObject> obj(CreateCadObject(*i, def.Entities, *this));
+		if (obj.get() == 0)
+			continue;
+		obj->Transform(toOrigin);
+		block->AddObject(obj.release());
+	}
+	m_making[index] = false;
+	block->AddRef();
+	m_blocks[index] = block.release();
+	return m_blocks[index];
+}
 
 
-string DxfReader::ReadLine()
+void AddDxfEntities(const DxfImporter & importer, Document & doc)
 {
-	string line;
-	while (true)
+	DxfBlockTable blocks(importer.GetBlocks());
+	const vector<DxfEntities> & parts = importer.GetParts();
+	doc.BeginUpdate();
+	for (vector<DxfEntities>::const_iterator part = parts.begin(); part != parts.end(); part++)
 	{
-		if (m_lastPos == m_bufSize)
+		for (vector<DxfEntity>::const_iterator i = part->Entities.begin(); i != part->Entities.end(); i++)
 		{
-			DWORD read;
-			if (!ReadFile(m_hfile, m_buffer, sizeof(m_buffer), &read, 0))
-				throw DxfIOError();
-			assert(read <= sizeof(m_buffer));
-			m_lastPos = 0;
-			m_bufSize = static_cast<unsigned int>(read);
-			if (m_bufSize == 0)
-				return line;
+			CadObject * obj = CreateCadObject(*i, *part, blocks);
+			if (obj != 0)
+				doc.Add(obj);
 		}
-		char ch = m_buffer[m_lastPos];
-		m_lastPos++;
-		switch (ch)
+	}
+	doc.EndUpdate();
+}
+
+
+namespace
+{
+	typedef map<const CadBlock *, string> DxfBlockNames;
+
+	struct DxfObjectWriter : IConstCadObjVisitor
+	{
+		DxfWriter & m_writer;
+		const DxfBlockNames & m_names;
+		DxfObjectWriter(DxfWriter & writer, const DxfBlockNames & names) : m_writer(writer), m_names(names) {}
+		virtual void Visit(const CadLine & obj) { m_writer.WriteLine(obj.Point1, obj.Point2); }
+		virtual void Visit(const CadCircle & obj) { m_writer.WriteCircle(obj.Center, obj.Radius); }
+		virtual void Visit(const CadArc & obj)
+		{
+			// dxf arcs always go counter clockwise
+			if (obj.Ccw)
+				m_writer.WriteArc(obj.Center, obj.Radius, obj.Start, obj.End);
+			else
+				m_writer.WriteArc(obj.Center, obj.Radius, obj.End, obj.Start);
+		}
+		virtual void Visit(const CadPolyline & obj)
+		{
+			m_writer.BeginPolyline(obj.Nodes.size(), obj.Closed);
+			for (vector<CadPolyline::Node>::const_iterator i = obj.Nodes.begin(); i != obj.Nodes.end(); i++)
+				m_writer.WritePolylineNode(i->point, i->Bulge);
+		}
+		virtual void Visit(const CadInsert & obj)
+		{
+			// matrix is made of scale, rotation and displacement, mirroring goes to y scale
+			const Matrix3<double> & mat = obj.GetMatrix();
+			double angle = atan2(mat[1][0], mat[0][0]);
+			Point<double> scale(sqrt(mat[0][0] * mat[0][0] + mat[1][0] * mat[1][0]),
+					sqrt(mat[0][1] * mat[0][1] + mat[1][1] * mat[1][1]));
+			if (IsMirroring(mat))
+				scale.Y = -scale.Y;
+			DxfBlockNames::const_iterator name = m_names.find(&obj.GetBlock());
+			assert(name != m_names.end());
+			m_writer.WriteInsert(name->second, obj.GetInsertionPoint(), scale, angle * 180 / M_PI);
+		}
+	};
+
+
+	// collects blocks of inserts, nested blocks go before blocks which insert them
+	struct DxfBlockCollector : IConstCadObjVisitor
+	{
+		DxfBlockNames Names;
+		vector<const CadBlock *> Blocks;
+		map<string, int> m_used;
+		virtual void Visit(const CadLine &) {}
+		virtual void Visit(const CadCircle &) {}
+		virtual void Visit(const CadArc &) {}
+		virtual void Visit(const CadPolyline &) {}
+		virtual void Visit(const CadInsert & obj) { AddBlock(obj.GetBlock()); }
+		void AddBlock(const CadBlock & block)
+		{
+			if (Names.count(&block))
+				return;
+			const vector<CadObject *> & objects = block.GetObjects();
+			for (vector<CadObject *>::const_iterator i = objects.begin(); i != objects.end(); i++)
+				(*i)->Accept(*this);
+			Names[&block] = MakeName(block.GetName());
+			Blocks.push_back(&block);
+		}
+		// names starting with * are reserved for anonymous blocks,
+		// different blocks can have same name after copy and paste
+		string MakeName(const string & name)
 		{
-		case '\r': break;
-		case '\n': return line;
-		default: line += ch;
+			string base = !name.empty() && name[0] != '*' ? name : "BLOCK";
+			string result = base;
+			while (m_used.count(result))
+			{
+				char suffix[32];
+				int len = sprintf(suffix, "_%d", ++m_used[base]);
+				assert(len > 0);
+				result = base + suffix;
+			}
+			m_used[result] = 0;
+			return result;
 		}
+	};
+}
+
+
+void WriteDxfObjects(DxfWriter & writer, const vector<const CadObject *> & objects, const GcadObjectSource * missing)
+{
+	DxfBlockCollector collector;
+	for (vector<const CadObject *>::const_iterator i = objects.begin(); i != objects.end(); i++)
+		(*i)->Accept(collector);
+	if (missing != 0)
+	{
+		const vector<CadBlock *> & blocks = missing->GetBlocks();
+		for (vector<CadBlock *>::const_iterator i = blocks.begin(); i != blocks.end(); i++)
+			collector.AddBlock(**i);
 	}
+	DxfObjectWriter visitor(writer, collector.Names);
+	for (vector<const CadBlock *>::const_iterator block = collector.Blocks.begin(); block != collector.Blocks.end(); block++)
+	{
+		writer.BeginBlock(collector.Names[*block]);
+		const vector<CadObject *> & blockObjects = (*block)->GetObjects();
+		for (vector<CadObject *>::const_iterator i = blockObjects.begin(); i != blockObjects.end(); i++)
+			(*i)->Accept(visitor);
+		writer.EndBlock();
+	}
+	for (vector<const CadObject *>::const_iterator i = objects.begin(); i != objects.end(); i++)
+		(*i)->Accept(visitor);
+	// missing objects are loaded one at a time
+	const size_t missingCount = missing != 0 ? missing->GetCount() : 0;
+	for (size_t i = 0; i < missingCount; i++)
+		auto_ptr<CadObject>(missing->Load(i))->Accept(visitor);
 }
 
 
-bool DxfReader::ReadItem(pair<int, string> & result)
+void ExportDxf(HWND hwnd)
 {
-	string codeStr;
-	string valStr;
+	wchar_t fileBuf[MAX_PATH] = {0};
+	OPENFILENAMEW ofn = {0};
+	ofn.lStructSize = sizeof(ofn);
+	ofn.hwndOwner = hwnd;
+	ofn.lpstrFilter = L"AutoCad Dxf Files\0*.dxf\0AutoCad Binary Dxf Files\0*.dxf\0All files\0*.*\0\0";
+	ofn.lpstrFile = fileBuf;
+	ofn.nMaxFile = sizeof(fileBuf)/sizeof(fileBuf[0]);
+	ofn.lpstrTitle = L"Export DXF";
+	ofn.lpstrDefExt = L"dxf";
+	ofn.Flags = OFN_PATHMUSTEXIST | OFN_OVERWRITEPROMPT;
+	if (!GetSaveFileNameW(&ofn))
+	{
+		if (CommDlgExtendedError() != 0)
+			assert(0);
+		return;
+	}
 	try
 	{
-		codeStr = ReadLine();
-		valStr = ReadLine();
+		// objects of paged drawing which aren't loaded are written too
+		auto_ptr<GcadObjectSource> missing = GetMissingGcadPages();
+		vector<const CadObject *> objects(g_doc.Objects.begin(), g_doc.Objects.end());
+		// second filter is binary format
+		DxfWriter writer(fileBuf, ofn.nFilterIndex == 2 ? DxfFormatBinary : DxfFormatAscii);
+		WriteDxfObjects(writer, objects, missing.get());
+		writer.Finish();
+	}
+	catch (DxfError & err)
+	{
+		wstring msg = err.Code == DxfErrorOpenFile ? L"Error creating file: " : L"Error writing file: ";
+		msg += fileBuf;
+		if (MessageBoxW(hwnd, msg.c_str(), 0, MB_ICONERROR) == 0)
+			assert(0);
 	}
-	catch (DxfIOError & ex)
+	catch (GcadError &)
 	{
-		throw wstring(L"Error reading file: ") + ex.GetStr().c_str();
+		if (MessageBoxW(hwnd, L"Paged drawing has invalid format", 0, MB_ICONERROR) == 0)
+			assert(0);
 	}
-	if (codeStr.size() == 0)
+}
+
+
+namespace
+{
+	// import running on background thread, parsed entities are posted
+	// to main window which adds those to document
+	class DxfImportJob : public DxfImportHandler
+	{
+	public:
+		DxfImportJob(HWND hwnd, const wchar_t * path) :
+			m_hwnd(hwnd), m_path(path), m_cancelled(0), m_thread(0), m_started(false), m_count(0) {}
+		void Start();
+		void Cancel() { InterlockedExchange(&m_cancelled, 1); }
+		void Wait();
+		void SetBlocks(const vector<DxfBlock> & blocks);
+		void AddEntities(const DxfEntities & entities);
+		void Finish();
+		virtual bool OnBlocks(const vector<DxfBlock> & blocks);
+		virtual bool OnEntities(const DxfEntities & entities);
+		virtual bool OnProgress(size_t done, size_t total);
+	private:
+		HWND m_hwnd;
+		wstring m_path;
+		DxfImporter m_importer;
+		volatile LONG m_cancelled;
+		HANDLE m_thread;
+		// set when long work of undo manager is started with first entities
+		bool m_started;
+		// made on main thread before first entities
+		auto_ptr<DxfBlockTable> m_blocks;
+		size_t m_count;
+		static unsigned __stdcall ThreadProc(void * param);
+	};
+}
+
+
+static auto_ptr<DxfImportJob> g_dxfImport;
+
+
+void DxfImportJob::Start()
+{
+	m_thread = reinterpret_cast<HANDLE>(_beginthreadex(0, 0, ThreadProc, this, 0, 0));
+	if (m_thread == 0)
+		throw wstring(L"Error starting import");
+	// objects of import can't be undone until it is finished
+	g_undoManager.SetLocked(true);
+}
+
+
+unsigned __stdcall DxfImportJob::ThreadProc(void * param)
+{
+	DxfImportJob * job = static_cast<DxfImportJob *>(param);
+	job->m_importer.ImportFile(job->m_path.c_str(), job);
+	if (!PostMessageW(job->m_hwnd, WM_DXFIMPORT, DxfImportDone, 0))
+		assert(0);
+	return 0;
+}
+
+
+bool DxfImportJob::OnBlocks(const vector<DxfBlock> & blocks)
+{
+	auto_ptr<vector<DxfBlock> > copy(new vector<DxfBlock>(blocks));
+	if (!PostMessageW(m_hwnd, WM_DXFIMPORT, DxfImportBlocks, reinterpret_cast<LPARAM>(copy.get())))
 		return false;
-	int code;
-	int ret = std::sscanf(codeStr.c_str(), "%d", &code);
-	if (ret != 1)
-		throw wstring(L"File has invalid format");
-	result = make_pair(code, valStr);
-	return true;
+	copy.release();
+	return m_cancelled == 0;
 }
 
 
-long DxfStrToLong(const char * str)
+bool DxfImportJob::OnEntities(const DxfEntities & entities)
 {
-	char * endp;
-	long result = strtol(str, &endp, 10);
-	if (result == 0 && str == endp)
-		throw wstring(L"File has invalid format");
-	return result;
+	auto_ptr<DxfEntities> batch(new DxfEntities(entities));
+	if (!PostMessageW(m_hwnd, WM_DXFIMPORT, DxfImportBatch, reinterpret_cast<LPARAM>(batch.get())))
+		return false;
+	batch.release();
+	return m_cancelled == 0;
 }
 
 
-double DxfStrToDouble(const char * str)
+bool DxfImportJob::OnProgress(size_t done, size_t total)
 {
-	char * endp;
-	double result = strtod(str, &endp);
-	if (result == 0 && str == endp)
-		throw wstring(L"File has invalid format");
-	return result;
+	LPARAM percent = total == 0 ? 100 : static_cast<LPARAM>(done / (total / 100.0));
+	PostMessageW(m_hwnd, WM_DXFIMPORT, DxfImportProgress, percent);
+	return m_cancelled == 0;
+}
+
+
+void DxfImportJob::Wait()
+{
+	if (m_thread == 0)
+		return;
+	if (WaitForSingleObject(m_thread, INFINITE) != WAIT_OBJECT_0)
+		assert(0);
+	CloseHandle(m_thread);
+	m_thread = 0;
+	g_undoManager.SetLocked(false);
+	// no batches are added after this, Finish comes after last of them
+	// and CancelDxfImport drops ones which are not handled yet
+	if (m_started)
+		g_undoManager.EndLongWork();
+	m_started = false;
+}
+
+
+void DxfImportJob::SetBlocks(const vector<DxfBlock> & blocks)
+{
+	m_blocks.reset(new DxfBlockTable(blocks));
+}
+
+
+void DxfImportJob::AddEntities(const DxfEntities & entities)
+{
+	if (entities.Entities.empty())
+		return;
+	assert(m_blocks.get() != 0);
+	if (!m_started)
+	{
+		g_undoManager.BeginLongWork();
+		m_started = true;
+	}
+	vector<CadObject *> objects;
+	objects.reserve(entities.Entities.size());
+	for (vector<DxfEntity>::const_iterator i = entities.Entities.begin(); i != entities.Entities.end(); i++)
+	{
+		CadObject * obj = CreateCadObject(*i, entities, *m_blocks);
+		if (obj != 0)
+			objects.push_back(obj);
+	}
+	vector<ObjectHandle> handles;
+	g_doc.Add(objects, handles);
+	g_undoManager.AddLongWorkItem(new AddObjectsUndoItem(objects, true));
+	m_count += objects.size();
+}
+
+
+void DxfImportJob::Finish()
+{
+	Wait();
+	SetWindowTextW(m_hwnd, L"GCad");
+	// entities imported before error or cancel are left in document
+	// and can be undone
+	wchar_t buffer[64];
+	int len = swprintf(buffer, sizeof(buffer) / sizeof(buffer[0]), L"%lu objects imported",
+			static_cast<unsigned long>(m_count));
+	assert(len > 0);
+	g_console.Log(buffer);
+	switch (m_importer.GetError())
+	{
+	case DxfOk:
+		break;
+	case DxfErrorCancelled:
+		g_console.Log(m_importer.GetErrorMessage());
+		break;
+	case DxfErrorNoEntities:
+		MessageBoxW(m_hwnd, m_importer.GetErrorMessage().c_str(), 0, MB_ICONEXCLAMATION);
+		break;
+	default:
+		if (MessageBoxW(m_hwnd, m_importer.GetErrorMessage().c_str(), 0, MB_ICONERROR) == 0)
+			assert(0);
+		break;
+	}
 }
 
 
 void ImportDxf(HWND hwnd)
 {
+	if (g_dxfImport.get() != 0)
+	{
+		if (MessageBoxW(hwnd, L"Import is in progress. Cancel it?", L"Import DXF", MB_YESNO | MB_ICONQUESTION) == IDYES)
+			g_dxfImport->Cancel();
+		return;
+	}
 	wchar_t fileBuf[MAX_PATH] = {0};
 	OPENFILENAMEW ofn = {0};
 	ofn.lStructSize = sizeof(ofn);
@@ -135,244 +509,73 @@ void ImportDxf(HWND hwnd)
 	}
 	try
 	{
-		WinHandle hfile = CreateFileW(fileBuf, FILE_READ_DATA, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
-		if (!hfile)
-		{
-			throw wstring(L"Error opening file: ") + fileBuf +
-							GetWinErrorStr().c_str();
-		}
-		DxfReader rdr(hfile.get());
-		bool foundEntities = false;
-		pair<int, string> item;
-		while (rdr.ReadItem(item))
+		auto_ptr<DxfImportJob> job(new DxfImportJob(hwnd, fileBuf));
+		job->Start();
+		g_dxfImport = job;
+	}
+	catch (wstring & err)
+	{
+		if (MessageBoxW(hwnd, err.c_str(), 0, MB_ICONERROR) == 0)
+			assert(0);
+	}
+}
+
+
+void OnDxfImportMessage(WPARAM wparam, LPARAM lparam)
+{
+	switch (wparam)
+	{
+	case DxfImportBlocks:
 		{
-			if (item.first == 2 && item.second == "ENTITIES")
-			{
-				foundEntities = true;
-				break;
-			}
+			auto_ptr<vector<DxfBlock> > blocks(reinterpret_cast<vector<DxfBlock> *>(lparam));
+			assert(g_dxfImport.get() != 0);
+			g_dxfImport->SetBlocks(*blocks);
 		}
-		if (!foundEntities)
+		break;
+	case DxfImportBatch:
 		{
-			MessageBoxW(hwnd, L"File does not contain drawing", 0, MB_ICONEXCLAMATION);
-			return;
+			auto_ptr<DxfEntities> batch(reinterpret_cast<DxfEntities *>(lparam));
+			assert(g_dxfImport.get() != 0);
+			g_dxfImport->AddEntities(*batch);
+			InvalidateRect(g_hclientWindow, 0, true);
 		}
-		if (!rdr.ReadItem(item) || item.first != 0)
-			throw wstring(L"File has invalid format");
-		bool done = false;
-		auto_ptr<GroupUndoItem> groupItem(new GroupUndoItem);
-		while (!done)
+		break;
+	case DxfImportProgress:
 		{
-			if (item.second == "LINE")
-			{
-				enum Flags
-				{
-					P1X = 1,
-					P1Y = 2,
-					P2X = 4,
-					P2Y = 8,
-				};
-				int flags = 0;
-				Point<double> p1, p2;
-				bool lineDone = false;
-				while (!lineDone && rdr.ReadItem(item))
-				{
-					switch (item.first)
-					{
-					case 0:
-						lineDone = true;
-						break;
-					case 10:
-						p1.X = DxfStrToDouble(item.second.c_str());
-						flags |= P1X;
-						break;
-					case 20:
-						p1.Y = DxfStrToDouble(item.second.c_str());
-						flags |= P1Y;
-						break;
-					case 11:
-						p2.X = DxfStrToDouble(item.second.c_str());
-						flags |= P2X;
-						break;
-					case 21:
-						p2.Y = DxfStrToDouble(item.second.c_str());
-						flags |= P2Y;
-						break;
-					}
-				}
-				if (!lineDone || flags != (P1X | P1Y | P2X | P2Y))
-					throw wstring(L"File has invalid format");
-				auto_ptr<CadLine> line(new CadLine);
-				line->Point1 = p1;
-				line->Point2 = p2;
-				groupItem->AddItem(new AddObjectUndoItem(line.release()));
-			}
-			else if (item.second == "CIRCLE")
-			{
-				Point<double> center;
-				double radius;
-				enum Flags
-				{
-					CX = 1,
-					CY = 2,
-					RADIUS = 4,
-				};
-				int flags = 0;
-				bool done = false;
-				while (!done && rdr.ReadItem(item))
-				{
-					switch (item.first)
-					{
-					case 0:
-						done = true;
-						break;
-					case 10:
-						center.X = DxfStrToDouble(item.second.c_str());
-						flags |= CX;
-						break;
-					case 20:
-						center.Y = DxfStrToDouble(item.second.c_str());
-						flags |= CY;
-						break;
-					case 40:
-						radius = DxfStrToDouble(item.second.c_str());
-						flags |= RADIUS;
-						break;
-					}
-				}
-				if (flags != (CX | CY | RADIUS))
-					throw wstring(L"File has invalid format");
-				auto_ptr<CadCircle> circle(new CadCircle);
-				circle->Center = center;
-				circle->Radius = radius;
-				groupItem->AddItem(new AddObjectUndoItem(circle.release()));
-			}
-			else if (item.second == "ARC")
-			{
-				Point<double> center;
-				double radius;
-				double ang1, ang2;
-				enum Flags
-				{
-					CX = 1,
-					CY = 2,
-					RADIUS = 4,
-					ANGLE1 = 8,
-					ANGLE2 = 16,
-				};
-				int flags = 0;
-				bool arcDone = false;
-				while (!arcDone && rdr.ReadItem(item))
-				{
-					switch (item.first)
-					{
-					case 0:
-						arcDone = true;
-						break;
-					case 10:
-						center.X = DxfStrToDouble(item.second.c_str());
-						flags |= CX;
-						break;
-					case 20:
-						center.Y = DxfStrToDouble(item.second.c_str());
-						flags |= CY;
-						break;
-					case 40:
-						radius = DxfStrToDouble(item.second.c_str());
-						flags |= RADIUS;
-						break;
-					case 50:
-						ang1 = DxfStrToDouble(item.second.c_str());
-						flags |= ANGLE1;
-						break;
-					case 51:
-						ang2 = DxfStrToDouble(item.second.c_str());
-						flags |= ANGLE2;
-						break;
-					}
-				}
-				if (!arcDone || flags != (CX | CY | RADIUS | ANGLE1 | ANGLE2))
-					throw wstring(L"File has invalid format");
-				auto_ptr<CadArc> arc(new CadArc);
-				arc->Center = center;
-				arc->Radius = radius;
-				arc->Ccw = true;
-				arc->Start.X = cos(ang1*M_PI/180)*radius + center.X;
-				arc->Start.Y = sin(ang1*M_PI/180)*radius + center.Y;
-				arc->End.X = cos(ang2*M_PI/180)*radius + center.X;
-				arc->End.Y = sin(ang2*M_PI/180)*radius + center.Y;
-				groupItem->AddItem(new AddObjectUndoItem(arc.release()));
-			}
-			else if (item.second == "LWPOLYLINE")
-			{
-				long numVerts = -1;
-				auto_ptr<CadPolyline> result(new CadPolyline);
-				bool done = false;
-				enum Flags
-				{
-					GOTX = 1,
-					GOTY = 2,
-				};
-				int flags;
-				while (!done && rdr.ReadItem(item))
-				{
-					switch (item.first)
-					{
-					case 0:
-						done = true;
-						break;
-					case 90:
-						numVerts = DxfStrToLong(item.second.c_str());
-						break;
-					case 70:
-						result->Closed = (DxfStrToLong(item.second.c_str()) & 0x1) != 0;
-						break;
-					case 10:
-						if (result->Nodes.size() > 0)
-						{
-							if ((flags & GOTX) == 0 || (flags & GOTY) == 0)
-								throw wstring(L"File has invalid format");
-						}
-						flags = 0;
-						assert(result->Nodes.size() <= static_cast<size_t>(numeric_limits<long>::max()));
-						if (numVerts <= static_cast<long>(result->Nodes.size()))
-							throw wstring(L"File has invalid format");
-						result->Nodes.push_back(CadPolyline::Node());
-						result->Nodes.back().Bulge = 0;
-						result->Nodes.back().point.X = DxfStrToDouble(item.second.c_str());
-						flags |= GOTX;
-						break;
-					case 20:
-						result->Nodes.back().point.Y = DxfStrToDouble(item.second.c_str());
-						flags |= GOTY;
-						break;
-					case 42:
-						result->Nodes.back().Bulge = DxfStrToDouble(item.second.c_str());
-						break;
-					}
-				}
-				assert(result->Nodes.size() <= static_cast<size_t>(numeric_limits<long>::max()));
-				if (static_cast<long>(result->Nodes.size()) != numVerts)
-					throw wstring(L"File has invalid format");
-				groupItem->AddItem(new AddObjectUndoItem(result.release()));
-			}
-			else if (item.second == "ENDSEC")
-			{
-				done = true;
-				break;
-			}
-			else
-			{
-				while (rdr.ReadItem(item) && item.first != 0)
-					;
-			}
+			wchar_t buffer[64];
+			int len = swprintf(buffer, sizeof(buffer) / sizeof(buffer[0]), L"GCad - importing %d%%",
+					static_cast<int>(lparam));
+			assert(len > 0);
+			SetWindowTextW(g_hmainWindow, buffer);
 		}
-		g_undoManager.AddWork(groupItem.release());
+		break;
+	case DxfImportDone:
+		assert(g_dxfImport.get() != 0);
+		g_dxfImport->Finish();
+		g_dxfImport.reset();
 		InvalidateRect(g_hclientWindow, 0, true);
+		break;
+	default:
+		assert(0);
+		break;
 	}
-	catch (wstring & err)
+}
+
+
+void CancelDxfImport()
+{
+	if (g_dxfImport.get() == 0)
+		return;
+	g_dxfImport->Cancel();
+	g_dxfImport->Wait();
+	// dropping batches which are not handled yet
+	MSG msg;
+	while (PeekMessageW(&msg, g_hmainWindow, WM_DXFIMPORT, WM_DXFIMPORT, PM_REMOVE))
 	{
-		if (MessageBoxW(hwnd, err.c_str(), 0, MB_ICONERROR) == 0)
-			assert(0);
+		if (msg.wParam == DxfImportBlocks)
+			delete reinterpret_cast<vector<DxfBlock> *>(msg.lParam);
+		else if (msg.wParam == DxfImportBatch)
+			delete reinterpret_cast<DxfEntities *>(msg.lParam);
 	}
+	g_dxfImport.reset();
 }
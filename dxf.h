@@ -10,9 +10,35 @@
 
 
 #include <windows.h>
+#include <vector>
 
 
+class Document;
+class DxfImporter;
+class DxfWriter;
+class CadObject;
+class GcadObjectSource;
+
+
+// posted by import thread to main window
+const UINT WM_DXFIMPORT = WM_APP + 1;
+
+
+// shows file dialog and starts importing dxf file into g_doc on background thread,
+// entities appear in document as those are parsed and form one undo step,
+// if import is running offers to cancel it
 void ImportDxf(HWND hwnd);
+void OnDxfImportMessage(WPARAM wparam, LPARAM lparam);
+// cancels running import and waits for it to stop
+void CancelDxfImport();
+// adds entities read by importer to document bypassing undo
+void AddDxfEntities(const DxfImporter & importer, Document & doc);
+// shows file dialog and writes all objects of g_doc into dxf file
+void ExportDxf(HWND hwnd);
+// writes objects and objects of missing to ENTITIES section, blocks of inserts
+// are written to BLOCKS section once each and get unique names
+void WriteDxfObjects(DxfWriter & writer, const std::vector<const CadObject *> & objects,
+		const GcadObjectSource * missing = 0);
 
 
 #endif /* DXF_H_ */
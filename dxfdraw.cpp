@@ -0,0 +1,215 @@
+/*
+ * dxfdraw.cpp
+ *
+ *  Created on: 18.10.2026
+ *      Author: misha
+ */
+#include "dxfdraw.h"
+
+
+using namespace std;
+
+
+static void AddBounds(Rect<double> & bounds, bool & hasBounds, const Rect<double> & rect)
+{
+	bounds = hasBounds ? GetBoundingRect(bounds, rect) : rect;
+	hasBounds = true;
+}
+
+
+static CircleArc MakeArc(const DxfEntity & entity)
+{
+	Circle circle;
+	circle.Center = entity.Center;
+	circle.Radius = entity.Radius;
+	return CircleArc(circle, entity.Pt1, entity.Pt2, true);
+}
+
+
+static Rect<double> TransformBounds(const Matrix3<double> & matrix, const Rect<double> & bounds)
+{
+	Point<double> pt1 = matrix * bounds.Pt1;
+	Point<double> pt2 = matrix * Point<double>(bounds.Pt2.X, bounds.Pt1.Y);
+	Point<double> pt3 = matrix * bounds.Pt2;
+	Point<double> pt4 = matrix * Point<double>(bounds.Pt1.X, bounds.Pt2.Y);
+	return Rect<double>(min(min(pt1.X, pt2.X), min(pt3.X, pt4.X)), min(min(pt1.Y, pt2.Y), min(pt3.Y, pt4.Y)),
+			max(max(pt1.X, pt2.X), max(pt3.X, pt4.X)), max(max(pt1.Y, pt2.Y), max(pt3.Y, pt4.Y)));
+}
+
+
+DxfDrawing::DxfDrawing(const vector<DxfEntities> & parts, const vector<DxfBlock> & blocks) :
+	m_parts(parts), m_defs(blocks), m_blocks(blocks.size()), m_partInserts(parts.size()),
+	m_hasBounds(false), m_entityCount(0)
+{
+	// first definition wins if names repeat, same as in import
+	for (size_t i = 0; i < m_defs.size(); i++)
+	{
+		m_index.insert(make_pair(m_defs[i].Name, i));
+		m_blocks[i].State = BlockNew;
+		m_blocks[i].HasBounds = false;
+	}
+	for (size_t i = 0; i < m_parts.size(); i++)
+	{
+		PrepareEntities(m_parts[i], m_partInserts[i], m_bounds, m_hasBounds);
+		m_entityCount += m_parts[i].Entities.size();
+	}
+}
+
+
+bool DxfDrawing::GetBounds(Rect<double> & bounds) const
+{
+	if (m_hasBounds)
+		bounds = m_bounds;
+	return m_hasBounds;
+}
+
+
+// returns -1 if there is no such block or it inserts itself
+long DxfDrawing::PrepareBlock(const string & name)
+{
+	map<string, size_t>::const_iterator pos = m_index.find(name);
+	if (pos == m_index.end())
+		return -1;
+	Block & block = m_blocks[pos->second];
+	if (block.State == BlockPreparing)
+		return -1;
+	if (block.State == BlockNew)
+	{
+		block.State = BlockPreparing;
+		PrepareEntities(m_defs[pos->second].Entities, block.Inserts, block.Bounds, block.HasBounds);
+		block.State = BlockReady;
+	}
+	return static_cast<long>(pos->second);
+}
+
+
+void DxfDrawing::PrepareEntities(const DxfEntities & entities, vector<long> & inserts,
+		Rect<double> & bounds, bool & hasBounds)
+{
+	for (vector<DxfEntity>::const_iterator i = entities.Entities.begin(); i != entities.Entities.end(); i++)
+	{
+		switch (i->Type)
+		{
+		case DxfEntityLine:
+			AddBounds(bounds, hasBounds, Rect<double>(i->Pt1, i->Pt2).Normalized());
+			break;
+		case DxfEntityCircle:
+			AddBounds(bounds, hasBounds, Rect<double>(i->Center.X - i->Radius, i->Center.Y - i->Radius,
+					i->Center.X + i->Radius, i->Center.Y + i->Radius));
+			break;
+		case DxfEntityArc:
+			AddBounds(bounds, hasBounds, MakeArc(*i).CalcBoundingRect());
+			break;
+		case DxfEntityPolyline:
+			for (size_t j = 0; j < i->NodeCount; j++)
+			{
+				const DxfNode & node = entities.Nodes[i->FirstNode + j];
+				if (j + 1 == i->NodeCount && !i->Closed)
+				{
+					AddBounds(bounds, hasBounds, Rect<double>(node.Pt, node.Pt));
+					break;
+				}
+				const DxfNode & next = entities.Nodes[i->FirstNode + (j + 1) % i->NodeCount];
+				if (node.Bulge == 0)
+					AddBounds(bounds, hasBounds, Rect<double>(node.Pt, next.Pt).Normalized());
+				else
+					AddBounds(bounds, hasBounds, ArcFrom2PtAndBulge(node.Pt, next.Pt, node.Bulge).CalcBoundingRect());
+			}
+			break;
+		case DxfEntityInsert:
+			{
+				long block = PrepareBlock(entities.Names[i->Name]);
+				inserts.push_back(block);
+				if (block >= 0 && m_blocks[block].HasBounds)
+				{
+					Matrix3<double> matrix = GetInsertMatrix(*i, m_defs[block]);
+					AddBounds(bounds, hasBounds, TransformBounds(matrix, m_blocks[block].Bounds));
+				}
+			}
+			break;
+		default:
+			assert(0);
+			break;
+		}
+	}
+}
+
+
+// same placement as inserts made by import
+Matrix3<double> DxfDrawing::GetInsertMatrix(const DxfEntity & entity, const DxfBlock & block)
+{
+	Matrix3<double> scale(entity.Pt2.X, 0, 0, 0, entity.Pt2.Y, 0, 0, 0, 1);
+	double angle = entity.Radius * M_PI / 180;
+	return DisplaceMatrix(entity.Pt1) * RotationMatrix(angle) * scale *
+			DisplaceMatrix(Point<double>(-block.Base.X, -block.Base.Y));
+}
+
+
+void DxfDrawing::Draw(RenderTarget & target) const
+{
+	target.SetPen(false);
+	// nodes of polyline are copied to arrays in layout of EntityStore
+	vector<double> nodes;
+	for (size_t i = 0; i < m_parts.size(); i++)
+		DrawEntities(target, m_parts[i], m_partInserts[i], nodes);
+}
+
+
+void DxfDrawing::DrawEntities(RenderTarget & target, const DxfEntities & entities, const vector<long> & inserts,
+		vector<double> & nodes) const
+{
+	vector<long>::const_iterator insert = inserts.begin();
+	for (vector<DxfEntity>::const_iterator i = entities.Entities.begin(); i != entities.Entities.end(); i++)
+	{
+		switch (i->Type)
+		{
+		case DxfEntityLine:
+			DrawLineEntity(target, i->Pt1, i->Pt2);
+			break;
+		case DxfEntityCircle:
+			DrawCircleEntity(target, i->Center, i->Radius);
+			break;
+		case DxfEntityArc:
+			DrawArcEntity(target, MakeArc(*i));
+			break;
+		case DxfEntityPolyline:
+			{
+				const size_t count = i->NodeCount;
+				if (count == 0)
+					break;
+				nodes.resize(3 * count);
+				for (size_t j = 0; j < count; j++)
+				{
+					const DxfNode & node = entities.Nodes[i->FirstNode + j];
+					nodes[j] = node.Pt.X;
+					nodes[count + j] = node.Pt.Y;
+					nodes[2 * count + j] = node.Bulge;
+				}
+				DrawPolylineEntity(target, &nodes[0], &nodes[count], &nodes[2 * count], count, i->Closed);
+			}
+			break;
+		case DxfEntityInsert:
+			{
+				assert(insert != inserts.end());
+				long index = *insert++;
+				if (index < 0 || !m_blocks[index].HasBounds)
+					break;
+				const Block & block = m_blocks[index];
+				Matrix3<double> matrix = GetInsertMatrix(*i, m_defs[index]);
+				const Rect<double> & bounds = block.Bounds;
+				double size = max(bounds.Pt2.X - bounds.Pt1.X, bounds.Pt2.Y - bounds.Pt1.Y) * LengthScale(matrix);
+				if (size * target.GetMagnification() < 1)
+				{
+					DrawDot(target, matrix * bounds.Pt1);
+					break;
+				}
+				TransformRenderTarget transformed(target, matrix);
+				DrawEntities(transformed, m_defs[index].Entities, block.Inserts, nodes);
+			}
+			break;
+		default:
+			assert(0);
+			break;
+		}
+	}
+}
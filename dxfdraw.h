@@ -0,0 +1,62 @@
+/*
+ * dxfdraw.h
+ *
+ *  Created on: 18.10.2026
+ *      Author: misha
+ */
+
+#ifndef DXFDRAW_H_
+#define DXFDRAW_H_
+
+
+#include "dxfreader.h"
+#include "render.h"
+#include <map>
+#include <string>
+#include <vector>
+
+
+// draws entities read by DxfImporter without document, so it works on systems
+// without windows, used for previews and for measuring drawing speed,
+// entities are drawn the same way as in document, inserts of unknown blocks
+// and blocks which insert themselves are skipped as by import
+class DxfDrawing
+{
+public:
+	// parts and blocks should live while drawing is used
+	DxfDrawing(const std::vector<DxfEntities> & parts, const std::vector<DxfBlock> & blocks);
+	// false if there is nothing to draw
+	bool GetBounds(Rect<double> & bounds) const;
+	size_t GetEntityCount() const { return m_entityCount; }
+	void Draw(RenderTarget & target) const;
+private:
+	DxfDrawing(const DxfDrawing &);
+	DxfDrawing & operator=(const DxfDrawing &);
+	enum BlockState { BlockNew, BlockPreparing, BlockReady };
+	struct Block
+	{
+		BlockState State;
+		// block index for each insert among block entities, -1 for skipped inserts
+		std::vector<long> Inserts;
+		Rect<double> Bounds;
+		bool HasBounds;
+	};
+	const std::vector<DxfEntities> & m_parts;
+	const std::vector<DxfBlock> & m_defs;
+	std::map<std::string, size_t> m_index;
+	std::vector<Block> m_blocks;
+	// inserts of each part same as in Block
+	std::vector<std::vector<long> > m_partInserts;
+	Rect<double> m_bounds;
+	bool m_hasBounds;
+	size_t m_entityCount;
+	long PrepareBlock(const std::string & name);
+	void PrepareEntities(const DxfEntities & entities, std::vector<long> & inserts,
+			Rect<double> & bounds, bool & hasBounds);
+	static Matrix3<double> GetInsertMatrix(const DxfEntity & entity, const DxfBlock & block);
+	void DrawEntities(RenderTarget & target, const DxfEntities & entities, const std::vector<long> & inserts,
+			std::vector<double> & nodes) const;
+};
+
+
+#endif /* DXFDRAW_H_ */
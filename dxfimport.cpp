@@ -0,0 +1,193 @@
+/*
+ * dxfimport.cpp
+ *
+ *  Created on: 18.10.2026
+ *      Author: misha
+ */
+#include "dxfimport.h"
+#include <algorithm>
+#include <cwchar>
+
+
+using namespace std;
+
+
+#ifdef _WIN32
+bool DxfImporter::ImportFile(const wchar_t * path, DxfImportHandler * handler)
+{
+	Clear();
+	m_path = path;
+#else
+// non ascii characters of file name are replaced in messages
+static wstring PathToWStr(const char * path)
+{
+	wstring result;
+	for (; *path; path++)
+		result += static_cast<unsigned char>(*path) < 0x80 ? static_cast<wchar_t>(*path) : L'?';
+	return result;
+}
+
+
+bool DxfImporter::ImportFile(const char * path, DxfImportHandler * handler)
+{
+	Clear();
+	m_path = PathToWStr(path);
+#endif
+	try
+	{
+		MappedFile file(path);
+		return ImportBuffer(file.Begin(), file.End(), handler);
+	}
+	catch (DxfError & err)
+	{
+		SetError(err, 0);
+		return false;
+	}
+}
+
+
+bool DxfImporter::ImportBuffer(const char * begin, const char * end, DxfImportHandler * handler)
+{
+	m_parts.clear();
+	m_blocks.clear();
+	m_error = DxfOk;
+	m_errorLine = 0;
+	m_errorOffset = 0;
+	try
+	{
+		const char * data = begin;
+		m_format = DetectDxfFormat(data, end);
+		const char * entities = FindDxfEntities(data, end, m_format, &m_blocks);
+		if (entities == 0)
+			throw DxfError(DxfErrorNoEntities);
+		if (handler != 0 && !handler->OnBlocks(m_blocks))
+			throw DxfError(DxfErrorCancelled);
+		if (handler == 0)
+			ParseDxfEntitiesParallel(entities, end, m_format, m_threads, m_parts);
+		else
+			ImportStreaming(entities, end, *handler);
+		return true;
+	}
+	catch (DxfError & err)
+	{
+		m_parts.clear();
+		m_blocks.clear();
+		SetError(err, begin);
+		return false;
+	}
+}
+
+
+// parts are parsed in waves of one part per thread, so first entities
+// are handed out soon after start and memory is not held for whole file
+void DxfImporter::ImportStreaming(const char * begin, const char * end, DxfImportHandler & handler)
+{
+	// about ten thousand entities
+	const size_t partSize = 1 << 20;
+	unsigned threads = m_threads;
+	if (threads == 0)
+		threads = GetProcessorCount();
+	// boundaries are found wave by wave, binary data is read through for those
+	vector<const char *> bounds(1, begin);
+	vector<DxfEntities> wave;
+	while (bounds.back() != end)
+	{
+		size_t first = bounds.size() - 1;
+		while (bounds.size() - 1 - first < threads && bounds.back() != end)
+			bounds.push_back(FindNextDxfPart(bounds.back(), end, m_format, partSize));
+		size_t last = bounds.size() - 1;
+		bool endFound = ParseDxfParts(bounds, first, last, m_format, threads, wave);
+		for (vector<DxfEntities>::const_iterator i = wave.begin(); i != wave.end(); i++)
+		{
+			if (!handler.OnEntities(*i))
+				throw DxfError(DxfErrorCancelled);
+		}
+		if (endFound)
+			break;
+		if (!handler.OnProgress(bounds[last] - begin, end - begin))
+			throw DxfError(DxfErrorCancelled);
+	}
+	if (!handler.OnProgress(end - begin, end - begin))
+		throw DxfError(DxfErrorCancelled);
+}
+
+
+size_t DxfImporter::GetEntityCount() const
+{
+	size_t result = 0;
+	for (vector<DxfEntities>::const_iterator i = m_parts.begin(); i != m_parts.end(); i++)
+		result += i->Entities.size();
+	return result;
+}
+
+
+void DxfImporter::Clear()
+{
+	m_parts.clear();
+	m_blocks.clear();
+	m_format = DxfFormatAscii;
+	m_error = DxfOk;
+	m_errorLine = 0;
+	m_errorOffset = 0;
+	m_path.clear();
+}
+
+
+void DxfImporter::SetError(const DxfError & error, const char * begin)
+{
+	m_error = error.Code;
+	if (begin == 0 || error.Pos == 0)
+		return;
+	// lines are counted only when error happens, so parsing doesn't need to track those,
+	// binary files have no lines
+	if (m_format == DxfFormatAscii)
+		m_errorLine = count(begin, error.Pos, '\n') + 1;
+	else
+		m_errorOffset = error.Pos - begin;
+}
+
+
+wstring DxfImporter::GetErrorMessage() const
+{
+	wstring result;
+	switch (m_error)
+	{
+	case DxfOk:
+		break;
+	case DxfErrorOpenFile:
+		result = L"Error opening file: " + m_path;
+		break;
+	case DxfErrorReadFile:
+		result = L"Error reading file: " + m_path;
+		break;
+	case DxfErrorNoEntities:
+		result = L"File does not contain drawing";
+		break;
+	case DxfErrorInvalidFormat:
+		result = L"File has invalid format";
+		break;
+	case DxfErrorCancelled:
+		result = L"Import is cancelled";
+		break;
+	default:
+		assert(0);
+		break;
+	}
+	if (m_errorLine != 0)
+	{
+		wchar_t buffer[64];
+		int len = swprintf(buffer, sizeof(buffer) / sizeof(buffer[0]), L" at line %lu",
+				static_cast<unsigned long>(m_errorLine));
+		assert(len > 0);
+		result += buffer;
+	}
+	else if (m_errorOffset != 0)
+	{
+		wchar_t buffer[64];
+		int len = swprintf(buffer, sizeof(buffer) / sizeof(buffer[0]), L" at offset %lu",
+				static_cast<unsigned long>(m_errorOffset));
+		assert(len > 0);
+		result += buffer;
+	}
+	return result;
+}
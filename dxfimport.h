@@ -0,0 +1,79 @@
+/*
+ * dxfimport.h
+ *
+ *  Created on: 18.10.2026
+ *      Author: misha
+ */
+
+#ifndef DXFIMPORT_H_
+#define DXFIMPORT_H_
+
+
+#include "dxfreader.h"
+#include <string>
+#include <vector>
+
+
+// receives entities while import goes on, functions are called on importing thread
+class DxfImportHandler
+{
+public:
+	virtual ~DxfImportHandler() {}
+	// called once before entities, returning false cancels import
+	virtual bool OnBlocks(const std::vector<DxfBlock> & blocks) = 0;
+	// entities come in file order, returning false cancels import
+	virtual bool OnEntities(const DxfEntities & entities) = 0;
+	// done and total are in bytes, returning false cancels import
+	virtual bool OnProgress(size_t done, size_t total) = 0;
+};
+
+
+// reads entities of dxf file without any user interface,
+// used by application and by command line tools
+class DxfImporter
+{
+public:
+	DxfImporter() : m_threads(0), m_format(DxfFormatAscii), m_error(DxfOk), m_errorLine(0), m_errorOffset(0) {}
+	// threads = 0 means one per processor
+	void SetThreads(unsigned threads) { m_threads = threads; }
+
+	// functions return false on error, entities read before are discarded,
+	// with handler entities are passed to it in batches and are not kept by importer
+#ifdef _WIN32
+	bool ImportFile(const wchar_t * path, DxfImportHandler * handler = 0);
+#else
+	bool ImportFile(const char * path, DxfImportHandler * handler = 0);
+#endif
+	bool ImportBuffer(const char * begin, const char * end, DxfImportHandler * handler = 0);
+
+	// entities in file order split into parts, polyline nodes are per part
+	const std::vector<DxfEntities> & GetParts() const { return m_parts; }
+	// definitions of blocks which are referenced by inserts, those are kept with handler too
+	const std::vector<DxfBlock> & GetBlocks() const { return m_blocks; }
+	size_t GetEntityCount() const;
+	// format of last imported data, it is detected by binary sentinel
+	DxfFormat GetFormat() const { return m_format; }
+	void Clear();
+
+	DxfErrorCode GetError() const { return m_error; }
+	// line number starting from 1, 0 if error is not related to line or file is binary
+	size_t GetErrorLine() const { return m_errorLine; }
+	// position of error in binary file, 0 if error is not related to position
+	size_t GetErrorOffset() const { return m_errorOffset; }
+	std::wstring GetErrorMessage() const;
+
+private:
+	unsigned m_threads;
+	std::vector<DxfEntities> m_parts;
+	std::vector<DxfBlock> m_blocks;
+	DxfFormat m_format;
+	DxfErrorCode m_error;
+	size_t m_errorLine;
+	size_t m_errorOffset;
+	std::wstring m_path;
+	void SetError(const DxfError & error, const char * begin);
+	void ImportStreaming(const char * begin, const char * end, DxfImportHandler & handler);
+};
+
+
+#endif /* DXFIMPORT_H_ */
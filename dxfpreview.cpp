@@ -0,0 +1,125 @@
+/*
+ * dxfpreview.cpp
+ *
+ *  Created on: 18.10.2026
+ *      Author: misha
+ */
+
+// command line tool which draws dxf file into image without windows,
+// it is used for thumbnails and for measuring speed of drawing:
+//   dxfpreview [-s size] [-r repeats] [-b] input.dxf [output.ppm]
+// without output file drawing is only timed, -b draws through
+// BatchRenderTarget same as window of application does
+
+#include "dxfdraw.h"
+#include "dxfimport.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <time.h>
+
+
+using namespace std;
+
+
+// returns time in milliseconds
+static double GetTimeMs()
+{
+	timespec ts;
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+		assert(0);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+
+static bool WritePpm(const char * path, const SoftwareRenderTarget & target)
+{
+	FILE * file = fopen(path, "wb");
+	if (file == 0)
+		return false;
+	fprintf(file, "P6\n%d %d\n255\n", target.GetWidth(), target.GetHeight());
+	const vector<unsigned char> & pixels = target.GetPixels();
+	vector<unsigned char> row(target.GetWidth() * 3);
+	bool ok = true;
+	for (int y = 0; y < target.GetHeight() && ok; y++)
+	{
+		for (int x = 0; x < target.GetWidth(); x++)
+			memcpy(&row[x * 3], &pixels[(y * target.GetWidth() + x) * 4], 3);
+		ok = fwrite(&row[0], 1, row.size(), file) == row.size();
+	}
+	return fclose(file) == 0 && ok;
+}
+
+
+static void Usage()
+{
+	fprintf(stderr, "usage: dxfpreview [-s size] [-r repeats] [-b] input.dxf [output.ppm]\n");
+	exit(2);
+}
+
+
+int main(int argc, char * argv[])
+{
+	int size = 256;
+	int repeats = 1;
+	bool batch = false;
+	int arg = 1;
+	for (; arg < argc && argv[arg][0] == '-'; arg++)
+	{
+		if (strcmp(argv[arg], "-s") == 0 && arg + 1 < argc)
+			size = atoi(argv[++arg]);
+		else if (strcmp(argv[arg], "-r") == 0 && arg + 1 < argc)
+			repeats = atoi(argv[++arg]);
+		else if (strcmp(argv[arg], "-b") == 0)
+			batch = true;
+		else
+			Usage();
+	}
+	if (argc - arg < 1 || argc - arg > 2 || size <= 0 || repeats <= 0)
+		Usage();
+	const char * input = argv[arg];
+	const char * output = argc - arg == 2 ? argv[arg + 1] : 0;
+
+	double start = GetTimeMs();
+	DxfImporter importer;
+	if (!importer.ImportFile(input))
+	{
+		fprintf(stderr, "%s: %ls\n", input, importer.GetErrorMessage().c_str());
+		return 1;
+	}
+	double imported = GetTimeMs();
+	DxfDrawing drawing(importer.GetParts(), importer.GetBlocks());
+	double prepared = GetTimeMs();
+
+	SoftwareRenderTarget target(size, size);
+	Rect<double> bounds;
+	if (drawing.GetBounds(bounds))
+		target.FitView(bounds);
+	double drawTime = 0;
+	for (int i = 0; i < repeats; i++)
+	{
+		target.Clear(0, 0, 0);
+		double drawStart = GetTimeMs();
+		if (batch)
+		{
+			BatchRenderTarget batchTarget(target);
+			drawing.Draw(batchTarget);
+		}
+		else
+		{
+			drawing.Draw(target);
+		}
+		drawTime += GetTimeMs() - drawStart;
+	}
+	printf("%lu entities, import %.1f ms, prepare %.1f ms, draw %.3f ms", static_cast<unsigned long>(drawing.GetEntityCount()),
+			imported - start, prepared - imported, drawTime / repeats);
+	if (drawTime > 0)
+		printf(", %.0f entities/s", drawing.GetEntityCount() * repeats / (drawTime / 1000));
+	printf("\n");
+	if (output != 0 && !WritePpm(output, target))
+	{
+		fprintf(stderr, "%s: unable to write file\n", output);
+		return 1;
+	}
+	return 0;
+}
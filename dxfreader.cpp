@@ -0,0 +1,1377 @@
+/*
+ * dxfreader.cpp
+ *
+ *  Created on: 18.10.2026
+ *      Author: misha
+ */
+#include "dxfreader.h"
+#include <cassert>
+#include <cstdlib>
+#include <limits>
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#undef max
+#undef min
+#else
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+using namespace std;
+
+
+#ifdef _WIN32
+MappedFile::MappedFile(const wchar_t * path) : m_data(0), m_size(0), m_hfile(INVALID_HANDLE_VALUE), m_hmapping(0)
+{
+	m_hfile = CreateFileW(path, FILE_READ_DATA, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+	if (m_hfile == INVALID_HANDLE_VALUE)
+		throw DxfError(DxfErrorOpenFile);
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(m_hfile, &size) || static_cast<unsigned long long>(size.QuadPart) > static_cast<size_t>(-1))
+	{
+		CloseHandle(m_hfile);
+		throw DxfError(DxfErrorReadFile);
+	}
+	m_size = static_cast<size_t>(size.QuadPart);
+	// empty files can't be mapped
+	if (m_size == 0)
+		return;
+	m_hmapping = CreateFileMappingW(m_hfile, 0, PAGE_READONLY, 0, 0, 0);
+	if (m_hmapping != 0)
+		m_data = static_cast<const char *>(MapViewOfFile(m_hmapping, FILE_MAP_READ, 0, 0, 0));
+	if (m_data == 0)
+	{
+		if (m_hmapping != 0)
+			CloseHandle(m_hmapping);
+		CloseHandle(m_hfile);
+		throw DxfError(DxfErrorReadFile);
+	}
+}
+
+
+MappedFile::~MappedFile()
+{
+	if (m_data != 0 && !UnmapViewOfFile(m_data))
+		assert(0);
+	if (m_hmapping != 0 && !CloseHandle(m_hmapping))
+		assert(0);
+	if (!CloseHandle(m_hfile))
+		assert(0);
+}
+#else
+MappedFile::MappedFile(const char * path) : m_data(0), m_size(0)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd == -1)
+		throw DxfError(DxfErrorOpenFile);
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		close(fd);
+		throw DxfError(DxfErrorReadFile);
+	}
+	m_size = static_cast<size_t>(st.st_size);
+	if (m_size != 0)
+	{
+		void * data = mmap(0, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED)
+		{
+			close(fd);
+			throw DxfError(DxfErrorReadFile);
+		}
+		madvise(data, m_size, MADV_SEQUENTIAL);
+		m_data = static_cast<const char *>(data);
+	}
+	// mapping stays valid after descriptor is closed
+	close(fd);
+}
+
+
+MappedFile::~MappedFile()
+{
+	if (m_data != 0 && munmap(const_cast<char *>(m_data), m_size) != 0)
+		assert(0);
+}
+#endif
+
+
+DxfStr DxfTokenizer::ReadLine()
+{
+	const char * begin = m_pos;
+	const char * eol = static_cast<const char *>(memchr(begin, '\n', m_end - begin));
+	const char * end;
+	if (eol == 0)
+	{
+		end = m_end;
+		m_pos = m_end;
+	}
+	else
+	{
+		end = eol;
+		m_pos = eol + 1;
+	}
+	if (end != begin && end[-1] == '\r')
+		end--;
+	m_line++;
+	return DxfStr(begin, end - begin);
+}
+
+
+bool DxfTokenizer::ReadItem(DxfItem & item)
+{
+	if (m_format != DxfFormatAscii)
+		return ReadBinaryItem(item);
+	if (m_pos == m_end)
+		return false;
+	item.Pos = m_pos;
+	item.Binary = false;
+	DxfStr code = ReadLine();
+	if (code.Size == 0)
+		return false;
+	long val = DxfToLong(code);
+	item.Code = static_cast<int>(val);
+	item.Value = m_pos == m_end ? DxfStr(m_end, 0) : ReadLine();
+	return true;
+}
+
+
+bool DxfTokenizer::ReadBinaryItem(DxfItem & item)
+{
+	if (m_pos == m_end)
+		return false;
+	item.Pos = m_pos;
+	item.Binary = true;
+	const unsigned char * p = reinterpret_cast<const unsigned char *>(m_pos);
+	size_t codeSize = m_format == DxfFormatBinary || p[0] == 255 ? 2 : 1;
+	if (m_format == DxfFormatBinaryR12 && codeSize == 2)
+		p++;
+	if (static_cast<size_t>(m_end - reinterpret_cast<const char *>(p)) < codeSize)
+		throw DxfError(DxfErrorInvalidFormat, item.Pos);
+	item.Code = codeSize == 1 ? p[0] : static_cast<short>(p[0] | p[1] << 8);
+	m_pos = reinterpret_cast<const char *>(p) + codeSize;
+	size_t size;
+	switch (GetDxfValueType(item.Code))
+	{
+	case DxfValueString:
+		{
+			const char * zero = static_cast<const char *>(memchr(m_pos, 0, m_end - m_pos));
+			if (zero == 0)
+				throw DxfError(DxfErrorInvalidFormat, item.Pos);
+			item.Value = DxfStr(m_pos, zero - m_pos);
+			m_pos = zero + 1;
+			return true;
+		}
+	case DxfValueDouble:
+	case DxfValueInt64:
+		size = 8;
+		break;
+	case DxfValueInt32:
+		size = 4;
+		break;
+	case DxfValueInt16:
+		size = 2;
+		break;
+	case DxfValueBool:
+		size = 1;
+		break;
+	case DxfValueChunk:
+		if (m_pos == m_end)
+			throw DxfError(DxfErrorInvalidFormat, item.Pos);
+		size = 1 + static_cast<unsigned char>(*m_pos);
+		break;
+	default:
+		assert(0);
+		size = 0;
+		break;
+	}
+	if (static_cast<size_t>(m_end - m_pos) < size)
+		throw DxfError(DxfErrorInvalidFormat, item.Pos);
+	item.Value = DxfStr(m_pos, size);
+	m_pos += size;
+	return true;
+}
+
+
+DxfFormat DetectDxfFormat(const char *& begin, const char * end)
+{
+	if (static_cast<size_t>(end - begin) < DXF_BINARY_SENTINEL_SIZE ||
+			memcmp(begin, DXF_BINARY_SENTINEL, DXF_BINARY_SENTINEL_SIZE) != 0)
+		return DxfFormatAscii;
+	begin += DXF_BINARY_SENTINEL_SIZE;
+	// file starts with group code 0 followed by SECTION,
+	// so second byte is zero only for two byte codes
+	return end - begin >= 2 && begin[1] == 0 ? DxfFormatBinary : DxfFormatBinaryR12;
+}
+
+
+// ranges are from group code table of dxf reference
+DxfValueType GetDxfValueType(int code)
+{
+	if (code < 10)
+		return DxfValueString;
+	if (code < 60)
+		return DxfValueDouble;
+	if (code < 90)
+		return DxfValueInt16;
+	if (code < 100)
+		return DxfValueInt32;
+	if (code < 110)
+		return DxfValueString;
+	if (code < 150)
+		return DxfValueDouble;
+	if (code >= 160 && code < 170)
+		return DxfValueInt64;
+	if (code >= 170 && code < 180)
+		return DxfValueInt16;
+	if (code >= 210 && code < 240)
+		return DxfValueDouble;
+	if (code >= 270 && code < 290)
+		return DxfValueInt16;
+	if (code >= 290 && code < 300)
+		return DxfValueBool;
+	if ((code >= 310 && code < 320) || code == 1004)
+		return DxfValueChunk;
+	if (code >= 370 && code < 390)
+		return DxfValueInt16;
+	if (code >= 400 && code < 410)
+		return DxfValueInt16;
+	if (code >= 420 && code < 430)
+		return DxfValueInt32;
+	if (code >= 440 && code < 460)
+		return DxfValueInt32;
+	if (code >= 460 && code < 470)
+		return DxfValueDouble;
+	if (code >= 1010 && code < 1060)
+		return DxfValueDouble;
+	if (code >= 1060 && code < 1071)
+		return DxfValueInt16;
+	if (code == 1071)
+		return DxfValueInt32;
+	return DxfValueString;
+}
+
+
+// little endian integer of size bytes
+static unsigned long long ReadBinaryNumber(const DxfStr & value)
+{
+	const unsigned char * p = reinterpret_cast<const unsigned char *>(value.Ptr);
+	unsigned long long result = 0;
+	for (size_t i = value.Size; i > 0; i--)
+		result = result << 8 | p[i - 1];
+	return result;
+}
+
+
+static long BinaryToLong(const DxfItem & item)
+{
+	unsigned long long bits = ReadBinaryNumber(item.Value);
+	switch (GetDxfValueType(item.Code))
+	{
+	case DxfValueInt16:
+		return static_cast<short>(bits);
+	case DxfValueInt32:
+		return static_cast<int>(bits);
+	case DxfValueInt64:
+		return static_cast<long>(static_cast<long long>(bits));
+	case DxfValueBool:
+		return static_cast<long>(bits);
+	case DxfValueString:
+		return DxfToLong(item.Value);
+	default:
+		throw DxfError(DxfErrorInvalidFormat, item.Pos);
+	}
+}
+
+
+long DxfToLong(const DxfItem & item)
+{
+	return item.Binary ? BinaryToLong(item) : DxfToLong(item.Value);
+}
+
+
+double DxfToDouble(const DxfItem & item)
+{
+	if (!item.Binary)
+		return DxfToDouble(item.Value);
+	DxfValueType type = GetDxfValueType(item.Code);
+	if (type == DxfValueString)
+		return DxfToDouble(item.Value);
+	if (type != DxfValueDouble)
+		return BinaryToLong(item);
+	unsigned long long bits = ReadBinaryNumber(item.Value);
+	double result;
+	memcpy(&result, &bits, sizeof(result));
+	return result;
+}
+
+
+static inline bool IsDxfSpace(char ch)
+{
+	return ch == ' ' || ch == '\t' || ch == '\r';
+}
+
+
+long DxfToLong(const DxfStr & str)
+{
+	const char * p = str.Ptr;
+	const char * end = str.Ptr + str.Size;
+	while (p != end && IsDxfSpace(*p))
+		p++;
+	bool negative = false;
+	if (p != end && (*p == '-' || *p == '+'))
+	{
+		negative = *p == '-';
+		p++;
+	}
+	const char * digits = p;
+	long result = 0;
+	for (; p != end && *p >= '0' && *p <= '9'; p++)
+		result = result * 10 + (*p - '0');
+	if (p == digits)
+		throw DxfError(DxfErrorInvalidFormat, str.Ptr);
+	while (p != end && IsDxfSpace(*p))
+		p++;
+	if (p != end)
+		throw DxfError(DxfErrorInvalidFormat, str.Ptr);
+	return negative ? -result : result;
+}
+
+
+// powers of ten which are exactly representable in double
+static const double g_exactPow10[] =
+{
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+
+// values with up to 15 significant digits and small exponent are converted exactly
+// from integer mantissa, others are passed to strtod
+double DxfToDouble(const DxfStr & str)
+{
+	const char * p = str.Ptr;
+	const char * end = str.Ptr + str.Size;
+	while (p != end && IsDxfSpace(*p))
+		p++;
+	const char * start = p;
+	bool negative = false;
+	if (p != end && (*p == '-' || *p == '+'))
+	{
+		negative = *p == '-';
+		p++;
+	}
+	unsigned long long mantissa = 0;
+	int digits = 0;
+	int exp10 = 0;
+	bool any = false;
+	for (; p != end && *p >= '0' && *p <= '9'; p++)
+	{
+		any = true;
+		if (mantissa == 0 && *p == '0')
+			continue;
+		if (digits < 19)
+		{
+			mantissa = mantissa * 10 + (*p - '0');
+			digits++;
+		}
+		else
+		{
+			exp10++;
+		}
+	}
+	if (p != end && *p == '.')
+	{
+		p++;
+		for (; p != end && *p >= '0' && *p <= '9'; p++)
+		{
+			any = true;
+			if (mantissa == 0 && *p == '0')
+			{
+				exp10--;
+				continue;
+			}
+			if (digits < 19)
+			{
+				mantissa = mantissa * 10 + (*p - '0');
+				digits++;
+				exp10--;
+			}
+		}
+	}
+	if (!any)
+		throw DxfError(DxfErrorInvalidFormat, str.Ptr);
+	if (p != end && (*p == 'e' || *p == 'E'))
+	{
+		const char * q = p + 1;
+		bool expNegative = false;
+		if (q != end && (*q == '-' || *q == '+'))
+		{
+			expNegative = *q == '-';
+			q++;
+		}
+		int exp = 0;
+		const char * expDigits = q;
+		for (; q != end && *q >= '0' && *q <= '9'; q++)
+		{
+			if (exp < 10000)
+				exp = exp * 10 + (*q - '0');
+		}
+		if (q != expDigits)
+		{
+			exp10 += expNegative ? -exp : exp;
+			p = q;
+		}
+	}
+	const char * rest = p;
+	while (rest != end && IsDxfSpace(*rest))
+		rest++;
+	if (rest != end)
+		throw DxfError(DxfErrorInvalidFormat, str.Ptr);
+	if (mantissa == 0)
+		return negative ? -0.0 : 0.0;
+	if (digits <= 15 && exp10 >= -22 && exp10 <= 22)
+	{
+		double result = static_cast<double>(mantissa);
+		if (exp10 < 0)
+			result /= g_exactPow10[-exp10];
+		else
+			result *= g_exactPow10[exp10];
+		return negative ? -result : result;
+	}
+	// rare case, strtod needs zero terminated string
+	char buf[128];
+	size_t len = p - start;
+	if (len >= sizeof(buf))
+		throw DxfError(DxfErrorInvalidFormat, str.Ptr);
+	memcpy(buf, start, len);
+	buf[len] = 0;
+	return strtod(buf, 0);
+}
+
+
+static const char * NextLine(const char * p, const char * end)
+{
+	const char * eol = static_cast<const char *>(memchr(p, '\n', end - p));
+	return eol == 0 ? end : eol + 1;
+}
+
+
+// true if line at p contains group code 0
+static bool IsZeroCodeLine(const char * p, const char * end)
+{
+	while (p != end && IsDxfSpace(*p))
+		p++;
+	if (p == end || *p != '0')
+		return false;
+	p++;
+	while (p != end && IsDxfSpace(*p))
+		p++;
+	return p == end || *p == '\n';
+}
+
+
+// group code lines are numbers, so zero line followed by line starting with letter
+// is group code 0 with name of entity and not value 0
+static bool IsEntityStart(const char * p, const char * end)
+{
+	if (!IsZeroCodeLine(p, end))
+		return false;
+	const char * next = NextLine(p, end);
+	return next != end && ((*next >= 'A' && *next <= 'Z') || *next == '_' || *next == '$');
+}
+
+
+// vertices of old style polyline are separate entities which go after it
+static bool IsPolylinePart(const char * p, const char * end)
+{
+	const char * name = NextLine(p, end);
+	size_t len = end - name;
+	return (len >= 6 && memcmp(name, "VERTEX", 6) == 0) || (len >= 6 && memcmp(name, "SEQEND", 6) == 0);
+}
+
+
+// returns start of first entity at or after line containing pos
+static const char * FindEntityStart(const char * begin, const char * pos, const char * end)
+{
+	while (pos != begin && pos[-1] != '\n')
+		pos--;
+	while (pos != end && (!IsEntityStart(pos, end) || IsPolylinePart(pos, end)))
+		pos = NextLine(pos, end);
+	return pos;
+}
+
+
+const char * FindDxfEntities(const char * begin, const char * end, DxfFormat format, vector<DxfBlock> * blocks)
+{
+	DxfTokenizer rdr(begin, end, format);
+	DxfItem item;
+	bool sectionStart = false;
+	while (rdr.ReadItem(item))
+	{
+		if (sectionStart && item.Code == 2)
+		{
+			if (item.Value == "ENTITIES")
+				return rdr.GetPos();
+			if (item.Value == "BLOCKS" && blocks != 0)
+				rdr = DxfTokenizer(ParseDxfBlocks(rdr.GetPos(), end, format, *blocks), end, format);
+		}
+		sectionStart = item.Code == 0 && item.Value == "SECTION";
+	}
+	return 0;
+}
+
+
+// bulge of arc going from p1 through pm to p2, pm should be near middle of arc,
+// doubled distance of pm from chord divided by chord length is tangent of quarter of arc angle
+static double BulgeFrom3Pt(const Point<double> & p1, const Point<double> & pm, const Point<double> & p2)
+{
+	Point<double> chord = p2 - p1;
+	double len2 = chord.X * chord.X + chord.Y * chord.Y;
+	if (len2 == 0)
+		return 0;
+	double cross = chord.X * (pm.Y - p1.Y) - chord.Y * (pm.X - p1.X);
+	return -2 * cross / len2;
+}
+
+
+// approximates curve by polyline of arcs, each segment goes through curve points
+// at its ends and in the middle of its parameter range,
+// if closed curve ends where it starts last point is dropped
+template <class Curve>
+static void AddCurve(const Curve & curve, const vector<double> & params, bool closed, DxfEntities & result)
+{
+	assert(params.size() >= 2);
+	DxfEntity polyline;
+	polyline.Type = DxfEntityPolyline;
+	polyline.FirstNode = result.Nodes.size();
+	polyline.Closed = closed;
+	size_t count = params.size();
+	Point<double> first = curve(params.front());
+	if (closed && EqualsEpsilon(first, curve(params.back())))
+		count--;
+	Point<double> pt = first;
+	for (size_t i = 0; i < count; i++)
+	{
+		DxfNode node;
+		node.Pt = pt;
+		node.Bulge = 0;
+		if (i + 1 < params.size())
+		{
+			pt = curve(params[i + 1]);
+			node.Bulge = BulgeFrom3Pt(node.Pt, curve((params[i] + params[i + 1]) / 2), pt);
+		}
+		result.Nodes.push_back(node);
+	}
+	polyline.NodeCount = count;
+	result.Entities.push_back(polyline);
+}
+
+
+namespace
+{
+	struct EllipseCurve
+	{
+		EllipseCurve() : Center(0, 0), Major(0, 0), Minor(0, 0) {}
+		Point<double> Center;
+		Point<double> Major;
+		Point<double> Minor;
+		Point<double> operator()(double t) const { return Center + Major * cos(t) + Minor * sin(t); }
+	};
+
+	// rational b-spline evaluated with de Boor algorithm
+	struct SplineCurve
+	{
+		static const int MAX_DEGREE = 15;
+		int Degree;
+		const vector<double> * Knots;
+		const vector<Point<double> > * Points;
+		const vector<double> * Weights;
+		Point<double> operator()(double t) const
+		{
+			const vector<double> & knots = *Knots;
+			const vector<Point<double> > & points = *Points;
+			const size_t p = Degree;
+			size_t k = p;
+			while (k + 1 < points.size() && t >= knots[k + 1])
+				k++;
+			// points in homogeneous coordinates
+			double x[MAX_DEGREE + 1], y[MAX_DEGREE + 1], w[MAX_DEGREE + 1];
+			for (size_t j = 0; j <= p; j++)
+			{
+				size_t i = k - p + j;
+				w[j] = Weights->empty() ? 1 : (*Weights)[i];
+				x[j] = points[i].X * w[j];
+				y[j] = points[i].Y * w[j];
+			}
+			for (size_t r = 1; r <= p; r++)
+			{
+				for (size_t j = p; j >= r; j--)
+				{
+					size_t i = k - p + j;
+					double denom = knots[i + p - r + 1] - knots[i];
+					double alpha = denom == 0 ? 0 : (t - knots[i]) / denom;
+					x[j] = (1 - alpha) * x[j - 1] + alpha * x[j];
+					y[j] = (1 - alpha) * y[j - 1] + alpha * y[j];
+					w[j] = (1 - alpha) * w[j - 1] + alpha * w[j];
+				}
+			}
+			return Point<double>(x[p] / w[p], y[p] / w[p]);
+		}
+	};
+}
+
+
+// full ellipse gets 32 segments, parameters are in radians
+static void AddEllipse(const EllipseCurve & curve, double startParam, double endParam, DxfEntities & result)
+{
+	const int fullSegments = 32;
+	while (endParam <= startParam)
+		endParam += 2 * M_PI;
+	double sweep = endParam - startParam;
+	bool closed = sweep >= 2 * M_PI - EPSILON;
+	int segments = max(1, static_cast<int>(ceil(fullSegments * sweep / (2 * M_PI) - EPSILON)));
+	vector<double> params(segments + 1);
+	for (int i = 0; i <= segments; i++)
+		params[i] = startParam + sweep * i / segments;
+	AddCurve(curve, params, closed, result);
+}
+
+
+// spline gets 4 segments per knot span, if control points are not given
+// it is polyline through fit points
+static void AddSpline(int degree, long flags, const vector<double> & knots, const vector<double> & weights,
+		const vector<Point<double> > & points, const vector<Point<double> > & fitPoints, const char * pos,
+		DxfEntities & result)
+{
+	const int spanSegments = 4;
+	bool closed = (flags & 1) != 0;
+	bool valid = degree >= 1 && degree <= SplineCurve::MAX_DEGREE && points.size() > static_cast<size_t>(degree) &&
+			knots.size() == points.size() + degree + 1 && (weights.empty() || weights.size() == points.size());
+	if (!valid)
+	{
+		if (fitPoints.size() < 2)
+			throw DxfError(DxfErrorInvalidFormat, pos);
+		DxfEntity polyline;
+		polyline.Type = DxfEntityPolyline;
+		polyline.FirstNode = result.Nodes.size();
+		polyline.NodeCount = fitPoints.size();
+		polyline.Closed = closed;
+		for (size_t i = 0; i < fitPoints.size(); i++)
+		{
+			DxfNode node;
+			node.Pt = fitPoints[i];
+			node.Bulge = 0;
+			result.Nodes.push_back(node);
+		}
+		result.Entities.push_back(polyline);
+		return;
+	}
+	SplineCurve curve;
+	curve.Degree = degree;
+	curve.Knots = &knots;
+	curve.Points = &points;
+	curve.Weights = &weights;
+	vector<double> params;
+	for (size_t k = degree; k < points.size(); k++)
+	{
+		if (knots[k + 1] <= knots[k])
+			continue;
+		for (int i = 0; i < spanSegments; i++)
+			params.push_back(knots[k] + (knots[k + 1] - knots[k]) * i / spanSegments);
+	}
+	if (params.empty())
+		throw DxfError(DxfErrorInvalidFormat, pos);
+	// end of domain is evaluated in last span
+	params.push_back(knots[points.size()]);
+	AddCurve(curve, params, closed, result);
+}
+
+
+// parses entities until end of section or block, item is group code 0 of first entity,
+// it receives group code 0 of ENDSEC or ENDBLK, returns false at end of data
+static bool ParseEntityItems(DxfTokenizer & rdr, DxfItem & item, DxfEntities & result)
+{
+	// entities end with group code 0 of next entity or with end of data
+	bool more = true;
+	while (more)
+	{
+		const char * entityPos = item.Pos;
+		if (item.Value == "LINE")
+		{
+			enum Flags
+			{
+				P1X = 1,
+				P1Y = 2,
+				P2X = 4,
+				P2Y = 8,
+			};
+			int flags = 0;
+			DxfEntity line;
+			line.Type = DxfEntityLine;
+			while ((more = rdr.ReadItem(item)) && item.Code != 0)
+			{
+				switch (item.Code)
+				{
+				case 10:
+					line.Pt1.X = DxfToDouble(item);
+					flags |= P1X;
+					break;
+				case 20:
+					line.Pt1.Y = DxfToDouble(item);
+					flags |= P1Y;
+					break;
+				case 11:
+					line.Pt2.X = DxfToDouble(item);
+					flags |= P2X;
+					break;
+				case 21:
+					line.Pt2.Y = DxfToDouble(item);
+					flags |= P2Y;
+					break;
+				}
+			}
+			if (flags != (P1X | P1Y | P2X | P2Y))
+				throw DxfError(DxfErrorInvalidFormat, entityPos);
+			result.Entities.push_back(line);
+		}
+		else if (item.Value == "CIRCLE" || item.Value == "ARC")
+		{
+			enum Flags
+			{
+				CX = 1,
+				CY = 2,
+				RADIUS = 4,
+				ANGLE1 = 8,
+				ANGLE2 = 16,
+			};
+			DxfEntity circle;
+			circle.Type = item.Value == "ARC" ? DxfEntityArc : DxfEntityCircle;
+			double ang1 = 0, ang2 = 0;
+			int flags = 0;
+			while ((more = rdr.ReadItem(item)) && item.Code != 0)
+			{
+				switch (item.Code)
+				{
+				case 10:
+					circle.Center.X = DxfToDouble(item);
+					flags |= CX;
+					break;
+				case 20:
+					circle.Center.Y = DxfToDouble(item);
+					flags |= CY;
+					break;
+				case 40:
+					circle.Radius = DxfToDouble(item);
+					flags |= RADIUS;
+					break;
+				case 50:
+					ang1 = DxfToDouble(item);
+					flags |= ANGLE1;
+					break;
+				case 51:
+					ang2 = DxfToDouble(item);
+					flags |= ANGLE2;
+					break;
+				}
+			}
+			if (circle.Type == DxfEntityArc)
+			{
+				if (flags != (CX | CY | RADIUS | ANGLE1 | ANGLE2))
+					throw DxfError(DxfErrorInvalidFormat, entityPos);
+				circle.Pt1.X = cos(ang1*M_PI/180)*circle.Radius + circle.Center.X;
+				circle.Pt1.Y = sin(ang1*M_PI/180)*circle.Radius + circle.Center.Y;
+				circle.Pt2.X = cos(ang2*M_PI/180)*circle.Radius + circle.Center.X;
+				circle.Pt2.Y = sin(ang2*M_PI/180)*circle.Radius + circle.Center.Y;
+			}
+			else if ((flags & (CX | CY | RADIUS)) != (CX | CY | RADIUS))
+			{
+				throw DxfError(DxfErrorInvalidFormat, entityPos);
+			}
+			result.Entities.push_back(circle);
+		}
+		else if (item.Value == "LWPOLYLINE")
+		{
+			long numVerts = -1;
+			DxfEntity polyline;
+			polyline.Type = DxfEntityPolyline;
+			polyline.FirstNode = result.Nodes.size();
+			polyline.NodeCount = 0;
+			polyline.Closed = false;
+			enum Flags
+			{
+				GOTX = 1,
+				GOTY = 2,
+			};
+			int flags = 0;
+			while ((more = rdr.ReadItem(item)) && item.Code != 0)
+			{
+				switch (item.Code)
+				{
+				case 90:
+					numVerts = DxfToLong(item);
+					break;
+				case 70:
+					polyline.Closed = (DxfToLong(item) & 0x1) != 0;
+					break;
+				case 10:
+					if (polyline.NodeCount > 0)
+					{
+						if ((flags & GOTX) == 0 || (flags & GOTY) == 0)
+							throw DxfError(DxfErrorInvalidFormat, entityPos);
+					}
+					flags = 0;
+					assert(polyline.NodeCount <= static_cast<size_t>(numeric_limits<long>::max()));
+					if (numVerts <= static_cast<long>(polyline.NodeCount))
+						throw DxfError(DxfErrorInvalidFormat, entityPos);
+					result.Nodes.push_back(DxfNode());
+					result.Nodes.back().Bulge = 0;
+					result.Nodes.back().Pt.X = DxfToDouble(item);
+					polyline.NodeCount++;
+					flags |= GOTX;
+					break;
+				case 20:
+					if (polyline.NodeCount == 0)
+						throw DxfError(DxfErrorInvalidFormat, entityPos);
+					result.Nodes.back().Pt.Y = DxfToDouble(item);
+					flags |= GOTY;
+					break;
+				case 42:
+					if (polyline.NodeCount == 0)
+						throw DxfError(DxfErrorInvalidFormat, entityPos);
+					result.Nodes.back().Bulge = DxfToDouble(item);
+					break;
+				}
+			}
+			assert(polyline.NodeCount <= static_cast<size_t>(numeric_limits<long>::max()));
+			if (static_cast<long>(polyline.NodeCount) != numVerts)
+				throw DxfError(DxfErrorInvalidFormat, entityPos);
+			result.Entities.push_back(polyline);
+		}
+		else if (item.Value == "POLYLINE")
+		{
+			enum Flags
+			{
+				GOTX = 1,
+				GOTY = 2,
+			};
+			DxfEntity polyline;
+			polyline.Type = DxfEntityPolyline;
+			polyline.FirstNode = result.Nodes.size();
+			polyline.NodeCount = 0;
+			long polylineFlags = 0;
+			while ((more = rdr.ReadItem(item)) && item.Code != 0)
+			{
+				if (item.Code == 70)
+					polylineFlags = DxfToLong(item);
+			}
+			polyline.Closed = (polylineFlags & 1) != 0;
+			// vertices go as separate entities up to SEQEND
+			while (more && item.Value == "VERTEX")
+			{
+				const char * vertexPos = item.Pos;
+				DxfNode node;
+				node.Bulge = 0;
+				long vertexFlags = 0;
+				int flags = 0;
+				while ((more = rdr.ReadItem(item)) && item.Code != 0)
+				{
+					switch (item.Code)
+					{
+					case 10:
+						node.Pt.X = DxfToDouble(item);
+						flags |= GOTX;
+						break;
+					case 20:
+						node.Pt.Y = DxfToDouble(item);
+						flags |= GOTY;
+						break;
+					case 42:
+						node.Bulge = DxfToDouble(item);
+						break;
+					case 70:
+						vertexFlags = DxfToLong(item);
+						break;
+					}
+				}
+				if (flags != (GOTX | GOTY))
+					throw DxfError(DxfErrorInvalidFormat, vertexPos);
+				// spline frame control points are not on curve
+				if ((vertexFlags & 16) == 0)
+				{
+					result.Nodes.push_back(node);
+					polyline.NodeCount++;
+				}
+			}
+			if (!more || item.Value != "SEQEND")
+				throw DxfError(DxfErrorInvalidFormat, entityPos);
+			while ((more = rdr.ReadItem(item)) && item.Code != 0)
+				;
+			// 3d meshes and polyface meshes are not curves
+			if ((polylineFlags & (16 | 64)) != 0 || polyline.NodeCount == 0)
+				result.Nodes.resize(polyline.FirstNode);
+			else
+				result.Entities.push_back(polyline);
+		}
+		else if (item.Value == "ELLIPSE")
+		{
+			enum Flags
+			{
+				CX = 1,
+				CY = 2,
+				AX = 4,
+				AY = 8,
+				RATIO = 16,
+			};
+			EllipseCurve curve;
+			double ratio = 1;
+			double startParam = 0;
+			double endParam = 2 * M_PI;
+			int flags = 0;
+			while ((more = rdr.ReadItem(item)) && item.Code != 0)
+			{
+				switch (item.Code)
+				{
+				case 10:
+					curve.Center.X = DxfToDouble(item);
+					flags |= CX;
+					break;
+				case 20:
+					curve.Center.Y = DxfToDouble(item);
+					flags |= CY;
+					break;
+				case 11:
+					curve.Major.X = DxfToDouble(item);
+					flags |= AX;
+					break;
+				case 21:
+					curve.Major.Y = DxfToDouble(item);
+					flags |= AY;
+					break;
+				case 40:
+					ratio = DxfToDouble(item);
+					flags |= RATIO;
+					break;
+				case 41:
+					startParam = DxfToDouble(item);
+					break;
+				case 42:
+					endParam = DxfToDouble(item);
+					break;
+				}
+			}
+			if (flags != (CX | CY | AX | AY | RATIO))
+				throw DxfError(DxfErrorInvalidFormat, entityPos);
+			curve.Minor = Point<double>(-curve.Major.Y, curve.Major.X) * ratio;
+			AddEllipse(curve, startParam, endParam, result);
+		}
+		else if (item.Value == "SPLINE")
+		{
+			long flags = 0;
+			long degree = 0;
+			vector<double> knots;
+			vector<double> weights;
+			vector<Point<double> > points;
+			vector<Point<double> > fitPoints;
+			while ((more = rdr.ReadItem(item)) && item.Code != 0)
+			{
+				switch (item.Code)
+				{
+				case 70:
+					flags = DxfToLong(item);
+					break;
+				case 71:
+					degree = DxfToLong(item);
+					break;
+				case 40:
+					knots.push_back(DxfToDouble(item));
+					break;
+				case 41:
+					weights.push_back(DxfToDouble(item));
+					break;
+				case 10:
+					points.push_back(Point<double>(DxfToDouble(item), 0));
+					break;
+				case 20:
+					if (points.empty())
+						throw DxfError(DxfErrorInvalidFormat, entityPos);
+					points.back().Y = DxfToDouble(item);
+					break;
+				case 11:
+					fitPoints.push_back(Point<double>(DxfToDouble(item), 0));
+					break;
+				case 21:
+					if (fitPoints.empty())
+						throw DxfError(DxfErrorInvalidFormat, entityPos);
+					fitPoints.back().Y = DxfToDouble(item);
+					break;
+				}
+			}
+			AddSpline(static_cast<int>(degree), flags, knots, weights, points, fitPoints, entityPos, result);
+		}
+		else if (item.Value == "INSERT")
+		{
+			enum Flags
+			{
+				NAME = 1,
+				PX = 2,
+				PY = 4,
+			};
+			DxfEntity insert;
+			insert.Type = DxfEntityInsert;
+			insert.Pt2 = Point<double>(1, 1);
+			insert.Radius = 0;
+			DxfStr name;
+			// minsert places block in rows and columns
+			long columns = 1, rows = 1;
+			double columnSpacing = 0, rowSpacing = 0;
+			int flags = 0;
+			while ((more = rdr.ReadItem(item)) && item.Code != 0)
+			{
+				switch (item.Code)
+				{
+				case 2:
+					name = item.Value;
+					flags |= NAME;
+					break;
+				case 10:
+					insert.Pt1.X = DxfToDouble(item);
+					flags |= PX;
+					break;
+				case 20:
+					insert.Pt1.Y = DxfToDouble(item);
+					flags |= PY;
+					break;
+				case 41:
+					insert.Pt2.X = DxfToDouble(item);
+					break;
+				case 42:
+					insert.Pt2.Y = DxfToDouble(item);
+					break;
+				case 50:
+					insert.Radius = DxfToDouble(item);
+					break;
+				case 70:
+					columns = DxfToLong(item);
+					break;
+				case 71:
+					rows = DxfToLong(item);
+					break;
+				case 44:
+					columnSpacing = DxfToDouble(item);
+					break;
+				case 45:
+					rowSpacing = DxfToDouble(item);
+					break;
+				}
+			}
+			if (flags != (NAME | PX | PY))
+				throw DxfError(DxfErrorInvalidFormat, entityPos);
+			insert.Name = result.Names.size();
+			result.Names.push_back(name.ToString());
+			Matrix3<double> rotation = RotationMatrix(insert.Radius * M_PI / 180);
+			Point<double> origin = insert.Pt1;
+			for (long row = 0; row < max(rows, 1l); row++)
+			{
+				for (long column = 0; column < max(columns, 1l); column++)
+				{
+					insert.Pt1 = origin + rotation * Point<double>(column * columnSpacing, row * rowSpacing);
+					result.Entities.push_back(insert);
+				}
+			}
+		}
+		else if (item.Value == "ENDSEC" || item.Value == "ENDBLK")
+		{
+			return true;
+		}
+		else
+		{
+			while ((more = rdr.ReadItem(item)) && item.Code != 0)
+				;
+		}
+	}
+	return false;
+}
+
+
+bool ParseDxfEntities(const char * begin, const char * end, DxfFormat format, DxfEntities & result)
+{
+	DxfTokenizer rdr(begin, end, format);
+	DxfItem item;
+	if (!rdr.ReadItem(item))
+		return false;
+	if (item.Code != 0)
+		throw DxfError(DxfErrorInvalidFormat, item.Pos);
+	if (!ParseEntityItems(rdr, item, result))
+		return false;
+	if (item.Value != "ENDSEC")
+		throw DxfError(DxfErrorInvalidFormat, item.Pos);
+	return true;
+}
+
+
+const char * ParseDxfBlocks(const char * begin, const char * end, DxfFormat format, vector<DxfBlock> & result)
+{
+	enum Flags
+	{
+		NAME = 1,
+		BX = 2,
+		BY = 4,
+	};
+	DxfTokenizer rdr(begin, end, format);
+	DxfItem item;
+	bool more = rdr.ReadItem(item);
+	while (more)
+	{
+		if (item.Code != 0)
+			throw DxfError(DxfErrorInvalidFormat, item.Pos);
+		if (item.Value == "ENDSEC")
+			return rdr.GetPos();
+		if (item.Value != "BLOCK")
+		{
+			while ((more = rdr.ReadItem(item)) && item.Code != 0)
+				;
+			continue;
+		}
+		const char * blockPos = item.Pos;
+		result.push_back(DxfBlock());
+		DxfBlock & block = result.back();
+		int flags = 0;
+		while ((more = rdr.ReadItem(item)) && item.Code != 0)
+		{
+			switch (item.Code)
+			{
+			case 2:
+				block.Name = item.Value.ToString();
+				flags |= NAME;
+				break;
+			case 10:
+				block.Base.X = DxfToDouble(item);
+				flags |= BX;
+				break;
+			case 20:
+				block.Base.Y = DxfToDouble(item);
+				flags |= BY;
+				break;
+			}
+		}
+		if (flags != (NAME | BX | BY) || !more)
+			throw DxfError(DxfErrorInvalidFormat, blockPos);
+		if (!ParseEntityItems(rdr, item, block.Entities) || item.Value != "ENDBLK")
+			throw DxfError(DxfErrorInvalidFormat, blockPos);
+		while ((more = rdr.ReadItem(item)) && item.Code != 0)
+			;
+	}
+	return end;
+}
+
+
+unsigned GetProcessorCount()
+{
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors;
+#else
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? static_cast<unsigned>(count) : 1;
+#endif
+}
+
+
+namespace
+{
+	// parts are taken by threads one by one until all are parsed
+	struct ParallelParseJob
+	{
+		// part i is [Bounds[i], Bounds[i + 1])
+		const char * const * Bounds;
+		DxfFormat Format;
+		std::vector<DxfEntities> * Result;
+		std::vector<DxfError> Errors;
+		std::vector<char> EndFound;
+		volatile long NextPart;
+	};
+}
+
+
+static long TakeNextPart(ParallelParseJob & job)
+{
+#ifdef _WIN32
+	return InterlockedIncrement(&job.NextPart) - 1;
+#else
+	return __sync_fetch_and_add(&job.NextPart, 1);
+#endif
+}
+
+
+static void ParseParts(ParallelParseJob & job)
+{
+	const long parts = static_cast<long>(job.Result->size());
+	for (long part = TakeNextPart(job); part < parts; part = TakeNextPart(job))
+	{
+		try
+		{
+			job.EndFound[part] = ParseDxfEntities(job.Bounds[part], job.Bounds[part + 1], job.Format, (*job.Result)[part]);
+		}
+		catch (DxfError & err)
+		{
+			job.Errors[part] = err;
+		}
+	}
+}
+
+
+#ifdef _WIN32
+static unsigned __stdcall ParseThreadProc(void * param)
+{
+	ParseParts(*static_cast<ParallelParseJob *>(param));
+	return 0;
+}
+#else
+static void * ParseThreadProc(void * param)
+{
+	ParseParts(*static_cast<ParallelParseJob *>(param));
+	return 0;
+}
+#endif
+
+
+const char * FindNextDxfPart(const char * begin, const char * end, DxfFormat format, size_t partSize)
+{
+	if (static_cast<size_t>(end - begin) <= partSize)
+		return end;
+	const char * next = begin + partSize;
+	if (format == DxfFormatAscii)
+		return FindEntityStart(NextLine(begin, end), next, end);
+	// entity names are checked by reading items one by one,
+	// part after end of section is not needed
+	DxfTokenizer rdr(begin, end, format);
+	DxfItem item;
+	while (rdr.ReadItem(item))
+	{
+		if (item.Code != 0 || item.Pos < next)
+			continue;
+		if (item.Value == "ENDSEC")
+			break;
+		if (item.Value == "VERTEX" || item.Value == "SEQEND")
+			continue;
+		return item.Pos;
+	}
+	return end;
+}
+
+
+// moves parsed parts to end of result
+static void AppendParts(std::vector<DxfEntities> & parts, std::vector<DxfEntities> & result)
+{
+	size_t first = result.size();
+	result.resize(first + parts.size());
+	for (size_t i = 0; i < parts.size(); i++)
+	{
+		result[first + i].Entities.swap(parts[i].Entities);
+		result[first + i].Nodes.swap(parts[i].Nodes);
+		result[first + i].Names.swap(parts[i].Names);
+	}
+}
+
+
+void ParseDxfEntitiesParallel(const char * begin, const char * end, DxfFormat format, unsigned threads,
+		std::vector<DxfEntities> & result)
+{
+	// small parts don't pay for thread start
+	const size_t minPartSize = 1 << 20;
+	if (threads == 0)
+		threads = GetProcessorCount();
+	const size_t waveParts = static_cast<size_t>(threads) * 4;
+	// text is split into one wave, binary data is read through to find boundaries,
+	// so its parts are found one wave ahead of parsing
+	size_t partSize = minPartSize;
+	if (format == DxfFormatAscii)
+		partSize = max(static_cast<size_t>(end - begin) / waveParts, minPartSize);
+	result.clear();
+	std::vector<const char *> bounds(1, begin);
+	std::vector<DxfEntities> wave;
+	while (bounds.back() != end)
+	{
+		size_t first = bounds.size() - 1;
+		while (bounds.size() - 1 - first < waveParts && bounds.back() != end)
+			bounds.push_back(FindNextDxfPart(bounds.back(), end, format, partSize));
+		bool endFound = ParseDxfParts(bounds, first, bounds.size() - 1, format, threads, wave);
+		AppendParts(wave, result);
+		if (endFound)
+			break;
+	}
+}
+
+
+bool ParseDxfParts(const std::vector<const char *> & bounds, size_t first, size_t last, DxfFormat format,
+		unsigned threads, std::vector<DxfEntities> & result)
+{
+	assert(first <= last && last < bounds.size());
+	if (threads == 0)
+		threads = GetProcessorCount();
+	size_t parts = last - first;
+	result.clear();
+	result.resize(parts);
+	if (parts == 0)
+		return false;
+	ParallelParseJob job;
+	job.Bounds = &bounds[first];
+	job.Format = format;
+	job.Result = &result;
+	job.Errors.resize(parts, DxfError(DxfOk));
+	job.EndFound.resize(parts);
+	job.NextPart = 0;
+	threads = static_cast<unsigned>(min<size_t>(threads, parts));
+	// calling thread works too
+#ifdef _WIN32
+	std::vector<HANDLE> handles;
+	for (unsigned i = 1; i < threads; i++)
+	{
+		HANDLE handle = reinterpret_cast<HANDLE>(_beginthreadex(0, 0, ParseThreadProc, &job, 0, 0));
+		if (handle == 0)
+			break;
+		handles.push_back(handle);
+	}
+	ParseParts(job);
+	for (size_t i = 0; i < handles.size(); i++)
+	{
+		if (WaitForSingleObject(handles[i], INFINITE) != WAIT_OBJECT_0)
+			assert(0);
+		CloseHandle(handles[i]);
+	}
+#else
+	std::vector<pthread_t> handles;
+	for (unsigned i = 1; i < threads; i++)
+	{
+		pthread_t handle;
+		if (pthread_create(&handle, 0, ParseThreadProc, &job) != 0)
+			break;
+		handles.push_back(handle);
+	}
+	ParseParts(job);
+	for (size_t i = 0; i < handles.size(); i++)
+	{
+		if (pthread_join(handles[i], 0) != 0)
+			assert(0);
+	}
+#endif
+	// parts after end of section are dropped,
+	// first error in file order is reported
+	for (size_t i = 0; i < parts; i++)
+	{
+		if (job.Errors[i].Code != DxfOk)
+			throw job.Errors[i];
+		if (job.EndFound[i])
+		{
+			result.resize(i + 1);
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,255 @@
+/*
+ * dxfreader.h
+ *
+ *  Created on: 18.10.2026
+ *      Author: misha
+ */
+
+#ifndef DXFREADER_H_
+#define DXFREADER_H_
+
+
+#include "exmath.h"
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+
+
+enum DxfErrorCode
+{
+	DxfOk,
+	DxfErrorOpenFile,
+	DxfErrorReadFile,
+	DxfErrorNoEntities,
+	DxfErrorInvalidFormat,
+	DxfErrorCancelled,
+	DxfErrorWriteFile,
+};
+
+
+// thrown by functions reading dxf data, Pos points to start of line
+// where format error is found, it is 0 for file errors
+struct DxfError
+{
+	DxfErrorCode Code;
+	const char * Pos;
+	explicit DxfError(DxfErrorCode code, const char * pos = 0) : Code(code), Pos(pos) {}
+};
+
+
+// binary files start with sentinel and have group codes and numbers in binary form,
+// AutoCad R12 writes one byte group codes where 255 is followed by two byte code,
+// later versions write two byte codes, numbers are little endian
+enum DxfFormat
+{
+	DxfFormatAscii,
+	DxfFormatBinary,
+	DxfFormatBinaryR12,
+};
+
+
+// terminating zero is part of sentinel
+const char DXF_BINARY_SENTINEL[] = "AutoCAD Binary DXF\r\n\x1a";
+const size_t DXF_BINARY_SENTINEL_SIZE = sizeof(DXF_BINARY_SENTINEL);
+
+
+// returns format of data and moves begin past sentinel of binary file
+DxfFormat DetectDxfFormat(const char *& begin, const char * end);
+
+
+// type of value is defined by group code, it matters only for binary files
+enum DxfValueType
+{
+	DxfValueString,
+	DxfValueDouble,
+	DxfValueInt16,
+	DxfValueInt32,
+	DxfValueInt64,
+	DxfValueBool,
+	// one byte of length followed by data
+	DxfValueChunk,
+};
+
+
+DxfValueType GetDxfValueType(int code);
+
+
+// read only view of file contents, file is mapped into memory and not copied,
+// errors are thrown as DxfError
+class MappedFile
+{
+public:
+#ifdef _WIN32
+	explicit MappedFile(const wchar_t * path);
+#else
+	explicit MappedFile(const char * path);
+#endif
+	~MappedFile();
+	const char * Begin() const { return m_data; }
+	const char * End() const { return m_data + m_size; }
+	size_t Size() const { return m_size; }
+private:
+	MappedFile(const MappedFile &);
+	MappedFile & operator=(const MappedFile &);
+	const char * m_data;
+	size_t m_size;
+#ifdef _WIN32
+	void * m_hfile;
+	void * m_hmapping;
+#endif
+};
+
+
+// points into buffer of tokenizer, does not own characters
+struct DxfStr
+{
+	const char * Ptr;
+	size_t Size;
+
+	DxfStr() : Ptr(0), Size(0) {}
+	DxfStr(const char * ptr, size_t size) : Ptr(ptr), Size(size) {}
+	std::string ToString() const { return std::string(Ptr, Size); }
+
+	friend bool operator==(const DxfStr & lhs, const char * rhs)
+	{
+		size_t len = std::strlen(rhs);
+		return lhs.Size == len && std::memcmp(lhs.Ptr, rhs, len) == 0;
+	}
+	friend bool operator!=(const DxfStr & lhs, const char * rhs) { return !(lhs == rhs); }
+};
+
+
+// group code and value of dxf file,
+// Pos is start of group code, it is used for error reporting,
+// numbers of binary file are kept in Value as bytes of file
+struct DxfItem
+{
+	int Code;
+	DxfStr Value;
+	const char * Pos;
+	bool Binary;
+};
+
+
+// splits dxf data into group code and value pairs,
+// values point into data so it should live while items are used
+class DxfTokenizer
+{
+public:
+	DxfTokenizer(const char * begin, const char * end, DxfFormat format = DxfFormatAscii) :
+		m_pos(begin), m_end(end), m_line(0), m_format(format) {}
+	// returns false at end of data, throws DxfError if group code is invalid
+	bool ReadItem(DxfItem & item);
+	// number of lines read so far, it is 0 for binary data
+	size_t GetLineNumber() const { return m_line; }
+	const char * GetPos() const { return m_pos; }
+private:
+	const char * m_pos;
+	const char * m_end;
+	size_t m_line;
+	DxfFormat m_format;
+	DxfStr ReadLine();
+	bool ReadBinaryItem(DxfItem & item);
+};
+
+
+enum DxfEntityType
+{
+	DxfEntityLine,
+	DxfEntityCircle,
+	DxfEntityArc,
+	DxfEntityPolyline,
+	DxfEntityInsert,
+};
+
+
+// geometry of entity from ENTITIES section,
+// line uses Pt1 and Pt2, circle uses Center and Radius,
+// arc uses Center, Radius and Pt1 and Pt2 as counter clockwise start and end,
+// nodes of polyline are at [FirstNode, FirstNode + NodeCount) in DxfEntities::Nodes,
+// ellipses, splines and old style polylines are read as polylines,
+// insert uses Pt1 as insertion point, Pt2 as x and y scale, Radius as rotation
+// in degrees and Name as index of block name in DxfEntities::Names
+struct DxfEntity
+{
+	DxfEntityType Type;
+	Point<double> Pt1;
+	Point<double> Pt2;
+	Point<double> Center;
+	double Radius;
+	size_t FirstNode;
+	size_t NodeCount;
+	bool Closed;
+	size_t Name;
+};
+
+
+struct DxfNode
+{
+	Point<double> Pt;
+	double Bulge;
+};
+
+
+// entities in file order, unsupported entities are skipped
+struct DxfEntities
+{
+	std::vector<DxfEntity> Entities;
+	std::vector<DxfNode> Nodes;
+	std::vector<std::string> Names;
+};
+
+
+// block definition from BLOCKS section, entities are relative to origin
+// and are placed at insertion point by moving base point there
+struct DxfBlock
+{
+	std::string Name;
+	Point<double> Base;
+	DxfEntities Entities;
+};
+
+
+// functions below take data after sentinel of binary file, see DetectDxfFormat
+
+// returns position of group code 0 of first entity in ENTITIES section
+// or 0 if there is no such section, if blocks is not 0 it receives
+// definitions of BLOCKS section which goes before
+const char * FindDxfEntities(const char * begin, const char * end, DxfFormat format,
+		std::vector<DxfBlock> * blocks = 0);
+// parses block definitions from range which starts after header of BLOCKS section,
+// returns position after end of section, throws DxfError if block is incomplete
+const char * ParseDxfBlocks(const char * begin, const char * end, DxfFormat format, std::vector<DxfBlock> & result);
+// parses entities from range which starts at group code 0 of entity,
+// returns true if parsing stopped at end of section,
+// throws DxfError if entity is incomplete
+bool ParseDxfEntities(const char * begin, const char * end, DxfFormat format, DxfEntities & result);
+// splits range at entity boundaries and parses parts on several threads,
+// end of range may be beyond end of section, parts after it are dropped,
+// threads = 0 means one per processor, result has one item per part in file order
+void ParseDxfEntitiesParallel(const char * begin, const char * end, DxfFormat format, unsigned threads,
+		std::vector<DxfEntities> & result);
+// returns start of first entity which is at least partSize after begin or end
+// if there is no such entity in section, begin should be at group code 0 of entity,
+// binary data can't be split at arbitrary position so whole part is read through
+const char * FindNextDxfPart(const char * begin, const char * end, DxfFormat format, size_t partSize);
+// parses parts [first, last) of bounds on several threads, result gets one item per part,
+// returns true if end of section is found, parts after it are dropped
+bool ParseDxfParts(const std::vector<const char *> & bounds, size_t first, size_t last, DxfFormat format,
+		unsigned threads, std::vector<DxfEntities> & result);
+
+
+unsigned GetProcessorCount();
+
+
+// parse numbers without copying, leading and trailing spaces are skipped,
+// throw DxfError if value is not a number
+long DxfToLong(const DxfStr & str);
+double DxfToDouble(const DxfStr & str);
+// same for value of item, it can be binary
+long DxfToLong(const DxfItem & item);
+double DxfToDouble(const DxfItem & item);
+
+
+#endif /* DXFREADER_H_ */
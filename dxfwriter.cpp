@@ -0,0 +1,702 @@
+/*
+ * dxfwriter.cpp
+ *
+ *  Created on: 18.10.2026
+ *      Author: misha
+ */
+#include "dxfwriter.h"
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+using namespace std;
+
+
+// shortest double formatting is done with grisu2 algorithm by Florian Loitsch,
+// numbers are handled as 64 bit mantissa and binary exponent
+namespace
+{
+	struct DiyFp
+	{
+		unsigned long long F;
+		int E;
+		DiyFp() : F(0), E(0) {}
+		DiyFp(unsigned long long f, int e) : F(f), E(e) {}
+		friend DiyFp operator-(const DiyFp & lhs, const DiyFp & rhs)
+		{
+			assert(lhs.E == rhs.E && lhs.F >= rhs.F);
+			return DiyFp(lhs.F - rhs.F, lhs.E);
+		}
+		// upper 64 bits of product, rounded
+		friend DiyFp operator*(const DiyFp & lhs, const DiyFp & rhs)
+		{
+			const unsigned long long mask = 0xffffffffull;
+			unsigned long long a = lhs.F >> 32, b = lhs.F & mask;
+			unsigned long long c = rhs.F >> 32, d = rhs.F & mask;
+			unsigned long long ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+			unsigned long long tmp = (bd >> 32) + (ad & mask) + (bc & mask) + (1ull << 31);
+			return DiyFp(ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), lhs.E + rhs.E + 64);
+		}
+	};
+}
+
+
+static const unsigned long long DOUBLE_HIDDEN_BIT = 0x0010000000000000ull;
+static const unsigned long long DOUBLE_SIGNIFICAND_MASK = 0x000fffffffffffffull;
+
+
+// normalized powers of ten from 10^-348 to 10^340 with step 8
+static const unsigned long long CACHED_POWERS_F[] =
+{
+	0xfa8fd5a0081c0288ull, 0xbaaee17fa23ebf76ull, 0x8b16fb203055ac76ull,
+	0xcf42894a5dce35eaull, 0x9a6bb0aa55653b2dull, 0xe61acf033d1a45dfull,
+	0xab70fe17c79ac6caull, 0xff77b1fcbebcdc4full, 0xbe5691ef416bd60cull,
+	0x8dd01fad907ffc3cull, 0xd3515c2831559a83ull, 0x9d71ac8fada6c9b5ull,
+	0xea9c227723ee8bcbull, 0xaecc49914078536dull, 0x823c12795db6ce57ull,
+	0xc21094364dfb5637ull, 0x9096ea6f3848984full, 0xd77485cb25823ac7ull,
+	0xa086cfcd97bf97f4ull, 0xef340a98172aace5ull, 0xb23867fb2a35b28eull,
+	0x84c8d4dfd2c63f3bull, 0xc5dd44271ad3cdbaull, 0x936b9fcebb25c996ull,
+	0xdbac6c247d62a584ull, 0xa3ab66580d5fdaf6ull, 0xf3e2f893dec3f126ull,
+	0xb5b5ada8aaff80b8ull, 0x87625f056c7c4a8bull, 0xc9bcff6034c13053ull,
+	0x964e858c91ba2655ull, 0xdff9772470297ebdull, 0xa6dfbd9fb8e5b88full,
+	0xf8a95fcf88747d94ull, 0xb94470938fa89bcfull, 0x8a08f0f8bf0f156bull,
+	0xcdb02555653131b6ull, 0x993fe2c6d07b7facull, 0xe45c10c42a2b3b06ull,
+	0xaa242499697392d3ull, 0xfd87b5f28300ca0eull, 0xbce5086492111aebull,
+	0x8cbccc096f5088ccull, 0xd1b71758e219652cull, 0x9c40000000000000ull,
+	0xe8d4a51000000000ull, 0xad78ebc5ac620000ull, 0x813f3978f8940984ull,
+	0xc097ce7bc90715b3ull, 0x8f7e32ce7bea5c70ull, 0xd5d238a4abe98068ull,
+	0x9f4f2726179a2245ull, 0xed63a231d4c4fb27ull, 0xb0de65388cc8ada8ull,
+	0x83c7088e1aab65dbull, 0xc45d1df942711d9aull, 0x924d692ca61be758ull,
+	0xda01ee641a708deaull, 0xa26da3999aef774aull, 0xf209787bb47d6b85ull,
+	0xb454e4a179dd1877ull, 0x865b86925b9bc5c2ull, 0xc83553c5c8965d3dull,
+	0x952ab45cfa97a0b3ull, 0xde469fbd99a05fe3ull, 0xa59bc234db398c25ull,
+	0xf6c69a72a3989f5cull, 0xb7dcbf5354e9beceull, 0x88fcf317f22241e2ull,
+	0xcc20ce9bd35c78a5ull, 0x98165af37b2153dfull, 0xe2a0b5dc971f303aull,
+	0xa8d9d1535ce3b396ull, 0xfb9b7cd9a4a7443cull, 0xbb764c4ca7a44410ull,
+	0x8bab8eefb6409c1aull, 0xd01fef10a657842cull, 0x9b10a4e5e9913129ull,
+	0xe7109bfba19c0c9dull, 0xac2820d9623bf429ull, 0x80444b5e7aa7cf85ull,
+	0xbf21e44003acdd2dull, 0x8e679c2f5e44ff8full, 0xd433179d9c8cb841ull,
+	0x9e19db92b4e31ba9ull, 0xeb96bf6ebadf77d9ull, 0xaf87023b9bf0ee6bull,
+};
+
+
+static const short CACHED_POWERS_E[] =
+{
+	-1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954, -927,
+	-901, -874, -847, -821, -794, -768, -741, -715, -688, -661, -635, -608,
+	-582, -555, -529, -502, -475, -449, -422, -396, -369, -343, -316, -289,
+	-263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30,
+	56, 83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+	375, 402, 428, 455, 481, 508, 534, 561, 588, 614, 641, 667,
+	694, 720, 747, 774, 800, 827, 853, 880, 907, 933, 960, 986,
+	1013, 1039, 1066,
+};
+
+
+static const unsigned POW10[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000};
+
+
+static DiyFp Normalize(DiyFp fp)
+{
+	while ((fp.F & (1ull << 63)) == 0)
+	{
+		fp.F <<= 1;
+		fp.E--;
+	}
+	return fp;
+}
+
+
+// returns boundaries of interval of numbers which are rounded to value,
+// both have same exponent
+static void GetBoundaries(const DiyFp & value, DiyFp & minus, DiyFp & plus)
+{
+	plus = Normalize(DiyFp((value.F << 1) + 1, value.E - 1));
+	// lower boundary is closer when value is power of two
+	if (value.F == DOUBLE_HIDDEN_BIT)
+		minus = DiyFp((value.F << 2) - 1, value.E - 2);
+	else
+		minus = DiyFp((value.F << 1) - 1, value.E - 1);
+	minus.F <<= minus.E - plus.E;
+	minus.E = plus.E;
+}
+
+
+// returns power of ten which brings binary exponent e into range [-60, -32],
+// k receives decimal exponent of value which is multiplied by it
+static DiyFp GetCachedPower(int e, int & k)
+{
+	double dk = (-61 - e) * 0.30102999566398114 + 347;
+	int ik = static_cast<int>(dk);
+	if (dk - ik > 0.0)
+		ik++;
+	unsigned index = static_cast<unsigned>((ik >> 3) + 1);
+	assert(index < sizeof(CACHED_POWERS_F) / sizeof(CACHED_POWERS_F[0]));
+	k = -(-348 + static_cast<int>(index << 3));
+	return DiyFp(CACHED_POWERS_F[index], CACHED_POWERS_E[index]);
+}
+
+
+// moves last digit closer to value while number stays inside of boundaries
+static void GrisuRound(char * buffer, int len, unsigned long long delta, unsigned long long rest,
+		unsigned long long tenKappa, unsigned long long distance)
+{
+	while (rest < distance && delta - rest >= tenKappa &&
+			(rest + tenKappa < distance || distance - rest > rest + tenKappa - distance))
+	{
+		buffer[len - 1]--;
+		rest += tenKappa;
+	}
+}
+
+
+static int CountDigits(unsigned n)
+{
+	int result = 1;
+	while (result < 10 && n >= POW10[result])
+		result++;
+	return result;
+}
+
+
+// generates shortest digits of number in range (plus - delta, plus)
+static void DigitGen(const DiyFp & w, const DiyFp & plus, unsigned long long delta,
+		char * buffer, int & len, int & k)
+{
+	const DiyFp one(1ull << -plus.E, plus.E);
+	const unsigned long long distance = (plus - w).F;
+	unsigned p1 = static_cast<unsigned>(plus.F >> -one.E);
+	unsigned long long p2 = plus.F & (one.F - 1);
+	int kappa = CountDigits(p1);
+	len = 0;
+	while (kappa > 0)
+	{
+		unsigned d = p1 / POW10[kappa - 1];
+		p1 %= POW10[kappa - 1];
+		if (d != 0 || len != 0)
+			buffer[len++] = static_cast<char>('0' + d);
+		kappa--;
+		unsigned long long rest = (static_cast<unsigned long long>(p1) << -one.E) + p2;
+		if (rest <= delta)
+		{
+			k += kappa;
+			GrisuRound(buffer, len, delta, rest, static_cast<unsigned long long>(POW10[kappa]) << -one.E, distance);
+			return;
+		}
+	}
+	for (;;)
+	{
+		p2 *= 10;
+		delta *= 10;
+		char d = static_cast<char>(p2 >> -one.E);
+		if (d != 0 || len != 0)
+			buffer[len++] = static_cast<char>('0' + d);
+		p2 &= one.F - 1;
+		kappa--;
+		if (p2 < delta)
+		{
+			k += kappa;
+			int index = -kappa;
+			GrisuRound(buffer, len, delta, p2, one.F, distance * (index < 10 ? POW10[index] : 0));
+			return;
+		}
+	}
+}
+
+
+// value is positive and finite, digits * 10^k is value
+static void Grisu2(double value, char * digits, int & len, int & k)
+{
+	unsigned long long bits;
+	memcpy(&bits, &value, sizeof(bits));
+	int biasedExp = static_cast<int>((bits >> 52) & 0x7ff);
+	DiyFp v;
+	if (biasedExp != 0)
+		v = DiyFp((bits & DOUBLE_SIGNIFICAND_MASK) | DOUBLE_HIDDEN_BIT, biasedExp - 1075);
+	else
+		v = DiyFp(bits & DOUBLE_SIGNIFICAND_MASK, -1074);
+	DiyFp minus, plus;
+	GetBoundaries(v, minus, plus);
+	DiyFp cached = GetCachedPower(plus.E, k);
+	DiyFp w = Normalize(v) * cached;
+	DiyFp wplus = plus * cached;
+	DiyFp wminus = minus * cached;
+	// boundaries are not exact after multiplication, interval is narrowed to be safe
+	wminus.F++;
+	wplus.F--;
+	DigitGen(w, wplus, wplus.F - wminus.F, digits, len, k);
+}
+
+
+char * DxfFormatDouble(double value, char * buffer)
+{
+	char * p = buffer;
+	if (value != value || value - value != 0)
+	{
+		// infinity and nan can't be stored in dxf
+		assert(0);
+		*p++ = '0';
+		return p;
+	}
+	if (value == 0)
+	{
+		*p++ = '0';
+		return p;
+	}
+	if (value < 0)
+	{
+		*p++ = '-';
+		value = -value;
+	}
+	char digits[20];
+	int len, k;
+	Grisu2(value, digits, len, k);
+	// position of decimal point relative to first digit
+	int point = len + k;
+	if (point > 0 && point <= 17)
+	{
+		if (point >= len)
+		{
+			memcpy(p, digits, len);
+			p += len;
+			for (int i = len; i < point; i++)
+				*p++ = '0';
+		}
+		else
+		{
+			memcpy(p, digits, point);
+			p += point;
+			*p++ = '.';
+			memcpy(p, digits + point, len - point);
+			p += len - point;
+		}
+	}
+	else if (point <= 0 && point > -5)
+	{
+		*p++ = '0';
+		*p++ = '.';
+		for (int i = point; i < 0; i++)
+			*p++ = '0';
+		memcpy(p, digits, len);
+		p += len;
+	}
+	else
+	{
+		*p++ = digits[0];
+		if (len > 1)
+		{
+			*p++ = '.';
+			memcpy(p, digits + 1, len - 1);
+			p += len - 1;
+		}
+		*p++ = 'E';
+		int exp = point - 1;
+		if (exp < 0)
+		{
+			*p++ = '-';
+			exp = -exp;
+		}
+		else
+		{
+			*p++ = '+';
+		}
+		if (exp >= 100)
+			*p++ = static_cast<char>('0' + exp / 100);
+		if (exp >= 10)
+			*p++ = static_cast<char>('0' + exp / 10 % 10);
+		*p++ = static_cast<char>('0' + exp % 10);
+	}
+	return p;
+}
+
+
+DxfWriter::DxfWriter(DxfFormat format) :
+#ifdef _WIN32
+		m_hfile(INVALID_HANDLE_VALUE)
+#else
+		m_fd(-1)
+#endif
+{
+	Init(format);
+}
+
+
+#ifdef _WIN32
+DxfWriter::DxfWriter(const wchar_t * path, DxfFormat format)
+{
+	m_hfile = CreateFileW(path, GENERIC_WRITE, 0, 0, CREATE_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+	if (m_hfile == INVALID_HANDLE_VALUE)
+		throw DxfError(DxfErrorOpenFile);
+	Init(format);
+}
+
+
+DxfWriter::~DxfWriter()
+{
+	if (m_hfile != INVALID_HANDLE_VALUE && !CloseHandle(m_hfile))
+		assert(0);
+}
+
+
+void DxfWriter::Flush()
+{
+	if (m_hfile == INVALID_HANDLE_VALUE)
+	{
+		m_data.insert(m_data.end(), m_buffer.begin(), m_buffer.begin() + m_used);
+	}
+	else if (m_used != 0)
+	{
+		DWORD written;
+		if (!WriteFile(m_hfile, &m_buffer[0], static_cast<DWORD>(m_used), &written, 0) || written != m_used)
+			throw DxfError(DxfErrorWriteFile);
+	}
+	m_used = 0;
+}
+#else
+DxfWriter::DxfWriter(const char * path, DxfFormat format)
+{
+	m_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (m_fd == -1)
+		throw DxfError(DxfErrorOpenFile);
+	Init(format);
+}
+
+
+DxfWriter::~DxfWriter()
+{
+	if (m_fd != -1 && close(m_fd) != 0)
+		assert(0);
+}
+
+
+void DxfWriter::Flush()
+{
+	if (m_fd == -1)
+	{
+		m_data.insert(m_data.end(), m_buffer.begin(), m_buffer.begin() + m_used);
+		m_used = 0;
+		return;
+	}
+	const char * p = m_buffer.empty() ? 0 : &m_buffer[0];
+	size_t left = m_used;
+	while (left != 0)
+	{
+		ssize_t written = write(m_fd, p, left);
+		if (written == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			throw DxfError(DxfErrorWriteFile);
+		}
+		p += written;
+		left -= written;
+	}
+	m_used = 0;
+}
+#endif
+
+
+void DxfWriter::Init(DxfFormat format)
+{
+	m_format = format;
+	m_buffer.resize(1 << 20);
+	m_used = 0;
+	m_section = SectionNone;
+	m_inBlock = false;
+	if (m_format != DxfFormatAscii)
+	{
+		memcpy(&m_buffer[0], DXF_BINARY_SENTINEL, DXF_BINARY_SENTINEL_SIZE);
+		m_used = DXF_BINARY_SENTINEL_SIZE;
+	}
+}
+
+
+void DxfWriter::BeginEntities()
+{
+	if (m_section == SectionEntities)
+		return;
+	if (m_section == SectionBlocks)
+		WriteStr(0, "ENDSEC");
+	WriteStr(0, "SECTION");
+	WriteStr(2, "ENTITIES");
+	m_section = SectionEntities;
+}
+
+
+// entities outside of blocks go into ENTITIES section which is started on first of them
+void DxfWriter::BeginEntity(const char * type)
+{
+	if (!m_inBlock)
+		BeginEntities();
+	WriteStr(0, type);
+	WriteStr(8, "0");
+}
+
+
+void DxfWriter::WriteBinary(unsigned long long value, size_t size)
+{
+	for (size_t i = 0; i < size; i++)
+	{
+		m_buffer[m_used++] = static_cast<char>(value & 0xff);
+		value >>= 8;
+	}
+}
+
+
+void DxfWriter::WriteCode(int code)
+{
+	if (m_format == DxfFormatBinary)
+	{
+		WriteBinary(code, 2);
+		return;
+	}
+	if (m_format == DxfFormatBinaryR12)
+	{
+		if (code < 255)
+		{
+			WriteBinary(code, 1);
+			return;
+		}
+		m_buffer[m_used++] = static_cast<char>(255);
+		WriteBinary(code, 2);
+		return;
+	}
+	assert(code >= 0 && code < 1000);
+	char * p = &m_buffer[m_used];
+	if (code >= 100)
+		*p++ = static_cast<char>('0' + code / 100);
+	if (code >= 10)
+		*p++ = static_cast<char>('0' + code / 10 % 10);
+	*p++ = static_cast<char>('0' + code % 10);
+	*p++ = '\n';
+	m_used = p - &m_buffer[0];
+}
+
+
+void DxfWriter::WriteStr(int code, const char * value)
+{
+	Reserve();
+	WriteCode(code);
+	size_t len = strlen(value);
+	assert(len < 32);
+	memcpy(&m_buffer[m_used], value, len);
+	m_used += len;
+	m_buffer[m_used++] = m_format == DxfFormatAscii ? '\n' : 0;
+}
+
+
+// names can be long, those don't fit into reserve of other groups
+void DxfWriter::WriteStr(int code, const string & value)
+{
+	if (m_buffer.size() - m_used < value.size() + 64)
+		Flush();
+	assert(value.size() + 64 <= m_buffer.size());
+	WriteCode(code);
+	if (!value.empty())
+		memcpy(&m_buffer[m_used], value.data(), value.size());
+	m_used += value.size();
+	m_buffer[m_used++] = m_format == DxfFormatAscii ? '\n' : 0;
+}
+
+
+void DxfWriter::WriteInt(int code, long value)
+{
+	Reserve();
+	WriteCode(code);
+	if (m_format != DxfFormatAscii)
+	{
+		switch (GetDxfValueType(code))
+		{
+		case DxfValueInt16:
+			WriteBinary(static_cast<unsigned long long>(value), 2);
+			break;
+		case DxfValueInt32:
+			WriteBinary(static_cast<unsigned long long>(value), 4);
+			break;
+		case DxfValueBool:
+			WriteBinary(value != 0, 1);
+			break;
+		default:
+			assert(0);
+			break;
+		}
+		return;
+	}
+	char digits[24];
+	int len = 0;
+	unsigned long rest = value < 0 ? 0ul - static_cast<unsigned long>(value) : static_cast<unsigned long>(value);
+	do
+	{
+		digits[len++] = static_cast<char>('0' + rest % 10);
+		rest /= 10;
+	} while (rest != 0);
+	if (value < 0)
+		m_buffer[m_used++] = '-';
+	while (len > 0)
+		m_buffer[m_used++] = digits[--len];
+	m_buffer[m_used++] = '\n';
+}
+
+
+void DxfWriter::WriteDouble(int code, double value)
+{
+	Reserve();
+	WriteCode(code);
+	if (m_format != DxfFormatAscii)
+	{
+		assert(GetDxfValueType(code) == DxfValueDouble);
+		unsigned long long bits;
+		memcpy(&bits, &value, sizeof(bits));
+		WriteBinary(bits, 8);
+		return;
+	}
+	char * end = DxfFormatDouble(value, &m_buffer[m_used]);
+	m_used = end - &m_buffer[0];
+	m_buffer[m_used++] = '\n';
+}
+
+
+void DxfWriter::WriteLine(const Point<double> & pt1, const Point<double> & pt2)
+{
+	BeginEntity("LINE");
+	WriteDouble(10, pt1.X);
+	WriteDouble(20, pt1.Y);
+	WriteDouble(11, pt2.X);
+	WriteDouble(21, pt2.Y);
+}
+
+
+void DxfWriter::WriteCircle(const Point<double> & center, double radius)
+{
+	BeginEntity("CIRCLE");
+	WriteDouble(10, center.X);
+	WriteDouble(20, center.Y);
+	WriteDouble(40, radius);
+}
+
+
+// angle of point on circle in degrees in range [0, 360)
+static double GetDxfAngle(const Point<double> & center, const Point<double> & pt)
+{
+	double result = atan2(pt.Y - center.Y, pt.X - center.X) * 180 / M_PI;
+	return result < 0 ? result + 360 : result;
+}
+
+
+void DxfWriter::WriteArc(const Point<double> & center, double radius, const Point<double> & start, const Point<double> & end)
+{
+	BeginEntity("ARC");
+	WriteDouble(10, center.X);
+	WriteDouble(20, center.Y);
+	WriteDouble(40, radius);
+	WriteDouble(50, GetDxfAngle(center, start));
+	WriteDouble(51, GetDxfAngle(center, end));
+}
+
+
+void DxfWriter::BeginPolyline(size_t count, bool closed)
+{
+	BeginEntity("LWPOLYLINE");
+	WriteInt(90, static_cast<long>(count));
+	WriteInt(70, closed ? 1 : 0);
+}
+
+
+void DxfWriter::WritePolylineNode(const Point<double> & pt, double bulge)
+{
+	WriteDouble(10, pt.X);
+	WriteDouble(20, pt.Y);
+	if (bulge != 0)
+		WriteDouble(42, bulge);
+}
+
+
+void DxfWriter::WriteInsert(const string & name, const Point<double> & pt, const Point<double> & scale, double angle)
+{
+	BeginEntity("INSERT");
+	WriteStr(2, name);
+	WriteDouble(10, pt.X);
+	WriteDouble(20, pt.Y);
+	if (scale.X != 1)
+		WriteDouble(41, scale.X);
+	if (scale.Y != 1)
+		WriteDouble(42, scale.Y);
+	if (angle != 0)
+		WriteDouble(50, angle);
+}
+
+
+void DxfWriter::WriteEntity(const DxfEntity & entity, const vector<DxfNode> & nodes, const vector<string> & names)
+{
+	switch (entity.Type)
+	{
+	case DxfEntityLine:
+		WriteLine(entity.Pt1, entity.Pt2);
+		break;
+	case DxfEntityCircle:
+		WriteCircle(entity.Center, entity.Radius);
+		break;
+	case DxfEntityArc:
+		WriteArc(entity.Center, entity.Radius, entity.Pt1, entity.Pt2);
+		break;
+	case DxfEntityPolyline:
+		BeginPolyline(entity.NodeCount, entity.Closed);
+		for (size_t i = 0; i < entity.NodeCount; i++)
+			WritePolylineNode(nodes[entity.FirstNode + i].Pt, nodes[entity.FirstNode + i].Bulge);
+		break;
+	case DxfEntityInsert:
+		WriteInsert(names[entity.Name], entity.Pt1, entity.Pt2, entity.Radius);
+		break;
+	default:
+		assert(0);
+		break;
+	}
+}
+
+
+void DxfWriter::BeginBlock(const string & name, const Point<double> & base)
+{
+	assert(!m_inBlock && m_section != SectionEntities);
+	if (m_section == SectionNone)
+	{
+		WriteStr(0, "SECTION");
+		WriteStr(2, "BLOCKS");
+		m_section = SectionBlocks;
+	}
+	WriteStr(0, "BLOCK");
+	WriteStr(8, "0");
+	WriteStr(2, name);
+	WriteInt(70, 0);
+	WriteDouble(10, base.X);
+	WriteDouble(20, base.Y);
+	WriteStr(3, name);
+	m_inBlock = true;
+}
+
+
+void DxfWriter::EndBlock()
+{
+	assert(m_inBlock);
+	WriteStr(0, "ENDBLK");
+	WriteStr(8, "0");
+	m_inBlock = false;
+}
+
+
+void DxfWriter::Finish()
+{
+	assert(!m_inBlock);
+	// file without entities still has ENTITIES section
+	BeginEntities();
+	WriteStr(0, "ENDSEC");
+	WriteStr(0, "EOF");
+	Flush();
+}
@@ -0,0 +1,100 @@
+/*
+ * dxfwriter.h
+ *
+ *  Created on: 18.10.2026
+ *      Author: misha
+ */
+
+#ifndef DXFWRITER_H_
+#define DXFWRITER_H_
+
+
+#include "dxfreader.h"
+#include <string>
+#include <vector>
+
+
+// writes ascii or binary dxf file with BLOCKS and ENTITIES sections, output goes through
+// large buffer which is flushed when full, errors are thrown as DxfError
+class DxfWriter
+{
+public:
+	// output is kept in memory and is returned by GetData
+	explicit DxfWriter(DxfFormat format = DxfFormatAscii);
+	// file is created or truncated
+#ifdef _WIN32
+	explicit DxfWriter(const wchar_t * path, DxfFormat format = DxfFormatAscii);
+#else
+	explicit DxfWriter(const char * path, DxfFormat format = DxfFormatAscii);
+#endif
+	~DxfWriter();
+
+	void WriteLine(const Point<double> & pt1, const Point<double> & pt2);
+	void WriteCircle(const Point<double> & center, double radius);
+	// arc goes counter clockwise from start to end point
+	void WriteArc(const Point<double> & center, double radius, const Point<double> & start, const Point<double> & end);
+	// should be followed by count calls to WritePolylineNode
+	void BeginPolyline(size_t count, bool closed);
+	void WritePolylineNode(const Point<double> & pt, double bulge);
+	// block is placed at pt after scaling and rotation by angle in degrees
+	void WriteInsert(const std::string & name, const Point<double> & pt, const Point<double> & scale, double angle);
+	// writes entity as it is read by ParseDxfEntities, names are block names of inserts
+	void WriteEntity(const DxfEntity & entity, const std::vector<DxfNode> & nodes,
+			const std::vector<std::string> & names);
+
+	// entities written between those calls form block, base point is placed
+	// at insertion point, all blocks should be written before entities of drawing
+	void BeginBlock(const std::string & name, const Point<double> & base = Point<double>(0, 0));
+	void EndBlock();
+
+	// ends section and file and flushes buffer, no entities can be written after it
+	void Finish();
+	const std::vector<char> & GetData() const { return m_data; }
+
+private:
+	DxfWriter(const DxfWriter &);
+	DxfWriter & operator=(const DxfWriter &);
+	enum Section
+	{
+		SectionNone,
+		SectionBlocks,
+		SectionEntities,
+	};
+	DxfFormat m_format;
+	std::vector<char> m_buffer;
+	size_t m_used;
+	Section m_section;
+	bool m_inBlock;
+	// output when there is no file
+	std::vector<char> m_data;
+#ifdef _WIN32
+	void * m_hfile;
+#else
+	int m_fd;
+#endif
+	void Init(DxfFormat format);
+	void Flush();
+	void Reserve()
+	{
+		// longest group is code, double and two line ends
+		if (m_buffer.size() - m_used < 64)
+			Flush();
+	}
+	void BeginEntities();
+	void BeginEntity(const char * type);
+	void WriteCode(int code);
+	// little endian number of size bytes
+	void WriteBinary(unsigned long long value, size_t size);
+	void WriteStr(int code, const char * value);
+	void WriteStr(int code, const std::string & value);
+	void WriteInt(int code, long value);
+	void WriteDouble(int code, double value);
+};
+
+
+// writes shortest representation which DxfToDouble reads back to same value,
+// in rare cases one digit longer than shortest, buffer should have room for 32 characters, returns end of written characters
+char * DxfFormatDouble(double value, char * buffer);
+
+
+#endif /* DXFWRITER_H_ */
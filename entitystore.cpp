@@ -0,0 +1,269 @@
+/*
+ * entitystore.cpp
+ *
+ *  Created on: 18.10.2026
+ *      Author: misha
+ */
+#include "entitystore.h"
+#include "globals.h"
+
+
+using namespace std;
+
+
+// stores value at slot i, slot is either existing or next after last
+template <class T>
+static void SetSlot(vector<T> & vec, size_t i, const T & val)
+{
+	assert(i <= vec.size());
+	if (i == vec.size())
+		vec.push_back(val);
+	else
+		vec[i] = val;
+}
+
+
+void EntityStore::Clear()
+{
+	*this = EntityStore();
+}
+
+
+EntityHandle EntityStore::Allocate(EntityType type, CadObject * owner)
+{
+	assert(owner != 0);
+	EntityHandle result;
+	result.Type = type;
+	if (m_free[type].empty())
+	{
+		result.Index = m_owners[type].size();
+		m_owners[type].push_back(owner);
+	}
+	else
+	{
+		result.Index = m_free[type].back();
+		m_free[type].pop_back();
+		m_owners[type][result.Index] = owner;
+	}
+	m_size++;
+	return result;
+}
+
+
+EntityHandle EntityStore::AddLine(CadObject * owner, const Line & line)
+{
+	EntityHandle result = Allocate(EntityTypeLine, owner);
+	SetSlot(m_lines.X1, result.Index, line.Point1.X);
+	SetSlot(m_lines.Y1, result.Index, line.Point1.Y);
+	SetSlot(m_lines.X2, result.Index, line.Point2.X);
+	SetSlot(m_lines.Y2, result.Index, line.Point2.Y);
+	return result;
+}
+
+
+EntityHandle EntityStore::AddCircle(CadObject * owner, const Circle & circle)
+{
+	EntityHandle result = Allocate(EntityTypeCircle, owner);
+	SetSlot(m_circles.CX, result.Index, circle.Center.X);
+	SetSlot(m_circles.CY, result.Index, circle.Center.Y);
+	SetSlot(m_circles.R, result.Index, circle.Radius);
+	return result;
+}
+
+
+EntityHandle EntityStore::AddArc(CadObject * owner, const CircleArc & arc)
+{
+	EntityHandle result = Allocate(EntityTypeArc, owner);
+	SetSlot(m_arcs.CX, result.Index, arc.Center.X);
+	SetSlot(m_arcs.CY, result.Index, arc.Center.Y);
+	SetSlot(m_arcs.R, result.Index, arc.Radius);
+	SetSlot(m_arcs.SX, result.Index, arc.Start.X);
+	SetSlot(m_arcs.SY, result.Index, arc.Start.Y);
+	SetSlot(m_arcs.EX, result.Index, arc.End.X);
+	SetSlot(m_arcs.EY, result.Index, arc.End.Y);
+	SetSlot(m_arcs.Ccw, result.Index, static_cast<char>(arc.Ccw));
+	return result;
+}
+
+
+EntityHandle EntityStore::AddPolyline(CadObject * owner, bool closed)
+{
+	EntityHandle result = Allocate(EntityTypePolyline, owner);
+	SetSlot(m_polylines.First, result.Index, static_cast<unsigned long>(m_nodes.X.size()));
+	SetSlot(m_polylines.Count, result.Index, 0ul);
+	SetSlot(m_polylines.Closed, result.Index, static_cast<char>(closed));
+	return result;
+}
+
+
+void EntityStore::AddPolylineNode(EntityHandle polyline, const Point<double> & pt, double bulge)
+{
+	assert(polyline.Type == EntityTypePolyline);
+	assert(m_polylines.First[polyline.Index] + m_polylines.Count[polyline.Index] == m_nodes.X.size());
+	m_nodes.X.push_back(pt.X);
+	m_nodes.Y.push_back(pt.Y);
+	m_nodes.Bulge.push_back(bulge);
+	m_polylines.Count[polyline.Index]++;
+}
+
+
+EntityHandle EntityStore::AddInsert(CadObject * owner, const CadBlock & block, const Matrix3<double> & matrix)
+{
+	EntityHandle result = Allocate(EntityTypeInsert, owner);
+	SetSlot(m_inserts.Block, result.Index, &block);
+	SetSlot(m_inserts.M11, result.Index, matrix[0][0]);
+	SetSlot(m_inserts.M12, result.Index, matrix[0][1]);
+	SetSlot(m_inserts.M13, result.Index, matrix[0][2]);
+	SetSlot(m_inserts.M21, result.Index, matrix[1][0]);
+	SetSlot(m_inserts.M22, result.Index, matrix[1][1]);
+	SetSlot(m_inserts.M23, result.Index, matrix[1][2]);
+	return result;
+}
+
+
+void EntityStore::Remove(EntityHandle handle)
+{
+	assert(m_owners[handle.Type][handle.Index] != 0);
+	m_owners[handle.Type][handle.Index] = 0;
+	m_free[handle.Type].push_back(handle.Index);
+	m_size--;
+	if (handle.Type == EntityTypePolyline)
+	{
+		m_deadNodes += m_polylines.Count[handle.Index];
+		m_polylines.Count[handle.Index] = 0;
+		if (m_deadNodes > 1024 && m_deadNodes > m_nodes.X.size() / 2)
+			CompactNodes();
+	}
+}
+
+
+void EntityStore::CompactNodes()
+{
+	NodeArrays nodes;
+	size_t live = m_nodes.X.size() - m_deadNodes;
+	nodes.X.reserve(live);
+	nodes.Y.reserve(live);
+	nodes.Bulge.reserve(live);
+	for (size_t i = 0; i < m_polylines.First.size(); i++)
+	{
+		unsigned long first = m_polylines.First[i];
+		unsigned long count = m_polylines.Count[i];
+		m_polylines.First[i] = static_cast<unsigned long>(nodes.X.size());
+		nodes.X.insert(nodes.X.end(), m_nodes.X.begin() + first, m_nodes.X.begin() + first + count);
+		nodes.Y.insert(nodes.Y.end(), m_nodes.Y.begin() + first, m_nodes.Y.begin() + first + count);
+		nodes.Bulge.insert(nodes.Bulge.end(), m_nodes.Bulge.begin() + first, m_nodes.Bulge.begin() + first + count);
+	}
+	m_nodes.X.swap(nodes.X);
+	m_nodes.Y.swap(nodes.Y);
+	m_nodes.Bulge.swap(nodes.Bulge);
+	m_deadNodes = 0;
+}
+
+
+void EntityStore::Draw(RenderTarget & target, EntityHandle handle, bool selected) const
+{
+	assert(GetOwner(handle) != 0);
+	const size_t i = handle.Index;
+	target.SetPen(selected);
+	switch (handle.Type)
+	{
+	case EntityTypeLine:
+		DrawLineEntity(target, Point<double>(m_lines.X1[i], m_lines.Y1[i]), Point<double>(m_lines.X2[i], m_lines.Y2[i]));
+		break;
+	case EntityTypeCircle:
+		DrawCircleEntity(target, Point<double>(m_circles.CX[i], m_circles.CY[i]), m_circles.R[i]);
+		break;
+	case EntityTypeArc:
+		{
+			Circle circle;
+			circle.Center = Point<double>(m_arcs.CX[i], m_arcs.CY[i]);
+			circle.Radius = m_arcs.R[i];
+			DrawArcEntity(target, CircleArc(circle, Point<double>(m_arcs.SX[i], m_arcs.SY[i]),
+					Point<double>(m_arcs.EX[i], m_arcs.EY[i]), m_arcs.Ccw[i] != 0));
+		}
+		break;
+	case EntityTypePolyline:
+		{
+			const size_t first = m_polylines.First[i];
+			DrawPolylineEntity(target, &m_nodes.X[first], &m_nodes.Y[first], &m_nodes.Bulge[first],
+					m_polylines.Count[i], m_polylines.Closed[i] != 0);
+		}
+		break;
+	case EntityTypeInsert:
+		{
+			Matrix3<double> matrix(
+					m_inserts.M11[i], m_inserts.M12[i], m_inserts.M13[i],
+					m_inserts.M21[i], m_inserts.M22[i], m_inserts.M23[i],
+					0, 0, 1);
+			const CadBlock & block = *m_inserts.Block[i];
+			const Rect<double> & bounds = block.GetBoundingRect();
+			double size = max(bounds.Pt2.X - bounds.Pt1.X, bounds.Pt2.Y - bounds.Pt1.Y) * LengthScale(matrix);
+			if (size * target.GetMagnification() < 1)
+			{
+				DrawDot(target, matrix * bounds.Pt1);
+				break;
+			}
+			TransformRenderTarget transformed(target, matrix);
+			block.Draw(transformed, selected);
+		}
+		break;
+	default:
+		assert(0);
+		break;
+	}
+}
+
+
+bool EntityStore::IntersectsRect(EntityHandle handle, const Rect<double> & rect) const
+{
+	assert(GetOwner(handle) != 0);
+	const size_t i = handle.Index;
+	switch (handle.Type)
+	{
+	case EntityTypeLine:
+		return LineIntersectsRect(m_lines.X1[i], m_lines.Y1[i], m_lines.X2[i], m_lines.Y2[i],
+				rect.Pt1.X, rect.Pt1.Y, rect.Pt2.X, rect.Pt2.Y);
+	case EntityTypeCircle:
+		{
+			Circle circle;
+			circle.Center = Point<double>(m_circles.CX[i], m_circles.CY[i]);
+			circle.Radius = m_circles.R[i];
+			return CircleIntersectsRect(circle, rect);
+		}
+	case EntityTypeArc:
+		{
+			Circle circle;
+			circle.Center = Point<double>(m_arcs.CX[i], m_arcs.CY[i]);
+			circle.Radius = m_arcs.R[i];
+			return IsIntersects(CircleArc(circle, Point<double>(m_arcs.SX[i], m_arcs.SY[i]),
+					Point<double>(m_arcs.EX[i], m_arcs.EY[i]), m_arcs.Ccw[i] != 0), rect);
+		}
+	case EntityTypePolyline:
+		{
+			const size_t first = m_polylines.First[i];
+			const size_t count = m_polylines.Count[i];
+			const double * xs = &m_nodes.X[first];
+			const double * ys = &m_nodes.Y[first];
+			const double * bulges = &m_nodes.Bulge[first];
+			size_t segs = m_polylines.Closed[i] ? count : count - 1;
+			for (size_t j = 0; j < segs; j++)
+			{
+				size_t next = j + 1 < count ? j + 1 : 0;
+				Point<double> from(xs[j], ys[j]);
+				Point<double> to(xs[next], ys[next]);
+				if (bulges[j] == 0 ? LineIntersectsRect(from, to, rect) :
+						IsIntersects(ArcFrom2PtAndBulge(from, to, bulges[j]), rect))
+				{
+					return true;
+				}
+			}
+			return false;
+		}
+	case EntityTypeInsert:
+		// objects of blocks are not in store
+		return GetOwner(handle)->IntersectsRect(rect.Pt1.X, rect.Pt1.Y, rect.Pt2.X, rect.Pt2.Y);
+	default:
+		assert(0);
+		return false;
+	}
+}
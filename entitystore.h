@@ -0,0 +1,130 @@
+/*
+ * entitystore.h
+ *
+ *  Created on: 18.10.2026
+ *      Author: misha
+ */
+
+#ifndef ENTITYSTORE_H_
+#define ENTITYSTORE_H_
+
+
+#include "exmath.h"
+#include "render.h"
+#include <vector>
+
+
+class CadObject;
+class CadBlock;
+
+
+enum EntityType
+{
+	EntityTypeLine,
+	EntityTypeCircle,
+	EntityTypeArc,
+	EntityTypePolyline,
+	EntityTypeInsert,
+	EntityTypeCount,
+};
+
+
+// refers to entity in EntityStore, stays valid until entity is removed
+struct EntityHandle
+{
+	EntityType Type;
+	unsigned long Index;
+};
+
+
+// keeps geometry of document objects in contiguous arrays, one set of arrays per type,
+// coordinates are stored as structure of arrays,
+// slots of removed entities are reused so handles of other entities don't change.
+// It is copy of geometry which is read by painting and by picking instead of objects,
+// objects are still kept since tools and undo work with them. Copy takes about
+// as much memory as objects do, 40 bytes per line and 24 bytes per node of polyline,
+// in return painting of large drawing goes through arrays without cache misses
+// of following object pointers. Snapping doesn't use it, points for it are
+// copied to snap index of document.
+class EntityStore
+{
+public:
+	struct LineArrays
+	{
+		std::vector<double> X1, Y1, X2, Y2;
+	};
+	struct CircleArrays
+	{
+		std::vector<double> CX, CY, R;
+	};
+	struct ArcArrays
+	{
+		std::vector<double> CX, CY, R, SX, SY, EX, EY;
+		std::vector<char> Ccw;
+	};
+	// nodes of polyline are at [First, First + Count) in node arrays
+	struct PolylineArrays
+	{
+		std::vector<unsigned long> First, Count;
+		std::vector<char> Closed;
+	};
+	struct NodeArrays
+	{
+		std::vector<double> X, Y, Bulge;
+	};
+	// first two rows of matrix which places block
+	struct InsertArrays
+	{
+		std::vector<const CadBlock *> Block;
+		std::vector<double> M11, M12, M13, M21, M22, M23;
+	};
+
+	EntityStore() : m_size(0), m_deadNodes(0) {}
+	size_t Size() const { return m_size; }
+	void Clear();
+
+	// owner is facade object which is returned by GetOwner
+	EntityHandle AddLine(CadObject * owner, const Line & line);
+	EntityHandle AddCircle(CadObject * owner, const Circle & circle);
+	EntityHandle AddArc(CadObject * owner, const CircleArc & arc);
+	// nodes should be added right after polyline
+	EntityHandle AddPolyline(CadObject * owner, bool closed);
+	void AddPolylineNode(EntityHandle polyline, const Point<double> & pt, double bulge);
+	// block is shared, it should live while entity is in store
+	EntityHandle AddInsert(CadObject * owner, const CadBlock & block, const Matrix3<double> & matrix);
+	void Remove(EntityHandle handle);
+
+	// returns 0 for removed slots
+	CadObject * GetOwner(EntityHandle handle) const { return m_owners[handle.Type][handle.Index]; }
+	// number of slots of given type including removed ones
+	size_t GetSlotCount(EntityType type) const { return m_owners[type].size(); }
+	const LineArrays & GetLines() const { return m_lines; }
+	const CircleArrays & GetCircles() const { return m_circles; }
+	const ArcArrays & GetArcs() const { return m_arcs; }
+	const PolylineArrays & GetPolylines() const { return m_polylines; }
+	const NodeArrays & GetNodes() const { return m_nodes; }
+	const InsertArrays & GetInserts() const { return m_inserts; }
+
+	// entities smaller than a pixel are drawn as dots
+	void Draw(RenderTarget & target, EntityHandle handle, bool selected) const;
+	// same as CadObject::IntersectsRect, rect should be normalized
+	bool IntersectsRect(EntityHandle handle, const Rect<double> & rect) const;
+
+private:
+	LineArrays m_lines;
+	CircleArrays m_circles;
+	ArcArrays m_arcs;
+	PolylineArrays m_polylines;
+	NodeArrays m_nodes;
+	InsertArrays m_inserts;
+	std::vector<CadObject *> m_owners[EntityTypeCount];
+	std::vector<unsigned long> m_free[EntityTypeCount];
+	size_t m_size;
+	// nodes of removed polylines, those are compacted when there are too many
+	size_t m_deadNodes;
+	EntityHandle Allocate(EntityType type, CadObject * owner);
+	void CompactNodes();
+};
+
+
+#endif /* ENTITYSTORE_H_ */
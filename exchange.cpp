@@ -0,0 +1,337 @@
+/*
+ * exchange.cpp
+ *
+ *  Created on: 18.10.2026
+ *      Author: misha
+ */
+#include "exchange.h"
+#include "compress.h"
+#include "gcadfile.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <unistd.h>
+#endif
+
+
+using namespace std;
+
+
+static const char EXCHANGE_MAGIC[8] = {'G', 'C', 'A', 'D', 'X', 'C', 'H', 'G'};
+// magic, version, flags, image size and payload size
+static const size_t EXCHANGE_HEADER_SIZE = 32;
+
+
+static bool IsLittleEndian()
+{
+	uint32_t value = 1;
+	return *reinterpret_cast<const char *>(&value) == 1;
+}
+
+
+static void PutLe(char * dest, uint64_t value, size_t size)
+{
+	for (size_t i = 0; i < size; i++, value >>= 8)
+		dest[i] = static_cast<char>(value & 0xff);
+}
+
+
+static uint64_t GetLe(const char * src, size_t size)
+{
+	uint64_t result = 0;
+	for (size_t i = size; i > 0; i--)
+		result = (result << 8) | static_cast<unsigned char>(src[i - 1]);
+	return result;
+}
+
+
+static void WriteHeader(unsigned flags, uint64_t imageSize, uint64_t payloadSize, vector<char> & result)
+{
+	char header[EXCHANGE_HEADER_SIZE];
+	memcpy(header, EXCHANGE_MAGIC, sizeof(EXCHANGE_MAGIC));
+	PutLe(header + 8, EXCHANGE_VERSION, 4);
+	PutLe(header + 12, flags, 4);
+	PutLe(header + 16, imageSize, 8);
+	PutLe(header + 24, payloadSize, 8);
+	result.insert(result.end(), header, header + sizeof(header));
+}
+
+
+#ifdef _WIN32
+typedef wstring ExchangePath;
+#else
+typedef string ExchangePath;
+#endif
+
+
+static ExchangePath GetExchangePath(const string & fileName)
+{
+#ifdef _WIN32
+	wchar_t dir[MAX_PATH + 1];
+	DWORD len = GetTempPathW(sizeof(dir) / sizeof(dir[0]), dir);
+	if (len == 0 || len > sizeof(dir) / sizeof(dir[0]))
+		throw GcadError(GcadErrorOpenFile);
+	// names are made by EncodeExchange and contain only ascii characters
+	return wstring(dir, len) + wstring(fileName.begin(), fileName.end());
+#else
+	const char * dir = getenv("TMPDIR");
+	return string(dir != 0 && *dir != 0 ? dir : "/tmp") + "/" + fileName;
+#endif
+}
+
+
+static FILE * OpenExchangeFile(const ExchangePath & path, bool write)
+{
+#ifdef _WIN32
+	return _wfopen(path.c_str(), write ? L"wb" : L"rb");
+#else
+	return fopen(path.c_str(), write ? "wb" : "rb");
+#endif
+}
+
+
+static void WriteWholeFile(const ExchangePath & path, const vector<char> & data)
+{
+	FILE * file = OpenExchangeFile(path, true);
+	if (file == 0)
+		throw GcadError(GcadErrorOpenFile);
+	bool ok = data.empty() || fwrite(&data[0], 1, data.size(), file) == data.size();
+	if (fclose(file) != 0 || !ok)
+		throw GcadError(GcadErrorWriteFile);
+}
+
+
+// returns false if there is no such file
+static bool ReadWholeFile(const ExchangePath & path, vector<char> & result)
+{
+	FILE * file = OpenExchangeFile(path, false);
+	if (file == 0)
+		return false;
+	result.clear();
+	char buffer[64 << 10];
+	size_t read;
+	while ((read = fread(buffer, 1, sizeof(buffer), file)) != 0)
+		result.insert(result.end(), buffer, buffer + read);
+	bool ok = ferror(file) == 0;
+	fclose(file);
+	if (!ok)
+		throw GcadError(GcadErrorReadFile);
+	return true;
+}
+
+
+static string MakeExchangeFileName()
+{
+	static unsigned counter = 0;
+#ifdef _WIN32
+	unsigned long pid = GetCurrentProcessId();
+#else
+	unsigned long pid = getpid();
+#endif
+	char name[64];
+	sprintf(name, "gcad-%lu-%lu-%u.clip", pid, static_cast<unsigned long>(time(0)), counter++);
+	return name;
+}
+
+
+void EncodeExchange(const vector<char> & image, bool allowFile, vector<char> & result, string & fileName)
+{
+	result.clear();
+	fileName.clear();
+	const vector<char> * source = &image;
+	vector<char> swapped;
+	if (!IsLittleEndian())
+	{
+		swapped = image;
+		SwapGcadImage(&swapped[0], swapped.size());
+		source = &swapped;
+	}
+	if (source->size() > EXCHANGE_COMPRESS_THRESHOLD && source->size() < 0xffffffffu)
+	{
+		WriteHeader(ExchangeCompressed, source->size(), 0, result);
+		CompressBlock(&(*source)[0], source->size(), result);
+		PutLe(&result[24], result.size() - EXCHANGE_HEADER_SIZE, 8);
+	}
+	else
+	{
+		WriteHeader(0, source->size(), source->size(), result);
+		result.insert(result.end(), source->begin(), source->end());
+	}
+	if (!allowFile || result.size() <= EXCHANGE_FILE_THRESHOLD)
+		return;
+	fileName = MakeExchangeFileName();
+	WriteWholeFile(GetExchangePath(fileName), result);
+	result.clear();
+	WriteHeader(ExchangeFileReference, 0, fileName.size(), result);
+	result.insert(result.end(), fileName.begin(), fileName.end());
+}
+
+
+void DecodeExchange(const char * data, size_t size, vector<char> & image)
+{
+	if (size < EXCHANGE_HEADER_SIZE || memcmp(data, EXCHANGE_MAGIC, sizeof(EXCHANGE_MAGIC)) != 0)
+		throw GcadError(GcadErrorInvalidFormat);
+	if (GetLe(data + 8, 4) > EXCHANGE_VERSION)
+		throw GcadError(GcadErrorVersion);
+	unsigned flags = static_cast<unsigned>(GetLe(data + 12, 4));
+	uint64_t imageSize = GetLe(data + 16, 8);
+	uint64_t payloadSize = GetLe(data + 24, 8);
+	const char * payload = data + EXCHANGE_HEADER_SIZE;
+	if (payloadSize > size - EXCHANGE_HEADER_SIZE)
+		throw GcadError(GcadErrorInvalidFormat);
+	if (flags & ExchangeFileReference)
+	{
+		string fileName(payload, payload + static_cast<size_t>(payloadSize));
+		// name is used only inside temporary directory
+		if (fileName.empty() || fileName.find_first_of("/\\:") != string::npos || fileName.find("..") != string::npos)
+			throw GcadError(GcadErrorInvalidFormat);
+		vector<char> encoded;
+		if (!ReadWholeFile(GetExchangePath(fileName), encoded))
+			throw GcadError(GcadErrorOpenFile);
+		if (encoded.size() < EXCHANGE_HEADER_SIZE || (GetLe(&encoded[12], 4) & ExchangeFileReference))
+			throw GcadError(GcadErrorInvalidFormat);
+		DecodeExchange(&encoded[0], encoded.size(), image);
+		return;
+	}
+	if (imageSize > static_cast<uint64_t>(static_cast<size_t>(-1)))
+		throw GcadError(GcadErrorInvalidFormat);
+	if (flags & ExchangeCompressed)
+	{
+		image.resize(static_cast<size_t>(imageSize));
+		if (!DecompressBlock(payload, static_cast<size_t>(payloadSize), image.empty() ? 0 : &image[0], image.size()))
+			throw GcadError(GcadErrorInvalidFormat);
+	}
+	else
+	{
+		if (imageSize != payloadSize)
+			throw GcadError(GcadErrorInvalidFormat);
+		image.assign(payload, payload + static_cast<size_t>(payloadSize));
+	}
+	if (image.size() < sizeof(GcadHeader))
+		throw GcadError(GcadErrorInvalidFormat);
+	if (reinterpret_cast<const GcadHeader *>(&image[0])->ByteOrder != GCAD_BYTE_ORDER)
+		SwapGcadImage(&image[0], image.size());
+}
+
+
+void DeleteExchangeFile(const string & fileName)
+{
+	if (fileName.empty())
+		return;
+#ifdef _WIN32
+	DeleteFileW(GetExchangePath(fileName).c_str());
+#else
+	remove(GetExchangePath(fileName).c_str());
+#endif
+}
+
+
+string GetExchangeFileName(const char * data, size_t size)
+{
+	if (size < EXCHANGE_HEADER_SIZE || memcmp(data, EXCHANGE_MAGIC, sizeof(EXCHANGE_MAGIC)) != 0)
+		return string();
+	if (!(GetLe(data + 12, 4) & ExchangeFileReference))
+		return string();
+	uint64_t payloadSize = GetLe(data + 24, 8);
+	if (payloadSize > size - EXCHANGE_HEADER_SIZE)
+		return string();
+	return string(data + EXCHANGE_HEADER_SIZE, data + EXCHANGE_HEADER_SIZE + static_cast<size_t>(payloadSize));
+}
+
+
+// checks that name is made by MakeExchangeFileName and written long enough ago
+static bool IsStaleExchangeFile(const string & fileName, unsigned long now)
+{
+	unsigned long pid, written;
+	unsigned counter;
+	char tail[8];
+	if (sscanf(fileName.c_str(), "gcad-%lu-%lu-%u.%7s", &pid, &written, &counter, tail) != 4 || strcmp(tail, "clip") != 0)
+		return false;
+	return written + EXCHANGE_FILE_MIN_AGE < now;
+}
+
+
+void DeleteStaleExchangeFiles(const string & keep)
+{
+	unsigned long now = static_cast<unsigned long>(time(0));
+	vector<string> stale;
+#ifdef _WIN32
+	WIN32_FIND_DATAW data;
+	HANDLE find = FindFirstFileW(GetExchangePath("gcad-*.clip").c_str(), &data);
+	if (find == INVALID_HANDLE_VALUE)
+		return;
+	do
+	{
+		wstring name(data.cFileName);
+		// names of our files contain only ascii characters
+		if (name.find_first_not_of(L"0123456789-.abcdgilp") != wstring::npos)
+			continue;
+		string fileName(name.begin(), name.end());
+		if (fileName != keep && IsStaleExchangeFile(fileName, now))
+			stale.push_back(fileName);
+	}
+	while (FindNextFileW(find, &data));
+	FindClose(find);
+#else
+	string path = GetExchangePath("");
+	DIR * dir = opendir(path.c_str());
+	if (dir == 0)
+		return;
+	while (dirent * entry = readdir(dir))
+	{
+		string fileName(entry->d_name);
+		if (fileName != keep && IsStaleExchangeFile(fileName, now))
+			stale.push_back(fileName);
+	}
+	closedir(dir);
+#endif
+	for (vector<string>::const_iterator i = stale.begin(); i != stale.end(); i++)
+		DeleteExchangeFile(*i);
+}
+
+
+static ExchangePath GetScratchClipboardPath()
+{
+	const char * path = getenv("GCAD_CLIPBOARD");
+	if (path == 0 || *path == 0)
+		return GetExchangePath("gcad.clip");
+	string result(path);
+	return ExchangePath(result.begin(), result.end());
+}
+
+
+void WriteScratchClipboard(const vector<char> & image)
+{
+	vector<char> encoded;
+	string fileName;
+	EncodeExchange(image, false, encoded, fileName);
+	// written under other name and renamed, so reader never sees half of file
+	ExchangePath path = GetScratchClipboardPath();
+	ExchangePath temp = path;
+	temp += '~';
+	WriteWholeFile(temp, encoded);
+#ifdef _WIN32
+	if (!MoveFileExW(temp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING))
+		throw GcadError(GcadErrorWriteFile);
+#else
+	if (rename(temp.c_str(), path.c_str()) != 0)
+		throw GcadError(GcadErrorWriteFile);
+#endif
+}
+
+
+bool ReadScratchClipboard(vector<char> & image)
+{
+	vector<char> encoded;
+	if (!ReadWholeFile(GetScratchClipboardPath(), encoded))
+		return false;
+	if (encoded.empty())
+		throw GcadError(GcadErrorInvalidFormat);
+	DecodeExchange(&encoded[0], encoded.size(), image);
+	return true;
+}
@@ -0,0 +1,64 @@
+/*
+ * exchange.h
+ *
+ *  Created on: 18.10.2026
+ *      Author: misha
+ */
+
+#ifndef EXCHANGE_H_
+#define EXCHANGE_H_
+
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+
+// Encoding of gcad images for clipboard and scratch files. It starts with
+// ExchangeHeader, all numbers in it and in image are little endian.
+// Large images are compressed, very large ones are put to temporary file
+// and only name of that file goes to clipboard.
+
+const unsigned EXCHANGE_VERSION = 1;
+// images above this are compressed
+const size_t EXCHANGE_COMPRESS_THRESHOLD = 64 << 10;
+// encoded data above this is put to temporary file by EncodeExchange
+const size_t EXCHANGE_FILE_THRESHOLD = 16 << 20;
+// seconds, younger temporary files can be just written by other instance
+// which hasn't put reference to clipboard yet
+const unsigned long EXCHANGE_FILE_MIN_AGE = 60;
+
+
+enum ExchangeFlags
+{
+	ExchangeCompressed = 1,
+	// payload is name of file in temporary directory with encoded data
+	ExchangeFileReference = 2,
+};
+
+
+// encodes gcad image made by WriteGcadMemory, when allowFile is set large
+// data is written to temporary file which name is returned in fileName,
+// throws GcadError
+void EncodeExchange(const std::vector<char> & image, bool allowFile,
+		std::vector<char> & result, std::string & fileName);
+// decodes data of EncodeExchange into gcad image in native byte order, throws GcadError
+void DecodeExchange(const char * data, size_t size, std::vector<char> & image);
+// deletes temporary file made by EncodeExchange
+void DeleteExchangeFile(const std::string & fileName);
+// returns name of temporary file which data of EncodeExchange refers to,
+// empty if data isn't file reference
+std::string GetExchangeFileName(const char * data, size_t size);
+// temporary files are left when application exits while clipboard refers to them,
+// deletes those which are older than EXCHANGE_FILE_MIN_AGE except keep,
+// which should be file referred by current clipboard
+void DeleteStaleExchangeFiles(const std::string & keep);
+
+// Clipboard kept in file, for command line tools and headless tests. File is
+// named by GCAD_CLIPBOARD environment variable or is gcad.clip in temporary directory.
+void WriteScratchClipboard(const std::vector<char> & image);
+// returns false if there is nothing in clipboard, throws GcadError
+bool ReadScratchClipboard(std::vector<char> & image);
+
+
+#endif /* EXCHANGE_H_ */
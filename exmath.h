@@ -8,6 +8,14 @@
 #include <limits>
 #include <utility>
 #include <vector>
+// vector instructions for batch intersection
+#if !defined(EXMATH_NO_SIMD) && defined(__AVX2__)
+#include <immintrin.h>
+#define EXMATH_SIMD_LANES SimdLanesAvx
+#elif !defined(EXMATH_NO_SIMD) && defined(__SSE2__)
+#include <emmintrin.h>
+#define EXMATH_SIMD_LANES SimdLanesSse2
+#endif
 
 #undef min
 #undef max
@@ -424,6 +432,20 @@ inline Matrix3<scalar> RotationMatrix(scalar angle)
 	return RotationMatrix(DirVector(angle));
 }
 
+// how lengths change with transformation, exact for rotation with uniform scaling
+template<typename scalar>
+inline scalar LengthScale(const Matrix3<scalar> & mat)
+{
+	return std::sqrt(std::fabs(mat[0][0]*mat[1][1] - mat[0][1]*mat[1][0]));
+}
+
+// true if transformation mirrors, so counter clockwise becomes clockwise
+template<typename scalar>
+inline bool IsMirroring(const Matrix3<scalar> & mat)
+{
+	return mat[0][0]*mat[1][1] - mat[0][1]*mat[1][0] < 0;
+}
+
 
 // checks if angle inside arc
 // range is started from startAndle and sweeps CCW to endAngle
@@ -784,6 +806,44 @@ inline bool IsIntersects(CircleArc arc, Rect<double> rect)
 }
 
 
+inline bool CircleIntersectsRect(const Circle & circle, Rect<double> rect)
+{
+	assert(rect.IsNormalized());
+	const Point<double> & center = circle.Center;
+	const double r = circle.Radius;
+	Rect<double> brect(center.X - r, center.Y - r, center.X + r, center.Y + r);
+	if (!IsRectsIntersects(rect, brect))
+		return false;
+	// circle fits in rectangle
+	if (IsLeftContainsRight(rect, brect))
+		return true;
+	// otherwise it crosses one of sides
+	const double xs[2] = {rect.Pt1.X, rect.Pt2.X};
+	for (int i = 0; i < 2; i++)
+	{
+		std::pair<bool, double> res = VertLineIntersectsCircle(xs[i], circle);
+		if (!res.first)
+			continue;
+		if (rect.Pt1.Y <= center.Y + res.second && center.Y + res.second <= rect.Pt2.Y)
+			return true;
+		if (res.second != 0 && rect.Pt1.Y <= center.Y - res.second && center.Y - res.second <= rect.Pt2.Y)
+			return true;
+	}
+	const double ys[2] = {rect.Pt1.Y, rect.Pt2.Y};
+	for (int i = 0; i < 2; i++)
+	{
+		std::pair<bool, double> res = HorzLineIntersectsCircle(ys[i], circle);
+		if (!res.first)
+			continue;
+		if (rect.Pt1.X <= center.X + res.second && center.X + res.second <= rect.Pt2.X)
+			return true;
+		if (res.second != 0 && rect.Pt1.X <= center.X - res.second && center.X - res.second <= rect.Pt2.X)
+			return true;
+	}
+	return false;
+}
+
+
 struct Straight
 {
 	double A, B, C;
@@ -813,7 +873,31 @@ struct Line
 };
 
 
-inline std::vector<Point<double> > Intersect(const Line & l1,
+// result of intersection of two lines, circles or arcs,
+// there are at most two points so those are stored inline without heap allocation,
+// interface is subset of std::vector
+class IntersectResult
+{
+public:
+	typedef const Point<double> * const_iterator;
+	IntersectResult() : m_size(0) {}
+	size_t size() const { return m_size; }
+	bool empty() const { return m_size == 0; }
+	const_iterator begin() const { return m_points; }
+	const_iterator end() const { return m_points + m_size; }
+	const Point<double> & operator[](size_t i) const { assert(i < m_size); return m_points[i]; }
+	void push_back(const Point<double> & pt)
+	{
+		assert(m_size < 2);
+		m_points[m_size++] = pt;
+	}
+private:
+	Point<double> m_points[2];
+	size_t m_size;
+};
+
+
+inline IntersectResult Intersect(const Line & l1,
 		const Line & l2)
 {
 	Point<double> p1 = l1.Point1, p2 = l1.Point2;
@@ -836,7 +920,7 @@ inline std::vector<Point<double> > Intersect(const Line & l1,
 	Matrix2<double> m(p2.Y - p1.Y, p1.X - p2.X,
 			p4.Y - p3.Y, p3.X - p4.X);
 	double detm = m.Determinant();
-	std::vector<Point<double> > res;
+	IntersectResult res;
 	if (detm == 0)
 		return res;
 	Matrix2<double> mx(p1.X*p2.Y - p2.X*p1.Y, p1.X - p2.X,
@@ -892,7 +976,7 @@ struct CircLineIntersectRes
 };
 
 
-inline std::vector<Point<double> > Intersect(const Line & line, const Circle & circle)
+inline IntersectResult Intersect(const Line & line, const Circle & circle)
 {
 	Straight str = line.GetStraight();
 	double a = str.A, b = str.B, c = str.C;
@@ -904,10 +988,10 @@ inline std::vector<Point<double> > Intersect(const Line & line, const Circle & c
 	{
 		double y = line.Point1.Y;
 		std::pair<bool, double> tuple = HorzLineIntersectsCircle(y, circle);
-		if (hasPoints = tuple.first)
+		if ((hasPoints = tuple.first))
 		{
 			pt1 = Point<double>(cx + tuple.second, y);
-			if (twoPoints = tuple.second != 0)
+			if ((twoPoints = tuple.second != 0))
 				pt2 = Point<double>(cx - tuple.second, y);
 		}
 	}
@@ -915,24 +999,24 @@ inline std::vector<Point<double> > Intersect(const Line & line, const Circle & c
 	{
 		double x = line.Point1.X;
 		std::pair<bool, double> tuple = VertLineIntersectsCircle(x, circle);
-		if (hasPoints = tuple.first)
+		if ((hasPoints = tuple.first))
 		{
 			pt1 = Point<double>(x, cy + tuple.second);
-			if (twoPoints = tuple.second != 0)
+			if ((twoPoints = tuple.second != 0))
 				pt2 = Point<double>(x, cy - tuple.second);
 		}
 	}
 	else
 	{
 		SquareEquation eq(a/b*a/b + 1, 2*(a*c/b/b + a*cy/b - cx), (c/b + cy)*(c/b + cy) + cx*cx - r*r);
-		if (hasPoints = eq.HasRoots)
+		if ((hasPoints = eq.HasRoots))
 		{
 			pt1 = Point<double>(eq.Root1, -(c + a*eq.Root1)/b);
-			if (twoPoints = eq.TwoRoots)
+			if ((twoPoints = eq.TwoRoots))
 				pt2 = Point<double>(eq.Root2, -(c + a*eq.Root2)/b);
 		}
 	}
-	std::vector<Point<double> > res;
+	IntersectResult res;
 	if (hasPoints)
 	{
 		Rect<double> brect = line.GetBoundingRect();
@@ -944,17 +1028,17 @@ inline std::vector<Point<double> > Intersect(const Line & line, const Circle & c
 	return res;
 }
 
-inline std::vector<Point<double> > Intersect(const Circle & circle, const Line & line)
+inline IntersectResult Intersect(const Circle & circle, const Line & line)
 {
 	return Intersect(line, circle);
 }
 
 
-inline std::vector<Point<double> > Intersect(const Line & line, const CircleArc & arc)
+inline IntersectResult Intersect(const Line & line, const CircleArc & arc)
 {
-	std::vector<Point<double> > points = Intersect(static_cast<const Circle&>(arc), line);
-	std::vector<Point<double> > res;
-	for (std::vector<Point<double> >::const_iterator i = points.begin();
+	IntersectResult points = Intersect(static_cast<const Circle&>(arc), line);
+	IntersectResult res;
+	for (IntersectResult::const_iterator i = points.begin();
 		i != points.end(); i++)
 	{
 		if (arc.ContainsAngWithEpsilon((*i - arc.Center).Angle()))
@@ -963,18 +1047,18 @@ inline std::vector<Point<double> > Intersect(const Line & line, const CircleArc
 	return res;
 }
 
-inline std::vector<Point<double> > Intersect(const CircleArc & arc, const Line & line)
+inline IntersectResult Intersect(const CircleArc & arc, const Line & line)
 {
 	return Intersect(line, arc);
 }
 
 
-inline std::vector<Point<double> > Intersect(const Circle & lhs, const Circle & rhs)
+inline IntersectResult Intersect(const Circle & lhs, const Circle & rhs)
 {
 	double r0 = rhs.Radius, r1 = lhs.Radius;
 	Point<double> p0 = rhs.Center;
 	Point<double> p1 = lhs.Center;
-	std::vector<Point<double> > res;
+	IntersectResult res;
 	if (rhs == lhs)
 		return res;
 	double d = (p1 - p0).Length();
@@ -999,11 +1083,11 @@ inline std::vector<Point<double> > Intersect(const Circle & lhs, const Circle &
 }
 
 
-inline std::vector<Point<double> > Intersect(const Circle & circle, const CircleArc & arc)
+inline IntersectResult Intersect(const Circle & circle, const CircleArc & arc)
 {
-	std::vector<Point<double> > points = Intersect(circle, static_cast<const Circle&>(arc));
-	std::vector<Point<double> > res;
-	for (std::vector<Point<double> >::const_iterator i = points.begin();
+	IntersectResult points = Intersect(circle, static_cast<const Circle&>(arc));
+	IntersectResult res;
+	for (IntersectResult::const_iterator i = points.begin();
 		i != points.end(); i++)
 	{
 		if (arc.ContainsAngWithEpsilon((*i - arc.Center).Angle()))
@@ -1012,18 +1096,18 @@ inline std::vector<Point<double> > Intersect(const Circle & circle, const Circle
 	return res;
 }
 
-inline std::vector<Point<double> > Intersect(const CircleArc & arc, const Circle & circle)
+inline IntersectResult Intersect(const CircleArc & arc, const Circle & circle)
 {
 	return Intersect(circle, arc);
 }
 
 
-inline std::vector<Point<double> > Intersect(const CircleArc & lhs, const CircleArc & rhs)
+inline IntersectResult Intersect(const CircleArc & lhs, const CircleArc & rhs)
 {
-	std::vector<Point<double> > points = Intersect(static_cast<const Circle&>(lhs),
+	IntersectResult points = Intersect(static_cast<const Circle&>(lhs),
 			static_cast<const Circle&>(rhs));
-	std::vector<Point<double> > res;
-	for (std::vector<Point<double> >::const_iterator i = points.begin();
+	IntersectResult res;
+	for (IntersectResult::const_iterator i = points.begin();
 		i != points.end(); i++)
 	{
 		if (lhs.ContainsAngWithEpsilon((*i - lhs.Center).Angle()) &&
@@ -1036,4 +1120,456 @@ inline std::vector<Point<double> > Intersect(const CircleArc & lhs, const Circle
 }
 
 
+// batch intersection of one primitive with many primitives,
+// primitives are passed in structure of arrays layout and
+// results are written into buffer provided by caller,
+// vector instructions are used when compiler targets those,
+// EXMATH_NO_SIMD forces scalar code
+
+struct LineSpan
+{
+	const double * X1;
+	const double * Y1;
+	const double * X2;
+	const double * Y2;
+	size_t Count;
+};
+
+
+struct CircleSpan
+{
+	const double * CX;
+	const double * CY;
+	const double * R;
+	size_t Count;
+};
+
+
+struct ArcSpan
+{
+	const double * CX;
+	const double * CY;
+	const double * R;
+	const double * SX;
+	const double * SY;
+	const double * EX;
+	const double * EY;
+	const char * Ccw;
+	size_t Count;
+
+	CircleSpan GetCircles() const
+	{
+		CircleSpan result = {CX, CY, R, Count};
+		return result;
+	}
+
+	CircleArc GetArc(size_t i) const
+	{
+		Circle circle;
+		circle.Center = Point<double>(CX[i], CY[i]);
+		circle.Radius = R[i];
+		return CircleArc(circle, Point<double>(SX[i], SY[i]), Point<double>(EX[i], EY[i]), Ccw[i] != 0);
+	}
+};
+
+
+// Index is position of primitive in span
+struct BatchIntersection
+{
+	size_t Index;
+	Point<double> Pt;
+};
+
+
+// lane operations used by batch kernels, arithmetic is done with operators,
+// for vector types those come from gcc vector extensions
+struct SimdLanesScalar
+{
+	typedef double Value;
+	typedef bool Mask;
+	enum { Width = 1 };
+	static Value Load(const double * p) { return *p; }
+	static Value Set(double x) { return x; }
+	static void Store(double * p, Value v) { *p = v; }
+	static Value Sqrt(Value a) { return std::sqrt(a); }
+	static Value Min(Value a, Value b) { return a < b ? a : b; }
+	static Value Max(Value a, Value b) { return a > b ? a : b; }
+	static Value Abs(Value a) { return std::fabs(a); }
+	static Mask Less(Value a, Value b) { return a < b; }
+	static Mask LessEq(Value a, Value b) { return a <= b; }
+	static Mask Equal(Value a, Value b) { return a == b; }
+	static Mask NotEqual(Value a, Value b) { return a != b; }
+	static Mask And(Mask a, Mask b) { return a && b; }
+	// a and not b
+	static Mask AndNot(Mask a, Mask b) { return a && !b; }
+	static Value Select(Mask m, Value a, Value b) { return m ? a : b; }
+	static int Bits(Mask m) { return m ? 1 : 0; }
+};
+
+
+#if defined(EXMATH_SIMD_LANES) && defined(__AVX2__)
+struct SimdLanesAvx
+{
+	typedef __m256d Value;
+	typedef __m256d Mask;
+	enum { Width = 4 };
+	static Value Load(const double * p) { return _mm256_loadu_pd(p); }
+	static Value Set(double x) { return _mm256_set1_pd(x); }
+	static void Store(double * p, Value v) { _mm256_storeu_pd(p, v); }
+	static Value Sqrt(Value a) { return _mm256_sqrt_pd(a); }
+	static Value Min(Value a, Value b) { return _mm256_min_pd(a, b); }
+	static Value Max(Value a, Value b) { return _mm256_max_pd(a, b); }
+	static Value Abs(Value a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a); }
+	static Mask Less(Value a, Value b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+	static Mask LessEq(Value a, Value b) { return _mm256_cmp_pd(a, b, _CMP_LE_OQ); }
+	static Mask Equal(Value a, Value b) { return _mm256_cmp_pd(a, b, _CMP_EQ_OQ); }
+	static Mask NotEqual(Value a, Value b) { return _mm256_cmp_pd(a, b, _CMP_NEQ_UQ); }
+	static Mask And(Mask a, Mask b) { return _mm256_and_pd(a, b); }
+	static Mask AndNot(Mask a, Mask b) { return _mm256_andnot_pd(b, a); }
+	static Value Select(Mask m, Value a, Value b) { return _mm256_blendv_pd(b, a, m); }
+	static int Bits(Mask m) { return _mm256_movemask_pd(m); }
+};
+#elif defined(EXMATH_SIMD_LANES)
+struct SimdLanesSse2
+{
+	typedef __m128d Value;
+	typedef __m128d Mask;
+	enum { Width = 2 };
+	static Value Load(const double * p) { return _mm_loadu_pd(p); }
+	static Value Set(double x) { return _mm_set1_pd(x); }
+	static void Store(double * p, Value v) { _mm_storeu_pd(p, v); }
+	static Value Sqrt(Value a) { return _mm_sqrt_pd(a); }
+	static Value Min(Value a, Value b) { return _mm_min_pd(a, b); }
+	static Value Max(Value a, Value b) { return _mm_max_pd(a, b); }
+	static Value Abs(Value a) { return _mm_andnot_pd(_mm_set1_pd(-0.0), a); }
+	static Mask Less(Value a, Value b) { return _mm_cmplt_pd(a, b); }
+	static Mask LessEq(Value a, Value b) { return _mm_cmple_pd(a, b); }
+	static Mask Equal(Value a, Value b) { return _mm_cmpeq_pd(a, b); }
+	static Mask NotEqual(Value a, Value b) { return _mm_cmpneq_pd(a, b); }
+	static Mask And(Mask a, Mask b) { return _mm_and_pd(a, b); }
+	static Mask AndNot(Mask a, Mask b) { return _mm_andnot_pd(b, a); }
+	static Value Select(Mask m, Value a, Value b) { return _mm_or_pd(_mm_and_pd(m, a), _mm_andnot_pd(m, b)); }
+	static int Bits(Mask m) { return _mm_movemask_pd(m); }
+};
+#endif
+
+
+// points found by kernel for one group of lanes, at most two per lane
+template <class S>
+struct BatchLanesResult
+{
+	typename S::Value X1, Y1, X2, Y2;
+	typename S::Mask Found1, Found2;
+};
+
+
+// appends found points of lanes starting from index first
+template <class S>
+inline size_t EmitBatchLanes(const BatchLanesResult<S> & lanes, size_t first,
+		BatchIntersection * result)
+{
+	int bits1 = S::Bits(lanes.Found1);
+	int bits2 = S::Bits(lanes.Found2);
+	if ((bits1 | bits2) == 0)
+		return 0;
+	double x1[S::Width], y1[S::Width], x2[S::Width], y2[S::Width];
+	S::Store(x1, lanes.X1);
+	S::Store(y1, lanes.Y1);
+	S::Store(x2, lanes.X2);
+	S::Store(y2, lanes.Y2);
+	size_t count = 0;
+	for (int i = 0; i < S::Width; i++)
+	{
+		if (bits1 & (1 << i))
+		{
+			result[count].Index = first + i;
+			result[count].Pt = Point<double>(x1[i], y1[i]);
+			count++;
+		}
+		if (bits2 & (1 << i))
+		{
+			result[count].Index = first + i;
+			result[count].Pt = Point<double>(x2[i], y2[i]);
+			count++;
+		}
+	}
+	return count;
+}
+
+
+// true for lanes where point is in bounding rectangle of segment with epsilon
+template <class S>
+inline typename S::Mask BatchInSegmentRect(typename S::Value x, typename S::Value y,
+		typename S::Value x1, typename S::Value y1, typename S::Value x2, typename S::Value y2)
+{
+	typename S::Value eps = S::Set(EPSILON);
+	typename S::Mask inX = S::And(S::LessEq(S::Min(x1, x2) - eps, x), S::LessEq(x, S::Max(x1, x2) + eps));
+	typename S::Mask inY = S::And(S::LessEq(S::Min(y1, y2) - eps, y), S::LessEq(y, S::Max(y1, y2) + eps));
+	return S::And(inX, inY);
+}
+
+
+// same method as Intersect(Line, Line)
+template <class S>
+inline BatchLanesResult<S> BatchLineLine(typename S::Value x1, typename S::Value y1,
+		typename S::Value x2, typename S::Value y2, typename S::Value x3, typename S::Value y3,
+		typename S::Value x4, typename S::Value y4)
+{
+	typedef typename S::Value V;
+	V a1 = y2 - y1, b1 = x1 - x2, c1 = x1*y2 - x2*y1;
+	V a2 = y4 - y3, b2 = x3 - x4, c2 = x3*y4 - x4*y3;
+	V detm = a1*b2 - b1*a2;
+	BatchLanesResult<S> res;
+	// lanes with zero determinant get garbage which is masked out
+	res.X1 = (c1*b2 - b1*c2)/detm;
+	res.Y1 = (a1*c2 - c1*a2)/detm;
+	res.X2 = res.X1;
+	res.Y2 = res.Y1;
+	res.Found1 = S::And(S::NotEqual(detm, S::Set(0)),
+			S::And(BatchInSegmentRect<S>(res.X1, res.Y1, x1, y1, x2, y2),
+					BatchInSegmentRect<S>(res.X1, res.Y1, x3, y3, x4, y4)));
+	res.Found2 = S::AndNot(res.Found1, res.Found1);
+	return res;
+}
+
+
+// solves |p1 + t*(p2 - p1) - c| = r for t, points are checked
+// to be within bounding rectangle of segment like Intersect(Line, Circle) does
+template <class S>
+inline BatchLanesResult<S> BatchLineCircle(typename S::Value x1, typename S::Value y1,
+		typename S::Value x2, typename S::Value y2, typename S::Value cx, typename S::Value cy,
+		typename S::Value r)
+{
+	typedef typename S::Value V;
+	V zero = S::Set(0);
+	V dx = x2 - x1, dy = y2 - y1;
+	V fx = x1 - cx, fy = y1 - cy;
+	V a = dx*dx + dy*dy;
+	V b = dx*fx + dy*fy;
+	// quarter of discriminant is b*b - a*(|f|^2 - r*r) = a*r*r - cross*cross,
+	// second form has no cancellation and is exactly 0 when axis aligned line
+	// touches circle as in Intersect(Line, Circle), because sqrt(dx*dx) is |dx|
+	V lr = S::Sqrt(a)*r;
+	V cross = S::Abs(dx*fy - dy*fx);
+	V discr = (lr - cross)*(lr + cross);
+	typename S::Mask valid = S::And(S::LessEq(zero, discr), S::Less(zero, a));
+	V sq = S::Sqrt(S::Max(discr, zero));
+	V t1 = (zero - b - sq)/a;
+	V t2 = (zero - b + sq)/a;
+	BatchLanesResult<S> res;
+	res.X1 = x1 + t1*dx;
+	res.Y1 = y1 + t1*dy;
+	res.X2 = x1 + t2*dx;
+	res.Y2 = y1 + t2*dy;
+	res.Found1 = S::And(valid, BatchInSegmentRect<S>(res.X1, res.Y1, x1, y1, x2, y2));
+	res.Found2 = S::And(S::AndNot(valid, S::Equal(discr, zero)),
+			BatchInSegmentRect<S>(res.X2, res.Y2, x1, y1, x2, y2));
+	return res;
+}
+
+
+// same method as Intersect(Circle, Circle), lhs is circle 1 and rhs is circle 0
+template <class S>
+inline BatchLanesResult<S> BatchCircleCircle(typename S::Value x1, typename S::Value y1,
+		typename S::Value r1, typename S::Value x0, typename S::Value y0, typename S::Value r0)
+{
+	typedef typename S::Value V;
+	typedef typename S::Mask M;
+	V zero = S::Set(0);
+	V eps = S::Set(EPSILON);
+	V dx = x1 - x0, dy = y1 - y0;
+	V d = S::Sqrt(dx*dx + dy*dy);
+	M same = S::And(S::And(S::Equal(dx, zero), S::Equal(dy, zero)), S::Equal(r0, r1));
+	M outside = S::Less(r0 + r1 + eps, d);
+	M inside = S::Less(d, S::Abs(r0 - r1) - eps);
+	M valid = S::AndNot(S::AndNot(S::AndNot(S::Less(zero, d), same), outside), inside);
+	M onePoint = S::LessEq(S::Abs(d - (r0 + r1)), eps);
+	V ux = dx/d, uy = dy/d;
+	V a = (r0*r0 - r1*r1 + d*d)/(S::Set(2)*d);
+	V h = S::Sqrt(S::Max(r0*r0 - a*a, zero));
+	V px = x0 + a*ux, py = y0 + a*uy;
+	BatchLanesResult<S> res;
+	res.X1 = S::Select(onePoint, x0 + r0*ux, px + h*uy);
+	res.Y1 = S::Select(onePoint, y0 + r0*uy, py - h*ux);
+	res.X2 = px - h*uy;
+	res.Y2 = py + h*ux;
+	res.Found1 = valid;
+	res.Found2 = S::AndNot(valid, onePoint);
+	return res;
+}
+
+
+// runs kernel over vector lanes and finishes remaining elements with scalar lanes,
+// Kernel is functor with template operator()(S, first) returning BatchLanesResult<S>
+template <class Kernel>
+inline size_t RunBatch(const Kernel & kernel, size_t count, BatchIntersection * result)
+{
+	size_t found = 0;
+	size_t i = 0;
+#ifdef EXMATH_SIMD_LANES
+	for (; i + EXMATH_SIMD_LANES::Width <= count; i += EXMATH_SIMD_LANES::Width)
+		found += EmitBatchLanes<EXMATH_SIMD_LANES>(kernel(EXMATH_SIMD_LANES(), i), i, result + found);
+#endif
+	for (; i < count; i++)
+		found += EmitBatchLanes<SimdLanesScalar>(kernel(SimdLanesScalar(), i), i, result + found);
+	return found;
+}
+
+
+struct LineLinesKernel
+{
+	const Line & Query;
+	const LineSpan & Lines;
+	LineLinesKernel(const Line & query, const LineSpan & lines) : Query(query), Lines(lines) {}
+	template <class S>
+	BatchLanesResult<S> operator()(S, size_t i) const
+	{
+		return BatchLineLine<S>(S::Set(Query.Point1.X), S::Set(Query.Point1.Y),
+				S::Set(Query.Point2.X), S::Set(Query.Point2.Y),
+				S::Load(Lines.X1 + i), S::Load(Lines.Y1 + i), S::Load(Lines.X2 + i), S::Load(Lines.Y2 + i));
+	}
+};
+
+
+struct LineCirclesKernel
+{
+	const Line & Query;
+	const CircleSpan & Circles;
+	LineCirclesKernel(const Line & query, const CircleSpan & circles) : Query(query), Circles(circles) {}
+	template <class S>
+	BatchLanesResult<S> operator()(S, size_t i) const
+	{
+		return BatchLineCircle<S>(S::Set(Query.Point1.X), S::Set(Query.Point1.Y),
+				S::Set(Query.Point2.X), S::Set(Query.Point2.Y),
+				S::Load(Circles.CX + i), S::Load(Circles.CY + i), S::Load(Circles.R + i));
+	}
+};
+
+
+struct CircleLinesKernel
+{
+	const Circle & Query;
+	const LineSpan & Lines;
+	CircleLinesKernel(const Circle & query, const LineSpan & lines) : Query(query), Lines(lines) {}
+	template <class S>
+	BatchLanesResult<S> operator()(S, size_t i) const
+	{
+		return BatchLineCircle<S>(S::Load(Lines.X1 + i), S::Load(Lines.Y1 + i),
+				S::Load(Lines.X2 + i), S::Load(Lines.Y2 + i),
+				S::Set(Query.Center.X), S::Set(Query.Center.Y), S::Set(Query.Radius));
+	}
+};
+
+
+struct CircleCirclesKernel
+{
+	const Circle & Query;
+	const CircleSpan & Circles;
+	CircleCirclesKernel(const Circle & query, const CircleSpan & circles) : Query(query), Circles(circles) {}
+	template <class S>
+	BatchLanesResult<S> operator()(S, size_t i) const
+	{
+		return BatchCircleCircle<S>(S::Set(Query.Center.X), S::Set(Query.Center.Y), S::Set(Query.Radius),
+				S::Load(Circles.CX + i), S::Load(Circles.CY + i), S::Load(Circles.R + i));
+	}
+};
+
+
+// removes points which are not on arcs of span, compacts result in place
+inline size_t FilterBatchByArcs(const ArcSpan & arcs, BatchIntersection * result, size_t count)
+{
+	size_t res = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		CircleArc arc = arcs.GetArc(result[i].Index);
+		if (arc.ContainsAngWithEpsilon((result[i].Pt - arc.Center).Angle()))
+			result[res++] = result[i];
+	}
+	return res;
+}
+
+
+// removes points which are not on query arc, compacts result in place
+inline size_t FilterBatchByArc(const CircleArc & arc, BatchIntersection * result, size_t count)
+{
+	size_t res = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		if (arc.ContainsAngWithEpsilon((result[i].Pt - arc.Center).Angle()))
+			result[res++] = result[i];
+	}
+	return res;
+}
+
+
+// result should have room for lines.Count items,
+// functions return number of items written to result
+inline size_t IntersectBatch(const Line & line, const LineSpan & lines, BatchIntersection * result)
+{
+	return RunBatch(LineLinesKernel(line, lines), lines.Count, result);
+}
+
+
+// result should have room for 2 * circles.Count items
+inline size_t IntersectBatch(const Line & line, const CircleSpan & circles, BatchIntersection * result)
+{
+	return RunBatch(LineCirclesKernel(line, circles), circles.Count, result);
+}
+
+
+// result should have room for 2 * arcs.Count items
+inline size_t IntersectBatch(const Line & line, const ArcSpan & arcs, BatchIntersection * result)
+{
+	size_t count = IntersectBatch(line, arcs.GetCircles(), result);
+	return FilterBatchByArcs(arcs, result, count);
+}
+
+
+// result should have room for 2 * lines.Count items
+inline size_t IntersectBatch(const Circle & circle, const LineSpan & lines, BatchIntersection * result)
+{
+	return RunBatch(CircleLinesKernel(circle, lines), lines.Count, result);
+}
+
+
+// result should have room for 2 * circles.Count items
+inline size_t IntersectBatch(const Circle & circle, const CircleSpan & circles, BatchIntersection * result)
+{
+	return RunBatch(CircleCirclesKernel(circle, circles), circles.Count, result);
+}
+
+
+// result should have room for 2 * arcs.Count items
+inline size_t IntersectBatch(const Circle & circle, const ArcSpan & arcs, BatchIntersection * result)
+{
+	size_t count = IntersectBatch(circle, arcs.GetCircles(), result);
+	return FilterBatchByArcs(arcs, result, count);
+}
+
+
+// result should have room for 2 * lines.Count items
+inline size_t IntersectBatch(const CircleArc & arc, const LineSpan & lines, BatchIntersection * result)
+{
+	size_t count = IntersectBatch(static_cast<const Circle &>(arc), lines, result);
+	return FilterBatchByArc(arc, result, count);
+}
+
+
+// result should have room for 2 * circles.Count items
+inline size_t IntersectBatch(const CircleArc & arc, const CircleSpan & circles, BatchIntersection * result)
+{
+	size_t count = IntersectBatch(static_cast<const Circle &>(arc), circles, result);
+	return FilterBatchByArc(arc, result, count);
+}
+
+
+// result should have room for 2 * arcs.Count items
+inline size_t IntersectBatch(const CircleArc & arc, const ArcSpan & arcs, BatchIntersection * result)
+{
+	size_t count = IntersectBatch(static_cast<const Circle &>(arc), arcs, result);
+	return FilterBatchByArc(arc, result, count);
+}
+
+
+
 #endif // EXMATH_H_INCLUDED
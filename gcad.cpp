@@ -0,0 +1,899 @@
+/*
+ * gcad.cpp
+ *
+ *  Created on: 18.10.2026
+ *      Author: misha
+ */
+#include "gcad.h"
+#include "gcadfile.h"
+#include "globals.h"
+#include <process.h>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+
+
+using namespace std;
+
+
+namespace
+{
+	// blocks go before blocks which insert them
+	struct GcadBlockCollector : IConstCadObjVisitor
+	{
+		vector<const CadBlock *> Blocks;
+		set<const CadBlock *> m_seen;
+		virtual void Visit(const CadLine &) {}
+		virtual void Visit(const CadCircle &) {}
+		virtual void Visit(const CadArc &) {}
+		virtual void Visit(const CadPolyline &) {}
+		virtual void Visit(const CadInsert & obj) { AddBlock(obj.GetBlock()); }
+		void AddBlock(const CadBlock & block)
+		{
+			if (!m_seen.insert(&block).second)
+				return;
+			const vector<CadObject *> & objects = block.GetObjects();
+			for (vector<CadObject *>::const_iterator i = objects.begin(); i != objects.end(); i++)
+				(*i)->Accept(*this);
+			Blocks.push_back(&block);
+		}
+	};
+
+
+	// appends objects to arrays of their types and to objects arrays
+	struct GcadObjectWriter : IConstCadObjVisitor
+	{
+		GcadArrays & m_arrays;
+		map<const CadBlock *, uint32_t> m_blocks;
+		explicit GcadObjectWriter(GcadArrays & arrays) : m_arrays(arrays) {}
+		void AddObject(GcadObjectKind kind, size_t index)
+		{
+			m_arrays.Objects.Type.push_back(static_cast<unsigned char>(kind));
+			m_arrays.Objects.Index.push_back(static_cast<uint32_t>(index));
+		}
+		virtual void Visit(const CadLine & obj)
+		{
+			AddObject(GcadObjectLine, m_arrays.Lines.X1.size());
+			m_arrays.Lines.X1.push_back(obj.Point1.X);
+			m_arrays.Lines.Y1.push_back(obj.Point1.Y);
+			m_arrays.Lines.X2.push_back(obj.Point2.X);
+			m_arrays.Lines.Y2.push_back(obj.Point2.Y);
+		}
+		virtual void Visit(const CadCircle & obj)
+		{
+			AddObject(GcadObjectCircle, m_arrays.Circles.CX.size());
+			m_arrays.Circles.CX.push_back(obj.Center.X);
+			m_arrays.Circles.CY.push_back(obj.Center.Y);
+			m_arrays.Circles.R.push_back(obj.Radius);
+		}
+		virtual void Visit(const CadArc & obj)
+		{
+			AddObject(GcadObjectArc, m_arrays.Arcs.CX.size());
+			m_arrays.Arcs.CX.push_back(obj.Center.X);
+			m_arrays.Arcs.CY.push_back(obj.Center.Y);
+			m_arrays.Arcs.R.push_back(obj.Radius);
+			m_arrays.Arcs.SX.push_back(obj.Start.X);
+			m_arrays.Arcs.SY.push_back(obj.Start.Y);
+			m_arrays.Arcs.EX.push_back(obj.End.X);
+			m_arrays.Arcs.EY.push_back(obj.End.Y);
+			m_arrays.Arcs.Ccw.push_back(obj.Ccw);
+		}
+		virtual void Visit(const CadPolyline & obj)
+		{
+			AddObject(GcadObjectPolyline, m_arrays.Polylines.First.size());
+			m_arrays.Polylines.First.push_back(static_cast<uint32_t>(m_arrays.Nodes.X.size()));
+			m_arrays.Polylines.Count.push_back(static_cast<uint32_t>(obj.Nodes.size()));
+			m_arrays.Polylines.Closed.push_back(obj.Closed);
+			for (vector<CadPolyline::Node>::const_iterator i = obj.Nodes.begin(); i != obj.Nodes.end(); i++)
+			{
+				m_arrays.Nodes.X.push_back(i->point.X);
+				m_arrays.Nodes.Y.push_back(i->point.Y);
+				m_arrays.Nodes.Bulge.push_back(i->Bulge);
+			}
+		}
+		virtual void Visit(const CadInsert & obj)
+		{
+			map<const CadBlock *, uint32_t>::const_iterator block = m_blocks.find(&obj.GetBlock());
+			assert(block != m_blocks.end());
+			AddObject(GcadObjectInsert, m_arrays.Inserts.Block.size());
+			const Matrix3<double> & mat = obj.GetMatrix();
+			m_arrays.Inserts.Block.push_back(block->second);
+			m_arrays.Inserts.M11.push_back(mat[0][0]);
+			m_arrays.Inserts.M12.push_back(mat[0][1]);
+			m_arrays.Inserts.M13.push_back(mat[0][2]);
+			m_arrays.Inserts.M21.push_back(mat[1][0]);
+			m_arrays.Inserts.M22.push_back(mat[1][1]);
+			m_arrays.Inserts.M23.push_back(mat[1][2]);
+		}
+	};
+}
+
+
+void MakeGcadArrays(const vector<const CadObject *> & objects, GcadArrays & result, const GcadObjectSource * missing)
+{
+	GcadBlockCollector collector;
+	for (vector<const CadObject *>::const_iterator i = objects.begin(); i != objects.end(); i++)
+		(*i)->Accept(collector);
+	const size_t missingCount = missing != 0 ? missing->GetCount() : 0;
+	if (missing != 0)
+	{
+		const vector<CadBlock *> & blocks = missing->GetBlocks();
+		for (vector<CadBlock *>::const_iterator i = blocks.begin(); i != blocks.end(); i++)
+			collector.AddBlock(**i);
+	}
+	GcadObjectWriter writer(result);
+	for (vector<const CadBlock *>::const_iterator block = collector.Blocks.begin(); block != collector.Blocks.end(); block++)
+	{
+		const string & name = (*block)->GetName();
+		result.Blocks.NameOffset.push_back(static_cast<uint32_t>(result.Names.size()));
+		result.Blocks.NameSize.push_back(static_cast<uint32_t>(name.size()));
+		result.Names.insert(result.Names.end(), name.begin(), name.end());
+		result.Blocks.First.push_back(static_cast<uint32_t>(result.Objects.Type.size()));
+		const vector<CadObject *> & blockObjects = (*block)->GetObjects();
+		for (vector<CadObject *>::const_iterator i = blockObjects.begin(); i != blockObjects.end(); i++)
+			(*i)->Accept(writer);
+		result.Blocks.Count.push_back(static_cast<uint32_t>(blockObjects.size()));
+		writer.m_blocks[*block] = static_cast<uint32_t>(writer.m_blocks.size());
+	}
+	// drawing objects are written by tiles, so their geometry can be paged in by regions,
+	// missing objects are loaded one at a time, first for bounds and then for writing
+	vector<Rect<double> > bounds;
+	bounds.reserve(objects.size() + missingCount);
+	for (vector<const CadObject *>::const_iterator i = objects.begin(); i != objects.end(); i++)
+		bounds.push_back((*i)->GetBoundingRect());
+	for (size_t i = 0; i < missingCount; i++)
+		bounds.push_back(auto_ptr<CadObject>(missing->Load(i))->GetBoundingRect());
+	vector<uint32_t> order;
+	SortGcadTiles(bounds, order);
+	result.DrawingBounds.reserve(bounds.size());
+	for (vector<uint32_t>::const_iterator i = order.begin(); i != order.end(); i++)
+	{
+		if (*i < objects.size())
+			objects[*i]->Accept(writer);
+		else
+			auto_ptr<CadObject>(missing->Load(*i - objects.size()))->Accept(writer);
+		result.DrawingBounds.push_back(bounds[*i]);
+	}
+}
+
+
+namespace
+{
+	// makes objects from arrays of mapped file, references between sections
+	// are checked here because file doesn't check those on open
+	class GcadObjectLoader
+	{
+	public:
+		explicit GcadObjectLoader(const GcadFile & file);
+		~GcadObjectLoader();
+		// blocks can insert only blocks which go before them
+		void LoadBlocks();
+		CadObject * LoadObject(size_t pos, size_t blockCount) const;
+		size_t GetObjectCount() const { return m_file.GetCount(GcadSectionObjects); }
+		const vector<CadBlock *> & GetBlocks() const { return m_blocks; }
+	private:
+		GcadObjectLoader(const GcadObjectLoader &);
+		GcadObjectLoader & operator=(const GcadObjectLoader &);
+		const GcadFile & m_file;
+		vector<CadBlock *> m_blocks;
+		const unsigned char * m_types;
+		const uint32_t * m_indexes;
+		template <class T>
+		const T * Array(GcadSection section, int array) const { return m_file.GetArray<T>(section, array); }
+		void CheckIndex(GcadSection section, size_t index) const
+		{
+			if (index >= m_file.GetCount(section))
+				throw GcadError(GcadErrorInvalidFormat);
+		}
+	};
+}
+
+
+GcadObjectLoader::GcadObjectLoader(const GcadFile & file) :
+	m_file(file),
+	m_types(file.GetArray<unsigned char>(GcadSectionObjects, GcadObjectType)),
+	m_indexes(file.GetArray<uint32_t>(GcadSectionObjects, GcadObjectIndex))
+{
+}
+
+
+GcadObjectLoader::~GcadObjectLoader()
+{
+	for (vector<CadBlock *>::iterator i = m_blocks.begin(); i != m_blocks.end(); i++)
+		(*i)->Release();
+}
+
+
+void GcadObjectLoader::LoadBlocks()
+{
+	const size_t count = m_file.GetCount(GcadSectionBlocks);
+	const size_t names = m_file.GetCount(GcadSectionNames);
+	const size_t drawingFirst = m_file.GetDrawingFirst();
+	for (size_t i = 0; i < count; i++)
+	{
+		uint32_t nameOffset = Array<uint32_t>(GcadSectionBlocks, GcadBlockNameOffset)[i];
+		uint32_t nameSize = Array<uint32_t>(GcadSectionBlocks, GcadBlockNameSize)[i];
+		uint32_t first = Array<uint32_t>(GcadSectionBlocks, GcadBlockFirst)[i];
+		uint32_t objects = Array<uint32_t>(GcadSectionBlocks, GcadBlockCount)[i];
+		if (nameOffset > names || nameSize > names - nameOffset || first > drawingFirst || objects > drawingFirst - first)
+			throw GcadError(GcadErrorInvalidFormat);
+		const char * name = Array<char>(GcadSectionNames, 0) + nameOffset;
+		auto_ptr<CadBlock> block(new CadBlock(string(name, name + nameSize)));
+		for (size_t pos = first; pos < first + objects; pos++)
+			block->AddObject(LoadObject(pos, i));
+		block->AddRef();
+		m_blocks.push_back(block.release());
+	}
+}
+
+
+CadObject * GcadObjectLoader::LoadObject(size_t pos, size_t blockCount) const
+{
+	const size_t index = m_indexes[pos];
+	switch (m_types[pos])
+	{
+	case GcadObjectLine:
+		CheckIndex(GcadSectionLines, index);
+		return new CadLine(
+				Point<double>(Array<double>(GcadSectionLines, GcadLineX1)[index], Array<double>(GcadSectionLines, GcadLineY1)[index]),
+				Point<double>(Array<double>(GcadSectionLines, GcadLineX2)[index], Array<double>(GcadSectionLines, GcadLineY2)[index]));
+	case GcadObjectCircle:
+		{
+			CheckIndex(GcadSectionCircles, index);
+			auto_ptr<CadCircle> circle(new CadCircle);
+			circle->Center = Point<double>(Array<double>(GcadSectionCircles, GcadCircleX)[index],
+					Array<double>(GcadSectionCircles, GcadCircleY)[index]);
+			circle->Radius = Array<double>(GcadSectionCircles, GcadCircleR)[index];
+			return circle.release();
+		}
+	case GcadObjectArc:
+		{
+			CheckIndex(GcadSectionArcs, index);
+			Circle circle;
+			circle.Center = Point<double>(Array<double>(GcadSectionArcs, GcadArcX)[index], Array<double>(GcadSectionArcs, GcadArcY)[index]);
+			circle.Radius = Array<double>(GcadSectionArcs, GcadArcR)[index];
+			return new CadArc(circle,
+					Point<double>(Array<double>(GcadSectionArcs, GcadArcSX)[index], Array<double>(GcadSectionArcs, GcadArcSY)[index]),
+					Point<double>(Array<double>(GcadSectionArcs, GcadArcEX)[index], Array<double>(GcadSectionArcs, GcadArcEY)[index]),
+					Array<char>(GcadSectionArcs, GcadArcCcw)[index] != 0);
+		}
+	case GcadObjectPolyline:
+		{
+			CheckIndex(GcadSectionPolylines, index);
+			size_t first = Array<uint32_t>(GcadSectionPolylines, GcadPolylineFirst)[index];
+			size_t count = Array<uint32_t>(GcadSectionPolylines, GcadPolylineCount)[index];
+			size_t nodes = m_file.GetCount(GcadSectionNodes);
+			if (first > nodes || count > nodes - first)
+				throw GcadError(GcadErrorInvalidFormat);
+			const double * xs = Array<double>(GcadSectionNodes, GcadNodeX) + first;
+			const double * ys = Array<double>(GcadSectionNodes, GcadNodeY) + first;
+			const double * bulges = Array<double>(GcadSectionNodes, GcadNodeBulge) + first;
+			auto_ptr<CadPolyline> polyline(new CadPolyline);
+			polyline->Closed = Array<char>(GcadSectionPolylines, GcadPolylineClosed)[index] != 0;
+			polyline->Nodes.resize(count);
+			for (size_t i = 0; i < count; i++)
+			{
+				polyline->Nodes[i].point = Point<double>(xs[i], ys[i]);
+				polyline->Nodes[i].Bulge = bulges[i];
+			}
+			return polyline.release();
+		}
+	case GcadObjectInsert:
+		{
+			CheckIndex(GcadSectionInserts, index);
+			uint32_t block = Array<uint32_t>(GcadSectionInserts, GcadInsertBlock)[index];
+			if (block >= blockCount)
+				throw GcadError(GcadErrorInvalidFormat);
+			Matrix3<double> mat(
+					Array<double>(GcadSectionInserts, GcadInsertM11)[index],
+					Array<double>(GcadSectionInserts, GcadInsertM12)[index],
+					Array<double>(GcadSectionInserts, GcadInsertM13)[index],
+					Array<double>(GcadSectionInserts, GcadInsertM21)[index],
+					Array<double>(GcadSectionInserts, GcadInsertM22)[index],
+					Array<double>(GcadSectionInserts, GcadInsertM23)[index],
+					0, 0, 1);
+			return new CadInsert(m_blocks[block], mat);
+		}
+	default:
+		throw GcadError(GcadErrorInvalidFormat);
+	}
+}
+
+
+void LoadGcadObjects(const GcadFile & file, vector<CadObject *> & result)
+{
+	GcadObjectLoader loader(file);
+	loader.LoadBlocks();
+	const size_t blocks = file.GetCount(GcadSectionBlocks);
+	result.reserve(result.size() + loader.GetObjectCount() - file.GetDrawingFirst());
+	try
+	{
+		for (size_t pos = file.GetDrawingFirst(); pos < loader.GetObjectCount(); pos++)
+			result.push_back(loader.LoadObject(pos, blocks));
+	}
+	catch (GcadError &)
+	{
+		for (vector<CadObject *>::iterator i = result.begin(); i != result.end(); i++)
+			delete *i;
+		result.clear();
+		throw;
+	}
+}
+
+
+// tiles of paged drawing are dropped when resident objects exceed this,
+// visible tiles are loaded while they fit
+static const size_t MAX_RESIDENT_OBJECTS = 1 << 20;
+
+
+namespace
+{
+	// ranges of objects of file which aren't loaded
+	class GcadMissingObjects : public GcadObjectSource
+	{
+	public:
+		GcadMissingObjects(const GcadObjectLoader & loader, size_t blockCount) :
+			m_loader(loader), m_blockCount(blockCount), m_count(0) {}
+		void AddRange(size_t first, size_t count)
+		{
+			m_firsts.push_back(first);
+			m_starts.push_back(m_count);
+			m_count += count;
+		}
+		virtual size_t GetCount() const { return m_count; }
+		virtual CadObject * Load(size_t index) const
+		{
+			assert(index < m_count);
+			size_t range = upper_bound(m_starts.begin(), m_starts.end(), index) - m_starts.begin() - 1;
+			return m_loader.LoadObject(m_firsts[range] + index - m_starts[range], m_blockCount);
+		}
+		virtual const vector<CadBlock *> & GetBlocks() const { return m_loader.GetBlocks(); }
+	private:
+		const GcadObjectLoader & m_loader;
+		size_t m_blockCount;
+		// position in file and index in source of first object of each range
+		vector<size_t> m_firsts;
+		vector<size_t> m_starts;
+		size_t m_count;
+	};
+
+
+	// gcad file which is loaded to g_doc by tiles, tiles which intersect view or
+	// have selected objects are resident, others are dropped by least recently used
+	class GcadPager : public DocumentListener
+	{
+	public:
+		explicit GcadPager(const wchar_t * path);
+		~GcadPager();
+		// loads tiles of view and drops unused ones to keep memory bounded,
+		// neighbours of view are prefetched on background thread
+		void Update(const Rect<double> & view);
+		// draws visible objects of tiles which didn't fit in memory
+		void DrawMissing(RenderTarget & target, const Rect<double> & rect) const;
+		// objects of tiles which aren't resident
+		auto_ptr<GcadObjectSource> GetMissing() const;
+		// drops all tiles which weren't modified
+		void DropTiles();
+		virtual void OnObjectChanged(CadObject * obj);
+	private:
+		GcadPager(const GcadPager &);
+		GcadPager & operator=(const GcadPager &);
+		struct Tile
+		{
+			size_t First;
+			size_t Count;
+			Rect<double> Bounds;
+			// sorted, empty if tile is not resident
+			vector<CadObject *> Objects;
+			bool Resident;
+			// objects of tile were modified, so it can't be reloaded from file
+			bool Pinned;
+			unsigned long LastUse;
+		};
+		struct NearerTo
+		{
+			const GcadPager & m_pager;
+			Point<double> m_center;
+			NearerTo(const GcadPager & pager, const Point<double> & center) : m_pager(pager), m_center(center) {}
+			double Distance(uint32_t tile) const
+			{
+				const Rect<double> & bounds = m_pager.m_tiles[tile].Bounds;
+				return ((bounds.Pt1 + bounds.Pt2) / 2 - m_center).Length();
+			}
+			bool operator()(uint32_t lhs, uint32_t rhs) const { return Distance(lhs) < Distance(rhs); }
+		};
+		struct UsedBefore
+		{
+			const vector<Tile> & m_tiles;
+			explicit UsedBefore(const vector<Tile> & tiles) : m_tiles(tiles) {}
+			bool operator()(uint32_t lhs, uint32_t rhs) const { return m_tiles[lhs].LastUse < m_tiles[rhs].LastUse; }
+		};
+		GcadFile m_file;
+		GcadObjectLoader m_loader;
+		vector<Tile> m_tiles;
+		size_t m_resident;
+		unsigned long m_clock;
+		// set while pager removes objects itself
+		bool m_dropping;
+		// tiles to prefetch, nearest first, guarded by m_lock
+		vector<uint32_t> m_prefetch;
+		bool m_stopping;
+		CRITICAL_SECTION m_lock;
+		HANDLE m_event;
+		HANDLE m_thread;
+		void QueryTiles(const Rect<double> & rect, vector<uint32_t> & result) const;
+		void Load(Tile & tile);
+		void Drop(Tile & tile);
+		bool IsDroppable(const Tile & tile) const;
+		static unsigned __stdcall PrefetchProc(void * param);
+	};
+}
+
+
+GcadPager::GcadPager(const wchar_t * path) :
+	m_file(path), m_loader(m_file), m_resident(0), m_clock(0), m_dropping(false),
+	m_stopping(false), m_event(0), m_thread(0)
+{
+	m_loader.LoadBlocks();
+	const size_t count = m_file.GetCount(GcadSectionTiles);
+	const size_t objects = m_file.GetCount(GcadSectionObjects);
+	const size_t drawingFirst = m_file.GetDrawingFirst();
+	m_tiles.resize(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		Tile & tile = m_tiles[i];
+		tile.First = m_file.GetArray<uint32_t>(GcadSectionTiles, GcadTileFirst)[i];
+		tile.Count = m_file.GetArray<uint32_t>(GcadSectionTiles, GcadTileCount)[i];
+		if (tile.First < drawingFirst || tile.First > objects || tile.Count > objects - tile.First)
+			throw GcadError(GcadErrorInvalidFormat);
+		tile.Bounds = Rect<double>(m_file.GetArray<double>(GcadSectionTiles, GcadTileMinX)[i],
+				m_file.GetArray<double>(GcadSectionTiles, GcadTileMinY)[i],
+				m_file.GetArray<double>(GcadSectionTiles, GcadTileMaxX)[i],
+				m_file.GetArray<double>(GcadSectionTiles, GcadTileMaxY)[i]);
+		tile.Resident = false;
+		tile.Pinned = false;
+		tile.LastUse = 0;
+	}
+	InitializeCriticalSection(&m_lock);
+	m_event = CreateEventW(0, false, false, 0);
+	if (m_event == 0)
+	{
+		DeleteCriticalSection(&m_lock);
+		throw GcadError(GcadErrorReadFile);
+	}
+	m_thread = reinterpret_cast<HANDLE>(_beginthreadex(0, 0, PrefetchProc, this, 0, 0));
+	if (m_thread == 0)
+	{
+		CloseHandle(m_event);
+		DeleteCriticalSection(&m_lock);
+		throw GcadError(GcadErrorReadFile);
+	}
+	g_doc.SetListener(this);
+}
+
+
+// resident objects stay in document
+GcadPager::~GcadPager()
+{
+	// pager of next drawing is created before this one is destroyed
+	if (g_doc.GetListener() == this)
+		g_doc.SetListener(0);
+	EnterCriticalSection(&m_lock);
+	m_stopping = true;
+	LeaveCriticalSection(&m_lock);
+	if (!SetEvent(m_event))
+		assert(0);
+	if (WaitForSingleObject(m_thread, INFINITE) != WAIT_OBJECT_0)
+		assert(0);
+	CloseHandle(m_thread);
+	CloseHandle(m_event);
+	DeleteCriticalSection(&m_lock);
+}
+
+
+unsigned __stdcall GcadPager::PrefetchProc(void * param)
+{
+	GcadPager * pager = static_cast<GcadPager *>(param);
+	for (;;)
+	{
+		if (WaitForSingleObject(pager->m_event, INFINITE) != WAIT_OBJECT_0)
+			assert(0);
+		// newer requests replace older ones, so every tile is taken under lock
+		for (;;)
+		{
+			EnterCriticalSection(&pager->m_lock);
+			if (pager->m_stopping)
+			{
+				LeaveCriticalSection(&pager->m_lock);
+				return 0;
+			}
+			if (pager->m_prefetch.empty())
+			{
+				LeaveCriticalSection(&pager->m_lock);
+				break;
+			}
+			uint32_t tile = pager->m_prefetch.front();
+			pager->m_prefetch.erase(pager->m_prefetch.begin());
+			LeaveCriticalSection(&pager->m_lock);
+			// tiles don't change after opening, so those are read without lock
+			pager->m_file.Prefetch(pager->m_tiles[tile].First, pager->m_tiles[tile].Count);
+		}
+	}
+}
+
+
+void GcadPager::QueryTiles(const Rect<double> & rect, vector<uint32_t> & result) const
+{
+	result.clear();
+	for (size_t i = 0; i < m_tiles.size(); i++)
+	{
+		if (IsRectsIntersects(m_tiles[i].Bounds, rect))
+			result.push_back(static_cast<uint32_t>(i));
+	}
+}
+
+
+void GcadPager::Load(Tile & tile)
+{
+	assert(!tile.Resident);
+	tile.Objects.reserve(tile.Count);
+	try
+	{
+		for (size_t pos = tile.First; pos < tile.First + tile.Count; pos++)
+			tile.Objects.push_back(m_loader.LoadObject(pos, m_file.GetCount(GcadSectionBlocks)));
+	}
+	catch (GcadError &)
+	{
+		for (vector<CadObject *>::iterator i = tile.Objects.begin(); i != tile.Objects.end(); i++)
+			delete *i;
+		tile.Objects.clear();
+		throw;
+	}
+	for (vector<CadObject *>::iterator i = tile.Objects.begin(); i != tile.Objects.end(); i++)
+		g_doc.Add(*i);
+	sort(tile.Objects.begin(), tile.Objects.end());
+	tile.Resident = true;
+	m_resident += tile.Count;
+}
+
+
+void GcadPager::Drop(Tile & tile)
+{
+	assert(IsDroppable(tile));
+	m_dropping = true;
+	g_doc.Remove(tile.Objects);
+	m_dropping = false;
+	for (vector<CadObject *>::iterator i = tile.Objects.begin(); i != tile.Objects.end(); i++)
+		delete *i;
+	vector<CadObject *>().swap(tile.Objects);
+	tile.Resident = false;
+	m_resident -= tile.Count;
+}
+
+
+bool GcadPager::IsDroppable(const Tile & tile) const
+{
+	if (!tile.Resident || tile.Pinned)
+		return false;
+	for (vector<CadObject *>::const_iterator i = tile.Objects.begin(); i != tile.Objects.end(); i++)
+	{
+		if (IsSelected(*i))
+			return false;
+	}
+	return true;
+}
+
+
+void GcadPager::Update(const Rect<double> & view)
+{
+	m_clock++;
+	const Point<double> center = (view.Pt1 + view.Pt2) / 2;
+	vector<uint32_t> visible;
+	QueryTiles(view, visible);
+	sort(visible.begin(), visible.end(), NearerTo(*this, center));
+	size_t needed = 0;
+	for (vector<uint32_t>::const_iterator i = visible.begin(); i != visible.end(); i++)
+	{
+		m_tiles[*i].LastUse = m_clock;
+		if (!m_tiles[*i].Resident)
+			needed += m_tiles[*i].Count;
+	}
+
+	// tools other than default one can hold objects which aren't selected
+	if (m_resident + needed > MAX_RESIDENT_OBJECTS && g_curTool == &g_defaultTool)
+	{
+		vector<uint32_t> unused;
+		for (size_t i = 0; i < m_tiles.size(); i++)
+		{
+			if (m_tiles[i].LastUse != m_clock && IsDroppable(m_tiles[i]))
+				unused.push_back(static_cast<uint32_t>(i));
+		}
+		sort(unused.begin(), unused.end(), UsedBefore(m_tiles));
+		g_doc.BeginUpdate();
+		for (vector<uint32_t>::const_iterator i = unused.begin(); i != unused.end() && m_resident + needed > MAX_RESIDENT_OBJECTS; i++)
+			Drop(m_tiles[*i]);
+		g_doc.EndUpdate();
+	}
+
+	g_doc.BeginUpdate();
+	try
+	{
+		for (vector<uint32_t>::const_iterator i = visible.begin(); i != visible.end(); i++)
+		{
+			Tile & tile = m_tiles[*i];
+			if (tile.Resident)
+				continue;
+			// at least nearest tile is loaded, others are drawn by DrawMissing
+			if (m_resident != 0 && m_resident + tile.Count > MAX_RESIDENT_OBJECTS)
+				break;
+			Load(tile);
+		}
+	}
+	catch (GcadError &)
+	{
+		g_doc.EndUpdate();
+		throw;
+	}
+	g_doc.EndUpdate();
+
+	// neighbours are tiles which come into view by panning on one view size
+	// or by zooming out three times
+	Point<double> size = view.Pt2 - view.Pt1;
+	vector<uint32_t> neighbours;
+	QueryTiles(Rect<double>(view.Pt1 - size, view.Pt2 + size), neighbours);
+	sort(neighbours.begin(), neighbours.end(), NearerTo(*this, center));
+	vector<uint32_t> prefetch;
+	for (vector<uint32_t>::const_iterator i = neighbours.begin(); i != neighbours.end(); i++)
+	{
+		if (!m_tiles[*i].Resident)
+			prefetch.push_back(*i);
+	}
+	EnterCriticalSection(&m_lock);
+	m_prefetch.swap(prefetch);
+	LeaveCriticalSection(&m_lock);
+	if (!m_prefetch.empty() && !SetEvent(m_event))
+		assert(0);
+}
+
+
+void GcadPager::DrawMissing(RenderTarget & output, const Rect<double> & rect) const
+{
+	BatchRenderTarget target(output);
+	target.SetClip(rect);
+	vector<uint32_t> visible;
+	QueryTiles(rect, visible);
+	for (vector<uint32_t>::const_iterator i = visible.begin(); i != visible.end(); i++)
+	{
+		const Tile & tile = m_tiles[*i];
+		if (tile.Resident)
+			continue;
+		for (size_t pos = tile.First; pos < tile.First + tile.Count; pos++)
+		{
+			auto_ptr<CadObject> obj(m_loader.LoadObject(pos, m_file.GetCount(GcadSectionBlocks)));
+			if (IsRectsIntersects(obj->GetBoundingRect(), rect))
+				obj->Draw(target, false);
+		}
+	}
+	target.Flush();
+}
+
+
+auto_ptr<GcadObjectSource> GcadPager::GetMissing() const
+{
+	auto_ptr<GcadMissingObjects> result(new GcadMissingObjects(m_loader, m_file.GetCount(GcadSectionBlocks)));
+	for (vector<Tile>::const_iterator tile = m_tiles.begin(); tile != m_tiles.end(); tile++)
+	{
+		if (!tile->Resident)
+			result->AddRange(tile->First, tile->Count);
+	}
+	return auto_ptr<GcadObjectSource>(result);
+}
+
+
+void GcadPager::DropTiles()
+{
+	g_doc.BeginUpdate();
+	for (vector<Tile>::iterator i = m_tiles.begin(); i != m_tiles.end(); i++)
+	{
+		if (i->Resident && !i->Pinned)
+		{
+			// objects can't stay selected after those are deleted
+			g_selected.remove(i->Objects);
+			Drop(*i);
+		}
+	}
+	g_doc.EndUpdate();
+}
+
+
+void GcadPager::OnObjectChanged(CadObject * obj)
+{
+	if (m_dropping)
+		return;
+	for (vector<Tile>::iterator i = m_tiles.begin(); i != m_tiles.end(); i++)
+	{
+		if (i->Resident && !i->Pinned && binary_search(i->Objects.begin(), i->Objects.end(), obj))
+		{
+			i->Pinned = true;
+			return;
+		}
+	}
+}
+
+
+static auto_ptr<GcadPager> g_gcadPager;
+
+
+// objects are checked when tiles are loaded, so damaged file
+// is found out only while drawing
+static void OnGcadPageError()
+{
+	g_console.Log(L"Paged drawing has invalid format, it is closed");
+	g_gcadPager.reset();
+}
+
+
+void UpdateGcadPages()
+{
+	if (g_gcadPager.get() == 0)
+		return;
+	Point<float> viewMin = ScreenToWorld(0, g_viewHeight);
+	Point<float> viewMax = ScreenToWorld(g_viewWidth, 0);
+	try
+	{
+		g_gcadPager->Update(Rect<double>(viewMin.X, viewMin.Y, viewMax.X, viewMax.Y));
+	}
+	catch (GcadError &)
+	{
+		OnGcadPageError();
+	}
+}
+
+
+void DrawGcadPages(RenderTarget & target, const Rect<double> & rect)
+{
+	if (g_gcadPager.get() == 0)
+		return;
+	try
+	{
+		g_gcadPager->DrawMissing(target, rect);
+	}
+	catch (GcadError &)
+	{
+		OnGcadPageError();
+	}
+}
+
+
+auto_ptr<GcadObjectSource> GetMissingGcadPages()
+{
+	if (g_gcadPager.get() == 0)
+		return auto_ptr<GcadObjectSource>();
+	return g_gcadPager->GetMissing();
+}
+
+
+void CloseGcadPages()
+{
+	g_gcadPager.reset();
+}
+
+
+static wstring GetGcadErrorMessage(GcadErrorCode code, const wchar_t * path)
+{
+	switch (code)
+	{
+	case GcadErrorOpenFile:
+		return wstring(L"Error opening file: ") + path;
+	case GcadErrorReadFile:
+		return wstring(L"Error reading file: ") + path;
+	case GcadErrorWriteFile:
+		return wstring(L"Error writing file: ") + path;
+	case GcadErrorInvalidFormat:
+		return L"File has invalid format";
+	case GcadErrorVersion:
+		return L"File is written by newer version of program";
+	default:
+		assert(0);
+		return wstring();
+	}
+}
+
+
+static bool ShowGcadFileDialog(HWND hwnd, bool save, wchar_t * fileBuf, DWORD size)
+{
+	OPENFILENAMEW ofn = {0};
+	ofn.lStructSize = sizeof(ofn);
+	ofn.hwndOwner = hwnd;
+	ofn.lpstrFilter = L"GCad Files\0*.gcad\0All files\0*.*\0\0";
+	ofn.lpstrFile = fileBuf;
+	ofn.nMaxFile = size;
+	ofn.lpstrDefExt = L"gcad";
+	BOOL ok;
+	if (save)
+	{
+		ofn.lpstrTitle = L"Save";
+		ofn.Flags = OFN_PATHMUSTEXIST | OFN_OVERWRITEPROMPT;
+		ok = GetSaveFileNameW(&ofn);
+	}
+	else
+	{
+		ofn.lpstrTitle = L"Open";
+		ofn.Flags = OFN_FILEMUSTEXIST | OFN_PATHMUSTEXIST;
+		ok = GetOpenFileNameW(&ofn);
+	}
+	if (!ok && CommDlgExtendedError() != 0)
+		assert(0);
+	return ok != 0;
+}
+
+
+void OpenGcad(HWND hwnd)
+{
+	wchar_t fileBuf[MAX_PATH] = {0};
+	if (!ShowGcadFileDialog(hwnd, false, fileBuf, sizeof(fileBuf)/sizeof(fileBuf[0])))
+		return;
+	try
+	{
+		GcadFile file(fileBuf);
+		vector<CadObject *> objects;
+		LoadGcadObjects(file, objects);
+		vector<ObjectHandle> handles;
+		g_doc.Add(objects, handles);
+		g_undoManager.AddWork(new AddObjectsUndoItem(objects, true));
+		InvalidateRect(g_hclientWindow, 0, true);
+	}
+	catch (GcadError & err)
+	{
+		if (MessageBoxW(hwnd, GetGcadErrorMessage(err.Code, fileBuf).c_str(), 0, MB_ICONERROR) == 0)
+			assert(0);
+	}
+}
+
+
+void OpenGcadPaged(HWND hwnd)
+{
+	wchar_t fileBuf[MAX_PATH] = {0};
+	if (!ShowGcadFileDialog(hwnd, false, fileBuf, sizeof(fileBuf)/sizeof(fileBuf[0])))
+		return;
+	try
+	{
+		auto_ptr<GcadPager> pager(new GcadPager(fileBuf));
+		if (g_gcadPager.get() != 0)
+		{
+			// current tool can refer to objects of dropped tiles
+			Cancel();
+			g_gcadPager->DropTiles();
+		}
+		g_gcadPager = pager;
+		InvalidateRect(g_hclientWindow, 0, true);
+	}
+	catch (GcadError & err)
+	{
+		if (MessageBoxW(hwnd, GetGcadErrorMessage(err.Code, fileBuf).c_str(), 0, MB_ICONERROR) == 0)
+			assert(0);
+	}
+}
+
+
+void SaveGcad(HWND hwnd)
+{
+	wchar_t fileBuf[MAX_PATH] = {0};
+	if (!ShowGcadFileDialog(hwnd, true, fileBuf, sizeof(fileBuf)/sizeof(fileBuf[0])))
+		return;
+	try
+	{
+		// objects of paged drawing which aren't loaded are written too
+		auto_ptr<GcadObjectSource> missing = GetMissingGcadPages();
+		vector<const CadObject *> objects(g_doc.Objects.begin(), g_doc.Objects.end());
+		GcadArrays arrays;
+		MakeGcadArrays(objects, arrays, missing.get());
+		WriteGcadFile(fileBuf, arrays);
+	}
+	catch (GcadError & err)
+	{
+		if (MessageBoxW(hwnd, GetGcadErrorMessage(err.Code, fileBuf).c_str(), 0, MB_ICONERROR) == 0)
+			assert(0);
+	}
+}
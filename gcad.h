@@ -0,0 +1,64 @@
+/*
+ * gcad.h
+ *
+ *  Created on: 18.10.2026
+ *      Author: misha
+ */
+
+#ifndef GCAD_H_
+#define GCAD_H_
+
+
+#include "exmath.h"
+#include <windows.h>
+#include <memory>
+#include <vector>
+
+
+class Document;
+class CadObject;
+class CadBlock;
+class GcadFile;
+class RenderTarget;
+struct GcadArrays;
+
+
+// shows file dialog and adds objects of gcad file to g_doc as one undo step
+void OpenGcad(HWND hwnd);
+// shows file dialog and opens gcad file as paged drawing, only tiles near view
+// are loaded to g_doc, previous paged drawing is closed
+void OpenGcadPaged(HWND hwnd);
+// shows file dialog and writes all objects of g_doc into gcad file
+void SaveGcad(HWND hwnd);
+// loads and drops tiles of paged drawing for current view,
+// should be called before drawing
+void UpdateGcadPages();
+// draws objects of paged drawing which don't fit in memory
+void DrawGcadPages(RenderTarget & target, const Rect<double> & rect);
+// drawing objects which aren't kept in memory, writers load them one at a time
+// so writing large drawing doesn't need memory for all of its objects
+class GcadObjectSource
+{
+public:
+	virtual ~GcadObjectSource() {}
+	virtual size_t GetCount() const = 0;
+	// object should be deleted by caller, throws GcadError
+	virtual CadObject * Load(size_t index) const = 0;
+	// blocks which loaded inserts can refer to
+	virtual const std::vector<CadBlock *> & GetBlocks() const = 0;
+};
+// objects of paged drawing which aren't in g_doc, 0 if there is no paged drawing,
+// source is valid until pages are updated or closed
+std::auto_ptr<GcadObjectSource> GetMissingGcadPages();
+// stops prefetching, loaded objects stay in g_doc
+void CloseGcadPages();
+// converts objects and objects of missing to arrays of file, blocks of inserts
+// are written once, drawing objects are reordered by tiles
+void MakeGcadArrays(const std::vector<const CadObject *> & objects, GcadArrays & result,
+		const GcadObjectSource * missing = 0);
+// creates drawing objects of file, those should be deleted by caller,
+// throws GcadError if file refers to missing items
+void LoadGcadObjects(const GcadFile & file, std::vector<CadObject *> & result);
+
+
+#endif /* GCAD_H_ */
@@ -0,0 +1,699 @@
+/*
+ * gcadfile.cpp
+ *
+ *  Created on: 18.10.2026
+ *      Author: misha
+ */
+#include "gcadfile.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+
+
+using namespace std;
+
+
+static const char GCAD_MAGIC[8] = {'G', 'C', 'A', 'D', '\r', '\n', '\x1a', 0};
+// sections start at cache line
+static const size_t GCAD_SECTION_ALIGN = 64;
+
+
+namespace
+{
+	struct SectionLayout
+	{
+		int ArrayCount;
+		size_t ElementSizes[8];
+	};
+}
+
+
+// indexed by GcadSection
+static const SectionLayout g_layouts[GcadSectionCount] =
+{
+	{0, {0}},
+	{4, {8, 8, 8, 8}},
+	{3, {8, 8, 8}},
+	{8, {8, 8, 8, 8, 8, 8, 8, 1}},
+	{3, {4, 4, 1}},
+	{3, {8, 8, 8}},
+	{7, {4, 8, 8, 8, 8, 8, 8}},
+	{2, {1, 4}},
+	{4, {4, 4, 4, 4}},
+	{1, {1}},
+	{1, {sizeof(GcadIndexNode)}},
+	{6, {4, 4, 8, 8, 8, 8}},
+};
+
+
+static size_t Align(size_t size, size_t align)
+{
+	return (size + align - 1) / align * align;
+}
+
+
+size_t GcadFile::GetElementSize(GcadSection section, int array)
+{
+	assert(section > 0 && section < GcadSectionCount);
+	assert(array >= 0 && array < g_layouts[section].ArrayCount);
+	return g_layouts[section].ElementSizes[array];
+}
+
+
+// sorts entries into tiles of Sort-Tile-Recursive packing, same as RTree::BulkLoad
+namespace
+{
+	typedef pair<Rect<double>, uint32_t> IndexEntry;
+
+	struct CenterXLess
+	{
+		bool operator()(const IndexEntry & lhs, const IndexEntry & rhs) const
+		{
+			return lhs.first.Pt1.X + lhs.first.Pt2.X < rhs.first.Pt1.X + rhs.first.Pt2.X;
+		}
+	};
+
+	struct CenterYLess
+	{
+		bool operator()(const IndexEntry & lhs, const IndexEntry & rhs) const
+		{
+			return lhs.first.Pt1.Y + lhs.first.Pt2.Y < rhs.first.Pt1.Y + rhs.first.Pt2.Y;
+		}
+	};
+}
+
+
+static void SortTiles(vector<IndexEntry> & entries, size_t maxEntries)
+{
+	size_t pages = (entries.size() + maxEntries - 1) / maxEntries;
+	size_t slices = static_cast<size_t>(ceil(sqrt(static_cast<double>(pages))));
+	size_t sliceSize = slices * maxEntries;
+	sort(entries.begin(), entries.end(), CenterXLess());
+	for (size_t i = 0; i < entries.size(); i += sliceSize)
+		sort(entries.begin() + i, entries.begin() + min(i + sliceSize, entries.size()), CenterYLess());
+}
+
+
+// levels are packed bottom up, so children go before parents and root is last
+static void BuildIndex(const vector<Rect<double> > & bounds, uint32_t first, vector<GcadIndexNode> & nodes)
+{
+	nodes.clear();
+	if (bounds.empty())
+		return;
+	vector<IndexEntry> level(bounds.size());
+	for (size_t i = 0; i < bounds.size(); i++)
+		level[i] = IndexEntry(bounds[i], first + static_cast<uint32_t>(i));
+	bool leaf = true;
+	for (;;)
+	{
+		SortTiles(level, GcadIndexNode::MAX_ENTRIES);
+		vector<IndexEntry> upper;
+		for (size_t i = 0; i < level.size(); i += GcadIndexNode::MAX_ENTRIES)
+		{
+			GcadIndexNode node;
+			memset(&node, 0, sizeof(node));
+			node.Leaf = leaf;
+			Rect<double> nodeBounds = level[i].first;
+			for (size_t j = i; j < level.size() && j < i + GcadIndexNode::MAX_ENTRIES; j++)
+			{
+				const Rect<double> & rect = level[j].first;
+				node.MinX[node.Count] = rect.Pt1.X;
+				node.MinY[node.Count] = rect.Pt1.Y;
+				node.MaxX[node.Count] = rect.Pt2.X;
+				node.MaxY[node.Count] = rect.Pt2.Y;
+				node.Child[node.Count] = level[j].second;
+				node.Count++;
+				nodeBounds = GetBoundingRect(nodeBounds, rect);
+			}
+			upper.push_back(IndexEntry(nodeBounds, static_cast<uint32_t>(nodes.size())));
+			nodes.push_back(node);
+		}
+		if (upper.size() == 1)
+			break;
+		level.swap(upper);
+		leaf = false;
+	}
+}
+
+
+void SortGcadTiles(const vector<Rect<double> > & bounds, vector<uint32_t> & order)
+{
+	vector<IndexEntry> entries(bounds.size());
+	for (size_t i = 0; i < bounds.size(); i++)
+		entries[i] = IndexEntry(bounds[i], static_cast<uint32_t>(i));
+	SortTiles(entries, GCAD_TILE_SIZE);
+	order.resize(entries.size());
+	for (size_t i = 0; i < entries.size(); i++)
+		order[i] = entries[i].second;
+}
+
+
+namespace
+{
+	// section which is written from arrays of writer
+	struct SectionData
+	{
+		GcadSection Type;
+		size_t Count;
+		const void * Arrays[8];
+	};
+
+
+	// made by writer from bounds of drawing objects
+	struct TileArrays
+	{
+		vector<uint32_t> First, Count;
+		vector<double> MinX, MinY, MaxX, MaxY;
+	};
+
+
+	class GcadOutput
+	{
+	public:
+#ifdef _WIN32
+		explicit GcadOutput(const wchar_t * path) : m_file(_wfopen(path, L"wb"))
+#else
+		explicit GcadOutput(const char * path) : m_file(fopen(path, "wb"))
+#endif
+		{
+			if (m_file == 0)
+				throw GcadError(GcadErrorOpenFile);
+			setvbuf(m_file, 0, _IOFBF, 1 << 20);
+		}
+		~GcadOutput()
+		{
+			if (m_file != 0)
+				fclose(m_file);
+		}
+		void Write(const void * data, size_t size)
+		{
+			if (size != 0 && fwrite(data, 1, size, m_file) != size)
+				throw GcadError(GcadErrorWriteFile);
+		}
+		void Pad(size_t size)
+		{
+			static const char zeros[GCAD_SECTION_ALIGN] = {0};
+			assert(size <= sizeof(zeros));
+			Write(zeros, size);
+		}
+		void Close()
+		{
+			FILE * file = m_file;
+			m_file = 0;
+			if (fclose(file) != 0)
+				throw GcadError(GcadErrorWriteFile);
+		}
+	private:
+		GcadOutput(const GcadOutput &);
+		GcadOutput & operator=(const GcadOutput &);
+		FILE * m_file;
+	};
+
+
+	class GcadMemoryOutput
+	{
+	public:
+		explicit GcadMemoryOutput(vector<char> & result) : m_result(result) {}
+		void Write(const void * data, size_t size)
+		{
+			const char * begin = static_cast<const char *>(data);
+			m_result.insert(m_result.end(), begin, begin + size);
+		}
+		void Pad(size_t size) { m_result.resize(m_result.size() + size); }
+		void Close() {}
+	private:
+		GcadMemoryOutput(const GcadMemoryOutput &);
+		GcadMemoryOutput & operator=(const GcadMemoryOutput &);
+		vector<char> & m_result;
+	};
+}
+
+
+template <class T>
+static const void * ArrayData(const vector<T> & vec, size_t count)
+{
+	assert(vec.size() == count);
+	return vec.empty() ? 0 : &vec[0];
+}
+
+
+static size_t GetSectionSize(GcadSection type, size_t count)
+{
+	size_t result = 0;
+	for (int i = 0; i < g_layouts[type].ArrayCount; i++)
+		result += Align(count * g_layouts[type].ElementSizes[i], 8);
+	return result;
+}
+
+
+template <class Output>
+static void WriteGcad(const GcadArrays & arrays, Output & output)
+{
+	const size_t objectCount = arrays.Objects.Type.size();
+	assert(arrays.DrawingBounds.size() <= objectCount);
+	uint32_t drawingFirst = static_cast<uint32_t>(objectCount - arrays.DrawingBounds.size());
+	vector<GcadIndexNode> index;
+	BuildIndex(arrays.DrawingBounds, drawingFirst, index);
+	// drawing objects are expected in order of SortGcadTiles,
+	// otherwise tiles are still valid but overlap each other
+	TileArrays tiles;
+	for (size_t i = 0; i < arrays.DrawingBounds.size(); i += GCAD_TILE_SIZE)
+	{
+		size_t end = min(i + GCAD_TILE_SIZE, arrays.DrawingBounds.size());
+		Rect<double> bounds = arrays.DrawingBounds[i];
+		for (size_t j = i + 1; j < end; j++)
+			bounds = GetBoundingRect(bounds, arrays.DrawingBounds[j]);
+		tiles.First.push_back(drawingFirst + static_cast<uint32_t>(i));
+		tiles.Count.push_back(static_cast<uint32_t>(end - i));
+		tiles.MinX.push_back(bounds.Pt1.X);
+		tiles.MinY.push_back(bounds.Pt1.Y);
+		tiles.MaxX.push_back(bounds.Pt2.X);
+		tiles.MaxY.push_back(bounds.Pt2.Y);
+	}
+
+	vector<SectionData> sections;
+	SectionData section;
+	memset(&section, 0, sizeof(section));
+
+	section.Type = GcadSectionLines;
+	section.Count = arrays.Lines.X1.size();
+	section.Arrays[GcadLineX1] = ArrayData(arrays.Lines.X1, section.Count);
+	section.Arrays[GcadLineY1] = ArrayData(arrays.Lines.Y1, section.Count);
+	section.Arrays[GcadLineX2] = ArrayData(arrays.Lines.X2, section.Count);
+	section.Arrays[GcadLineY2] = ArrayData(arrays.Lines.Y2, section.Count);
+	sections.push_back(section);
+
+	section.Type = GcadSectionCircles;
+	section.Count = arrays.Circles.CX.size();
+	section.Arrays[GcadCircleX] = ArrayData(arrays.Circles.CX, section.Count);
+	section.Arrays[GcadCircleY] = ArrayData(arrays.Circles.CY, section.Count);
+	section.Arrays[GcadCircleR] = ArrayData(arrays.Circles.R, section.Count);
+	sections.push_back(section);
+
+	section.Type = GcadSectionArcs;
+	section.Count = arrays.Arcs.CX.size();
+	section.Arrays[GcadArcX] = ArrayData(arrays.Arcs.CX, section.Count);
+	section.Arrays[GcadArcY] = ArrayData(arrays.Arcs.CY, section.Count);
+	section.Arrays[GcadArcR] = ArrayData(arrays.Arcs.R, section.Count);
+	section.Arrays[GcadArcSX] = ArrayData(arrays.Arcs.SX, section.Count);
+	section.Arrays[GcadArcSY] = ArrayData(arrays.Arcs.SY, section.Count);
+	section.Arrays[GcadArcEX] = ArrayData(arrays.Arcs.EX, section.Count);
+	section.Arrays[GcadArcEY] = ArrayData(arrays.Arcs.EY, section.Count);
+	section.Arrays[GcadArcCcw] = ArrayData(arrays.Arcs.Ccw, section.Count);
+	sections.push_back(section);
+
+	section.Type = GcadSectionPolylines;
+	section.Count = arrays.Polylines.First.size();
+	section.Arrays[GcadPolylineFirst] = ArrayData(arrays.Polylines.First, section.Count);
+	section.Arrays[GcadPolylineCount] = ArrayData(arrays.Polylines.Count, section.Count);
+	section.Arrays[GcadPolylineClosed] = ArrayData(arrays.Polylines.Closed, section.Count);
+	sections.push_back(section);
+
+	section.Type = GcadSectionNodes;
+	section.Count = arrays.Nodes.X.size();
+	section.Arrays[GcadNodeX] = ArrayData(arrays.Nodes.X, section.Count);
+	section.Arrays[GcadNodeY] = ArrayData(arrays.Nodes.Y, section.Count);
+	section.Arrays[GcadNodeBulge] = ArrayData(arrays.Nodes.Bulge, section.Count);
+	sections.push_back(section);
+
+	section.Type = GcadSectionInserts;
+	section.Count = arrays.Inserts.Block.size();
+	section.Arrays[GcadInsertBlock] = ArrayData(arrays.Inserts.Block, section.Count);
+	section.Arrays[GcadInsertM11] = ArrayData(arrays.Inserts.M11, section.Count);
+	section.Arrays[GcadInsertM12] = ArrayData(arrays.Inserts.M12, section.Count);
+	section.Arrays[GcadInsertM13] = ArrayData(arrays.Inserts.M13, section.Count);
+	section.Arrays[GcadInsertM21] = ArrayData(arrays.Inserts.M21, section.Count);
+	section.Arrays[GcadInsertM22] = ArrayData(arrays.Inserts.M22, section.Count);
+	section.Arrays[GcadInsertM23] = ArrayData(arrays.Inserts.M23, section.Count);
+	sections.push_back(section);
+
+	section.Type = GcadSectionObjects;
+	section.Count = objectCount;
+	section.Arrays[GcadObjectType] = ArrayData(arrays.Objects.Type, section.Count);
+	section.Arrays[GcadObjectIndex] = ArrayData(arrays.Objects.Index, section.Count);
+	sections.push_back(section);
+
+	section.Type = GcadSectionBlocks;
+	section.Count = arrays.Blocks.First.size();
+	section.Arrays[GcadBlockNameOffset] = ArrayData(arrays.Blocks.NameOffset, section.Count);
+	section.Arrays[GcadBlockNameSize] = ArrayData(arrays.Blocks.NameSize, section.Count);
+	section.Arrays[GcadBlockFirst] = ArrayData(arrays.Blocks.First, section.Count);
+	section.Arrays[GcadBlockCount] = ArrayData(arrays.Blocks.Count, section.Count);
+	sections.push_back(section);
+
+	section.Type = GcadSectionNames;
+	section.Count = arrays.Names.size();
+	section.Arrays[0] = ArrayData(arrays.Names, section.Count);
+	sections.push_back(section);
+
+	section.Type = GcadSectionIndex;
+	section.Count = index.size();
+	section.Arrays[0] = ArrayData(index, section.Count);
+	sections.push_back(section);
+
+	section.Type = GcadSectionTiles;
+	section.Count = tiles.First.size();
+	section.Arrays[GcadTileFirst] = ArrayData(tiles.First, section.Count);
+	section.Arrays[GcadTileCount] = ArrayData(tiles.Count, section.Count);
+	section.Arrays[GcadTileMinX] = ArrayData(tiles.MinX, section.Count);
+	section.Arrays[GcadTileMinY] = ArrayData(tiles.MinY, section.Count);
+	section.Arrays[GcadTileMaxX] = ArrayData(tiles.MaxX, section.Count);
+	section.Arrays[GcadTileMaxY] = ArrayData(tiles.MaxY, section.Count);
+	sections.push_back(section);
+
+	GcadHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.Magic, GCAD_MAGIC, sizeof(header.Magic));
+	header.Version = GCAD_VERSION;
+	header.ByteOrder = GCAD_BYTE_ORDER;
+	header.SectionCount = static_cast<uint32_t>(sections.size());
+	header.DrawingFirst = drawingFirst;
+	if (!arrays.DrawingBounds.empty())
+	{
+		Rect<double> bounds = arrays.DrawingBounds.front();
+		for (size_t i = 1; i < arrays.DrawingBounds.size(); i++)
+			bounds = GetBoundingRect(bounds, arrays.DrawingBounds[i]);
+		header.Bounds[0] = bounds.Pt1.X;
+		header.Bounds[1] = bounds.Pt1.Y;
+		header.Bounds[2] = bounds.Pt2.X;
+		header.Bounds[3] = bounds.Pt2.Y;
+	}
+
+	vector<GcadSectionEntry> table(sections.size());
+	size_t offset = Align(sizeof(header) + table.size() * sizeof(GcadSectionEntry), GCAD_SECTION_ALIGN);
+	for (size_t i = 0; i < sections.size(); i++)
+	{
+		memset(&table[i], 0, sizeof(table[i]));
+		table[i].Type = sections[i].Type;
+		table[i].Offset = offset;
+		table[i].Count = sections[i].Count;
+		table[i].Size = GetSectionSize(sections[i].Type, sections[i].Count);
+		offset = Align(offset + static_cast<size_t>(table[i].Size), GCAD_SECTION_ALIGN);
+	}
+
+	output.Write(&header, sizeof(header));
+	output.Write(&table[0], table.size() * sizeof(GcadSectionEntry));
+	size_t pos = sizeof(header) + table.size() * sizeof(GcadSectionEntry);
+	for (size_t i = 0; i < sections.size(); i++)
+	{
+		output.Pad(static_cast<size_t>(table[i].Offset) - pos);
+		pos = static_cast<size_t>(table[i].Offset);
+		const SectionLayout & layout = g_layouts[sections[i].Type];
+		for (int j = 0; j < layout.ArrayCount; j++)
+		{
+			size_t size = sections[i].Count * layout.ElementSizes[j];
+			output.Write(sections[i].Arrays[j], size);
+			output.Pad(Align(size, 8) - size);
+			pos += Align(size, 8);
+		}
+	}
+	output.Close();
+}
+
+
+#ifdef _WIN32
+void WriteGcadFile(const wchar_t * path, const GcadArrays & arrays)
+#else
+void WriteGcadFile(const char * path, const GcadArrays & arrays)
+#endif
+{
+	GcadOutput output(path);
+	WriteGcad(arrays, output);
+}
+
+
+void WriteGcadMemory(const GcadArrays & arrays, vector<char> & result)
+{
+	result.clear();
+	GcadMemoryOutput output(result);
+	WriteGcad(arrays, output);
+}
+
+
+static void SwapBytes(char * data, size_t elementSize, size_t count)
+{
+	for (size_t i = 0; i < count; i++, data += elementSize)
+		reverse(data, data + elementSize);
+}
+
+
+static void SwapHeader(GcadHeader & header)
+{
+	SwapBytes(reinterpret_cast<char *>(&header.Version), 4, 4);
+	SwapBytes(reinterpret_cast<char *>(header.Bounds), 8, 4);
+}
+
+
+static void SwapSectionEntry(GcadSectionEntry & entry)
+{
+	SwapBytes(reinterpret_cast<char *>(&entry.Type), 4, 2);
+	SwapBytes(reinterpret_cast<char *>(&entry.Offset), 8, 3);
+}
+
+
+void SwapGcadImage(char * image, size_t size)
+{
+	if (size < sizeof(GcadHeader) || reinterpret_cast<size_t>(image) % 8 != 0)
+		throw GcadError(GcadErrorInvalidFormat);
+	GcadHeader & header = *reinterpret_cast<GcadHeader *>(image);
+	if (memcmp(header.Magic, GCAD_MAGIC, sizeof(GCAD_MAGIC)) != 0)
+		throw GcadError(GcadErrorInvalidFormat);
+	// structure is read in native order, so foreign header is swapped first
+	bool native = header.ByteOrder == GCAD_BYTE_ORDER;
+	if (!native)
+		SwapHeader(header);
+	if (header.ByteOrder != GCAD_BYTE_ORDER)
+		throw GcadError(GcadErrorInvalidFormat);
+	uint32_t sectionCount = header.SectionCount;
+	if (sectionCount > (size - sizeof(GcadHeader)) / sizeof(GcadSectionEntry))
+		throw GcadError(GcadErrorInvalidFormat);
+	GcadSectionEntry * table = reinterpret_cast<GcadSectionEntry *>(image + sizeof(GcadHeader));
+	for (uint32_t i = 0; i < sectionCount; i++)
+	{
+		GcadSectionEntry & entry = table[i];
+		if (!native)
+			SwapSectionEntry(entry);
+		if (entry.Type == 0 || entry.Type >= GcadSectionCount)
+			throw GcadError(GcadErrorInvalidFormat);
+		if (entry.Offset % 8 != 0 || entry.Offset > size || entry.Size > size - entry.Offset)
+			throw GcadError(GcadErrorInvalidFormat);
+		const SectionLayout & layout = g_layouts[entry.Type];
+		size_t count = static_cast<size_t>(entry.Count);
+		char * pos = image + static_cast<size_t>(entry.Offset);
+		// arrays are checked same as in GcadFile::Validate before anything is swapped,
+		// after that sizes of arrays can't overflow
+		const char * check = pos;
+		const char * end = pos + static_cast<size_t>(entry.Size);
+		for (int j = 0; j < layout.ArrayCount; j++)
+		{
+			if (entry.Count > static_cast<uint64_t>(end - check) / layout.ElementSizes[j])
+				throw GcadError(GcadErrorInvalidFormat);
+			check += min(Align(count * layout.ElementSizes[j], 8), static_cast<size_t>(end - check));
+		}
+		if (entry.Size != GetSectionSize(static_cast<GcadSection>(entry.Type), count))
+			throw GcadError(GcadErrorInvalidFormat);
+		for (int j = 0; j < layout.ArrayCount; j++)
+		{
+			if (entry.Type == GcadSectionIndex)
+			{
+				// bounds are doubles, rest of node is 32 bit numbers
+				for (size_t k = 0; k < count; k++)
+				{
+					GcadIndexNode & node = reinterpret_cast<GcadIndexNode *>(pos)[k];
+					SwapBytes(reinterpret_cast<char *>(node.MinX), 8, 4 * GcadIndexNode::MAX_ENTRIES);
+					SwapBytes(reinterpret_cast<char *>(node.Child), 4, GcadIndexNode::MAX_ENTRIES + 2);
+				}
+			}
+			else
+			{
+				SwapBytes(pos, layout.ElementSizes[j], count);
+			}
+			pos += Align(count * layout.ElementSizes[j], 8);
+		}
+		if (native)
+			SwapSectionEntry(entry);
+	}
+	if (native)
+		SwapHeader(header);
+}
+
+
+#ifdef _WIN32
+GcadFile::GcadFile(const wchar_t * path) : m_begin(0), m_size(0), m_header(0)
+#else
+GcadFile::GcadFile(const char * path) : m_begin(0), m_size(0), m_header(0)
+#endif
+{
+	try
+	{
+		m_file.reset(new MappedFile(path));
+	}
+	catch (DxfError & err)
+	{
+		throw GcadError(err.Code == DxfErrorOpenFile ? GcadErrorOpenFile : GcadErrorReadFile);
+	}
+	m_begin = m_file->Begin();
+	m_size = m_file->Size();
+	Validate();
+}
+
+
+GcadFile::GcadFile(const char * data, size_t size) : m_begin(data), m_size(size), m_header(0)
+{
+	if (reinterpret_cast<size_t>(data) % 8 != 0)
+		throw GcadError(GcadErrorInvalidFormat);
+	Validate();
+}
+
+
+// only structure is checked here, so opening doesn't touch pages of sections,
+// values which refer to other sections are checked by users
+void GcadFile::Validate()
+{
+	memset(m_counts, 0, sizeof(m_counts));
+	memset(m_arrays, 0, sizeof(m_arrays));
+	const char * begin = m_begin;
+	const size_t size = m_size;
+	if (size < sizeof(GcadHeader))
+		throw GcadError(GcadErrorInvalidFormat);
+	m_header = reinterpret_cast<const GcadHeader *>(begin);
+	if (memcmp(m_header->Magic, GCAD_MAGIC, sizeof(GCAD_MAGIC)) != 0)
+		throw GcadError(GcadErrorInvalidFormat);
+	if (m_header->ByteOrder != GCAD_BYTE_ORDER || m_header->Version > GCAD_VERSION)
+		throw GcadError(GcadErrorVersion);
+	if (m_header->SectionCount > (size - sizeof(GcadHeader)) / sizeof(GcadSectionEntry))
+		throw GcadError(GcadErrorInvalidFormat);
+	const GcadSectionEntry * table = reinterpret_cast<const GcadSectionEntry *>(begin + sizeof(GcadHeader));
+	bool found[GcadSectionCount] = {false};
+	for (uint32_t i = 0; i < m_header->SectionCount; i++)
+	{
+		const GcadSectionEntry & entry = table[i];
+		// sections of later versions are skipped
+		if (entry.Type == 0 || entry.Type >= GcadSectionCount)
+			continue;
+		GcadSection type = static_cast<GcadSection>(entry.Type);
+		if (found[type] || entry.Offset % 8 != 0 || entry.Offset > size || entry.Size > size - entry.Offset)
+			throw GcadError(GcadErrorInvalidFormat);
+		found[type] = true;
+		const SectionLayout & layout = g_layouts[type];
+		size_t count = static_cast<size_t>(entry.Count);
+		const char * pos = begin + static_cast<size_t>(entry.Offset);
+		const char * end = pos + static_cast<size_t>(entry.Size);
+		for (int j = 0; j < layout.ArrayCount; j++)
+		{
+			if (entry.Count > static_cast<uint64_t>(end - pos) / layout.ElementSizes[j])
+				throw GcadError(GcadErrorInvalidFormat);
+			m_arrays[type][j] = pos;
+			pos += min(Align(count * layout.ElementSizes[j], 8), static_cast<size_t>(end - pos));
+		}
+		m_counts[type] = count;
+	}
+	if (m_header->DrawingFirst > m_counts[GcadSectionObjects])
+		throw GcadError(GcadErrorInvalidFormat);
+}
+
+
+Rect<double> GcadFile::GetBounds() const
+{
+	return Rect<double>(m_header->Bounds[0], m_header->Bounds[1], m_header->Bounds[2], m_header->Bounds[3]);
+}
+
+
+void GcadFile::Query(const Rect<double> & rect, vector<uint32_t> & result) const
+{
+	const size_t count = m_counts[GcadSectionIndex];
+	if (count == 0)
+		return;
+	const GcadIndexNode * nodes = GetArray<GcadIndexNode>(GcadSectionIndex, 0);
+	vector<uint32_t> stack(1, static_cast<uint32_t>(count - 1));
+	while (!stack.empty())
+	{
+		uint32_t pos = stack.back();
+		stack.pop_back();
+		const GcadIndexNode & node = nodes[pos];
+		uint32_t entries = min<uint32_t>(node.Count, GcadIndexNode::MAX_ENTRIES);
+		for (uint32_t i = 0; i < entries; i++)
+		{
+			if (node.MinX[i] > rect.Pt2.X || node.MaxX[i] < rect.Pt1.X ||
+					node.MinY[i] > rect.Pt2.Y || node.MaxY[i] < rect.Pt1.Y)
+				continue;
+			if (node.Leaf)
+			{
+				result.push_back(node.Child[i]);
+			}
+			else
+			{
+				// children always go before parent, so damaged file can't make loop
+				if (node.Child[i] >= pos)
+					throw GcadError(GcadErrorInvalidFormat);
+				stack.push_back(node.Child[i]);
+			}
+		}
+	}
+}
+
+
+static const size_t PREFETCH_STRIDE = 4096;
+
+
+// reads one byte of every page of elements [first, last) of array
+static char TouchArray(const char * array, size_t elementSize, size_t first, size_t last)
+{
+	char result = 0;
+	if (first >= last)
+		return result;
+	const char * begin = array + first * elementSize;
+	const char * end = array + last * elementSize;
+	for (const char * pos = begin; pos < end; pos += PREFETCH_STRIDE)
+		result ^= *pos;
+	return result ^ end[-1];
+}
+
+
+void GcadFile::Prefetch(size_t first, size_t count) const
+{
+	const size_t objects = m_counts[GcadSectionObjects];
+	if (first >= objects)
+		return;
+	const size_t last = first + min(count, objects - first);
+	volatile char sink = 0;
+	sink ^= TouchArray(m_arrays[GcadSectionObjects][GcadObjectType], 1, first, last);
+	sink ^= TouchArray(m_arrays[GcadSectionObjects][GcadObjectIndex], 4, first, last);
+	// objects of tile are written together, so their geometry
+	// occupies one range in each section
+	const unsigned char * types = GetArray<unsigned char>(GcadSectionObjects, GcadObjectType);
+	const uint32_t * indexes = GetArray<uint32_t>(GcadSectionObjects, GcadObjectIndex);
+	static const GcadSection sectionOfKind[] = {GcadSectionLines, GcadSectionCircles, GcadSectionArcs,
+			GcadSectionPolylines, GcadSectionInserts};
+	const size_t kinds = sizeof(sectionOfKind) / sizeof(sectionOfKind[0]);
+	size_t minIndex[kinds], maxIndex[kinds];
+	for (size_t i = 0; i < kinds; i++)
+	{
+		minIndex[i] = numeric_limits<size_t>::max();
+		maxIndex[i] = 0;
+	}
+	for (size_t i = first; i < last; i++)
+	{
+		if (types[i] >= kinds)
+			continue;
+		minIndex[types[i]] = min<size_t>(minIndex[types[i]], indexes[i]);
+		maxIndex[types[i]] = max<size_t>(maxIndex[types[i]], indexes[i]);
+	}
+	for (size_t i = 0; i < kinds; i++)
+	{
+		GcadSection section = sectionOfKind[i];
+		size_t end = min(maxIndex[i] + 1, m_counts[section]);
+		for (int j = 0; j < g_layouts[section].ArrayCount; j++)
+			sink ^= TouchArray(m_arrays[section][j], g_layouts[section].ElementSizes[j], minIndex[i], end);
+		if (section == GcadSectionPolylines && minIndex[i] < end)
+		{
+			const uint32_t * nodeFirst = GetArray<uint32_t>(GcadSectionPolylines, GcadPolylineFirst);
+			const uint32_t * nodeCount = GetArray<uint32_t>(GcadSectionPolylines, GcadPolylineCount);
+			size_t nodesEnd = min<size_t>(static_cast<size_t>(nodeFirst[end - 1]) + nodeCount[end - 1], m_counts[GcadSectionNodes]);
+			for (int j = 0; j < g_layouts[GcadSectionNodes].ArrayCount; j++)
+				sink ^= TouchArray(m_arrays[GcadSectionNodes][j], 8, nodeFirst[minIndex[i]], nodesEnd);
+		}
+	}
+}
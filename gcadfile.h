@@ -0,0 +1,257 @@
+/*
+ * gcadfile.h
+ *
+ *  Created on: 18.10.2026
+ *      Author: misha
+ */
+
+#ifndef GCADFILE_H_
+#define GCADFILE_H_
+
+
+#include "dxfreader.h"
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+
+// Native drawing file. It starts with GcadHeader followed by table of sections,
+// each section holds arrays of one kind of entities in the same structure of arrays
+// layout as EntityStore, so mapped file is used in place without parsing.
+// Arrays start at 8 byte boundary, numbers are in byte order of writer,
+// files of other byte order are rejected.
+
+const uint32_t GCAD_VERSION = 1;
+// written as number, reads differently on machine with other byte order
+const uint32_t GCAD_BYTE_ORDER = 0x01020304;
+
+
+enum GcadErrorCode
+{
+	GcadOk,
+	GcadErrorOpenFile,
+	GcadErrorReadFile,
+	GcadErrorWriteFile,
+	GcadErrorInvalidFormat,
+	// file is written by newer version or on machine with other byte order
+	GcadErrorVersion,
+};
+
+
+struct GcadError
+{
+	GcadErrorCode Code;
+	explicit GcadError(GcadErrorCode code) : Code(code) {}
+};
+
+
+enum GcadSection
+{
+	GcadSectionLines = 1,
+	GcadSectionCircles,
+	GcadSectionArcs,
+	GcadSectionPolylines,
+	GcadSectionNodes,
+	GcadSectionInserts,
+	// all objects in drawing order, objects of blocks go first
+	GcadSectionObjects,
+	GcadSectionBlocks,
+	// characters of block names
+	GcadSectionNames,
+	GcadSectionIndex,
+	// ranges of drawing objects which are near each other
+	GcadSectionTiles,
+	GcadSectionCount,
+};
+
+
+// arrays of sections in file order
+enum GcadLineArray { GcadLineX1, GcadLineY1, GcadLineX2, GcadLineY2 };
+enum GcadCircleArray { GcadCircleX, GcadCircleY, GcadCircleR };
+enum GcadArcArray { GcadArcX, GcadArcY, GcadArcR, GcadArcSX, GcadArcSY, GcadArcEX, GcadArcEY, GcadArcCcw };
+enum GcadPolylineArray { GcadPolylineFirst, GcadPolylineCount, GcadPolylineClosed };
+enum GcadNodeArray { GcadNodeX, GcadNodeY, GcadNodeBulge };
+enum GcadInsertArray { GcadInsertBlock, GcadInsertM11, GcadInsertM12, GcadInsertM13, GcadInsertM21, GcadInsertM22, GcadInsertM23 };
+enum GcadObjectArray { GcadObjectType, GcadObjectIndex };
+enum GcadBlockArray { GcadBlockNameOffset, GcadBlockNameSize, GcadBlockFirst, GcadBlockCount };
+enum GcadTileArray { GcadTileFirst, GcadTileCount, GcadTileMinX, GcadTileMinY, GcadTileMaxX, GcadTileMaxY };
+
+
+// drawing objects are written in tiles of this many objects,
+// tile is unit of loading for paged drawings
+const size_t GCAD_TILE_SIZE = 4096;
+
+
+// values of GcadObjectType array, index is position in section of that type
+enum GcadObjectKind
+{
+	GcadObjectLine,
+	GcadObjectCircle,
+	GcadObjectArc,
+	GcadObjectPolyline,
+	GcadObjectInsert,
+};
+
+
+struct GcadHeader
+{
+	char Magic[8];
+	uint32_t Version;
+	uint32_t ByteOrder;
+	uint32_t SectionCount;
+	// objects of drawing are [DrawingFirst, end) in objects section
+	uint32_t DrawingFirst;
+	// extents of drawing objects
+	double Bounds[4];
+};
+
+
+struct GcadSectionEntry
+{
+	uint32_t Type;
+	uint32_t Reserved;
+	uint64_t Offset;
+	uint64_t Count;
+	uint64_t Size;
+};
+
+
+// packed R-tree node, root is last node of index section,
+// children of leaves are positions in objects section
+struct GcadIndexNode
+{
+	static const int MAX_ENTRIES = 16;
+	double MinX[MAX_ENTRIES];
+	double MinY[MAX_ENTRIES];
+	double MaxX[MAX_ENTRIES];
+	double MaxY[MAX_ENTRIES];
+	uint32_t Child[MAX_ENTRIES];
+	uint32_t Count;
+	uint32_t Leaf;
+};
+
+
+// drawing as it is written, arrays of one type go to one section,
+// inserts refer to blocks by position in Blocks arrays
+struct GcadArrays
+{
+	struct LineArrays
+	{
+		std::vector<double> X1, Y1, X2, Y2;
+	};
+	struct CircleArrays
+	{
+		std::vector<double> CX, CY, R;
+	};
+	struct ArcArrays
+	{
+		std::vector<double> CX, CY, R, SX, SY, EX, EY;
+		std::vector<char> Ccw;
+	};
+	struct PolylineArrays
+	{
+		std::vector<uint32_t> First, Count;
+		std::vector<char> Closed;
+	};
+	struct NodeArrays
+	{
+		std::vector<double> X, Y, Bulge;
+	};
+	struct InsertArrays
+	{
+		std::vector<uint32_t> Block;
+		std::vector<double> M11, M12, M13, M21, M22, M23;
+	};
+	struct ObjectArrays
+	{
+		std::vector<unsigned char> Type;
+		std::vector<uint32_t> Index;
+	};
+	// objects of block are [First, First + Count) in objects arrays
+	struct BlockArrays
+	{
+		std::vector<uint32_t> NameOffset, NameSize, First, Count;
+	};
+
+	LineArrays Lines;
+	CircleArrays Circles;
+	ArcArrays Arcs;
+	PolylineArrays Polylines;
+	NodeArrays Nodes;
+	InsertArrays Inserts;
+	ObjectArrays Objects;
+	BlockArrays Blocks;
+	std::vector<char> Names;
+	// bounding rectangles of drawing objects, those go last in objects arrays,
+	// spatial index is built from them
+	std::vector<Rect<double> > DrawingBounds;
+};
+
+
+// makes order of drawing objects in which consecutive GCAD_TILE_SIZE
+// objects lie near each other, order[i] is position of object in bounds
+void SortGcadTiles(const std::vector<Rect<double> > & bounds, std::vector<uint32_t> & order);
+
+
+// throws GcadError
+#ifdef _WIN32
+void WriteGcadFile(const wchar_t * path, const GcadArrays & arrays);
+#else
+void WriteGcadFile(const char * path, const GcadArrays & arrays);
+#endif
+// writes image of file to result, used for clipboard
+void WriteGcadMemory(const GcadArrays & arrays, std::vector<char> & result);
+// converts image of file in memory to other byte order, both
+// native and foreign images are accepted, throws GcadError
+void SwapGcadImage(char * image, size_t size);
+
+
+// mapped gcad file, arrays point into mapping and pages are read
+// by system only when those are touched
+class GcadFile
+{
+public:
+	// throws GcadError
+#ifdef _WIN32
+	explicit GcadFile(const wchar_t * path);
+#else
+	explicit GcadFile(const char * path);
+#endif
+	// reads image of file in memory, data should be aligned to 8 bytes
+	// and outlive this object, throws GcadError
+	GcadFile(const char * data, size_t size);
+	Rect<double> GetBounds() const;
+	size_t GetDrawingFirst() const { return m_header->DrawingFirst; }
+	// number of items in section, 0 if there is no such section
+	size_t GetCount(GcadSection section) const { return m_counts[section]; }
+	// array of section, T should have size of array elements
+	template <class T>
+	const T * GetArray(GcadSection section, int array) const
+	{
+		assert(sizeof(T) == GetElementSize(section, array));
+		return reinterpret_cast<const T *>(m_arrays[section][array]);
+	}
+	// appends positions in objects section of drawing objects
+	// which bounding rectangles intersect rect
+	void Query(const Rect<double> & rect, std::vector<uint32_t> & result) const;
+	// reads pages of objects [first, first + count) and of their geometry,
+	// so later access to those doesn't wait for disk, it is safe to call from other thread
+	void Prefetch(size_t first, size_t count) const;
+
+	static size_t GetElementSize(GcadSection section, int array);
+private:
+	GcadFile(const GcadFile &);
+	GcadFile & operator=(const GcadFile &);
+	static const int MAX_ARRAYS = 8;
+	// null for image in memory
+	std::auto_ptr<MappedFile> m_file;
+	const char * m_begin;
+	size_t m_size;
+	const GcadHeader * m_header;
+	size_t m_counts[GcadSectionCount];
+	const char * m_arrays[GcadSectionCount][MAX_ARRAYS];
+	void Validate();
+};
+
+
+#endif /* GCADFILE_H_ */
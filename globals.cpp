@@ -6,7 +6,10 @@
  */
 #include "globals.h"
 #include "console.h"
+#include "exchange.h"
 #include "exmath.h"
+#include "gcad.h"
+#include "gcadfile.h"
 #include <commctrl.h>
 #include <windowsx.h>
 #include <loki/Functor.h>
@@ -64,7 +67,7 @@ UndoManager g_undoManager;
 
 bool g_canSnap = false;
 
-std::list<CadObject *> g_selected;
+SelectionSet g_selected;
 
 
 void DrawCursorRaw(HDC hdc, int x, int y)
@@ -105,18 +108,14 @@ void DrawCursorRaw(HDC hdc, int x, int y)
 }
 
 
-void CadLine::Draw(HDC hdc, bool selected) const
+void CadLine::Draw(RenderTarget & target, bool selected) const
 {
-	HPEN hpen = selected ? g_selectedLineHPen : g_lineHPen;
-	if (SelectObject(hdc, hpen) == NULL)
-		assert(0);
-	if (SetBkColor(hdc, RGB(0, 0, 0)) == CLR_INVALID)
-		assert(0);
-	Point<int> fromScn = WorldToScreen(Point1.X, Point1.Y);
-	Point<int> toScn = WorldToScreen(Point2.X, Point2.Y);
-	MoveToEx(hdc, fromScn.X, fromScn.Y, 0);
-	LineTo(hdc, toScn.X, toScn.Y);
-	LineTo(hdc, toScn.X + 1, toScn.Y);
+	target.SetPen(selected);
+	Point<int> fromScn = target.WorldToScreen(Point1);
+	Point<int> toScn = target.WorldToScreen(Point2);
+	target.MoveTo(fromScn);
+	target.LineTo(toScn);
+	target.LineTo(Point<int>(toScn.X + 1, toScn.Y));
 }
 
 
@@ -211,82 +210,29 @@ void CadLine::Load(unsigned char const *& ptr, size_t & size)
 }
 
 
-static void DrawArcInternal(HDC hdc, const CircleArc & arc, void (*drawer)(HDC, int, int, int, int, int, int, int, int))
-{
-	if (arc.Radius != 0 & arc.Radius < 10E+10)
-	{
-		Point<int> center = WorldToScreen(arc.Center);
-		Point<int> start = WorldToScreen(arc.Start);
-		Point<int> end = WorldToScreen(arc.End);
-		int r = static_cast<int>(floor(arc.Radius * g_magification + 0.5));
-		if (!SetArcDirection(hdc, arc.Ccw ? AD_COUNTERCLOCKWISE : AD_CLOCKWISE))
-			assert(0);
-		drawer(hdc, center.X - r, center.Y - r, center.X + r + 1, center.Y + r + 1, start.X, start.Y, end.X, end.Y);
-	}
-}
-
-
-static void ArcDrawer(HDC hdc, int rcl, int rct, int rcr, int rcb, int sx, int sy, int ex, int ey)
-{
-	if (!Arc(hdc, rcl, rct, rcr, rcb, sx, sy, ex, ey))
-		assert(0);
-}
-
-static void ArcToDrawer(HDC hdc, int rcl, int rct, int rcr, int rcb, int sx, int sy, int ex, int ey)
-{
-	if (!LineTo(hdc, sx, sy))
-		assert(0);
-	if (!ArcTo(hdc, rcl, rct, rcr, rcb, sx, sy, ex, ey))
-		assert(0);
-	if (!LineTo(hdc, ex, ey))
-		assert(0);
-}
-
-
-inline void DrawArc(HDC hdc, const CircleArc & arc)
-{
-	DrawArcInternal(hdc, arc, &ArcDrawer);
-}
-
-inline void DrawArcTo(HDC hdc, const CircleArc & arc)
-{
-	DrawArcInternal(hdc, arc, &ArcToDrawer);
-}
-
-
 // draws from current raster position
-static void DrawPolylineSeg(HDC hdc, const CadPolyline::Node & from, const CadPolyline::Node & to)
+static void DrawPolylineSeg(RenderTarget & target, const CadPolyline::Node & from, const CadPolyline::Node & to)
 {
 	if (from.Bulge == 0)
-	{
-		Point<int> scnPt = WorldToScreen(to.point.X, to.point.Y);
-		LineTo(hdc, scnPt.X, scnPt.Y);
-	}
+		target.LineTo(target.WorldToScreen(to.point));
 	else
-	{
-		DrawArcTo(hdc, ArcFrom2PtAndBulge(from.point, to.point, from.Bulge));
-	}
+		DrawCircleArcTo(target, ArcFrom2PtAndBulge(from.point, to.point, from.Bulge));
 }
 
 
-void CadPolyline::Draw(HDC hdc, bool selected) const
+void CadPolyline::Draw(RenderTarget & target, bool selected) const
 {
-	HPEN hpen = selected ? g_selectedLineHPen : g_lineHPen;
-	if (SelectObject(hdc, hpen) == NULL)
-		assert(0);
-	if (SetBkColor(hdc, RGB(0, 0, 0)) == CLR_INVALID)
-		assert(0);
+	target.SetPen(selected);
 	vector<Node>::const_iterator i = Nodes.begin();
 	Node prev;
 	assert(i != Nodes.end());
-	Point<int> scnPt = WorldToScreen(i->point);
-	MoveToEx(hdc, scnPt.X, scnPt.Y, 0);
+	target.MoveTo(target.WorldToScreen(i->point));
 	prev = *i;
 	i++;
 	for (; i != Nodes.end(); prev = *i, i++)
-		DrawPolylineSeg(hdc, prev, *i);
+		DrawPolylineSeg(target, prev, *i);
 	if (Closed)
-		DrawPolylineSeg(hdc, Nodes.back(), Nodes.front());
+		DrawPolylineSeg(target, Nodes.back(), Nodes.front());
 }
 
 
@@ -332,33 +278,30 @@ static Rect<double> PolylineSegBoundingRect(const CadPolyline::Node & from,
 }
 
 
+// GetBoundingRect friend of Rect is hidden by member functions with same name
+static Rect<double> UniteRects(const Rect<double> & lhs, const Rect<double> & rhs)
+{
+	return GetBoundingRect(lhs, rhs);
+}
+
+
 Rect<double> CadPolyline::GetBoundingRect() const
 {
-	throw runtime_error("CadPolyline::GetBoundingRect not implemented");
-	/*Rect<double> result;
-	bool first = true;
+	assert(Nodes.size() > 0);
+	Rect<double> result(Nodes.front().point, Nodes.front().point);
 	Node prev;
 	for (vector<Node>::const_iterator i = Nodes.begin(); i != Nodes.end(); prev = *i, i++)
 	{
 		if (i == Nodes.begin())
 			continue;
-		Rect<double> rect = PolylineSegBoundingRect(prev, *i);
-		if (first)
-		{
-			result = rect;
-			first = false;
-		}
-		else
-		{
-			result = ::GetBoundingRect(result, rect);
-		}
+		result = UniteRects(result, PolylineSegBoundingRect(prev, *i));
 	}
 	if (Closed)
 	{
-		result = ::GetBoundingRect(result,
+		result = UniteRects(result,
 				PolylineSegBoundingRect(Nodes.back(), Nodes.front()));
 	}
-	return result;*/
+	return result;
 }
 
 
@@ -562,61 +505,17 @@ CadPolyline CadPolyline2::ToCadPolyline() const
 	return result;
 }
 
-void CadCircle::Draw(HDC hdc, bool selected) const
+void CadCircle::Draw(RenderTarget & target, bool selected) const
 {
-	HPEN hpen = selected ? g_selectedLineHPen : g_lineHPen;
-	if (SelectObject(hdc, hpen) == NULL)
-		assert(0);
-	if (SetBkColor(hdc, RGB(0, 0, 0)) == CLR_INVALID)
-		assert(0);
-	Point<int> center = WorldToScreen(Center);
-	int r = static_cast<int>(Radius * g_magification + 0.5);
-	if (!Arc(hdc, center.X - r, center.Y - r, center.X + r + 1, center.Y + r + 1, 0, 0, 0, 0))
-		assert(0);
+	target.SetPen(selected);
+	int r = static_cast<int>(Radius * target.GetMagnification() + 0.5);
+	target.DrawCircle(target.WorldToScreen(Center), r);
 }
 
 
 bool CadCircle::IntersectsRect(double x1, double y1, double x2, double y2) const
 {
-	Rect<double> brect = GetBoundingRect();
-	if (!IsRectsIntersects(Rect<double>(x1, y1, x2, y2), brect))
-		return false;
-	if (IsLeftContainsRight(Rect<double>(x1, y1, x2, y2), brect))
-		return true;
-	pair<bool, double> res;
-	res = VertLineIntersectsCircle(x1, *this);
-	if (res.first)
-	{
-		if (y1 <= Center.Y + res.second && Center.Y + res.second <= y2)
-			return true;
-		else if (res.second != 0 && y1 <= Center.Y - res.second && Center.Y - res.second <= y2)
-			return true;
-	}
-	res = VertLineIntersectsCircle(x2, *this);
-	if (res.first)
-	{
-		if (y1 <= Center.Y + res.second && Center.Y + res.second <= y2)
-			return true;
-		else if (res.second != 0 && y1 <= Center.Y - res.second && Center.Y - res.second <= y2)
-			return true;
-	}
-	res = HorzLineIntersectsCircle(y1, *this);
-	if (res.first)
-	{
-		if (x1 <= Center.X + res.second && Center.X + res.second <= x2)
-			return true;
-		else if (res.second != 0 && x1 <= Center.X - res.second && Center.X - res.second <= x2)
-			return true;
-	}
-	res = HorzLineIntersectsCircle(y2, *this);
-	if (res.first)
-	{
-		if (x1 <= Center.X + res.second && Center.X + res.second <= x2)
-			return true;
-		else if (res.second != 0 && x1 <= Center.X - res.second && Center.X - res.second <= x2)
-			return true;
-	}
-	return false;
+	return CircleIntersectsRect(*this, Rect<double>(x1, y1, x2, y2));
 }
 
 
@@ -670,6 +569,7 @@ std::vector<std::pair<Point<double>, PointType> > CadCircle::GetPoints() const
 void CadCircle::Transform(Matrix3<double> mat)
 {
 	Center = mat * Center;
+	Radius *= LengthScale(mat);
 }
 
 
@@ -706,14 +606,10 @@ void CadCircle::Load(unsigned char const *& ptr, size_t & size)
 }
 
 
-void CadArc::Draw(HDC hdc, bool selected) const
+void CadArc::Draw(RenderTarget & target, bool selected) const
 {
-	HPEN hpen = selected ? g_selectedLineHPen : g_lineHPen;
-	if (SelectObject(hdc, hpen) == NULL)
-		assert(0);
-	if (SetBkColor(hdc, RGB(0, 0, 0)) == CLR_INVALID)
-		assert(0);
-	DrawArc(hdc, *this);
+	target.SetPen(selected);
+	DrawCircleArc(target, *this);
 }
 
 
@@ -762,6 +658,9 @@ void CadArc::Transform(const Matrix3<double> mat)
 	Center = mat * Center;
 	Start = mat * Start;
 	End = mat * End;
+	Radius *= LengthScale(mat);
+	if (IsMirroring(mat))
+		Ccw = !Ccw;
 }
 
 
@@ -814,15 +713,225 @@ void CadArc::Load(unsigned char const *& ptr, size_t & size)
 }
 
 
+CadBlock::~CadBlock()
+{
+	for (vector<CadObject *>::iterator i = m_objects.begin(); i != m_objects.end(); i++)
+		delete *i;
+}
+
+
+void CadBlock::AddObject(CadObject * obj)
+{
+	if (m_objects.empty())
+		m_bounds = obj->GetBoundingRect();
+	else
+		m_bounds = UniteRects(m_bounds, obj->GetBoundingRect());
+	m_objects.push_back(obj);
+}
+
+
+void CadBlock::Draw(RenderTarget & target, bool selected) const
+{
+	for (vector<CadObject *>::const_iterator i = m_objects.begin(); i != m_objects.end(); i++)
+		(*i)->Draw(target, selected);
+}
+
+
+CadInsert::CadInsert() : m_block(new CadBlock(string())), m_matrix(DisplaceMatrix(Point<double>(0, 0)))
+{
+	m_block->AddRef();
+}
+
+
+CadInsert::CadInsert(CadBlock * block, const Matrix3<double> & matrix) : m_block(block), m_matrix(matrix)
+{
+	m_block->AddRef();
+}
+
+
+CadInsert::CadInsert(const CadInsert & rhs) : CadObject(rhs), m_block(rhs.m_block), m_matrix(rhs.m_matrix)
+{
+	m_block->AddRef();
+}
+
+
+CadInsert::~CadInsert()
+{
+	m_block->Release();
+}
+
+
+CadInsert & CadInsert::operator=(const CadInsert & rhs)
+{
+	rhs.m_block->AddRef();
+	m_block->Release();
+	m_block = rhs.m_block;
+	m_matrix = rhs.m_matrix;
+	return *this;
+}
+
+
+CadObject * CadInsert::MakeWorldObject(const CadObject & obj) const
+{
+	CadObject * result = obj.Clone();
+	result->Transform(m_matrix);
+	return result;
+}
+
+
+void CadInsert::Draw(RenderTarget & target, bool selected) const
+{
+	TransformRenderTarget transformed(target, m_matrix);
+	m_block->Draw(transformed, selected);
+}
+
+
+bool CadInsert::IntersectsRect(double x1, double y1, double x2, double y2) const
+{
+	Rect<double> rect(x1, y1, x2, y2);
+	Rect<double> brect = GetBoundingRect();
+	if (!IsRectsIntersects(rect, brect))
+		return false;
+	if (IsLeftContainsRight(rect, brect))
+		return true;
+	const vector<CadObject *> & objects = m_block->GetObjects();
+	for (vector<CadObject *>::const_iterator i = objects.begin(); i != objects.end(); i++)
+	{
+		auto_ptr<CadObject> obj(MakeWorldObject(**i));
+		if (obj->IntersectsRect(x1, y1, x2, y2))
+			return true;
+	}
+	return false;
+}
+
+
+Rect<double> CadInsert::GetBoundingRect() const
+{
+	const Rect<double> & bounds = m_block->GetBoundingRect();
+	Point<double> pt1 = m_matrix * bounds.Pt1;
+	Point<double> pt2 = m_matrix * Point<double>(bounds.Pt2.X, bounds.Pt1.Y);
+	Point<double> pt3 = m_matrix * bounds.Pt2;
+	Point<double> pt4 = m_matrix * Point<double>(bounds.Pt1.X, bounds.Pt2.Y);
+	return Rect<double>(min(min(pt1.X, pt2.X), min(pt3.X, pt4.X)), min(min(pt1.Y, pt2.Y), min(pt3.Y, pt4.Y)),
+			max(max(pt1.X, pt2.X), max(pt3.X, pt4.X)), max(max(pt1.Y, pt2.Y), max(pt3.Y, pt4.Y)));
+}
+
+
+vector<Point<double> > CadInsert::GetManipulators()
+{
+	return vector<Point<double> >(1, GetInsertionPoint());
+}
+
+
+void CadInsert::UpdateManip(const Point<double> & pt, int id)
+{
+	assert(id == 0);
+	m_matrix = DisplaceMatrix(pt - GetInsertionPoint()) * m_matrix;
+}
+
+
+// only insertion point is snapped to, so thousands of inserts
+// don't fill snap index with points of their blocks
+vector<pair<Point<double>, PointType> > CadInsert::GetPoints() const
+{
+	return vector<pair<Point<double>, PointType> >(1, make_pair(GetInsertionPoint(), PointTypeEndPoint));
+}
+
+
+void CadInsert::Assign(const CadObject & rhs)
+{
+	const CadInsert * rhsInsert = dynamic_cast<const CadInsert *>(&rhs);
+	assert(rhsInsert != 0);
+	*this = *rhsInsert;
+}
+
+
+size_t CadInsert::Serialize(unsigned char * ptr) const
+{
+	size_t result = 0;
+	result += WritePtr(ptr, ID);
+	for (int row = 0; row < 2; row++)
+	{
+		for (int col = 0; col < 3; col++)
+			result += WritePtr(ptr, m_matrix[row][col]);
+	}
+	const vector<CadObject *> & objects = m_block->GetObjects();
+	result += WritePtr(ptr, static_cast<unsigned long>(objects.size()));
+	for (vector<CadObject *>::const_iterator i = objects.begin(); i != objects.end(); i++)
+	{
+		size_t size = (*i)->Serialize(ptr);
+		if (ptr != 0)
+			ptr += size;
+		result += size;
+	}
+	return result;
+}
+
+
+// loaded insert gets its own block
+void CadInsert::Load(unsigned char const *& ptr, size_t & size)
+{
+	for (int row = 0; row < 2; row++)
+	{
+		for (int col = 0; col < 3; col++)
+			ReadPtr(ptr, m_matrix[row][col], size);
+	}
+	unsigned long count;
+	ReadPtr(ptr, count, size);
+	CadBlock * block = new CadBlock(m_block->GetName());
+	block->AddRef();
+	m_block->Release();
+	m_block = block;
+	for (unsigned long i = 0; i < count; i++)
+	{
+		int id;
+		ReadPtr(ptr, id, size);
+		auto_ptr<CadObject> obj(CreateObjectById(id));
+		obj->Load(ptr, size);
+		m_block->AddObject(obj.release());
+	}
+}
+
+
+CadObject * CreateObjectById(int id)
+{
+	switch (id)
+	{
+	case CadLine::ID: return new CadLine();
+	case CadCircle::ID: return new CadCircle();
+	case CadArc::ID: return new CadArc();
+	case CadPolyline::ID: return new CadPolyline();
+	case CadInsert::ID: return new CadInsert();
+	default: assert(0); return 0;
+	}
+}
+
+
 struct Intersector
 {
 	template <class T1, class T2>
-	vector<Point<double> > Fire(const T1 & lhs, const T2 & rhs) {return Intersect(lhs, rhs);}
+	vector<Point<double> > Fire(const T1 & lhs, const T2 & rhs)
+	{
+		IntersectResult res = Intersect(lhs, rhs);
+		return vector<Point<double> >(res.begin(), res.end());
+	}
 	template<class T>
 	vector<Point<double> > Fire(const T & lhs, const CadPolyline & polyline) {return Intersect2(lhs, polyline);}
 	template<class T>
+	vector<Point<double> > Fire(const T & lhs, const CadInsert & insert)
+	{
+		vector<Point<double> > result;
+		Intersect2(lhs, insert, result);
+		return result;
+	}
+	template<class T>
 	vector<Point<double> > Fire(const CadPolyline & polyline, const T & rhs) { assert(0); }
 	vector<Point<double> > Fire(const CadPolyline & lhs, const CadPolyline & rhs) { assert(0); return vector<Point<double> >(); }
+	vector<Point<double> > Fire(const CadPolyline & lhs, const CadInsert & rhs) { assert(0); return vector<Point<double> >(); }
+	template<class T>
+	vector<Point<double> > Fire(const CadInsert & insert, const T & rhs) { assert(0); return vector<Point<double> >(); }
+	vector<Point<double> > Fire(const CadInsert & lhs, const CadPolyline & rhs) { assert(0); return vector<Point<double> >(); }
+	vector<Point<double> > Fire(const CadInsert & lhs, const CadInsert & rhs) { assert(0); return vector<Point<double> >(); }
 	vector<Point<double> > OnError(const CadObject & lhs, const CadObject & rhs) { assert(0); return vector<Point<double> >(); }
 };
 
@@ -830,9 +939,9 @@ vector<Point<double> > Intersect2(const CadObject & lhs, const CadObject & rhs)
 {
 	Intersector intersector;
 	return Loki::StaticDispatcher<Intersector,
-		const CadObject, LOKI_TYPELIST_4(const CadLine, const CadCircle, const CadArc, const CadPolyline),
+		const CadObject, LOKI_TYPELIST_5(const CadLine, const CadCircle, const CadArc, const CadPolyline, const CadInsert),
 		true,
-		const CadObject, LOKI_TYPELIST_4(const CadLine, const CadCircle, const CadArc, const CadPolyline),
+		const CadObject, LOKI_TYPELIST_5(const CadLine, const CadCircle, const CadArc, const CadPolyline, const CadInsert),
 		vector<Point<double> > >::Go(lhs, rhs, intersector);
 }
 
@@ -910,13 +1019,56 @@ void ExitTool()
 
 bool IsSelected(const CadObject * obj)
 {
-	for (std::list<CadObject *>::const_iterator i = g_selected.begin();
-		i != g_selected.end(); i++)
+	return g_selected.Contains(obj);
+}
+
+
+void SelectionSet::push_back(CadObject * obj)
+{
+	if (obj->m_selected)
+		return;
+	m_objects.push_back(obj);
+	obj->m_selected = true;
+}
+
+
+SelectionSet::iterator SelectionSet::erase(iterator pos)
+{
+	(*pos)->m_selected = false;
+	return m_objects.erase(pos);
+}
+
+
+void SelectionSet::remove(CadObject * obj)
+{
+	if (!obj->m_selected)
+		return;
+	obj->m_selected = false;
+	m_objects.remove(obj);
+}
+
+
+void SelectionSet::remove(const vector<CadObject *> & objects)
+{
+	bool found = false;
+	for (vector<CadObject *>::const_iterator i = objects.begin(); i != objects.end(); i++)
 	{
-		if (*i == obj)
-			return true;
+		if ((*i)->m_selected)
+		{
+			(*i)->m_selected = false;
+			found = true;
+		}
 	}
-	return false;
+	if (found)
+		m_objects.remove_if(&SelectionSet::IsNotSelected);
+}
+
+
+void SelectionSet::clear()
+{
+	for (list<CadObject *>::iterator i = m_objects.begin(); i != m_objects.end(); i++)
+		(*i)->m_selected = false;
+	m_objects.clear();
 }
 
 
@@ -985,17 +1137,17 @@ bool Selector::TrySelect()
 	{
 		// selecting single cad object, if clicked on it
 		bool result = false;
-		for (list<CadObject *>::reverse_iterator i = g_doc.Objects.rbegin();
-			i != g_doc.Objects.rend(); i++)
+		vector<CadObject *> candidates;
+		if (intersect)
+			g_doc.QueryIntersecting(testRect, candidates);
+		else
+			g_doc.Query(testRect, candidates);
+		for (vector<CadObject *>::const_iterator i = candidates.begin();
+			i != candidates.end(); i++)
 		{
 			if (m_multiselect && IsSelected(*i))
 				continue;
-			bool good;
-			if (intersect)
-				good = (*i)->IntersectsRect(testRect);
-			else
-				good = IsLeftContainsRight(testRect, (*i)->GetBoundingRect());
-			if (good)
+			if (intersect || IsLeftContainsRight(testRect, (*i)->GetBoundingRect()))
 			{
 				if (!m_multiselect)
 				{
@@ -1181,16 +1333,18 @@ bool DefaultTool::ProcessInput(HWND hwnd, unsigned int msg, WPARAM wparam, LPARA
 		case WM_LBUTTONDOWN:
 		{
 			auto_ptr<GroupUndoItem> group(new GroupUndoItem);
+			vector<CadObject *> originals;
 			for (list<Manipulated>::iterator i = m_manipulated.begin();
 				i != m_manipulated.end(); i++)
 			{
 				RemoveManipulators(i->Original);
-				g_selected.remove(i->Original);
+				originals.push_back(i->Original);
 				group->AddItem(new AssignObjectUndoItem(i->Original, i->Copy));
 				g_selected.push_back(i->Copy);
 				AddManipulators(i->Copy);
 				i->Copy = 0;
 			}
+			g_selected.remove(originals);
 			g_undoManager.AddWork(group.release());
 			m_manipulated.clear();
 			m_selManip = m_manipulators.end();
@@ -1338,6 +1492,29 @@ void DefaultTool::RemoveManipulators(CadObject * obj)
 }
 
 
+void DefaultTool::RemoveManipulators(const vector<CadObject *> & objects)
+{
+	vector<CadObject *> sorted(objects);
+	sort(sorted.begin(), sorted.end());
+	for (list<Manipulator>::iterator i = m_manipulators.begin();
+		i != m_manipulators.end();)
+	{
+		for (list<pair<CadObject*, int> >::iterator j = i->Links.begin();
+			j != i->Links.end();)
+		{
+			if (binary_search(sorted.begin(), sorted.end(), j->first))
+				j = i->Links.erase(j);
+			else
+				j++;
+		}
+		if (i->Links.size() == 0)
+			i = m_manipulators.erase(i);
+		else
+			i++;
+	}
+}
+
+
 void DefaultTool::DrawManipulators(HDC hdc)
 {
 	for (list<Manipulator>::const_iterator i = m_manipulators.begin();
@@ -1509,6 +1686,28 @@ void PanTool::Start()
 }
 
 
+void DeleteUnusedClipboardFiles()
+{
+	// without clipboard it is unknown which file is in use
+	if (!OpenClipboard(g_hmainWindow))
+		return;
+	// file which is still in clipboard is kept, other instances can paste it
+	string keep;
+	HGLOBAL hglob = GetClipboardData(g_clipboardFormat);
+	if (hglob != 0)
+	{
+		const char * data = reinterpret_cast<const char *>(GlobalLock(hglob));
+		assert(data);
+		keep = GetExchangeFileName(data, GlobalSize(hglob));
+		if (!GlobalUnlock(hglob))
+			assert(GetLastError() == NO_ERROR);
+	}
+	if (!CloseClipboard())
+		assert(0);
+	DeleteStaleExchangeFiles(keep);
+}
+
+
 typedef SelectWrapperTool<CopyTool> WrappedCopyTool;
 REGISTER_TOOL(L"copyclip", WrappedCopyTool);
 
@@ -1530,22 +1729,29 @@ bool CopyTool::InternalStart()
 	}
 	if (!EmptyClipboard())
 		assert(0);
-	size_t totalSize = 0;
-	for (list<CadObject *>::const_iterator i = g_selected.begin();
-		i != g_selected.end(); i++)
+	// objects are written in arrays by type with bounds in header,
+	// same as gcad file, large ones go through temporary file
+	vector<char> encoded;
+	try
 	{
-		totalSize += (*i)->Serialize(0);
+		vector<char> image;
+		GcadArrays arrays;
+		MakeGcadArrays(vector<const CadObject *>(g_selected.begin(), g_selected.end()), arrays);
+		WriteGcadMemory(arrays, image);
+		EncodeExchange(image, true, encoded, g_clipboardFile);
 	}
-	HGLOBAL hglob = GlobalAlloc(GMEM_MOVEABLE, totalSize);
-	assert(hglob);
-	unsigned char * pmem = reinterpret_cast<unsigned char *>(GlobalLock(hglob));
-	unsigned char * ptr = pmem;
-	assert(pmem);
-	for (list<CadObject *>::const_iterator i = g_selected.begin();
-		i != g_selected.end(); i++)
+	catch (GcadError &)
 	{
-		ptr += (*i)->Serialize(ptr);
+		g_console.Log(L"Unable to write temporary file for clipboard");
+		if (!CloseClipboard())
+			assert(0);
+		return false;
 	}
+	HGLOBAL hglob = GlobalAlloc(GMEM_MOVEABLE, encoded.size());
+	assert(hglob);
+	void * pmem = GlobalLock(hglob);
+	assert(pmem);
+	memcpy(pmem, &encoded[0], encoded.size());
 	if (!GlobalUnlock(hglob))
 		assert(GetLastError() == NO_ERROR);
 	if (!SetClipboardData(g_clipboardFormat, hglob))
@@ -1597,30 +1803,28 @@ void PasteTool::Start()
 	HGLOBAL hglob = GetClipboardData(g_clipboardFormat);
 	if (hglob != 0)
 	{
-		size_t size = GlobalSize(hglob);
-		assert(size != 0);
-		unsigned char const * ptr = reinterpret_cast<unsigned char *>(GlobalLock(hglob));
-		m_basePoint = Point<double>(numeric_limits<double>::max(),
-				numeric_limits<double>::max());
-		while (size != 0)
+		const char * data = reinterpret_cast<const char *>(GlobalLock(hglob));
+		assert(data);
+		try
 		{
-			int id;
-			ReadPtr(ptr, id, size);
-			CadObject * obj;
-			switch (id)
-			{
-			case CadLine::ID: obj = new CadLine(); break;
-			case CadCircle::ID: obj = new CadCircle(); break;
-			case CadArc::ID: obj = new CadArc(); break;
-			case CadPolyline::ID: obj = new CadPolyline(); break;
-			default: assert(0); break;
-			}
-			obj->Load(ptr, size);
-			m_objects.push_back(obj);
-			g_fantomManager.AddFantom(obj);
-			m_basePoint = Point<double>(min(m_basePoint.X, obj->GetBoundingRect().Pt1.X),
-					min(m_basePoint.Y, obj->GetBoundingRect().Pt1.Y));
+			vector<char> image;
+			DecodeExchange(data, GlobalSize(hglob), image);
+			GcadFile file(&image[0], image.size());
+			LoadGcadObjects(file, m_objects);
+			m_basePoint = file.GetBounds().Pt1;
 		}
+		catch (GcadError & err)
+		{
+			g_console.Log(err.Code == GcadErrorOpenFile ? L"Temporary file of clipboard is missing" :
+					L"Clipboard has invalid data");
+		}
+		if (!GlobalUnlock(hglob))
+			assert(GetLastError() == NO_ERROR);
+	}
+	if (!m_objects.empty())
+	{
+		for (vector<CadObject *>::const_iterator i = m_objects.begin(); i != m_objects.end(); i++)
+			g_fantomManager.AddFantom(*i);
 		g_fantomManager.RecalcFantomsHandler = Functor<void>(this, &PasteTool::RecalcFantomsHandler);
 		// aligning base point of objects with cursor
 		CalcPositions(g_cursorWrld);
@@ -1680,14 +1884,9 @@ void PasteTool::CalcPositions(const Point<double> & pt)
 void PasteTool::FeedInsertionPoint(const Point<double> & pt)
 {
 	CalcPositions(pt);
-	auto_ptr<GroupUndoItem> group(new GroupUndoItem);
-	for (vector<CadObject*>::iterator i = m_objects.begin();
-		i != m_objects.end(); i++)
-	{
-		group->AddItem(new AddObjectUndoItem(*i));
-		*i = 0;
-	}
-	g_undoManager.AddWork(group.release());
+	auto_ptr<UndoItem> item(new AddObjectsUndoItem(m_objects));
+	m_objects.assign(m_objects.size(), 0);
+	g_undoManager.AddWork(item.release());
 	ExitTool();
 }
 
@@ -1712,6 +1911,33 @@ void RedoTool::Start()
 }
 
 
+REGISTER_TOOL(L"undolimit", UndoLimitTool);
+
+
+void UndoLimitTool::Start()
+{
+	wchar_t buffer[128];
+	int len = swprintf(buffer, sizeof(buffer) / sizeof(buffer[0]),
+			L"Undo history takes %.1f MB in memory", g_undoManager.GetMemorySize() / (1024.0 * 1024.0));
+	assert(len > 0);
+	g_console.Log(buffer);
+	len = swprintf(buffer, sizeof(buffer) / sizeof(buffer[0]),
+			L"Specify memory limit of undo history in MB <%lu>:",
+			static_cast<unsigned long>(g_undoManager.GetMemoryLimit() >> 20));
+	assert(len > 0);
+	g_console.SetPrompt(buffer);
+}
+
+
+void UndoLimitTool::Command(const wstring & cmd)
+{
+	unsigned long limit;
+	if (swscanf(cmd.c_str(), L"%lu", &limit) == 1 && limit > 0)
+		g_undoManager.SetMemoryLimit(static_cast<size_t>(limit) << 20);
+	ExitTool();
+}
+
+
 typedef SelectWrapperTool<EraseTool> WrappedEraseTool;
 REGISTER_TOOL(L"erase", WrappedEraseTool);
 
@@ -1736,13 +1962,94 @@ Point<int> WorldToScreen(float x, float y)
 }
 
 
+Point<int> GdiRenderTarget::WorldToScreen(const Point<double> & pt) const
+{
+	return ::WorldToScreen(pt);
+}
+
+
+double GdiRenderTarget::GetMagnification() const
+{
+	return g_magification;
+}
+
+
+void GdiRenderTarget::SetPen(bool selected)
+{
+	if (SelectObject(m_hdc, selected ? g_selectedLineHPen : g_lineHPen) == NULL)
+		assert(0);
+	if (SetBkColor(m_hdc, RGB(0, 0, 0)) == CLR_INVALID)
+		assert(0);
+}
+
+
+void GdiRenderTarget::MoveTo(Point<int> pt)
+{
+	MoveToEx(m_hdc, pt.X, pt.Y, 0);
+}
+
+
+void GdiRenderTarget::LineTo(Point<int> pt)
+{
+	::LineTo(m_hdc, pt.X, pt.Y);
+}
+
+
+void GdiRenderTarget::DrawArc(Point<int> center, int radius, Point<int> start, Point<int> end, bool ccw)
+{
+	if (!SetArcDirection(m_hdc, ccw ? AD_COUNTERCLOCKWISE : AD_CLOCKWISE))
+		assert(0);
+	if (!Arc(m_hdc, center.X - radius, center.Y - radius, center.X + radius + 1, center.Y + radius + 1,
+			start.X, start.Y, end.X, end.Y))
+	{
+		assert(0);
+	}
+}
+
+
+void GdiRenderTarget::DrawCircle(Point<int> center, int radius)
+{
+	if (!Arc(m_hdc, center.X - radius, center.Y - radius, center.X + radius + 1, center.Y + radius + 1, 0, 0, 0, 0))
+		assert(0);
+}
+
+
+void GdiRenderTarget::DrawPolylines(const vector<Point<int> > & points, const vector<unsigned long> & counts)
+{
+	if (counts.empty())
+		return;
+	// Point<int> has same layout as POINT
+	assert(sizeof(Point<int>) == sizeof(POINT));
+	if (!PolyPolyline(m_hdc, reinterpret_cast<const POINT *>(&points[0]), &counts[0], static_cast<DWORD>(counts.size())))
+		assert(0);
+}
+
+
+void DrawDocument(RenderTarget & output, const Document & doc, const Rect<double> & rect)
+{
+	// all objects are sent to output in one call per pen
+	BatchRenderTarget target(output);
+	target.SetClip(rect);
+	const EntityStore & entities = doc.GetEntities();
+	vector<EntityHandle> visible;
+	doc.QueryEntities(rect, visible);
+	for (vector<EntityHandle>::reverse_iterator i = visible.rbegin();
+		i != visible.rend(); i++)
+	{
+		entities.Draw(target, *i, IsSelected(entities.GetOwner(*i)));
+	}
+	target.Flush();
+}
+
+
 void FantomManager::DrawFantoms(HDC hdc)
 {
 	SetROP2(hdc, R2_XORPEN);
+	GdiRenderTarget target(hdc);
 	for (list<CadObject *>::const_iterator i = m_fantoms.begin();
 		i != m_fantoms.end(); i++)
 	{
-		(*i)->Draw(hdc, false);
+		(*i)->Draw(target, false);
 	}
 }
 
@@ -1774,6 +2081,528 @@ void FantomManager::DeleteFantoms(HDC hdc)
 }
 
 
+ObjectHandle Document::Add(CadObject * obj)
+{
+	unsigned long slot;
+	if (m_freeSlots.empty())
+	{
+		slot = m_slots.size();
+		m_slots.push_back(Slot());
+		m_slots.back().Generation = 0;
+	}
+	else
+	{
+		slot = m_freeSlots.back();
+		m_freeSlots.pop_back();
+	}
+	Slot & s = m_slots[slot];
+	s.Object = obj;
+	s.Position = Objects.insert(Objects.end(), obj);
+	s.Entry.Order = m_nextOrder++;
+	s.Used = true;
+	obj->m_docSlot = slot;
+	IndexObject(slot);
+	return ObjectHandle(slot, s.Generation);
+}
+
+
+void Document::Remove(CadObject * obj)
+{
+	ObjectHandle handle = GetHandle(obj);
+	Detach(handle);
+	FreeSlot(handle.Slot);
+}
+
+
+void Document::Remove(const vector<CadObject *> & objects)
+{
+	for (vector<CadObject *>::const_iterator i = objects.begin(); i != objects.end(); i++)
+		Remove(*i);
+}
+
+
+CadObject * Document::Detach(ObjectHandle handle)
+{
+	assert(GetObject(handle) != 0);
+	Slot & slot = m_slots[handle.Slot];
+	CadObject * obj = slot.Object;
+	if (m_listener != 0)
+		m_listener->OnObjectChanged(obj);
+	Objects.erase(slot.Position);
+	UnindexObject(handle.Slot);
+	obj->m_docSlot = CadObject::NO_DOC_SLOT;
+	slot.Object = 0;
+	return obj;
+}
+
+
+void Document::Attach(ObjectHandle handle, CadObject * obj)
+{
+	assert(IsValid(handle) && m_slots[handle.Slot].Object == 0);
+	Slot & slot = m_slots[handle.Slot];
+	// object keeps its order, so it is drawn as before it was detached
+	slot.Object = obj;
+	slot.Position = Objects.insert(Objects.end(), obj);
+	obj->m_docSlot = handle.Slot;
+	IndexObject(handle.Slot);
+}
+
+
+void Document::Release(ObjectHandle handle)
+{
+	assert(IsValid(handle) && m_slots[handle.Slot].Object == 0);
+	FreeSlot(handle.Slot);
+}
+
+
+CadObject * Document::Replace(ObjectHandle handle, CadObject * to)
+{
+	assert(GetObject(handle) != 0);
+	Slot & slot = m_slots[handle.Slot];
+	CadObject * from = slot.Object;
+	if (m_listener != 0)
+		m_listener->OnObjectChanged(from);
+	UnindexObject(handle.Slot);
+	from->m_docSlot = CadObject::NO_DOC_SLOT;
+	*slot.Position = to;
+	slot.Object = to;
+	to->m_docSlot = handle.Slot;
+	IndexObject(handle.Slot);
+	return from;
+}
+
+
+void Document::Update(CadObject * obj)
+{
+	if (m_listener != 0)
+		m_listener->OnObjectChanged(obj);
+	assert(Contains(obj));
+	UnindexObject(obj->m_docSlot);
+	IndexObject(obj->m_docSlot);
+}
+
+
+void Document::Add(const vector<CadObject *> & objects, vector<ObjectHandle> & handles)
+{
+	BeginUpdate();
+	handles.resize(objects.size());
+	for (size_t i = 0; i < objects.size(); i++)
+		handles[i] = Add(objects[i]);
+	EndUpdate();
+}
+
+
+void Document::Detach(const vector<ObjectHandle> & handles, vector<CadObject *> & objects)
+{
+	BeginUpdate();
+	objects.resize(handles.size());
+	for (size_t i = 0; i < handles.size(); i++)
+		objects[i] = Detach(handles[i]);
+	EndUpdate();
+}
+
+
+void Document::Attach(const vector<ObjectHandle> & handles, const vector<CadObject *> & objects)
+{
+	assert(handles.size() == objects.size());
+	BeginUpdate();
+	for (size_t i = 0; i < handles.size(); i++)
+		Attach(handles[i], objects[i]);
+	EndUpdate();
+}
+
+
+void Document::Replace(const vector<ObjectHandle> & handles, vector<CadObject *> & objects)
+{
+	assert(handles.size() == objects.size());
+	BeginUpdate();
+	for (size_t i = 0; i < handles.size(); i++)
+		objects[i] = Replace(handles[i], objects[i]);
+	EndUpdate();
+}
+
+
+void Document::FreeSlot(unsigned long slot)
+{
+	Slot & s = m_slots[slot];
+	s.Used = false;
+	s.Entry.Points.clear();
+	s.Generation++;
+	m_freeSlots.push_back(slot);
+}
+
+
+void Document::EndUpdate()
+{
+	assert(m_updating > 0);
+	if (--m_updating > 0)
+		return;
+	// removing is much slower than inserting, since nodes which become
+	// underfull are reinserted
+	if (m_pending.size() > m_index.Size() || m_removed.size() > m_index.Size() / 4)
+	{
+		// rebuilding whole index, it is cheaper than changing objects one by one
+		vector<RTree<IndexItem>::Item> items;
+		vector<RTree<SnapItem>::Item> snapItems;
+		items.reserve(Objects.size());
+		for (vector<Slot>::iterator i = m_slots.begin(); i != m_slots.end(); i++)
+		{
+			if (i->Object == 0)
+				continue;
+			IndexItem item = {i->Object, i->Entry.Order, i->Entry.Handle};
+			items.push_back(make_pair(i->Entry.Bounds, item));
+			for (vector<pair<Point<double>, PointType> >::const_iterator j = i->Entry.Points.begin();
+				j != i->Entry.Points.end(); j++)
+			{
+				SnapItem snapItem = {i->Object, j->first, j->second};
+				snapItems.push_back(make_pair(Rect<double>(j->first, j->first), snapItem));
+			}
+			i->Entry.Indexed = true;
+		}
+		m_index.BulkLoad(items);
+		m_snapIndex.BulkLoad(snapItems);
+	}
+	else
+	{
+		for (vector<RTree<IndexItem>::Item>::const_iterator i = m_removed.begin(); i != m_removed.end(); i++)
+		{
+			if (!m_index.Remove(i->first, i->second))
+				assert(0);
+		}
+		for (vector<RTree<SnapItem>::Item>::const_iterator i = m_removedSnaps.begin(); i != m_removedSnaps.end(); i++)
+		{
+			if (!m_snapIndex.Remove(i->first, i->second))
+				assert(0);
+		}
+		for (vector<unsigned long>::const_iterator i = m_pending.begin(); i != m_pending.end(); i++)
+		{
+			Slot & slot = m_slots[*i];
+			// object could be removed or already indexed
+			if (slot.Object == 0 || slot.Entry.Indexed)
+				continue;
+			InsertIndexEntry(slot.Object, slot.Entry);
+			slot.Entry.Indexed = true;
+		}
+	}
+	m_pending.clear();
+	m_removed.clear();
+	m_removedSnaps.clear();
+}
+
+
+void Document::QueryItems(const Rect<double> & rect, vector<IndexItem> & result) const
+{
+	assert(m_updating == 0);
+	result.clear();
+	m_index.Query(rect, result);
+	sort(result.begin(), result.end(), &Document::IsAbove);
+}
+
+
+void Document::Query(const Rect<double> & rect, vector<CadObject *> & result) const
+{
+	vector<IndexItem> items;
+	QueryItems(rect, items);
+	result.clear();
+	result.reserve(items.size());
+	for (vector<IndexItem>::const_iterator i = items.begin(); i != items.end(); i++)
+		result.push_back(i->Object);
+}
+
+
+void Document::QueryEntities(const Rect<double> & rect, vector<EntityHandle> & result) const
+{
+	vector<IndexItem> items;
+	QueryItems(rect, items);
+	result.clear();
+	result.reserve(items.size());
+	for (vector<IndexItem>::const_iterator i = items.begin(); i != items.end(); i++)
+		result.push_back(i->Handle);
+}
+
+
+void Document::QueryIntersecting(const Rect<double> & rect, vector<CadObject *> & result) const
+{
+	vector<IndexItem> items;
+	QueryItems(rect, items);
+	result.clear();
+	for (vector<IndexItem>::const_iterator i = items.begin(); i != items.end(); i++)
+	{
+		if (m_store.IntersectsRect(i->Handle, rect))
+			result.push_back(i->Object);
+	}
+}
+
+
+bool Document::FindSnapPoint(const Point<double> & pt, double maxDist,
+		Point<double> & result, PointType & type) const
+{
+	assert(m_updating == 0);
+	SnapItem item;
+	double dist;
+	if (!m_snapIndex.Nearest(pt, maxDist, item, dist))
+		return false;
+	result = item.Position;
+	type = item.Type;
+	return true;
+}
+
+
+// copies geometry of object to entity store
+struct EntityStoreAdder : IConstCadObjVisitor
+{
+	EntityStoreAdder(EntityStore & store, CadObject * owner) : m_store(store), m_owner(owner) {}
+	EntityStore & m_store;
+	CadObject * m_owner;
+	EntityHandle m_result;
+	virtual void Visit(const CadLine & line) { m_result = m_store.AddLine(m_owner, line); }
+	virtual void Visit(const CadCircle & circle) { m_result = m_store.AddCircle(m_owner, circle); }
+	virtual void Visit(const CadArc & arc) { m_result = m_store.AddArc(m_owner, arc); }
+	virtual void Visit(const CadPolyline & polyline)
+	{
+		m_result = m_store.AddPolyline(m_owner, polyline.Closed);
+		for (vector<CadPolyline::Node>::const_iterator i = polyline.Nodes.begin(); i != polyline.Nodes.end(); i++)
+			m_store.AddPolylineNode(m_result, i->point, i->Bulge);
+	}
+	virtual void Visit(const CadInsert & insert) { m_result = m_store.AddInsert(m_owner, insert.GetBlock(), insert.GetMatrix()); }
+};
+
+
+void Document::IndexObject(unsigned long slot)
+{
+	CadObject * obj = m_slots[slot].Object;
+	IndexEntry & entry = m_slots[slot].Entry;
+	EntityStoreAdder adder(m_store, obj);
+	obj->Accept(adder);
+	entry.Handle = adder.m_result;
+	entry.Bounds = obj->GetBoundingRect();
+	entry.Points = obj->GetPoints();
+	entry.Indexed = m_updating == 0;
+	if (entry.Indexed)
+		InsertIndexEntry(obj, entry);
+	else
+		m_pending.push_back(slot);
+}
+
+
+void Document::UnindexObject(unsigned long slot)
+{
+	CadObject * obj = m_slots[slot].Object;
+	IndexEntry & entry = m_slots[slot].Entry;
+	m_store.Remove(entry.Handle);
+	if (entry.Indexed && m_updating > 0)
+	{
+		// removed by EndUpdate, object pointer is only compared there
+		IndexItem item = {obj, entry.Order, entry.Handle};
+		m_removed.push_back(make_pair(entry.Bounds, item));
+		for (vector<pair<Point<double>, PointType> >::const_iterator i = entry.Points.begin();
+			i != entry.Points.end(); i++)
+		{
+			SnapItem snapItem = {obj, i->first, i->second};
+			m_removedSnaps.push_back(make_pair(Rect<double>(i->first, i->first), snapItem));
+		}
+	}
+	else if (entry.Indexed)
+	{
+		IndexItem item = {obj, entry.Order, entry.Handle};
+		if (!m_index.Remove(entry.Bounds, item))
+			assert(0);
+		for (vector<pair<Point<double>, PointType> >::const_iterator i = entry.Points.begin();
+			i != entry.Points.end(); i++)
+		{
+			SnapItem snapItem = {obj, i->first, i->second};
+			if (!m_snapIndex.Remove(Rect<double>(i->first, i->first), snapItem))
+				assert(0);
+		}
+	}
+	entry.Indexed = false;
+}
+
+
+void Document::InsertIndexEntry(CadObject * obj, const IndexEntry & entry)
+{
+	IndexItem item = {obj, entry.Order, entry.Handle};
+	m_index.Insert(entry.Bounds, item);
+	for (vector<pair<Point<double>, PointType> >::const_iterator i = entry.Points.begin();
+		i != entry.Points.end(); i++)
+	{
+		SnapItem snapItem = {obj, i->first, i->second};
+		m_snapIndex.Insert(Rect<double>(i->first, i->first), snapItem);
+	}
+}
+
+
+static void SerializeObject(const CadObject & obj, vector<unsigned char> & result)
+{
+	result.resize(obj.Serialize(0));
+	obj.Serialize(result.empty() ? 0 : &result[0]);
+}
+
+
+// FNV-1a, only to catch base which is not the same as when difference was made
+static unsigned long HashBytes(const vector<unsigned char> & data)
+{
+	unsigned long result = 2166136261u;
+	for (vector<unsigned char>::const_iterator i = data.begin(); i != data.end(); i++)
+		result = ((result ^ *i) * 16777619u) & 0xffffffffu;
+	return result;
+}
+
+
+// approximate, with allocator overhead and virtual tables
+static size_t GetObjectMemorySize(const CadObject & obj)
+{
+	return 64 + (StoredObject::CanStore(obj) ? obj.Serialize(0) : 0);
+}
+
+
+bool StoredObject::CanStore(const CadObject & obj)
+{
+	return dynamic_cast<const CadInsert *>(&obj) == 0;
+}
+
+
+void StoredObject::Store(const CadObject & obj)
+{
+	assert(CanStore(obj));
+	Clear();
+	SerializeObject(obj, m_data);
+	m_prefix = m_suffix = 0;
+	m_stored = true;
+}
+
+
+bool StoredObject::StoreDifference(const CadObject & obj, const CadObject & base)
+{
+	assert(CanStore(obj) && CanStore(base));
+	vector<unsigned char> data, baseData;
+	SerializeObject(obj, data);
+	SerializeObject(base, baseData);
+	size_t common = min(data.size(), baseData.size());
+	size_t prefix = 0;
+	while (prefix < common && data[prefix] == baseData[prefix])
+		prefix++;
+	size_t suffix = 0;
+	while (suffix < common - prefix && data[data.size() - 1 - suffix] == baseData[baseData.size() - 1 - suffix])
+		suffix++;
+	// like moved node of polyline, anything bigger is stored whole
+	if ((data.size() - prefix - suffix) * 2 > data.size())
+		return false;
+	Clear();
+	m_data.assign(data.begin() + prefix, data.end() - suffix);
+	m_prefix = prefix;
+	m_suffix = suffix;
+	m_baseSize = baseData.size();
+	m_baseHash = HashBytes(baseData);
+	m_stored = true;
+	return true;
+}
+
+
+void StoredObject::Spill(UndoJournal & journal)
+{
+	if (!m_stored || m_journal != 0)
+		return;
+	if (!journal.Write(m_data, m_record))
+		return;
+	m_journal = &journal;
+	vector<unsigned char>().swap(m_data);
+}
+
+
+bool StoredObject::Unspill()
+{
+	if (m_journal == 0)
+		return true;
+	vector<unsigned char> data;
+	if (!m_journal->Read(m_record, data))
+		return false;
+	m_journal->Free(m_record);
+	m_journal = 0;
+	m_data.swap(data);
+	return true;
+}
+
+
+CadObject * StoredObject::Load(const CadObject * base)
+{
+	vector<unsigned char> data;
+	TakeData(data);
+	if (m_prefix + m_suffix != 0)
+	{
+		assert(base != 0);
+		vector<unsigned char> baseData;
+		SerializeObject(*base, baseData);
+		assert(baseData.size() == m_baseSize && HashBytes(baseData) == m_baseHash);
+		data.insert(data.begin(), baseData.begin(), baseData.begin() + m_prefix);
+		data.insert(data.end(), baseData.end() - m_suffix, baseData.end());
+	}
+	Clear();
+	const unsigned char * ptr = &data[0];
+	size_t size = data.size();
+	int id;
+	ReadPtr(ptr, id, size);
+	auto_ptr<CadObject> result(CreateObjectById(id));
+	result->Load(ptr, size);
+	return result.release();
+}
+
+
+void StoredObject::Store(const vector<CadObject *> & objects)
+{
+	Clear();
+	size_t size = 0;
+	for (vector<CadObject *>::const_iterator i = objects.begin(); i != objects.end(); i++)
+	{
+		assert(CanStore(**i));
+		size += (*i)->Serialize(0);
+	}
+	m_data.resize(size);
+	unsigned char * ptr = m_data.empty() ? 0 : &m_data[0];
+	for (vector<CadObject *>::const_iterator i = objects.begin(); i != objects.end(); i++)
+		ptr += (*i)->Serialize(ptr);
+	m_prefix = m_suffix = 0;
+	m_stored = true;
+}
+
+
+void StoredObject::Load(vector<CadObject *> & objects)
+{
+	vector<unsigned char> data;
+	TakeData(data);
+	assert(m_prefix + m_suffix == 0);
+	Clear();
+	const unsigned char * ptr = data.empty() ? 0 : &data[0];
+	size_t size = data.size();
+	while (size != 0)
+	{
+		int id;
+		ReadPtr(ptr, id, size);
+		auto_ptr<CadObject> obj(CreateObjectById(id));
+		obj->Load(ptr, size);
+		objects.push_back(obj.release());
+	}
+}
+
+
+void StoredObject::TakeData(vector<unsigned char> & data)
+{
+	// journal can fail to read, so it is done by Unspill where failure is handled
+	assert(m_stored && m_journal == 0);
+	data.swap(m_data);
+}
+
+
+void StoredObject::Clear()
+{
+	if (m_journal != 0)
+		m_journal->Free(m_record);
+	m_journal = 0;
+	vector<unsigned char>().swap(m_data);
+	m_stored = false;
+}
+
+
 GroupUndoItem::~GroupUndoItem()
 {
 	for (Items::iterator i = m_items.begin(); i != m_items.end(); i++)
@@ -1782,40 +2611,168 @@ GroupUndoItem::~GroupUndoItem()
 
 void GroupUndoItem::Do()
 {
+	g_doc.BeginUpdate();
 	for (Items::iterator i = m_items.begin(); i != m_items.end(); i++)
 		(*i)->Do();
+	g_doc.EndUpdate();
 }
 
 void GroupUndoItem::Undo()
 {
+	g_doc.BeginUpdate();
 	for (Items::iterator i = m_items.end(); i != m_items.begin();)
 	{
 		i--;
 		(*i)->Undo();
 	}
+	g_doc.EndUpdate();
 }
 
+size_t GroupUndoItem::GetMemorySize() const
+{
+	size_t result = sizeof(*this) + m_items.capacity() * sizeof(UndoItem *);
+	for (Items::const_iterator i = m_items.begin(); i != m_items.end(); i++)
+		result += (*i)->GetMemorySize();
+	return result;
+}
+
+void GroupUndoItem::Compact(UndoJournal * journal)
+{
+	for (Items::iterator i = m_items.begin(); i != m_items.end(); i++)
+		(*i)->Compact(journal);
+}
+
+bool GroupUndoItem::OwnsSelected() const
+{
+	for (Items::const_iterator i = m_items.begin(); i != m_items.end(); i++)
+	{
+		if ((*i)->OwnsSelected())
+			return true;
+	}
+	return false;
+}
+
+bool GroupUndoItem::Restore()
+{
+	for (Items::iterator i = m_items.begin(); i != m_items.end(); i++)
+	{
+		if (!(*i)->Restore())
+			return false;
+	}
+	return true;
+}
+
+
+AddObjectUndoItem::AddObjectUndoItem(CadObject * obj, bool done) :
+	UndoItem(done), m_added(g_doc.Contains(obj))
+{
+	if (m_added)
+		m_handle = g_doc.GetHandle(obj);
+	else
+		m_ownedObj.reset(obj);
+}
+
+AddObjectUndoItem::~AddObjectUndoItem()
+{
+	// object was detached by undo
+	if (m_added && (m_ownedObj.get() != 0 || !m_storedObj.IsEmpty()))
+		g_doc.Release(m_handle);
+}
 
 void AddObjectUndoItem::Do()
 {
-	g_doc.Objects.push_back(m_obj);
-	m_ownedObj.release();
+	CadObject * obj = m_ownedObj.get() != 0 ? m_ownedObj.release() : m_storedObj.Load(0);
+	if (m_added)
+		g_doc.Attach(m_handle, obj);
+	else
+		m_handle = g_doc.Add(obj);
+	m_added = true;
 }
 
 void AddObjectUndoItem::Undo()
 {
-	g_doc.Objects.remove(m_obj);
-	m_ownedObj.reset(m_obj);
+	// object in slot could be replaced since it was added
+	m_ownedObj.reset(g_doc.Detach(m_handle));
 }
 
+size_t AddObjectUndoItem::GetMemorySize() const
+{
+	size_t result = sizeof(*this) + m_storedObj.GetMemorySize();
+	if (m_ownedObj.get() != 0)
+		result += GetObjectMemorySize(*m_ownedObj);
+	return result;
+}
+
+void AddObjectUndoItem::Compact(UndoJournal * journal)
+{
+	// serialized object is not much smaller, so it is done only for journal
+	if (journal == 0)
+		return;
+	if (m_ownedObj.get() != 0 && StoredObject::CanStore(*m_ownedObj) && !IsSelected(m_ownedObj.get()))
+	{
+		m_storedObj.Store(*m_ownedObj);
+		m_ownedObj.reset();
+	}
+	m_storedObj.Spill(*journal);
+}
+
+bool AddObjectUndoItem::OwnsSelected() const
+{
+	return m_ownedObj.get() != 0 && IsSelected(m_ownedObj.get());
+}
+
+bool AddObjectUndoItem::Restore()
+{
+	return m_storedObj.Unspill();
+}
+
+
+AssignObjectUndoItem::AssignObjectUndoItem(CadObject * toObject, CadObject * fromObject, bool done) :
+	UndoItem(done), m_handle(g_doc.GetHandle(toObject)), m_fromObject(fromObject)
+{
+}
 
 void AssignObjectUndoItem::Do()
 {
-	list<CadObject*>::iterator pos = find(g_doc.Objects.begin(), g_doc.Objects.end(), m_toObject);
-	assert(pos != g_doc.Objects.end());
-	CadObject * t = *pos;
-	*pos = m_toObject = m_fromObject.release();
-	m_fromObject.reset(t);
+	CadObject * from = m_fromObject.get() != 0 ? m_fromObject.release() :
+			m_storedObj.Load(g_doc.GetObject(m_handle));
+	m_storedObj.Clear();
+	m_fromObject.reset(g_doc.Replace(m_handle, from));
+	// difference is made now while document is as it will be when object is needed,
+	// object itself is deleted later by Compact since tools can still refer to it
+	if (StoredObject::CanStore(*m_fromObject) && StoredObject::CanStore(*from))
+		m_storedObj.StoreDifference(*m_fromObject, *from);
+}
+
+size_t AssignObjectUndoItem::GetMemorySize() const
+{
+	size_t result = sizeof(*this) + m_storedObj.GetMemorySize();
+	if (m_fromObject.get() != 0)
+		result += GetObjectMemorySize(*m_fromObject);
+	return result;
+}
+
+void AssignObjectUndoItem::Compact(UndoJournal * journal)
+{
+	if (m_fromObject.get() != 0 && !IsSelected(m_fromObject.get()))
+	{
+		if (m_storedObj.IsEmpty() && journal != 0 && StoredObject::CanStore(*m_fromObject))
+			m_storedObj.Store(*m_fromObject);
+		if (!m_storedObj.IsEmpty())
+			m_fromObject.reset();
+	}
+	if (journal != 0)
+		m_storedObj.Spill(*journal);
+}
+
+bool AssignObjectUndoItem::OwnsSelected() const
+{
+	return m_fromObject.get() != 0 && IsSelected(m_fromObject.get());
+}
+
+bool AssignObjectUndoItem::Restore()
+{
+	return m_storedObj.Unspill();
 }
 
 
@@ -1825,6 +2782,191 @@ void AssignObjectUndoItem::Undo()
 }
 
 
+// moves objects which can be stored to stored, leaving 0 in their places
+static void StoreObjects(vector<CadObject *> & objects, StoredObject & stored)
+{
+	if (!stored.IsEmpty())
+		return;
+	vector<CadObject *> storable;
+	for (vector<CadObject *>::const_iterator i = objects.begin(); i != objects.end(); i++)
+	{
+		if (*i != 0 && StoredObject::CanStore(**i) && !IsSelected(*i))
+			storable.push_back(*i);
+	}
+	if (storable.empty())
+		return;
+	stored.Store(storable);
+	for (vector<CadObject *>::iterator i = objects.begin(); i != objects.end(); i++)
+	{
+		if (*i != 0 && StoredObject::CanStore(**i) && !IsSelected(*i))
+		{
+			delete *i;
+			*i = 0;
+		}
+	}
+}
+
+
+// puts objects of StoreObjects back to their places
+static void LoadObjects(vector<CadObject *> & objects, StoredObject & stored)
+{
+	if (stored.IsEmpty())
+		return;
+	vector<CadObject *> loaded;
+	stored.Load(loaded);
+	vector<CadObject *>::const_iterator next = loaded.begin();
+	for (vector<CadObject *>::iterator i = objects.begin(); i != objects.end(); i++)
+	{
+		if (*i == 0)
+			*i = *next++;
+	}
+	assert(next == loaded.end());
+}
+
+
+static size_t GetObjectsMemorySize(const vector<CadObject *> & objects)
+{
+	size_t result = objects.capacity() * sizeof(CadObject *);
+	for (vector<CadObject *>::const_iterator i = objects.begin(); i != objects.end(); i++)
+	{
+		if (*i != 0)
+			result += GetObjectMemorySize(**i);
+	}
+	return result;
+}
+
+
+static bool AnySelected(const vector<CadObject *> & objects)
+{
+	for (vector<CadObject *>::const_iterator i = objects.begin(); i != objects.end(); i++)
+	{
+		if (*i != 0 && IsSelected(*i))
+			return true;
+	}
+	return false;
+}
+
+
+AddObjectsUndoItem::AddObjectsUndoItem(const vector<CadObject *> & objects, bool done) :
+	UndoItem(done), m_added(!objects.empty() && g_doc.Contains(objects.front()))
+{
+	if (m_added)
+	{
+		m_handles.reserve(objects.size());
+		for (vector<CadObject *>::const_iterator i = objects.begin(); i != objects.end(); i++)
+			m_handles.push_back(g_doc.GetHandle(*i));
+	}
+	else
+	{
+		m_ownedObjs = objects;
+	}
+}
+
+AddObjectsUndoItem::~AddObjectsUndoItem()
+{
+	// objects were detached by undo
+	if (m_added && !m_ownedObjs.empty())
+	{
+		for (vector<ObjectHandle>::const_iterator i = m_handles.begin(); i != m_handles.end(); i++)
+			g_doc.Release(*i);
+	}
+	for (vector<CadObject *>::iterator i = m_ownedObjs.begin(); i != m_ownedObjs.end(); i++)
+		delete *i;
+}
+
+void AddObjectsUndoItem::Do()
+{
+	LoadObjects(m_ownedObjs, m_storedObjs);
+	if (m_added)
+		g_doc.Attach(m_handles, m_ownedObjs);
+	else
+		g_doc.Add(m_ownedObjs, m_handles);
+	m_added = true;
+	vector<CadObject *>().swap(m_ownedObjs);
+}
+
+void AddObjectsUndoItem::Undo()
+{
+	g_doc.Detach(m_handles, m_ownedObjs);
+}
+
+size_t AddObjectsUndoItem::GetMemorySize() const
+{
+	return sizeof(*this) + m_handles.capacity() * sizeof(ObjectHandle) +
+			GetObjectsMemorySize(m_ownedObjs) + m_storedObjs.GetMemorySize();
+}
+
+void AddObjectsUndoItem::Compact(UndoJournal * journal)
+{
+	if (journal == 0)
+		return;
+	StoreObjects(m_ownedObjs, m_storedObjs);
+	m_storedObjs.Spill(*journal);
+}
+
+bool AddObjectsUndoItem::OwnsSelected() const
+{
+	return AnySelected(m_ownedObjs);
+}
+
+bool AddObjectsUndoItem::Restore()
+{
+	return m_storedObjs.Unspill();
+}
+
+
+AssignObjectsUndoItem::AssignObjectsUndoItem(const vector<CadObject *> & toObjects,
+		const vector<CadObject *> & fromObjects, bool done) :
+	UndoItem(done), m_fromObjects(fromObjects)
+{
+	assert(toObjects.size() == fromObjects.size());
+	m_handles.reserve(toObjects.size());
+	for (vector<CadObject *>::const_iterator i = toObjects.begin(); i != toObjects.end(); i++)
+		m_handles.push_back(g_doc.GetHandle(*i));
+}
+
+AssignObjectsUndoItem::~AssignObjectsUndoItem()
+{
+	for (vector<CadObject *>::iterator i = m_fromObjects.begin(); i != m_fromObjects.end(); i++)
+		delete *i;
+}
+
+void AssignObjectsUndoItem::Do()
+{
+	LoadObjects(m_fromObjects, m_storedObjs);
+	g_doc.Replace(m_handles, m_fromObjects);
+}
+
+void AssignObjectsUndoItem::Undo()
+{
+	Do();
+}
+
+size_t AssignObjectsUndoItem::GetMemorySize() const
+{
+	return sizeof(*this) + m_handles.capacity() * sizeof(ObjectHandle) +
+			GetObjectsMemorySize(m_fromObjects) + m_storedObjs.GetMemorySize();
+}
+
+void AssignObjectsUndoItem::Compact(UndoJournal * journal)
+{
+	if (journal == 0)
+		return;
+	StoreObjects(m_fromObjects, m_storedObjs);
+	m_storedObjs.Spill(*journal);
+}
+
+bool AssignObjectsUndoItem::OwnsSelected() const
+{
+	return AnySelected(m_fromObjects);
+}
+
+bool AssignObjectsUndoItem::Restore()
+{
+	return m_storedObjs.Unspill();
+}
+
+
 UndoManager::~UndoManager()
 {
 	DeleteItems(m_items.begin());
@@ -1832,16 +2974,19 @@ UndoManager::~UndoManager()
 
 void UndoManager::AddWork(UndoItem * item)
 {
+	CompactLastDone();
 	DeleteItems(m_pos);
 	m_items.push_back(item);
 	m_pos = m_items.end();
 	if (!item->IsDone())
 		item->Do();
+	CountMemory(item);
+	LimitMemory();
 }
 
 bool UndoManager::CanUndo()
 {
-	return m_pos != m_items.begin();
+	return !m_locked && m_pos != m_items.begin();
 }
 
 void UndoManager::Undo()
@@ -1849,14 +2994,27 @@ void UndoManager::Undo()
 	if (!CanUndo())
 		return;
 	ExitTool();
-	m_pos--;
+	// selected objects can leave document and be deleted later
+	g_selected.clear();
+	Items::iterator prev = m_pos;
+	prev--;
+	if (!(*prev)->Restore())
+	{
+		// item and everything before it can't be undone anymore
+		DeleteItemsBefore(m_pos);
+		g_console.Log(L"Unable to read temporary file of undo history, older history is dropped");
+		return;
+	}
+	m_pos = prev;
 	(*m_pos)->Undo();
+	CountMemory(*m_pos);
+	LimitMemory();
 	InvalidateRect(g_hclientWindow, 0, true);
 }
 
 bool UndoManager::CanRedo()
 {
-	return m_pos != m_items.end();
+	return !m_locked && m_pos != m_items.end();
 }
 
 void UndoManager::Redo()
@@ -1864,15 +3022,27 @@ void UndoManager::Redo()
 	if (!CanRedo())
 		return;
 	ExitTool();
+	g_selected.clear();
+	if (!(*m_pos)->Restore())
+	{
+		DeleteItems(m_pos);
+		g_console.Log(L"Unable to read temporary file of undo history, redo history is dropped");
+		return;
+	}
 	(*m_pos)->Do();
+	CountMemory(*m_pos);
 	m_pos++;
+	LimitMemory();
 	InvalidateRect(g_hclientWindow, 0, true);
 }
 
 void UndoManager::AddGroupItem(auto_ptr<UndoItem> item)
 {
 	if (m_group.get() == 0)
+	{
+		CompactLastDone();
 		m_group.reset(new GroupUndoItem);
+	}
 	item->Do();
 	m_group->AddItem(item.release());
 }
@@ -1893,29 +3063,118 @@ void UndoManager::EndGroup()
 	DeleteItems(m_pos);
 	m_items.push_back(m_group.release());
 	m_pos = m_items.end();
+	CountMemory(m_items.back());
+	LimitMemory();
+}
+
+void UndoManager::BeginLongWork()
+{
+	assert(m_longWork == 0);
+	auto_ptr<GroupUndoItem> group(new GroupUndoItem(true));
+	m_longWork = group.get();
+	AddWork(group.release());
+}
+
+void UndoManager::AddLongWorkItem(UndoItem * item)
+{
+	assert(m_longWork != 0 && item->IsDone());
+	m_longWork->AddItem(item);
+}
+
+void UndoManager::EndLongWork()
+{
+	assert(m_longWork != 0);
+	CountMemory(m_longWork);
+	m_longWork = 0;
+	LimitMemory();
+}
+
+void UndoManager::SetMemoryLimit(size_t limit)
+{
+	m_memoryLimit = limit;
+	LimitMemory();
 }
 
 void UndoManager::DeleteItems(Items::iterator pos)
 {
 	for (Items::iterator i = pos; i != m_items.end(); i++)
+	{
+		// undo is locked while long work goes on
+		assert(*i != m_longWork);
+		m_memorySize -= (*i)->m_memorySize;
 		delete *i;
+	}
 	m_items.erase(pos, m_items.end());
 }
 
+void UndoManager::DeleteItemsBefore(Items::iterator pos)
+{
+	while (m_items.begin() != pos)
+	{
+		m_memorySize -= m_items.front()->m_memorySize;
+		delete m_items.front();
+		m_items.pop_front();
+	}
+}
+
+// should be called after item was done or undone,
+// its objects are back in memory then
+void UndoManager::CountMemory(UndoItem * item)
+{
+	m_memorySize -= item->m_memorySize;
+	item->m_memorySize = item->GetMemorySize();
+	m_memorySize += item->m_memorySize;
+	item->m_spilled = false;
+}
+
+// tools don't refer to objects of last done item once new work is started
+void UndoManager::CompactLastDone()
+{
+	if (m_pos == m_items.begin())
+		return;
+	Items::iterator last = m_pos;
+	last--;
+	(*last)->Compact(0);
+	CountMemory(*last);
+}
+
+void UndoManager::LimitMemory()
+{
+	if (m_memorySize <= m_memoryLimit)
+		return;
+	// last done item is left alone, tools can still refer to its objects
+	Items::iterator last = m_pos;
+	if (last != m_items.begin())
+		last--;
+	for (Items::iterator i = m_items.begin(); i != m_items.end() && m_memorySize > m_memoryLimit; i++)
+	{
+		if (i == last || (*i)->m_spilled || *i == m_longWork)
+			continue;
+		(*i)->Compact(&m_journal);
+		CountMemory(*i);
+		(*i)->m_spilled = true;
+	}
+	// items after unfinished long work or item with selected objects
+	// are kept too, otherwise history would have a gap
+	while (m_memorySize > m_memoryLimit && m_items.begin() != last &&
+			m_items.front() != m_longWork && !m_items.front()->OwnsSelected())
+	{
+		m_memorySize -= m_items.front()->m_memorySize;
+		delete m_items.front();
+		m_items.pop_front();
+	}
+}
+
 
 void DeleteSelectedObjects()
 {
 	if (g_selected.size() != 0)
 	{
-		auto_ptr<GroupUndoItem> group(new GroupUndoItem);
-		for (list<CadObject *>::iterator i = g_selected.begin();
-			i != g_selected.end(); i++)
-		{
-			g_defaultTool.RemoveManipulators(*i);
-			group->AddItem(new AddObjectUndoItem(*i));
-		}
+		vector<CadObject *> objects(g_selected.begin(), g_selected.end());
+		g_defaultTool.RemoveManipulators(objects);
+		auto_ptr<UndoItem> item(new AddObjectsUndoItem(objects));
 		g_selected.clear();
-		g_undoManager.AddWork(new ReverseUndoItem(group.release()));
+		g_undoManager.AddWork(new ReverseUndoItem(item.release()));
 		InvalidateRect(g_hclientWindow, 0, true);
 	}
 }
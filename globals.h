@@ -10,8 +10,12 @@
 
 
 #include "console.h"
+#include "entitystore.h"
 #include "exmath.h"
+#include "render.h"
 #include "resource.h"
+#include "rtree.h"
+#include "undojournal.h"
 #include <windows.h> // for HDC
 #undef max
 #undef min
@@ -21,6 +25,7 @@
 #include <cctype>
 #include <boost/algorithm/string.hpp>
 #include "loki/Functor.h"
+#include "loki/SmallObj.h"
 
 
 #ifndef WM_MOUSEHWHEEL
@@ -68,6 +73,24 @@ private:
 };
 
 
+// draws on windows device context using current view
+class GdiRenderTarget : public RenderTarget
+{
+public:
+	explicit GdiRenderTarget(HDC hdc) : m_hdc(hdc) {}
+	virtual Point<int> WorldToScreen(const Point<double> & pt) const;
+	virtual double GetMagnification() const;
+	virtual void SetPen(bool selected);
+	virtual void MoveTo(Point<int> pt);
+	virtual void LineTo(Point<int> pt);
+	virtual void DrawArc(Point<int> center, int radius, Point<int> start, Point<int> end, bool ccw);
+	virtual void DrawCircle(Point<int> center, int radius);
+	virtual void DrawPolylines(const std::vector<Point<int> > & points, const std::vector<unsigned long> & counts);
+private:
+	HDC m_hdc;
+};
+
+
 enum PointType
 {
 	PointTypeEndPoint,
@@ -81,6 +104,7 @@ class CadLine;
 class CadCircle;
 class CadArc;
 class CadPolyline;
+class CadInsert;
 
 
 struct IConstCadObjVisitor
@@ -90,6 +114,7 @@ struct IConstCadObjVisitor
 	virtual void Visit(const CadCircle&) = 0;
 	virtual void Visit(const CadArc&) = 0;
 	virtual void Visit(const CadPolyline&) = 0;
+	virtual void Visit(const CadInsert&) = 0;
 };
 
 
@@ -100,14 +125,21 @@ struct ICadObjVisitor
 	virtual void Visit(CadCircle&) = 0;
 	virtual void Visit(CadArc&) = 0;
 	virtual void Visit(CadPolyline&) = 0;
+	virtual void Visit(CadInsert&) = 0;
 };
 
 
-class CadObject
+// cad objects are small and are cloned often (move, rotate, paste, trim fragments),
+// those are allocated from Loki small object pool instead of general heap
+typedef Loki::SmallObject<LOKI_DEFAULT_THREADING_NO_OBJ_LEVEL, LOKI_DEFAULT_CHUNK_SIZE,
+		LOKI_MAX_SMALL_OBJECT_SIZE, 8, Loki::NoDestroy> CadObjectAllocator;
+
+
+class CadObject : public CadObjectAllocator
 {
 public:
 	virtual ~CadObject() {}
-	virtual void Draw(HDC hdc, bool selected) const = 0;
+	virtual void Draw(RenderTarget & target, bool selected) const = 0;
 	bool IntersectsRect(const Rect<double> & rect) { return IntersectsRect(rect.Pt1.X, rect.Pt1.Y, rect.Pt2.X, rect.Pt2.Y); }
 	virtual bool IntersectsRect(double x1, double y1, double x2, double y2) const = 0;
 	virtual Rect<double> GetBoundingRect() const = 0; // returns normalized bounding rectangle
@@ -122,9 +154,17 @@ public:
 	virtual void Accept(ICadObjVisitor&) = 0;
 	virtual void Accept(IConstCadObjVisitor&) const = 0;
 protected:
-	CadObject() {}
-	CadObject(const CadObject & orig) {}
+	CadObject() : m_docSlot(NO_DOC_SLOT), m_selected(false) {}
+	CadObject(const CadObject & orig) : m_docSlot(NO_DOC_SLOT), m_selected(false) {}
 	CadObject & operator=(const CadObject & orig) { return *this; }
+private:
+	static const unsigned long NO_DOC_SLOT = ~0ul;
+	// slot of document which refers to this object, set by Document
+	unsigned long m_docSlot;
+	// set by SelectionSet
+	bool m_selected;
+	friend class Document;
+	friend class SelectionSet;
 };
 
 
@@ -150,7 +190,7 @@ public:
 
 	CadLine() {}
 	CadLine(Point<double> p1, Point<double> p2) : Line(p1, p2) {}
-	virtual void Draw(HDC hdc, bool selected) const;
+	virtual void Draw(RenderTarget & target, bool selected) const;
 	virtual bool IntersectsRect(double x1, double y1, double x2, double y2) const;
 	virtual Rect<double> GetBoundingRect() const { return Line::GetBoundingRect(); }
 	virtual std::vector<Point<double> > GetManipulators();
@@ -187,7 +227,7 @@ public:
 	std::vector<Node> Nodes;
 	bool Closed;
 	CadPolyline() : Closed(false) {}
-	virtual void Draw(HDC hdc, bool selected) const;
+	virtual void Draw(RenderTarget & target, bool selected) const;
 	virtual bool IntersectsRect(double x1, double y1, double x2, double y2) const;
 	virtual Rect<double> GetBoundingRect() const;
 	virtual std::vector<Point<double> > GetManipulators();
@@ -258,7 +298,7 @@ class CadCircle : public CadObject, public Circle
 {
 public:
 	static const int ID = 2;
-	virtual void Draw(HDC hdc, bool selected) const;
+	virtual void Draw(RenderTarget & target, bool selected) const;
 	virtual bool IntersectsRect(double x1, double y1, double x2, double y2) const;
 	virtual Rect<double> GetBoundingRect() const;
 	virtual std::vector<Point<double> > GetManipulators();
@@ -283,7 +323,7 @@ public:
 	CadArc(const CircleArc & rhs) : CircleArc(rhs) {}
 	CadArc(const Circle & circle, Point<double> start, Point<double> end, bool ccw) :
 		CircleArc(circle, start, end, ccw) {}
-	virtual void Draw(HDC hdc, bool selected) const;
+	virtual void Draw(RenderTarget & target, bool selected) const;
 	virtual bool IntersectsRect(double x1, double y1, double x2, double y2) const;
 	virtual Rect<double> GetBoundingRect() const;
 	virtual std::vector<Point<double> > GetManipulators();
@@ -311,48 +351,357 @@ private:
 };
 
 
+// geometry shared by inserts, objects are placed relative to origin and are not
+// changed after block is made, block is deleted with its last insert,
+// blocks are used from main thread only so reference count is not atomic
+class CadBlock
+{
+public:
+	explicit CadBlock(const std::string & name) : m_name(name), m_bounds(0, 0, 0, 0), m_refs(0) {}
+	~CadBlock();
+	const std::string & GetName() const { return m_name; }
+	// takes ownership of object
+	void AddObject(CadObject * obj);
+	const std::vector<CadObject *> & GetObjects() const { return m_objects; }
+	// normalized, it is empty rectangle at origin for block without objects
+	const Rect<double> & GetBoundingRect() const { return m_bounds; }
+	void Draw(RenderTarget & target, bool selected) const;
+	void AddRef() { m_refs++; }
+	void Release()
+	{
+		assert(m_refs > 0);
+		if (--m_refs == 0)
+			delete this;
+	}
+private:
+	CadBlock(const CadBlock &);
+	CadBlock & operator=(const CadBlock &);
+	std::string m_name;
+	std::vector<CadObject *> m_objects;
+	Rect<double> m_bounds;
+	size_t m_refs;
+};
+
+
+// block placed into drawing with transformation,
+// any number of inserts refer to one block without copying its objects
+class CadInsert : public CadObject
+{
+public:
+	static const int ID = 5;
+
+	// block is loaded later
+	CadInsert();
+	CadInsert(CadBlock * block, const Matrix3<double> & matrix);
+	CadInsert(const CadInsert & rhs);
+	~CadInsert();
+	CadInsert & operator=(const CadInsert & rhs);
+	const CadBlock & GetBlock() const { return *m_block; }
+	// maps block coordinates to drawing coordinates
+	const Matrix3<double> & GetMatrix() const { return m_matrix; }
+	Point<double> GetInsertionPoint() const { return m_matrix * Point<double>(0, 0); }
+	// returns copy of block object placed into drawing, it should be deleted by caller
+	CadObject * MakeWorldObject(const CadObject & obj) const;
+	virtual void Draw(RenderTarget & target, bool selected) const;
+	virtual bool IntersectsRect(double x1, double y1, double x2, double y2) const;
+	virtual Rect<double> GetBoundingRect() const;
+	virtual std::vector<Point<double> > GetManipulators();
+	virtual void UpdateManip(const Point<double> & pt, int id);
+	virtual std::vector<std::pair<Point<double>, PointType> > GetPoints() const;
+	virtual void Transform(const Matrix3<double> mat) { m_matrix = mat * m_matrix; }
+	virtual CadInsert * Clone() const { return new CadInsert(*this); }
+	virtual void Assign(const CadObject & rhs);
+	// block objects are written with each insert
+	virtual size_t Serialize(unsigned char * ptr) const;
+	virtual void Load(unsigned char const *& ptr, size_t & size);
+	virtual void Accept(ICadObjVisitor & vis) { vis.Visit(*this); }
+	virtual void Accept(IConstCadObjVisitor & vis) const { vis.Visit(*this); };
+private:
+	CadBlock * m_block;
+	Matrix3<double> m_matrix;
+};
+
+
+// makes empty object of type with given ID for loading it
+CadObject * CreateObjectById(int id);
+
+
+// calls visitor(segment, number) for each segment of polyline,
+// segments are Line or CircleArc values made from nodes in place
+template <class Visitor>
+void VisitPolylineSegs(const CadPolyline & polyline, Visitor & visitor)
+{
+	const std::vector<CadPolyline::Node> & nodes = polyline.Nodes;
+	if (nodes.empty())
+		return;
+	size_t segs = polyline.Closed ? nodes.size() : nodes.size() - 1;
+	for (size_t i = 0; i < segs; i++)
+	{
+		const CadPolyline::Node & node1 = nodes[i];
+		const CadPolyline::Node & node2 = nodes[i + 1 < nodes.size() ? i + 1 : 0];
+		if (node1.Bulge == 0)
+			visitor(Line(node1.point, node2.point), i);
+		else
+			visitor(ArcFrom2PtAndBulge(node1.point, node2.point, node1.Bulge), i);
+	}
+}
+
+
 template <class T>
-std::vector<Point<double> > Intersect2(const T & lhs, const CadPolyline & polyline1)
+struct PolylineSegIntersector
 {
-	std::vector<Point<double> > res;
-	CadPolyline2 polyline = polyline1;
-	for (CadPolyline2Iterator i = polyline.Begin(); i != polyline.End(); i++)
+	PolylineSegIntersector(const T & lhs, std::vector<Point<double> > & result) : m_lhs(lhs), m_result(result) {}
+	const T & m_lhs;
+	std::vector<Point<double> > & m_result;
+	void operator()(const Line & seg, size_t) { Add(Intersect(m_lhs, seg)); }
+	void operator()(const CircleArc & seg, size_t) { Add(Intersect(m_lhs, seg)); }
+	void Add(const IntersectResult & res) { m_result.insert(m_result.end(), res.begin(), res.end()); }
+};
+
+// appends points to result, no allocations are made if result has enough capacity
+template <class T>
+void Intersect2(const T & lhs, const CadPolyline & polyline, std::vector<Point<double> > & result)
+{
+	PolylineSegIntersector<T> intersector(lhs, result);
+	VisitPolylineSegs(polyline, intersector);
+}
+
+template <class T>
+void Intersect2(const T & lhs, const CadObject & rhs, std::vector<Point<double> > & result);
+
+template <class T>
+void Intersect2(const T & lhs, const CadInsert & insert, std::vector<Point<double> > & result)
+{
+	const std::vector<CadObject *> & objects = insert.GetBlock().GetObjects();
+	for (std::vector<CadObject *>::const_iterator i = objects.begin(); i != objects.end(); i++)
 	{
-		std::vector<Point<double> > subres = Intersect2(lhs, **i);
-		res.insert(res.end(), subres.begin(), subres.end());
+		std::auto_ptr<CadObject> obj(insert.MakeWorldObject(**i));
+		Intersect2(lhs, *obj, result);
 	}
-	return res;
 }
 
 template <class T>
-std::vector<Point<double> > Intersect2(const T & lhs, const CadObject & rhs)
+void Intersect2(const T & lhs, const CadObject & rhs, std::vector<Point<double> > & result)
 {
 	struct RhsDispatch : IConstCadObjVisitor
 	{
-		RhsDispatch(const T & lhs) : m_lhs(lhs) {}
+		RhsDispatch(const T & lhs, std::vector<Point<double> > & result) : m_lhs(lhs), m_result(result) {}
 		const T & m_lhs;
-		std::vector<Point<double> > m_result;
-		virtual void Visit(const CadLine & rhs) {m_result = Intersect(m_lhs, rhs);}
-		virtual void Visit(const CadCircle & rhs) {m_result = Intersect(m_lhs, rhs);}
-		virtual void Visit(const CadArc & rhs) {m_result = Intersect(m_lhs, rhs);}
-		virtual void Visit(const CadPolyline & rhs) {m_result = Intersect2(m_lhs, rhs);}
-	} dispatch(lhs);
+		std::vector<Point<double> > & m_result;
+		virtual void Visit(const CadLine & rhs) {Add(Intersect(m_lhs, rhs));}
+		virtual void Visit(const CadCircle & rhs) {Add(Intersect(m_lhs, rhs));}
+		virtual void Visit(const CadArc & rhs) {Add(Intersect(m_lhs, rhs));}
+		virtual void Visit(const CadPolyline & rhs) {Intersect2(m_lhs, rhs, m_result);}
+		virtual void Visit(const CadInsert & rhs) {Intersect2(m_lhs, rhs, m_result);}
+		void Add(const IntersectResult & res) { m_result.insert(m_result.end(), res.begin(), res.end()); }
+	} dispatch(lhs, result);
 	rhs.Accept(dispatch);
-	return dispatch.m_result;
+}
+
+template <class T>
+std::vector<Point<double> > Intersect2(const T & lhs, const CadPolyline & polyline)
+{
+	std::vector<Point<double> > res;
+	Intersect2(lhs, polyline, res);
+	return res;
+}
+
+template <class T>
+std::vector<Point<double> > Intersect2(const T & lhs, const CadObject & rhs)
+{
+	std::vector<Point<double> > res;
+	Intersect2(lhs, rhs, res);
+	return res;
 }
 
 std::vector<Point<double> > Intersect2(const CadObject & lhs, const CadObject & rhs);
 
 
+// refers to object of document, stays valid while object is in document and
+// while it is detached, after object is removed or released handle becomes stale
+// and its slot can be reused by other object with different generation
+struct ObjectHandle
+{
+	unsigned long Slot;
+	unsigned long Generation;
+	ObjectHandle() : Slot(~0ul), Generation(0) {}
+	ObjectHandle(unsigned long slot, unsigned long generation) : Slot(slot), Generation(generation) {}
+};
+
+
+// notified about objects of document which are modified in place,
+// replaced or removed
+class DocumentListener
+{
+public:
+	virtual void OnObjectChanged(CadObject * obj) = 0;
+protected:
+	~DocumentListener() {}
+};
+
+
 class Document
 {
 public:
 	std::list<CadObject *> Objects;
+	Document() : m_nextOrder(0), m_updating(0), m_listener(0) {}
 	~Document()
 	{
 		for (std::list<CadObject *>::iterator i = Objects.begin(); i != Objects.end(); i++)
 			delete *i;
 	}
+	// all operations on single object take constant time
+	// plus time of updating spatial index
+	ObjectHandle Add(CadObject * obj);
+	// removes object, caller becomes owner of it
+	void Remove(CadObject * obj);
+	void Remove(const std::vector<CadObject *> & objects);
+	// removes object but keeps its handle, so it or its copy can be put back
+	// by Attach, caller becomes owner of object until then
+	CadObject * Detach(ObjectHandle handle);
+	void Attach(ObjectHandle handle, CadObject * obj);
+	// forgets detached object, its handle becomes stale
+	void Release(ObjectHandle handle);
+	// puts object to in place of object with given handle,
+	// returns previous object which is now owned by caller
+	CadObject * Replace(ObjectHandle handle, CadObject * to);
+	// same as above for many objects with single update of spatial index
+	void Add(const std::vector<CadObject *> & objects, std::vector<ObjectHandle> & handles);
+	void Detach(const std::vector<ObjectHandle> & handles, std::vector<CadObject *> & objects);
+	void Attach(const std::vector<ObjectHandle> & handles, const std::vector<CadObject *> & objects);
+	// objects are exchanged with objects in document
+	void Replace(const std::vector<ObjectHandle> & handles, std::vector<CadObject *> & objects);
+	// should be called after object was modified in place
+	void Update(CadObject * obj);
+	bool Contains(const CadObject * obj) const
+	{
+		return obj->m_docSlot < m_slots.size() && m_slots[obj->m_docSlot].Object == obj;
+	}
+	// object should be in document
+	ObjectHandle GetHandle(const CadObject * obj) const
+	{
+		assert(Contains(obj));
+		return ObjectHandle(obj->m_docSlot, m_slots[obj->m_docSlot].Generation);
+	}
+	// returns 0 if handle is stale or object is detached
+	CadObject * GetObject(ObjectHandle handle) const
+	{
+		return IsValid(handle) ? m_slots[handle.Slot].Object : 0;
+	}
+	// between those calls spatial index is not updated, large batches
+	// of added or removed objects make index to be bulk loaded at the end
+	void BeginUpdate() { m_updating++; }
+	void EndUpdate();
+	// returns objects which bounding rectangles intersects given rectangle,
+	// topmost objects go first
+	void Query(const Rect<double> & rect, std::vector<CadObject *> & result) const;
+	// same as Query but returns handles of entities in entity store
+	void QueryEntities(const Rect<double> & rect, std::vector<EntityHandle> & result) const;
+	// returns objects which intersect given normalized rectangle, topmost first,
+	// geometry is tested in entity store
+	void QueryIntersecting(const Rect<double> & rect, std::vector<CadObject *> & result) const;
+	// geometry of all objects in contiguous arrays
+	const EntityStore & GetEntities() const { return m_store; }
+	// finds object snap point closest to given point within maxDist
+	bool FindSnapPoint(const Point<double> & pt, double maxDist,
+			Point<double> & result, PointType & type) const;
+	void SetListener(DocumentListener * listener) { m_listener = listener; }
+	DocumentListener * GetListener() const { return m_listener; }
+private:
+	struct IndexItem
+	{
+		CadObject * Object;
+		unsigned long Order;
+		EntityHandle Handle;
+		bool operator==(const IndexItem & rhs) const { return Object == rhs.Object; }
+	};
+	struct SnapItem
+	{
+		CadObject * Object;
+		Point<double> Position;
+		PointType Type;
+		bool operator==(const SnapItem & rhs) const
+		{
+			return Object == rhs.Object && Position == rhs.Position && Type == rhs.Type;
+		}
+	};
+	struct IndexEntry
+	{
+		Rect<double> Bounds;
+		// snap points as they were at the moment of indexing
+		std::vector<std::pair<Point<double>, PointType> > Points;
+		unsigned long Order;
+		EntityHandle Handle;
+		bool Indexed;
+	};
+	struct Slot
+	{
+		// 0 if slot is free or its object is detached
+		CadObject * Object;
+		// position in Objects, used only while object is attached
+		std::list<CadObject *>::iterator Position;
+		IndexEntry Entry;
+		// incremented when slot is freed
+		unsigned long Generation;
+		bool Used;
+	};
+	RTree<IndexItem> m_index;
+	RTree<SnapItem> m_snapIndex;
+	EntityStore m_store;
+	std::vector<Slot> m_slots;
+	std::vector<unsigned long> m_freeSlots;
+	// slots waiting for EndUpdate to be indexed
+	std::vector<unsigned long> m_pending;
+	// items waiting for EndUpdate to be removed from indexes
+	std::vector<RTree<IndexItem>::Item> m_removed;
+	std::vector<RTree<SnapItem>::Item> m_removedSnaps;
+	unsigned long m_nextOrder;
+	int m_updating;
+	DocumentListener * m_listener;
+	bool IsValid(ObjectHandle handle) const
+	{
+		return handle.Slot < m_slots.size() && m_slots[handle.Slot].Used &&
+				m_slots[handle.Slot].Generation == handle.Generation;
+	}
+	void FreeSlot(unsigned long slot);
+	void IndexObject(unsigned long slot);
+	void UnindexObject(unsigned long slot);
+	void InsertIndexEntry(CadObject * obj, const IndexEntry & entry);
+	void QueryItems(const Rect<double> & rect, std::vector<IndexItem> & result) const;
+	static bool IsAbove(const IndexItem & lhs, const IndexItem & rhs) { return lhs.Order > rhs.Order; }
+	Document(const Document &);
+	Document & operator=(const Document &);
+};
+
+
+// selected objects in order of selection, checking whether object is selected
+// takes constant time since objects keep flag of selection,
+// so there can be only one selection set
+class SelectionSet
+{
+public:
+	typedef std::list<CadObject *>::iterator iterator;
+	typedef std::list<CadObject *>::const_iterator const_iterator;
+	SelectionSet() {}
+	iterator begin() { return m_objects.begin(); }
+	iterator end() { return m_objects.end(); }
+	const_iterator begin() const { return m_objects.begin(); }
+	const_iterator end() const { return m_objects.end(); }
+	size_t size() const { return m_objects.size(); }
+	bool empty() const { return m_objects.empty(); }
+	bool Contains(const CadObject * obj) const { return obj->m_selected; }
+	// does nothing if object is already selected
+	void push_back(CadObject * obj);
+	iterator erase(iterator pos);
+	void remove(CadObject * obj);
+	// removes many objects in one pass over selection
+	void remove(const std::vector<CadObject *> & objects);
+	void clear();
+private:
+	std::list<CadObject *> m_objects;
+	static bool IsNotSelected(const CadObject * obj) { return !obj->m_selected; }
+	SelectionSet(const SelectionSet &);
+	SelectionSet & operator=(const SelectionSet &);
 };
 
 
@@ -417,6 +766,7 @@ public:
 	virtual void Exiting();
 	virtual void Command(const std::wstring & cmd);
 	void RemoveManipulators(CadObject * obj);
+	void RemoveManipulators(const std::vector<CadObject *> & objects);
 private:
 	enum State {Selecting, MovingManip};
 	static const int MANIP_SIZE = 10; // pixels
@@ -516,6 +866,15 @@ public:
 };
 
 
+// sets memory limit of undo history in megabytes
+class UndoLimitTool : public Tool
+{
+public:
+	virtual void Start();
+	virtual void Command(const std::wstring & cmd);
+};
+
+
 class EraseTool : public virtual Tool
 {
 public:
@@ -619,6 +978,53 @@ private:
 };
 
 
+// Object kept by undo history in compact form, serialized whole or as
+// difference from object which will be in document when it is loaded back.
+// Data can be moved to journal.
+class StoredObject
+{
+public:
+	StoredObject() : m_stored(false), m_journal(0) {}
+	~StoredObject() { Clear(); }
+	bool IsEmpty() const { return !m_stored; }
+	// inserts share their blocks, so those are not stored
+	static bool CanStore(const CadObject & obj);
+	void Store(const CadObject & obj);
+	// stores only bytes which differ from base, base should have same value
+	// when object is loaded, returns false and stores nothing if that
+	// doesn't save memory
+	bool StoreDifference(const CadObject & obj, const CadObject & base);
+	// leaves data in memory if journal can't be written
+	void Spill(UndoJournal & journal);
+	// reads data back from journal, returns false and leaves it
+	// there if journal can't be read
+	bool Unspill();
+	// returns stored object and becomes empty, data should be in memory
+	CadObject * Load(const CadObject * base);
+	// stores many objects whole, all of them should be possible to store
+	void Store(const std::vector<CadObject *> & objects);
+	// appends objects stored by above function and becomes empty
+	void Load(std::vector<CadObject *> & objects);
+	size_t GetMemorySize() const { return m_data.capacity(); }
+	void Clear();
+private:
+	bool m_stored;
+	// number of bytes same as in base at beginning and at end of object,
+	// both are 0 if whole object is stored
+	size_t m_prefix;
+	size_t m_suffix;
+	size_t m_baseSize;
+	unsigned long m_baseHash;
+	std::vector<unsigned char> m_data;
+	// set when data is in journal
+	UndoJournal * m_journal;
+	unsigned long m_record;
+	void TakeData(std::vector<unsigned char> & data);
+	StoredObject(const StoredObject &);
+	StoredObject & operator=(const StoredObject &);
+};
+
+
 class UndoItem
 {
 public:
@@ -626,9 +1032,25 @@ public:
 	virtual void Do() = 0;
 	virtual void Undo() = 0;
 	bool IsDone() { return m_done; }
+	// memory taken by item and objects it owns
+	virtual size_t GetMemorySize() const = 0;
+	// keeps owned objects in compact form, moves them to journal if it is given,
+	// objects which are still selected are kept as they are
+	virtual void Compact(UndoJournal * journal) {}
+	// true if item owns object which is still selected, tools can refer
+	// to it, so item can't be deleted
+	virtual bool OwnsSelected() const { return false; }
+	// brings objects moved to journal by Compact back to memory before Do or Undo,
+	// returns false if journal can't be read, item can't be done or undone then
+	virtual bool Restore() { return true; }
 protected:
 	bool m_done;
-	UndoItem(bool done) : m_done(done) {}
+	UndoItem(bool done) : m_done(done), m_memorySize(0), m_spilled(false) {}
+private:
+	// as it was counted by UndoManager
+	size_t m_memorySize;
+	bool m_spilled;
+	friend class UndoManager;
 };
 
 
@@ -638,6 +1060,10 @@ public:
 	ReverseUndoItem(UndoItem * base, bool done = false) : UndoItem(done), m_base(base) {}
 	virtual void Do() { m_base->Undo(); }
 	virtual void Undo() { m_base->Do(); }
+	virtual size_t GetMemorySize() const { return sizeof(*this) + m_base->GetMemorySize(); }
+	virtual void Compact(UndoJournal * journal) { m_base->Compact(journal); }
+	virtual bool OwnsSelected() const { return m_base->OwnsSelected(); }
+	virtual bool Restore() { return m_base->Restore(); }
 private:
 	std::auto_ptr<UndoItem> m_base;
 };
@@ -650,6 +1076,10 @@ public:
 	~GroupUndoItem();
 	virtual void Do();
 	virtual void Undo();
+	virtual size_t GetMemorySize() const;
+	virtual void Compact(UndoJournal * journal);
+	virtual bool OwnsSelected() const;
+	virtual bool Restore();
 	void AddItem(UndoItem * item) { m_items.push_back(item); }
 private:
 	typedef std::vector<UndoItem *> Items;
@@ -658,38 +1088,106 @@ private:
 };
 
 
+// object can be already in document, then undo detaches it,
+// otherwise item owns object until it is added
 class AddObjectUndoItem : public UndoItem
 {
 public:
-	AddObjectUndoItem(CadObject * obj, bool done = false) :
-		UndoItem(done), m_obj(obj)
-		{ if (!done) m_ownedObj.reset(obj); }
+	AddObjectUndoItem(CadObject * obj, bool done = false);
+	~AddObjectUndoItem();
 	virtual void Do();
 	virtual void Undo();
+	virtual size_t GetMemorySize() const;
+	virtual void Compact(UndoJournal * journal);
+	virtual bool OwnsSelected() const;
+	virtual bool Restore();
 private:
-	CadObject * m_obj;
+	// set once object got handle in document
+	bool m_added;
+	ObjectHandle m_handle;
+	// object while it is not in document, kept in one of those
 	std::auto_ptr<CadObject> m_ownedObj;
+	StoredObject m_storedObj;
 };
 
 
+// toObject should be in document
 class AssignObjectUndoItem : public UndoItem
 {
 public:
-	AssignObjectUndoItem(CadObject * toObject, CadObject * fromObject, bool done = false) :
-		UndoItem(done), m_toObject(toObject), m_fromObject(fromObject) {}
+	AssignObjectUndoItem(CadObject * toObject, CadObject * fromObject, bool done = false);
 	virtual void Do();
 	virtual void Undo();
+	virtual size_t GetMemorySize() const;
+	virtual void Compact(UndoJournal * journal);
+	virtual bool OwnsSelected() const;
+	virtual bool Restore();
 private:
-	CadObject * m_toObject;
+	ObjectHandle m_handle;
+	// object which is put to document by Do, kept as it is
+	// until Compact and also as difference once it is done
 	std::auto_ptr<CadObject> m_fromObject;
+	StoredObject m_storedObj;
 };
 
 
+// adds many objects with single update of document,
+// like group of AddObjectUndoItem without item for each object
+class AddObjectsUndoItem : public UndoItem
+{
+public:
+	// objects should be either all in document or all not in it,
+	// in later case item owns them until those are added
+	AddObjectsUndoItem(const std::vector<CadObject *> & objects, bool done = false);
+	~AddObjectsUndoItem();
+	virtual void Do();
+	virtual void Undo();
+	virtual size_t GetMemorySize() const;
+	virtual void Compact(UndoJournal * journal);
+	virtual bool OwnsSelected() const;
+	virtual bool Restore();
+private:
+	bool m_added;
+	std::vector<ObjectHandle> m_handles;
+	// objects while those are not in document, 0 for ones in m_storedObjs
+	std::vector<CadObject *> m_ownedObjs;
+	StoredObject m_storedObjs;
+};
+
+
+// replaces many objects with single update of document, objects are kept
+// whole, so it is for cases like moving where all of object changes
+class AssignObjectsUndoItem : public UndoItem
+{
+public:
+	// toObjects should be in document
+	AssignObjectsUndoItem(const std::vector<CadObject *> & toObjects,
+			const std::vector<CadObject *> & fromObjects, bool done = false);
+	~AssignObjectsUndoItem();
+	virtual void Do();
+	virtual void Undo();
+	virtual size_t GetMemorySize() const;
+	virtual void Compact(UndoJournal * journal);
+	virtual bool OwnsSelected() const;
+	virtual bool Restore();
+private:
+	std::vector<ObjectHandle> m_handles;
+	// objects which are put to document by Do, 0 for ones in m_storedObjs
+	std::vector<CadObject *> m_fromObjects;
+	StoredObject m_storedObjs;
+};
+
+
+// undo history above memory limit is moved to journal, oldest items first,
+// if that is not enough oldest items are deleted
 class UndoManager
 {
 public:
-	UndoManager() : m_pos(m_items.begin()) {}
+	UndoManager() : m_pos(m_items.begin()), m_longWork(0), m_locked(false),
+		m_memoryLimit(DEFAULT_MEMORY_LIMIT), m_memorySize(0) {}
 	~UndoManager();
+	// while locked undo and redo are not possible, new work can be added
+	void SetLocked(bool locked) { m_locked = locked; }
 	bool CanUndo();
 	void Undo();
 	bool CanRedo();
@@ -698,12 +1196,32 @@ public:
 	void AddGroupItem(std::auto_ptr<UndoItem> item);
 	void RemoveGroupItem();
 	void EndGroup();
+	// work which is added in parts while user can do other work, like import,
+	// it is in history from beginning but isn't counted or dropped until it is ended,
+	// items should be done
+	void BeginLongWork();
+	void AddLongWorkItem(UndoItem * item);
+	void EndLongWork();
+	void SetMemoryLimit(size_t limit);
+	size_t GetMemoryLimit() const { return m_memoryLimit; }
+	size_t GetMemorySize() const { return m_memorySize; }
+	static const size_t DEFAULT_MEMORY_LIMIT = 128 << 20;
 private:
 	typedef std::list<UndoItem *> Items;
 	Items m_items;
 	Items::iterator m_pos;
 	std::auto_ptr<GroupUndoItem> m_group;
+	// item of unfinished long work, it is in m_items
+	GroupUndoItem * m_longWork;
+	bool m_locked;
+	UndoJournal m_journal;
+	size_t m_memoryLimit;
+	size_t m_memorySize;
 	void DeleteItems(Items::iterator pos);
+	void DeleteItemsBefore(Items::iterator pos);
+	void CountMemory(UndoItem * item);
+	void CompactLastDone();
+	void LimitMemory();
 };
 
 
@@ -779,8 +1297,10 @@ extern PointType g_objSnapType;
 extern Point<int> g_objSnapPos;
 extern bool g_canSnap;
 
-extern std::list<CadObject *> g_selected;
+extern SelectionSet g_selected;
 extern unsigned int g_clipboardFormat;
+// temporary file with objects of last copy, empty if those are in clipboard itself
+extern std::string g_clipboardFile;
 
 
 Point<int> WorldToScreen(float x, float y);
@@ -835,6 +1355,9 @@ void DrawObjectSnap(HDC hdc, Point<int> pos, PointType type);
 
 bool IsSelected(const CadObject * obj);
 
+// draws document objects which are inside of rect, bottommost first
+void DrawDocument(RenderTarget & target, const Document & doc, const Rect<double> & rect);
+
 
 template<class T>
 size_t WritePtr(unsigned char * &ptr, T val)
@@ -859,6 +1382,8 @@ void ReadPtr(unsigned char const * &ptr, T & val, size_t & size)
 }
 
 void DeleteSelectedObjects();
+// deletes temporary files of copies which clipboard doesn't refer to anymore
+void DeleteUnusedClipboardFiles();
 void ExecuteCommand(const std::wstring & cmd);
 void Cancel();
 inline bool IsKey(const std::wstring & cmd, const std::wstring & key) {
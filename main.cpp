@@ -1,5 +1,7 @@
 #include "console.h"
 #include "dxf.h"
+#include "exchange.h"
+#include "gcad.h"
 #include "globals.h"
 #include "resource.h"
 #include <windows.h>
@@ -37,6 +39,7 @@ bool g_objSnapDrawn = false;
 PointType g_objSnapType;
 Point<int> g_objSnapPos;
 unsigned int g_clipboardFormat;
+std::string g_clipboardFile;
 
 
 void DrawObjectSnap(HDC hdc, Point<int> pos, PointType type)
@@ -122,6 +125,7 @@ LRESULT CALLBACK ClientWndProc(HWND hwnd, UINT msg, WPARAM wparam, LPARAM lparam
 		HDC hdc = BeginPaint(hwnd, &paintStruct);
 		if (hdc == 0)
 			return 0;
+		UpdateGcadPages();
 		Point<float> updateMin = ScreenToWorld(paintStruct.rcPaint.left, paintStruct.rcPaint.bottom);
 		Point<float> updateMax = ScreenToWorld(paintStruct.rcPaint.right, paintStruct.rcPaint.top);
 		Point<float> gridMin, gridMax;
@@ -153,11 +157,14 @@ LRESULT CALLBACK ClientWndProc(HWND hwnd, UINT msg, WPARAM wparam, LPARAM lparam
 			}
 		}
 
-		for (list<CadObject *>::const_iterator i = g_doc.Objects.begin();
-			i != g_doc.Objects.end(); i++)
-		{
-			(*i)->Draw(hdc, IsSelected(*i));
-		}
+		// drawing only objects inside update rectangle,
+		// rectangle is extended by a pixel for pen width
+		double border = 1 / g_magification;
+		Rect<double> updateRect(updateMin.X - border, updateMin.Y - border,
+				updateMax.X + border, updateMax.Y + border);
+		GdiRenderTarget target(hdc);
+		DrawDocument(target, g_doc, updateRect);
+		DrawGcadPages(target, updateRect);
 
 		g_defaultTool.DrawManipulators(hdc);
 		g_selector.DrawLasso(hdc);
@@ -468,76 +475,48 @@ LRESULT CALLBACK ClientWndProc(HWND hwnd, UINT msg, WPARAM wparam, LPARAM lparam
 					{
 						if (g_objectSnapEnable)
 						{
-							bool first = true;
-							double minDist;
 							Point<double> best;
 							PointType bestType;
-							// finding closest point
-							for (list<CadObject *>::iterator i = g_doc.Objects.begin();
-								i != g_doc.Objects.end(); i++)
-							{
-								vector<pair<Point<double>, PointType> > points = (*i)->GetPoints();
-								for (vector<pair<Point<double>, PointType> >::iterator j = points.begin();
-									j != points.end(); j++)
-								{
-									double dx = j->first.X - g_cursorWrld.X;
-									double dy = j->first.Y - g_cursorWrld.Y;
-									double dist = sqrt(dx*dx + dy*dy);
-									if (dist < minDist || first)
-									{
-										first = false;
-										minDist = dist;
-										best = j->first;
-										bestType = j->second;
-									}
-								}
-							}
-							// if found
-							if (!first)
+							// finding closest point within 50 pixels
+							if (g_doc.FindSnapPoint(g_cursorWrld, 50 / g_magification, best, bestType))
 							{
 								Point<int> bestScn = WorldToScreen(best);
-								bool show = false;
-								if (minDist * g_magification < 50)
-								{
-									show = true;
-								}
-								if (minDist * g_magification < 5)
+								double dx = best.X - g_cursorWrld.X;
+								double dy = best.Y - g_cursorWrld.Y;
+								if (sqrt(dx*dx + dy*dy) * g_magification < 5)
 								{
 									g_cursorWrld = best;
 									g_cursorScn = bestScn;
 									snapped = true;
 								}
-								if (show)
+								bool needDraw = false;
+								if (g_objSnapDrawn)
 								{
-									bool needDraw = false;
-									if (g_objSnapDrawn)
-									{
-										if (g_objSnapPos != bestScn || g_objSnapType != bestType)
-										{
-											// erasing
-											DrawObjectSnap(hdc, g_objSnapPos, g_objSnapType);
-											needDraw = true;
-										}
-									}
-									else
+									if (g_objSnapPos != bestScn || g_objSnapType != bestType)
 									{
+										// erasing
+										DrawObjectSnap(hdc, g_objSnapPos, g_objSnapType);
 										needDraw = true;
 									}
-									if (needDraw)
-									{
-										DrawObjectSnap(hdc, bestScn, bestType);
-										g_objSnapDrawn = true;
-										g_objSnapPos = bestScn;
-										g_objSnapType = bestType;
-									}
 								}
 								else
 								{
-									if (g_objSnapDrawn)
-									{
-										DrawObjectSnap(hdc, g_objSnapPos, g_objSnapType);
-										g_objSnapDrawn = false;
-									}
+									needDraw = true;
+								}
+								if (needDraw)
+								{
+									DrawObjectSnap(hdc, bestScn, bestType);
+									g_objSnapDrawn = true;
+									g_objSnapPos = bestScn;
+									g_objSnapType = bestType;
+								}
+							}
+							else
+							{
+								if (g_objSnapDrawn)
+								{
+									DrawObjectSnap(hdc, g_objSnapPos, g_objSnapType);
+									g_objSnapDrawn = false;
 								}
 							}
 						}
@@ -818,13 +797,26 @@ LRESULT CALLBACK MainWndProc(HWND hwnd, UINT msg, WPARAM wparam, LPARAM lparam)
 		g_hclientWindow = CreateWindowExW(0, MAINCLIENTCLASS, L"", WS_CHILD | WS_VISIBLE | WS_HSCROLL | WS_VSCROLL, 0, 0, 0, 0, hwnd, reinterpret_cast<HMENU>(1), g_hInstance, 0);
 		if (g_hclientWindow == 0)
 			return -1;
-		g_clipboardFormat = RegisterClipboardFormatW(L"805e724a-d4d2-4fd7-ac7e-bbd4641f220a");
+		g_clipboardFormat = RegisterClipboardFormatW(L"0e7bdbb5-1184-452f-a889-9ae86adb45d2");
 		if (!g_clipboardFormat)
 			assert(0);
+		// left by instances which exited while clipboard referred to their files
+		DeleteUnusedClipboardFiles();
+		return 0;
+	case WM_DESTROYCLIPBOARD:
+		// objects copied through temporary file are not needed anymore
+		DeleteExchangeFile(g_clipboardFile);
+		g_clipboardFile.clear();
 		return 0;
 	case WM_DESTROY:
+		CancelDxfImport();
+		CloseGcadPages();
+		DeleteUnusedClipboardFiles();
 		PostQuitMessage(0);
 		return 0;
+	case WM_DXFIMPORT:
+		OnDxfImportMessage(wparam, lparam);
+		return 0;
 	case WM_NOTIFY:
 		NMHDR * nmhdr;
 		nmhdr = reinterpret_cast<NMHDR*>(lparam);
@@ -851,9 +843,21 @@ LRESULT CALLBACK MainWndProc(HWND hwnd, UINT msg, WPARAM wparam, LPARAM lparam)
 		case ID_FILE_CLOSE:
 			DestroyWindow(hwnd);
 			return 0;
+		case ID_FILE_OPEN:
+			OpenGcad(hwnd);
+			return 0;
+		case ID_FILE_OPENPAGED:
+			OpenGcadPaged(hwnd);
+			return 0;
+		case ID_FILE_SAVE:
+			SaveGcad(hwnd);
+			return 0;
 		case ID_FILE_IMPORTDXF:
 			ImportDxf(hwnd);
 			return 0;
+		case ID_FILE_EXPORTDXF:
+			ExportDxf(hwnd);
+			return 0;
 		case ID_EDIT_UNDO:
 			ExecuteCommand(L"u");
 			break;
@@ -0,0 +1,595 @@
+/*
+ * render.cpp
+ *
+ *  Created on: 18.10.2026
+ *      Author: misha
+ */
+#include "render.h"
+#include <algorithm>
+#include <cstdlib>
+
+
+using namespace std;
+
+
+// arcs with radius of one pixel or less can't be seen as curves
+static bool IsArcTooSmall(int radius)
+{
+	return radius <= 1;
+}
+
+
+void DrawCircleArc(RenderTarget & target, const CircleArc & arc)
+{
+	if (arc.Radius != 0 && arc.Radius < 10E+10)
+	{
+		Point<int> start = target.WorldToScreen(arc.Start);
+		Point<int> end = target.WorldToScreen(arc.End);
+		int r = static_cast<int>(floor(arc.Radius * target.GetMagnification() + 0.5));
+		if (IsArcTooSmall(r))
+		{
+			target.MoveTo(start);
+			target.LineTo(end);
+		}
+		else
+		{
+			target.DrawArc(target.WorldToScreen(arc.Center), r, start, end, arc.Ccw);
+		}
+	}
+}
+
+
+void DrawCircleArcTo(RenderTarget & target, const CircleArc & arc)
+{
+	if (arc.Radius != 0 && arc.Radius < 10E+10)
+	{
+		Point<int> start = target.WorldToScreen(arc.Start);
+		Point<int> end = target.WorldToScreen(arc.End);
+		int r = static_cast<int>(floor(arc.Radius * target.GetMagnification() + 0.5));
+		target.LineTo(start);
+		if (!IsArcTooSmall(r))
+		{
+			target.DrawArc(target.WorldToScreen(arc.Center), r, start, end, arc.Ccw);
+			target.MoveTo(end);
+		}
+		target.LineTo(end);
+	}
+}
+
+
+void DrawDot(RenderTarget & target, const Point<double> & pt)
+{
+	Point<int> scn = target.WorldToScreen(pt);
+	target.MoveTo(scn);
+	target.LineTo(Point<int>(scn.X + 1, scn.Y));
+}
+
+
+void DrawLineEntity(RenderTarget & target, const Point<double> & pt1, const Point<double> & pt2)
+{
+	const double mag = target.GetMagnification();
+	if (fabs(pt2.X - pt1.X) * mag < 1 && fabs(pt2.Y - pt1.Y) * mag < 1)
+	{
+		DrawDot(target, pt1);
+		return;
+	}
+	Point<int> from = target.WorldToScreen(pt1);
+	Point<int> to = target.WorldToScreen(pt2);
+	target.MoveTo(from);
+	target.LineTo(to);
+	target.LineTo(Point<int>(to.X + 1, to.Y));
+}
+
+
+void DrawCircleEntity(RenderTarget & target, const Point<double> & center, double radius)
+{
+	const double mag = target.GetMagnification();
+	if (2 * radius * mag < 1)
+		DrawDot(target, center);
+	else
+		target.DrawCircle(target.WorldToScreen(center), static_cast<int>(radius * mag + 0.5));
+}
+
+
+void DrawArcEntity(RenderTarget & target, const CircleArc & arc)
+{
+	if (2 * arc.Radius * target.GetMagnification() < 1)
+		DrawDot(target, arc.Start);
+	else
+		DrawCircleArc(target, arc);
+}
+
+
+void DrawPolylineEntity(RenderTarget & target, const double * xs, const double * ys, const double * bulges,
+		size_t count, bool closed)
+{
+	assert(count > 0);
+	// bulged segments can go out of nodes bounding rectangle,
+	// those are accounted roughly
+	double minX = xs[0], maxX = xs[0], minY = ys[0], maxY = ys[0];
+	double maxBulge = 0;
+	for (size_t j = 1; j < count; j++)
+	{
+		minX = min(minX, xs[j]);
+		maxX = max(maxX, xs[j]);
+		minY = min(minY, ys[j]);
+		maxY = max(maxY, ys[j]);
+	}
+	for (size_t j = 0; j < count; j++)
+		maxBulge = max(maxBulge, fabs(bulges[j]));
+	if (max(maxX - minX, maxY - minY) * (1 + maxBulge * maxBulge) * target.GetMagnification() < 1)
+	{
+		DrawDot(target, Point<double>(minX, minY));
+		return;
+	}
+	target.MoveTo(target.WorldToScreen(Point<double>(xs[0], ys[0])));
+	size_t segs = closed ? count : count - 1;
+	for (size_t j = 0; j < segs; j++)
+	{
+		size_t next = j + 1 < count ? j + 1 : 0;
+		Point<double> to(xs[next], ys[next]);
+		if (bulges[j] == 0)
+			target.LineTo(target.WorldToScreen(to));
+		else
+			DrawCircleArcTo(target, ArcFrom2PtAndBulge(Point<double>(xs[j], ys[j]), to, bulges[j]));
+	}
+}
+
+
+SoftwareRenderTarget::SoftwareRenderTarget(int width, int height) :
+	m_width(width), m_height(height), m_pixels(width * height * 4),
+	m_origin(0, 0), m_magnification(1), m_pos(0, 0), m_dashed(false), m_dashPhase(0)
+{
+	assert(width > 0 && height > 0);
+	Clear(0, 0, 0);
+}
+
+
+void SoftwareRenderTarget::SetView(const Point<double> & origin, double magnification)
+{
+	assert(magnification > 0);
+	m_origin = origin;
+	m_magnification = magnification;
+}
+
+
+void SoftwareRenderTarget::FitView(const Rect<double> & rect)
+{
+	double width = rect.Pt2.X - rect.Pt1.X;
+	double height = rect.Pt2.Y - rect.Pt1.Y;
+	double mag;
+	if (width <= 0 && height <= 0)
+		mag = 1;
+	else if (width <= 0)
+		mag = (m_height - 1) / height;
+	else if (height <= 0)
+		mag = (m_width - 1) / width;
+	else
+		mag = min((m_width - 1) / width, (m_height - 1) / height);
+	Point<double> origin(
+		(rect.Pt1.X + rect.Pt2.X) / 2 - m_width / 2 / mag,
+		(rect.Pt1.Y + rect.Pt2.Y) / 2 + m_height / 2 / mag);
+	SetView(origin, mag);
+}
+
+
+void SoftwareRenderTarget::Clear(unsigned char r, unsigned char g, unsigned char b)
+{
+	for (size_t i = 0; i < m_pixels.size(); i += 4)
+	{
+		m_pixels[i] = r;
+		m_pixels[i + 1] = g;
+		m_pixels[i + 2] = b;
+		m_pixels[i + 3] = 255;
+	}
+}
+
+
+Point<int> SoftwareRenderTarget::WorldToScreen(const Point<double> & pt) const
+{
+	double x = floor((pt.X - m_origin.X) * m_magnification + 0.5);
+	double y = floor((m_origin.Y - pt.Y) * m_magnification + 0.5);
+	// keeping far away points representable, those are clipped anyway
+	const double limit = numeric_limits<int>::max() / 4;
+	return Point<int>(static_cast<int>(max(-limit, min(limit, x))),
+			static_cast<int>(max(-limit, min(limit, y))));
+}
+
+
+void SoftwareRenderTarget::SetPen(bool selected)
+{
+	// same look as gdi pens, selected lines are dotted
+	m_dashed = selected;
+	m_dashPhase = 0;
+}
+
+
+void SoftwareRenderTarget::Plot(int x, int y)
+{
+	if (m_dashed && (m_dashPhase++ & 1) != 0)
+		return;
+	if (x < 0 || x >= m_width || y < 0 || y >= m_height)
+		return;
+	unsigned char * pixel = &m_pixels[(y * m_width + x) * 4];
+	pixel[0] = pixel[1] = pixel[2] = pixel[3] = 255;
+}
+
+
+// Liang-Barsky clipping against buffer extended by one pixel,
+// returns false if line is fully outside
+bool SoftwareRenderTarget::ClipLine(Point<double> & from, Point<double> & to, bool & endClipped) const
+{
+	double t0 = 0, t1 = 1;
+	double dx = to.X - from.X;
+	double dy = to.Y - from.Y;
+	double p[4] = {-dx, dx, -dy, dy};
+	double q[4] = {from.X + 1, m_width - from.X, from.Y + 1, m_height - from.Y};
+	for (int i = 0; i < 4; i++)
+	{
+		if (p[i] == 0)
+		{
+			if (q[i] < 0)
+				return false;
+			continue;
+		}
+		double t = q[i] / p[i];
+		if (p[i] < 0)
+			t0 = max(t0, t);
+		else
+			t1 = min(t1, t);
+		if (t0 > t1)
+			return false;
+	}
+	endClipped = t1 < 1;
+	to = Point<double>(from.X + t1 * dx, from.Y + t1 * dy);
+	from = Point<double>(from.X + t0 * dx, from.Y + t0 * dy);
+	return true;
+}
+
+
+void SoftwareRenderTarget::LineTo(Point<int> pt)
+{
+	Point<double> from = m_pos;
+	Point<double> to = pt;
+	m_pos = pt;
+	bool endClipped;
+	if (!ClipLine(from, to, endClipped))
+		return;
+	int x = static_cast<int>(floor(from.X + 0.5));
+	int y = static_cast<int>(floor(from.Y + 0.5));
+	int x2 = static_cast<int>(floor(to.X + 0.5));
+	int y2 = static_cast<int>(floor(to.Y + 0.5));
+	// Bresenham
+	int dx = abs(x2 - x);
+	int dy = -abs(y2 - y);
+	int sx = x < x2 ? 1 : -1;
+	int sy = y < y2 ? 1 : -1;
+	int err = dx + dy;
+	while (x != x2 || y != y2)
+	{
+		Plot(x, y);
+		int e2 = 2 * err;
+		if (e2 >= dy)
+		{
+			err += dy;
+			x += sx;
+		}
+		if (e2 <= dx)
+		{
+			err += dx;
+			y += sy;
+		}
+	}
+	// last pixel of clipped line is not the real end of line
+	if (endClipped)
+		Plot(x2, y2);
+}
+
+
+static double ScreenAngle(Point<int> center, Point<int> pt)
+{
+	// y axis on screen points down
+	return atan2(static_cast<double>(center.Y - pt.Y), static_cast<double>(pt.X - center.X));
+}
+
+
+// finds parts of arc which are inside clip rectangle, parts are pairs of angles
+// relative to start of arc, clip is in screen coordinates, so huge arcs of
+// zoomed in view are approximated only where those can be seen
+static void ClipArc(Point<int> center, int radius, double startAng, double sweep, const Rect<double> & clip,
+		vector<pair<double, double> > & parts)
+{
+	parts.clear();
+	const double cx = center.X, cy = center.Y, r = radius;
+	if (cx + r < clip.Pt1.X || cx - r > clip.Pt2.X || cy + r < clip.Pt1.Y || cy - r > clip.Pt2.Y)
+		return;
+	if (clip.Pt1.X <= cx - r && cx + r <= clip.Pt2.X && clip.Pt1.Y <= cy - r && cy + r <= clip.Pt2.Y)
+	{
+		parts.push_back(make_pair(0.0, sweep));
+		return;
+	}
+	// arc is split where circle crosses sides of rectangle
+	vector<double> cuts;
+	cuts.reserve(10);
+	cuts.push_back(0);
+	cuts.push_back(sweep);
+	const double xs[2] = {clip.Pt1.X, clip.Pt2.X};
+	const double ys[2] = {clip.Pt1.Y, clip.Pt2.Y};
+	for (int i = 0; i < 2; i++)
+	{
+		// y axis on screen points down
+		double c = (xs[i] - cx) / r;
+		double s = (cy - ys[i]) / r;
+		double angles[4];
+		int found = 0;
+		if (fabs(c) <= 1)
+		{
+			angles[found++] = acos(c);
+			angles[found++] = -acos(c);
+		}
+		if (fabs(s) <= 1)
+		{
+			angles[found++] = asin(s);
+			angles[found++] = M_PI - asin(s);
+		}
+		for (int j = 0; j < found; j++)
+		{
+			double rel = fmod(angles[j] - startAng + 4*M_PI, 2*M_PI);
+			if (rel < sweep)
+				cuts.push_back(rel);
+		}
+	}
+	sort(cuts.begin(), cuts.end());
+	for (size_t i = 0; i + 1 < cuts.size(); i++)
+	{
+		if (cuts[i + 1] <= cuts[i])
+			continue;
+		double mid = startAng + (cuts[i] + cuts[i + 1]) / 2;
+		double x = cx + r * cos(mid);
+		double y = cy - r * sin(mid);
+		if (x < clip.Pt1.X || x > clip.Pt2.X || y < clip.Pt1.Y || y > clip.Pt2.Y)
+			continue;
+		// neighbouring visible parts are joined
+		if (!parts.empty() && parts.back().second == cuts[i])
+			parts.back().second = cuts[i + 1];
+		else
+			parts.push_back(make_pair(cuts[i], cuts[i + 1]));
+	}
+}
+
+
+static Point<int> ArcPoint(Point<int> center, int radius, double ang)
+{
+	return Point<int>(static_cast<int>(floor(center.X + radius * cos(ang) + 0.5)),
+			static_cast<int>(floor(center.Y - radius * sin(ang) + 0.5)));
+}
+
+
+void SoftwareRenderTarget::DrawArc(Point<int> center, int radius, Point<int> start, Point<int> end, bool ccw)
+{
+	double startAng = ScreenAngle(center, ccw ? start : end);
+	double endAng = ScreenAngle(center, ccw ? end : start);
+	double sweep = fmod(endAng - startAng + 4*M_PI, 2*M_PI);
+	if (sweep == 0)
+		sweep = 2*M_PI;
+	RasterizeArc(center, radius, startAng, sweep);
+}
+
+
+void SoftwareRenderTarget::DrawCircle(Point<int> center, int radius)
+{
+	RasterizeArc(center, radius, 0, 2*M_PI);
+}
+
+
+void SoftwareRenderTarget::DrawPolylines(const vector<Point<int> > & points, const vector<unsigned long> & counts)
+{
+	size_t pos = 0;
+	for (vector<unsigned long>::const_iterator i = counts.begin(); i != counts.end(); i++)
+	{
+		assert(pos + *i <= points.size());
+		if (*i > 0)
+		{
+			MoveTo(points[pos]);
+			for (size_t j = pos + 1; j < pos + *i; j++)
+				LineTo(points[j]);
+		}
+		pos += *i;
+	}
+}
+
+
+void SoftwareRenderTarget::RasterizeArc(Point<int> center, int radius, double startAng, double sweep)
+{
+	if (radius < 0)
+		return;
+	// skipping circles which don't cross buffer
+	if (center.X + radius < 0 || center.X - radius >= m_width ||
+		center.Y + radius < 0 || center.Y - radius >= m_height)
+	{
+		return;
+	}
+	if (radius > 2 * (m_width + m_height))
+	{
+		// huge arcs are approximated by lines with error below half of pixel,
+		// midpoint algorithm would walk the whole circumference,
+		// only parts over buffer are approximated
+		double step = 2 * acos(1 - 0.5 / radius);
+		ClipArc(center, radius, startAng, sweep, Rect<double>(-1, -1, m_width, m_height), m_arcParts);
+		Point<int> savedPos = m_pos;
+		for (vector<pair<double, double> >::const_iterator part = m_arcParts.begin(); part != m_arcParts.end(); part++)
+		{
+			double partSweep = part->second - part->first;
+			int segs = max(1, static_cast<int>(ceil(partSweep / step)));
+			for (int i = 0; i <= segs; i++)
+			{
+				Point<int> pt = ArcPoint(center, radius, startAng + part->first + partSweep * i / segs);
+				if (i == 0)
+					m_pos = pt;
+				else
+					LineTo(pt);
+			}
+		}
+		m_pos = savedPos;
+		return;
+	}
+	bool full = sweep >= 2*M_PI;
+	// midpoint circle algorithm, each step gives one point in every octant
+	int x = radius;
+	int y = 0;
+	int err = 1 - radius;
+	while (x >= y)
+	{
+		const int pts[8][2] = {
+			{x, y}, {y, x}, {-y, x}, {-x, y},
+			{-x, -y}, {-y, -x}, {y, -x}, {x, -y}};
+		for (int i = 0; i < 8; i++)
+		{
+			int px = center.X + pts[i][0];
+			int py = center.Y - pts[i][1];
+			if (!full)
+			{
+				double ang = atan2(static_cast<double>(pts[i][1]), static_cast<double>(pts[i][0]));
+				if (fmod(ang - startAng + 4*M_PI, 2*M_PI) > sweep)
+					continue;
+			}
+			Plot(px, py);
+		}
+		y++;
+		if (err < 0)
+		{
+			err += 2 * y + 1;
+		}
+		else
+		{
+			x--;
+			err += 2 * (y - x) + 1;
+		}
+	}
+}
+
+
+void BatchRenderTarget::Flush()
+{
+	for (int i = 0; i < 2; i++)
+	{
+		Batch & batch = m_batches[i];
+		if (batch.Counts.empty())
+			continue;
+		m_output.SetPen(i != 0);
+		m_output.DrawPolylines(batch.Points, batch.Counts);
+		batch.Points.clear();
+		batch.Counts.clear();
+	}
+	m_open = false;
+}
+
+
+void BatchRenderTarget::SetPen(bool selected)
+{
+	if (selected == m_selected)
+		return;
+	m_selected = selected;
+	m_open = false;
+}
+
+
+void BatchRenderTarget::MoveTo(Point<int> pt)
+{
+	m_pos = pt;
+	m_open = false;
+}
+
+
+void BatchRenderTarget::LineTo(Point<int> pt)
+{
+	Batch & batch = m_batches[m_selected ? 1 : 0];
+	if (!m_open)
+	{
+		batch.Points.push_back(m_pos);
+		batch.Counts.push_back(1);
+		m_open = true;
+	}
+	batch.Points.push_back(pt);
+	batch.Counts.back()++;
+	m_pos = pt;
+}
+
+
+void BatchRenderTarget::DrawArc(Point<int> center, int radius, Point<int> start, Point<int> end, bool ccw)
+{
+	double startAng = ScreenAngle(center, ccw ? start : end);
+	double endAng = ScreenAngle(center, ccw ? end : start);
+	double sweep = fmod(endAng - startAng + 4*M_PI, 2*M_PI);
+	if (sweep == 0)
+		sweep = 2*M_PI;
+	AddArc(center, radius, startAng, sweep);
+}
+
+
+void BatchRenderTarget::DrawCircle(Point<int> center, int radius)
+{
+	AddArc(center, radius, 0, 2*M_PI);
+}
+
+
+void BatchRenderTarget::DrawPolylines(const vector<Point<int> > & points, const vector<unsigned long> & counts)
+{
+	size_t pos = 0;
+	for (vector<unsigned long>::const_iterator i = counts.begin(); i != counts.end(); i++)
+	{
+		if (*i > 0)
+		{
+			MoveTo(points[pos]);
+			for (size_t j = pos + 1; j < pos + *i; j++)
+				LineTo(points[j]);
+		}
+		pos += *i;
+	}
+}
+
+
+void BatchRenderTarget::SetClip(const Rect<double> & rect)
+{
+	Point<int> pt1 = m_output.WorldToScreen(rect.Pt1);
+	Point<int> pt2 = m_output.WorldToScreen(rect.Pt2);
+	// margin keeps ends of clipped arcs out of sight
+	const double margin = 2;
+	m_clip = Rect<double>(min(pt1.X, pt2.X) - margin, min(pt1.Y, pt2.Y) - margin,
+			max(pt1.X, pt2.X) + margin, max(pt1.Y, pt2.Y) + margin);
+	m_clipped = true;
+}
+
+
+void BatchRenderTarget::AddArc(Point<int> center, int radius, double startAng, double sweep)
+{
+	if (radius <= 0)
+		return;
+	// number of segments is chosen so that error is below half of pixel,
+	// small arcs get only few segments
+	double step = radius > 1 ? 2 * acos(1 - 0.5 / radius) : M_PI / 2;
+	m_arcParts.clear();
+	if (m_clipped)
+		ClipArc(center, radius, startAng, sweep, m_clip, m_arcParts);
+	else
+		m_arcParts.push_back(make_pair(0.0, sweep));
+	if (m_arcParts.empty())
+		return;
+	Point<int> savedPos = m_pos;
+	for (vector<pair<double, double> >::const_iterator part = m_arcParts.begin(); part != m_arcParts.end(); part++)
+	{
+		double partSweep = part->second - part->first;
+		int segs = max(part->first == 0 && part->second == sweep ? 2 : 1, static_cast<int>(ceil(partSweep / step)));
+		for (int i = 0; i <= segs; i++)
+		{
+			Point<int> pt = ArcPoint(center, radius, startAng + part->first + partSweep * i / segs);
+			if (i == 0)
+				MoveTo(pt);
+			else
+				LineTo(pt);
+		}
+	}
+	// arc includes its last pixel like gdi does
+	LineTo(Point<int>(m_pos.X + 1, m_pos.Y));
+	MoveTo(savedPos);
+}
@@ -0,0 +1,173 @@
+/*
+ * render.h
+ *
+ *  Created on: 18.10.2026
+ *      Author: misha
+ */
+
+#ifndef RENDER_H_
+#define RENDER_H_
+
+
+#include "exmath.h"
+#include <vector>
+
+
+// surface on which cad objects are drawn,
+// drawing coordinates are in pixels with y axis pointing down
+class RenderTarget
+{
+public:
+	virtual ~RenderTarget() {}
+	virtual Point<int> WorldToScreen(const Point<double> & pt) const = 0;
+	// pixels per world unit
+	virtual double GetMagnification() const = 0;
+	virtual void SetPen(bool selected) = 0;
+	virtual void MoveTo(Point<int> pt) = 0;
+	// draws line from current position, last pixel is not drawn
+	virtual void LineTo(Point<int> pt) = 0;
+	// draws arc from ray going through start to ray going through end,
+	// ccw means counter clockwise in world coordinates,
+	// current position is not changed
+	virtual void DrawArc(Point<int> center, int radius, Point<int> start, Point<int> end, bool ccw) = 0;
+	virtual void DrawCircle(Point<int> center, int radius) = 0;
+	// draws several polylines with current pen, counts contains number of points
+	// in each polyline, last point of each polyline is not drawn
+	virtual void DrawPolylines(const std::vector<Point<int> > & points, const std::vector<unsigned long> & counts) = 0;
+protected:
+	RenderTarget() {}
+private:
+	RenderTarget(const RenderTarget &);
+	RenderTarget & operator=(const RenderTarget &);
+};
+
+
+// arcs with radius of one pixel or less are drawn as chords
+void DrawCircleArc(RenderTarget & target, const CircleArc & arc);
+// draws from current position and leaves it at the end of arc
+void DrawCircleArcTo(RenderTarget & target, const CircleArc & arc);
+
+
+// geometry of document entities, shared by document and by drawing
+// of dxf files without document, entities smaller than a pixel are drawn as dots
+void DrawDot(RenderTarget & target, const Point<double> & pt);
+void DrawLineEntity(RenderTarget & target, const Point<double> & pt1, const Point<double> & pt2);
+void DrawCircleEntity(RenderTarget & target, const Point<double> & center, double radius);
+void DrawArcEntity(RenderTarget & target, const CircleArc & arc);
+// bulge of node is for segment which starts at it, count should not be 0
+void DrawPolylineEntity(RenderTarget & target, const double * xs, const double * ys, const double * bulges,
+		size_t count, bool closed);
+
+
+// draws into other target mapping world coordinates with matrix,
+// used for inserts of blocks, circles are scaled with average scale of matrix
+class TransformRenderTarget : public RenderTarget
+{
+public:
+	TransformRenderTarget(RenderTarget & output, const Matrix3<double> & matrix) :
+		m_output(output), m_matrix(matrix), m_scale(LengthScale(matrix)), m_mirror(IsMirroring(matrix)) {}
+	virtual Point<int> WorldToScreen(const Point<double> & pt) const { return m_output.WorldToScreen(m_matrix * pt); }
+	virtual double GetMagnification() const { return m_output.GetMagnification() * m_scale; }
+	virtual void SetPen(bool selected) { m_output.SetPen(selected); }
+	virtual void MoveTo(Point<int> pt) { m_output.MoveTo(pt); }
+	virtual void LineTo(Point<int> pt) { m_output.LineTo(pt); }
+	virtual void DrawArc(Point<int> center, int radius, Point<int> start, Point<int> end, bool ccw)
+	{
+		m_output.DrawArc(center, radius, start, end, m_mirror ? !ccw : ccw);
+	}
+	virtual void DrawCircle(Point<int> center, int radius) { m_output.DrawCircle(center, radius); }
+	virtual void DrawPolylines(const std::vector<Point<int> > & points, const std::vector<unsigned long> & counts)
+	{
+		m_output.DrawPolylines(points, counts);
+	}
+private:
+	RenderTarget & m_output;
+	Matrix3<double> m_matrix;
+	double m_scale;
+	bool m_mirror;
+};
+
+
+// draws into memory buffer of RGBA pixels without any windowing system,
+// used for previews and for measuring drawing speed
+class SoftwareRenderTarget : public RenderTarget
+{
+public:
+	SoftwareRenderTarget(int width, int height);
+	// origin is world point at top left corner of buffer
+	void SetView(const Point<double> & origin, double magnification);
+	// sets view so that rectangle is centered and fits into buffer
+	void FitView(const Rect<double> & rect);
+	void Clear(unsigned char r, unsigned char g, unsigned char b);
+	int GetWidth() const { return m_width; }
+	int GetHeight() const { return m_height; }
+	// row by row, 4 bytes per pixel
+	const std::vector<unsigned char> & GetPixels() const { return m_pixels; }
+
+	virtual Point<int> WorldToScreen(const Point<double> & pt) const;
+	virtual double GetMagnification() const { return m_magnification; }
+	virtual void SetPen(bool selected);
+	virtual void MoveTo(Point<int> pt) { m_pos = pt; }
+	virtual void LineTo(Point<int> pt);
+	virtual void DrawArc(Point<int> center, int radius, Point<int> start, Point<int> end, bool ccw);
+	virtual void DrawCircle(Point<int> center, int radius);
+	virtual void DrawPolylines(const std::vector<Point<int> > & points, const std::vector<unsigned long> & counts);
+private:
+	int m_width;
+	int m_height;
+	std::vector<unsigned char> m_pixels;
+	Point<double> m_origin;
+	double m_magnification;
+	Point<int> m_pos;
+	bool m_dashed;
+	unsigned int m_dashPhase;
+	std::vector<std::pair<double, double> > m_arcParts;
+	void Plot(int x, int y);
+	bool ClipLine(Point<double> & from, Point<double> & to, bool & endClipped) const;
+	void RasterizeArc(Point<int> center, int radius, double startAng, double sweep);
+};
+
+
+// collects everything drawn into per pen arrays of polylines
+// and sends those to output target in one call per pen on Flush,
+// arcs are approximated by lines
+class BatchRenderTarget : public RenderTarget
+{
+public:
+	explicit BatchRenderTarget(RenderTarget & output) :
+		m_output(output), m_selected(false), m_pos(0, 0), m_open(false), m_clipped(false) {}
+	~BatchRenderTarget() { Flush(); }
+	void Flush();
+	// arcs are approximated only inside of given world rectangle,
+	// lines are left to output
+	void SetClip(const Rect<double> & rect);
+
+	virtual Point<int> WorldToScreen(const Point<double> & pt) const { return m_output.WorldToScreen(pt); }
+	virtual double GetMagnification() const { return m_output.GetMagnification(); }
+	virtual void SetPen(bool selected);
+	virtual void MoveTo(Point<int> pt);
+	virtual void LineTo(Point<int> pt);
+	virtual void DrawArc(Point<int> center, int radius, Point<int> start, Point<int> end, bool ccw);
+	virtual void DrawCircle(Point<int> center, int radius);
+	virtual void DrawPolylines(const std::vector<Point<int> > & points, const std::vector<unsigned long> & counts);
+private:
+	struct Batch
+	{
+		std::vector<Point<int> > Points;
+		std::vector<unsigned long> Counts;
+	};
+	RenderTarget & m_output;
+	Batch m_batches[2];
+	bool m_selected;
+	Point<int> m_pos;
+	// true if last polyline of current batch ends at current position
+	bool m_open;
+	bool m_clipped;
+	// in screen coordinates
+	Rect<double> m_clip;
+	std::vector<std::pair<double, double> > m_arcParts;
+	void AddArc(Point<int> center, int radius, double startAng, double sweep);
+};
+
+
+#endif /* RENDER_H_ */
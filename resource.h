@@ -12,6 +12,10 @@
 #define ID_VIEW_SELECT                  40001
 #define ID_FILE_CLOSE					40002
 #define ID_FILE_IMPORTDXF               40003
+#define ID_FILE_EXPORTDXF               40011
+#define ID_FILE_OPEN                    40012
+#define ID_FILE_SAVE                    40013
+#define ID_FILE_OPENPAGED               40014
 #define ID_VIEW_ZOOM                    40004
 #define ID_VIEW_PAN                     40005
 #define ID_40006                        40006
@@ -33,7 +37,7 @@
 #ifdef APSTUDIO_INVOKED
 #ifndef APSTUDIO_READONLY_SYMBOLS
 #define _APS_NEXT_RESOURCE_VALUE        117
-#define _APS_NEXT_COMMAND_VALUE         40010
+#define _APS_NEXT_COMMAND_VALUE         40015
 #define _APS_NEXT_CONTROL_VALUE         1001
 #define _APS_NEXT_SYMED_VALUE           101
 #endif
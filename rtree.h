@@ -0,0 +1,537 @@
+/*
+ * rtree.h
+ *
+ *  Created on: 18.10.2026
+ *      Author: misha
+ */
+
+#ifndef RTREE_H_
+#define RTREE_H_
+
+
+#include "exmath.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <utility>
+#include <vector>
+
+
+// R-tree of values keyed by normalized rectangles.
+// Incremental inserts use Guttman's quadratic split,
+// bulk loading uses Sort-Tile-Recursive packing.
+// Values must be default constructible and comparable with ==.
+template <class T>
+class RTree
+{
+public:
+	typedef std::pair<Rect<double>, T> Item;
+
+	RTree() : m_root(new Node(true)), m_size(0) {}
+	~RTree() { DeleteNode(m_root); }
+	size_t Size() const { return m_size; }
+	void Clear();
+	void Insert(const Rect<double> & rect, const T & value);
+	// rect must be the same rectangle value was inserted with
+	bool Remove(const Rect<double> & rect, const T & value);
+	// replaces content of tree, items are reordered
+	void BulkLoad(std::vector<Item> & items);
+	// calls visitor(rect, value) for each value which rectangle intersects given one
+	template <class Visitor>
+	void Query(const Rect<double> & rect, Visitor & visitor) const;
+	void Query(const Rect<double> & rect, std::vector<T> & result) const;
+	// finds value which rectangle is closest to given point but not farther than maxDist,
+	// returns false if there is no such value
+	bool Nearest(const Point<double> & pt, double maxDist, T & result, double & dist) const;
+
+private:
+	static const int MAX_ENTRIES = 16;
+	static const int MIN_ENTRIES = 6;
+	static const int MAX_DEPTH = 16;
+
+	struct Node
+	{
+		explicit Node(bool leaf) : Leaf(leaf), Count(0) {}
+		bool Leaf;
+		int Count;
+		// one extra slot for overflow before split
+		Rect<double> Rects[MAX_ENTRIES + 1];
+		Node * Children[MAX_ENTRIES + 1];
+		T Values[MAX_ENTRIES + 1];
+	};
+
+	struct CenterXLess
+	{
+		template <class E>
+		bool operator()(const E & lhs, const E & rhs) const
+		{
+			return lhs.first.Pt1.X + lhs.first.Pt2.X < rhs.first.Pt1.X + rhs.first.Pt2.X;
+		}
+	};
+
+	struct CenterYLess
+	{
+		template <class E>
+		bool operator()(const E & lhs, const E & rhs) const
+		{
+			return lhs.first.Pt1.Y + lhs.first.Pt2.Y < rhs.first.Pt1.Y + rhs.first.Pt2.Y;
+		}
+	};
+
+	struct Collector
+	{
+		explicit Collector(std::vector<T> & result) : m_result(result) {}
+		void operator()(const Rect<double> &, const T & value) { m_result.push_back(value); }
+		std::vector<T> & m_result;
+	};
+
+	Node * m_root;
+	size_t m_size;
+
+	static double Area(const Rect<double> & rect)
+	{
+		return (rect.Pt2.X - rect.Pt1.X) * (rect.Pt2.Y - rect.Pt1.Y);
+	}
+	static double DistSquared(const Rect<double> & rect, const Point<double> & pt)
+	{
+		double dx = std::max(std::max(rect.Pt1.X - pt.X, pt.X - rect.Pt2.X), 0.0);
+		double dy = std::max(std::max(rect.Pt1.Y - pt.Y, pt.Y - rect.Pt2.Y), 0.0);
+		return dx*dx + dy*dy;
+	}
+	static Rect<double> CalcBounds(const Node * node);
+	static void DeleteNode(Node * node);
+	static void AddEntry(Node * node, const Rect<double> & rect, Node * child, const T & value);
+	static void RemoveEntry(Node * node, int pos);
+	static void CollectItems(const Node * node, std::vector<Item> & result);
+	static int ChooseSubtree(const Node * node, const Rect<double> & rect);
+	static Node * Split(Node * node);
+	static Node * InsertRec(Node * node, const Rect<double> & rect, const T & value);
+	static bool RemoveRec(Node * node, const Rect<double> & rect, const T & value, std::vector<Item> & orphans);
+	template <class E>
+	static void SortTiles(std::vector<E> & entries);
+	void InsertItem(const Rect<double> & rect, const T & value);
+
+	RTree(const RTree &);
+	RTree & operator=(const RTree &);
+};
+
+
+template <class T>
+void RTree<T>::Clear()
+{
+	DeleteNode(m_root);
+	m_root = new Node(true);
+	m_size = 0;
+}
+
+
+template <class T>
+void RTree<T>::Insert(const Rect<double> & rect, const T & value)
+{
+	InsertItem(rect, value);
+	m_size++;
+}
+
+
+template <class T>
+bool RTree<T>::Remove(const Rect<double> & rect, const T & value)
+{
+	std::vector<Item> orphans;
+	if (!RemoveRec(m_root, rect, value, orphans))
+		return false;
+	m_size--;
+	// shrinking tree
+	while (!m_root->Leaf && m_root->Count <= 1)
+	{
+		Node * child = m_root->Count == 1 ? m_root->Children[0] : new Node(true);
+		m_root->Count = 0;
+		delete m_root;
+		m_root = child;
+	}
+	// reinserting entries of dissolved nodes
+	for (typename std::vector<Item>::const_iterator i = orphans.begin(); i != orphans.end(); i++)
+		InsertItem(i->first, i->second);
+	return true;
+}
+
+
+template <class T>
+void RTree<T>::BulkLoad(std::vector<Item> & items)
+{
+	Clear();
+	if (items.empty())
+		return;
+	m_size = items.size();
+	// packing leaves
+	SortTiles(items);
+	std::vector<std::pair<Rect<double>, Node *> > level;
+	for (size_t i = 0; i < items.size(); i += MAX_ENTRIES)
+	{
+		Node * node = new Node(true);
+		for (size_t j = i; j < items.size() && j < i + MAX_ENTRIES; j++)
+			AddEntry(node, items[j].first, 0, items[j].second);
+		level.push_back(std::make_pair(CalcBounds(node), node));
+	}
+	// packing upper levels
+	while (level.size() > 1)
+	{
+		SortTiles(level);
+		std::vector<std::pair<Rect<double>, Node *> > upper;
+		for (size_t i = 0; i < level.size(); i += MAX_ENTRIES)
+		{
+			Node * node = new Node(false);
+			for (size_t j = i; j < level.size() && j < i + MAX_ENTRIES; j++)
+				AddEntry(node, level[j].first, level[j].second, T());
+			upper.push_back(std::make_pair(CalcBounds(node), node));
+		}
+		level.swap(upper);
+	}
+	delete m_root;
+	m_root = level.front().second;
+}
+
+
+template <class T>
+template <class Visitor>
+void RTree<T>::Query(const Rect<double> & rect, Visitor & visitor) const
+{
+	const Node * stack[MAX_DEPTH * MAX_ENTRIES];
+	int top = 0;
+	stack[top++] = m_root;
+	while (top > 0)
+	{
+		const Node * node = stack[--top];
+		for (int i = 0; i < node->Count; i++)
+		{
+			if (!IsRectsIntersects(node->Rects[i], rect))
+				continue;
+			if (node->Leaf)
+			{
+				visitor(node->Rects[i], node->Values[i]);
+			}
+			else
+			{
+				assert(top < MAX_DEPTH * MAX_ENTRIES);
+				stack[top++] = node->Children[i];
+			}
+		}
+	}
+}
+
+
+template <class T>
+void RTree<T>::Query(const Rect<double> & rect, std::vector<T> & result) const
+{
+	Collector collector(result);
+	Query(rect, collector);
+}
+
+
+template <class T>
+bool RTree<T>::Nearest(const Point<double> & pt, double maxDist, T & result, double & dist) const
+{
+	bool found = false;
+	double best = maxDist * maxDist;
+	const Node * stack[MAX_DEPTH * MAX_ENTRIES];
+	int top = 0;
+	stack[top++] = m_root;
+	while (top > 0)
+	{
+		const Node * node = stack[--top];
+		for (int i = 0; i < node->Count; i++)
+		{
+			// pruning subtrees which can't contain closer value
+			double d = DistSquared(node->Rects[i], pt);
+			if (d > best)
+				continue;
+			if (node->Leaf)
+			{
+				found = true;
+				best = d;
+				result = node->Values[i];
+			}
+			else
+			{
+				assert(top < MAX_DEPTH * MAX_ENTRIES);
+				stack[top++] = node->Children[i];
+			}
+		}
+	}
+	if (found)
+		dist = std::sqrt(best);
+	return found;
+}
+
+
+template <class T>
+Rect<double> RTree<T>::CalcBounds(const Node * node)
+{
+	assert(node->Count > 0);
+	Rect<double> result = node->Rects[0];
+	for (int i = 1; i < node->Count; i++)
+		result = GetBoundingRect(result, node->Rects[i]);
+	return result;
+}
+
+
+template <class T>
+void RTree<T>::DeleteNode(Node * node)
+{
+	if (!node->Leaf)
+	{
+		for (int i = 0; i < node->Count; i++)
+			DeleteNode(node->Children[i]);
+	}
+	delete node;
+}
+
+
+template <class T>
+void RTree<T>::AddEntry(Node * node, const Rect<double> & rect, Node * child, const T & value)
+{
+	assert(node->Count <= MAX_ENTRIES);
+	node->Rects[node->Count] = rect;
+	if (node->Leaf)
+		node->Values[node->Count] = value;
+	else
+		node->Children[node->Count] = child;
+	node->Count++;
+}
+
+
+template <class T>
+void RTree<T>::RemoveEntry(Node * node, int pos)
+{
+	assert(0 <= pos && pos < node->Count);
+	node->Count--;
+	node->Rects[pos] = node->Rects[node->Count];
+	if (node->Leaf)
+		node->Values[pos] = node->Values[node->Count];
+	else
+		node->Children[pos] = node->Children[node->Count];
+}
+
+
+template <class T>
+void RTree<T>::CollectItems(const Node * node, std::vector<Item> & result)
+{
+	for (int i = 0; i < node->Count; i++)
+	{
+		if (node->Leaf)
+			result.push_back(Item(node->Rects[i], node->Values[i]));
+		else
+			CollectItems(node->Children[i], result);
+	}
+}
+
+
+template <class T>
+int RTree<T>::ChooseSubtree(const Node * node, const Rect<double> & rect)
+{
+	// choosing child which needs least enlargement, resolving ties by smallest area
+	int best = 0;
+	double bestEnlargement = std::numeric_limits<double>::max();
+	double bestArea = std::numeric_limits<double>::max();
+	for (int i = 0; i < node->Count; i++)
+	{
+		double area = Area(node->Rects[i]);
+		double enlargement = Area(GetBoundingRect(node->Rects[i], rect)) - area;
+		if (enlargement < bestEnlargement || (enlargement == bestEnlargement && area < bestArea))
+		{
+			best = i;
+			bestEnlargement = enlargement;
+			bestArea = area;
+		}
+	}
+	return best;
+}
+
+
+template <class T>
+typename RTree<T>::Node * RTree<T>::Split(Node * node)
+{
+	const int total = node->Count;
+	Rect<double> rects[MAX_ENTRIES + 1];
+	Node * children[MAX_ENTRIES + 1];
+	T values[MAX_ENTRIES + 1];
+	bool assigned[MAX_ENTRIES + 1];
+	for (int i = 0; i < total; i++)
+	{
+		rects[i] = node->Rects[i];
+		children[i] = node->Leaf ? 0 : node->Children[i];
+		if (node->Leaf)
+			values[i] = node->Values[i];
+		assigned[i] = false;
+	}
+	// picking seeds which would waste most area if put together
+	int seed1 = 0, seed2 = 1;
+	double worst = -std::numeric_limits<double>::max();
+	for (int i = 0; i < total; i++)
+	{
+		for (int j = i + 1; j < total; j++)
+		{
+			double waste = Area(GetBoundingRect(rects[i], rects[j])) - Area(rects[i]) - Area(rects[j]);
+			if (waste > worst)
+			{
+				worst = waste;
+				seed1 = i;
+				seed2 = j;
+			}
+		}
+	}
+	Node * sibling = new Node(node->Leaf);
+	node->Count = 0;
+	AddEntry(node, rects[seed1], children[seed1], values[seed1]);
+	AddEntry(sibling, rects[seed2], children[seed2], values[seed2]);
+	assigned[seed1] = assigned[seed2] = true;
+	Rect<double> bounds1 = rects[seed1], bounds2 = rects[seed2];
+	for (int remaining = total - 2; remaining > 0; remaining--)
+	{
+		// ensuring that both groups will have minimal number of entries
+		Node * forced = 0;
+		if (node->Count + remaining <= MIN_ENTRIES)
+			forced = node;
+		else if (sibling->Count + remaining <= MIN_ENTRIES)
+			forced = sibling;
+		// picking entry with greatest preference for one group
+		int next = -1;
+		double enl1 = 0, enl2 = 0;
+		double maxDiff = -1;
+		for (int i = 0; i < total; i++)
+		{
+			if (assigned[i])
+				continue;
+			double e1 = Area(GetBoundingRect(bounds1, rects[i])) - Area(bounds1);
+			double e2 = Area(GetBoundingRect(bounds2, rects[i])) - Area(bounds2);
+			if (std::fabs(e1 - e2) > maxDiff)
+			{
+				maxDiff = std::fabs(e1 - e2);
+				next = i;
+				enl1 = e1;
+				enl2 = e2;
+			}
+			if (forced)
+				break;
+		}
+		assert(next != -1);
+		Node * target = forced;
+		if (target == 0)
+		{
+			if (enl1 != enl2)
+				target = enl1 < enl2 ? node : sibling;
+			else if (Area(bounds1) != Area(bounds2))
+				target = Area(bounds1) < Area(bounds2) ? node : sibling;
+			else
+				target = node->Count <= sibling->Count ? node : sibling;
+		}
+		AddEntry(target, rects[next], children[next], values[next]);
+		assigned[next] = true;
+		if (target == node)
+			bounds1 = GetBoundingRect(bounds1, rects[next]);
+		else
+			bounds2 = GetBoundingRect(bounds2, rects[next]);
+	}
+	return sibling;
+}
+
+
+// returns new sibling if node was split
+template <class T>
+typename RTree<T>::Node * RTree<T>::InsertRec(Node * node, const Rect<double> & rect, const T & value)
+{
+	if (node->Leaf)
+	{
+		AddEntry(node, rect, 0, value);
+	}
+	else
+	{
+		int best = ChooseSubtree(node, rect);
+		Node * sibling = InsertRec(node->Children[best], rect, value);
+		if (sibling)
+		{
+			node->Rects[best] = CalcBounds(node->Children[best]);
+			AddEntry(node, CalcBounds(sibling), sibling, T());
+		}
+		else
+		{
+			node->Rects[best] = GetBoundingRect(node->Rects[best], rect);
+		}
+	}
+	return node->Count > MAX_ENTRIES ? Split(node) : 0;
+}
+
+
+template <class T>
+bool RTree<T>::RemoveRec(Node * node, const Rect<double> & rect, const T & value, std::vector<Item> & orphans)
+{
+	if (node->Leaf)
+	{
+		for (int i = 0; i < node->Count; i++)
+		{
+			if (node->Values[i] == value)
+			{
+				RemoveEntry(node, i);
+				return true;
+			}
+		}
+		return false;
+	}
+	for (int i = 0; i < node->Count; i++)
+	{
+		if (!IsLeftContainsRight(node->Rects[i], rect))
+			continue;
+		Node * child = node->Children[i];
+		if (!RemoveRec(child, rect, value, orphans))
+			continue;
+		if (child->Count < MIN_ENTRIES)
+		{
+			// dissolving underfilled node, its entries will be reinserted
+			CollectItems(child, orphans);
+			DeleteNode(child);
+			RemoveEntry(node, i);
+		}
+		else
+		{
+			node->Rects[i] = CalcBounds(child);
+		}
+		return true;
+	}
+	return false;
+}
+
+
+// orders entries so that each consecutive MAX_ENTRIES
+// entries form spatially compact tile
+template <class T>
+template <class E>
+void RTree<T>::SortTiles(std::vector<E> & entries)
+{
+	size_t numNodes = (entries.size() + MAX_ENTRIES - 1) / MAX_ENTRIES;
+	size_t numSlices = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(numNodes))));
+	size_t sliceSize = numSlices * MAX_ENTRIES;
+	std::sort(entries.begin(), entries.end(), CenterXLess());
+	for (size_t i = 0; i < entries.size(); i += sliceSize)
+	{
+		typename std::vector<E>::iterator end = i + sliceSize < entries.size() ?
+				entries.begin() + i + sliceSize : entries.end();
+		std::sort(entries.begin() + i, end, CenterYLess());
+	}
+}
+
+
+template <class T>
+void RTree<T>::InsertItem(const Rect<double> & rect, const T & value)
+{
+	Node * sibling = InsertRec(m_root, rect, value);
+	if (sibling)
+	{
+		Node * root = new Node(false);
+		AddEntry(root, CalcBounds(m_root), m_root, T());
+		AddEntry(root, CalcBounds(sibling), sibling, T());
+		m_root = root;
+	}
+}
+
+
+#endif /* RTREE_H_ */
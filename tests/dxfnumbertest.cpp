@@ -0,0 +1,107 @@
+/*
+ * dxfnumbertest.cpp
+ *
+ *  Created on: 18.10.2026
+ *      Author: misha
+ */
+
+#include "../dxfreader.h"
+#include <cstdio>
+#include <cstring>
+
+
+using namespace std;
+
+
+static int g_failures = 0;
+
+
+#define CHECK(cond) \
+	do { if (!(cond)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); g_failures++; } } while (0)
+
+
+static DxfStr Str(const char * value)
+{
+	return DxfStr(value, strlen(value));
+}
+
+
+static bool IsDouble(const char * value, double expected)
+{
+	try
+	{
+		return DxfToDouble(Str(value)) == expected;
+	}
+	catch (DxfError &)
+	{
+		return false;
+	}
+}
+
+
+static bool IsInvalidDouble(const char * value)
+{
+	try
+	{
+		DxfToDouble(Str(value));
+		return false;
+	}
+	catch (DxfError & err)
+	{
+		return err.Code == DxfErrorInvalidFormat;
+	}
+}
+
+
+static bool IsInvalidLong(const char * value)
+{
+	try
+	{
+		DxfToLong(Str(value));
+		return false;
+	}
+	catch (DxfError & err)
+	{
+		return err.Code == DxfErrorInvalidFormat;
+	}
+}
+
+
+static void TestDoubles()
+{
+	CHECK(IsDouble("1.5", 1.5));
+	CHECK(IsDouble("  -2.25\r", -2.25));
+	CHECK(IsDouble("1.", 1));
+	CHECK(IsDouble(".5", 0.5));
+	CHECK(IsDouble("1e3", 1000));
+	CHECK(IsDouble("1.5E-2 ", 0.015));
+	CHECK(IsDouble("123456789012345678901", 123456789012345678901.0));
+	CHECK(IsDouble("0.1", 0.1));
+}
+
+
+// whole value should be number, same as for integers
+static void TestInvalidDoubles()
+{
+	CHECK(IsInvalidDouble(""));
+	CHECK(IsInvalidDouble(" "));
+	CHECK(IsInvalidDouble("."));
+	CHECK(IsInvalidDouble("1.2.3"));
+	CHECK(IsInvalidDouble("1e"));
+	CHECK(IsInvalidDouble("1e+"));
+	CHECK(IsInvalidDouble("1 2"));
+	CHECK(IsInvalidDouble("12abc"));
+	CHECK(IsInvalidLong("12abc"));
+	CHECK(IsInvalidLong("1.5"));
+}
+
+
+int main()
+{
+	TestDoubles();
+	TestInvalidDoubles();
+	if (g_failures != 0)
+		return 1;
+	printf("dxfnumbertest: ok\n");
+	return 0;
+}
@@ -0,0 +1,184 @@
+/*
+ * exchangetest.cpp
+ *
+ *  Created on: 18.10.2026
+ *      Author: misha
+ */
+
+#include "../exchange.h"
+#include "../gcadfile.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <unistd.h>
+
+
+using namespace std;
+
+
+static int g_failures = 0;
+
+
+#define CHECK(cond) \
+	do { if (!(cond)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); g_failures++; } } while (0)
+
+
+template <class T>
+static T Swapped(T value)
+{
+	char * bytes = reinterpret_cast<char *>(&value);
+	reverse(bytes, bytes + sizeof(T));
+	return value;
+}
+
+
+static void PutLe(char * dest, uint64_t value, int size)
+{
+	for (int i = 0; i < size; i++, value >>= 8)
+		dest[i] = static_cast<char>(value & 0xff);
+}
+
+
+// uncompressed exchange data with image as payload
+static vector<char> MakeExchange(const vector<char> & image)
+{
+	vector<char> result(32);
+	memcpy(&result[0], "GCADXCHG", 8);
+	PutLe(&result[8], EXCHANGE_VERSION, 4);
+	PutLe(&result[12], 0, 4);
+	PutLe(&result[16], image.size(), 8);
+	PutLe(&result[24], image.size(), 8);
+	result.insert(result.end(), image.begin(), image.end());
+	return result;
+}
+
+
+static vector<char> MakeImage()
+{
+	GcadArrays arrays;
+	arrays.Lines.X1.push_back(1);
+	arrays.Lines.Y1.push_back(2);
+	arrays.Lines.X2.push_back(3);
+	arrays.Lines.Y2.push_back(4);
+	arrays.Objects.Type.push_back(GcadObjectLine);
+	arrays.Objects.Index.push_back(0);
+	arrays.DrawingBounds.push_back(Rect<double>(1, 2, 3, 4));
+	vector<char> image;
+	WriteGcadMemory(arrays, image);
+	return image;
+}
+
+
+static bool Decodes(const vector<char> & data, vector<char> & image)
+{
+	try
+	{
+		DecodeExchange(&data[0], data.size(), image);
+		return true;
+	}
+	catch (GcadError &)
+	{
+		return false;
+	}
+}
+
+
+static void TestForeignRoundTrip()
+{
+	vector<char> native = MakeImage();
+	vector<char> foreign = native;
+	SwapGcadImage(&foreign[0], foreign.size());
+	CHECK(foreign != native);
+	vector<char> image;
+	CHECK(Decodes(MakeExchange(foreign), image));
+	CHECK(image == native);
+}
+
+
+// section which claims huge count and zero size, count * element size
+// wraps to zero in size_t and used to pass size check of section
+static void TestForeignHugeCount()
+{
+	vector<char> foreign = MakeImage();
+	SwapGcadImage(&foreign[0], foreign.size());
+	GcadSectionEntry * table = reinterpret_cast<GcadSectionEntry *>(&foreign[0] + sizeof(GcadHeader));
+	CHECK(Swapped(table[0].Type) == GcadSectionLines);
+	table[0].Count = Swapped(static_cast<uint64_t>(1) << 62);
+	table[0].Size = 0;
+	vector<char> image;
+	CHECK(!Decodes(MakeExchange(foreign), image));
+}
+
+
+// section which is larger than rest of image
+static void TestForeignOversizedSection()
+{
+	vector<char> foreign = MakeImage();
+	SwapGcadImage(&foreign[0], foreign.size());
+	GcadSectionEntry * table = reinterpret_cast<GcadSectionEntry *>(&foreign[0] + sizeof(GcadHeader));
+	table[0].Count = Swapped(static_cast<uint64_t>(foreign.size()));
+	vector<char> image;
+	CHECK(!Decodes(MakeExchange(foreign), image));
+}
+
+
+static void Touch(const string & path)
+{
+	FILE * file = fopen(path.c_str(), "wb");
+	CHECK(file != 0);
+	if (file != 0)
+		fclose(file);
+}
+
+
+static bool Exists(const string & path)
+{
+	return access(path.c_str(), F_OK) == 0;
+}
+
+
+// only old files of copies are deleted, file in clipboard is kept
+static void TestDeleteStaleFiles()
+{
+	char dir[] = "/tmp/exchangetest-XXXXXX";
+	CHECK(mkdtemp(dir) != 0);
+	setenv("TMPDIR", dir, 1);
+	char fresh[64];
+	sprintf(fresh, "gcad-1-%lu-0.clip", static_cast<unsigned long>(time(0)));
+	const char * names[] = {"gcad-1-1000-0.clip", "gcad-1-1000-1.clip", fresh, "gcad.clip", "gcad-1-1000-2.clip.txt"};
+	const int count = sizeof(names) / sizeof(names[0]);
+	for (int i = 0; i < count; i++)
+		Touch(string(dir) + "/" + names[i]);
+	vector<char> reference(32);
+	memcpy(&reference[0], "GCADXCHG", 8);
+	PutLe(&reference[8], EXCHANGE_VERSION, 4);
+	PutLe(&reference[12], ExchangeFileReference, 4);
+	PutLe(&reference[24], strlen(names[1]), 8);
+	reference.insert(reference.end(), names[1], names[1] + strlen(names[1]));
+	CHECK(GetExchangeFileName(&reference[0], reference.size()) == names[1]);
+	CHECK(GetExchangeFileName(&reference[0], reference.size() - 1).empty());
+	vector<char> embedded = MakeExchange(MakeImage());
+	CHECK(GetExchangeFileName(&embedded[0], embedded.size()).empty());
+	DeleteStaleExchangeFiles(GetExchangeFileName(&reference[0], reference.size()));
+	CHECK(!Exists(string(dir) + "/" + names[0]));
+	for (int i = 1; i < count; i++)
+		CHECK(Exists(string(dir) + "/" + names[i]));
+	for (int i = 0; i < count; i++)
+		remove((string(dir) + "/" + names[i]).c_str());
+	rmdir(dir);
+}
+
+
+int main()
+{
+	TestForeignRoundTrip();
+	TestForeignHugeCount();
+	TestForeignOversizedSection();
+	TestDeleteStaleFiles();
+	if (g_failures != 0)
+		return 1;
+	printf("exchangetest: ok\n");
+	return 0;
+}
@@ -0,0 +1,351 @@
+/*
+ * intersectbatchtest.cpp
+ *
+ *  Created on: 18.10.2026
+ *      Author: misha
+ */
+
+// compares IntersectBatch with scalar Intersect, it is built for each kind of lanes:
+// default target, -mavx2 and EXMATH_NO_SIMD
+
+#include "../exmath.h"
+#include <cstdio>
+#include <vector>
+
+
+using namespace std;
+
+
+#if defined(EXMATH_NO_SIMD) || !defined(EXMATH_SIMD_LANES)
+static const char * const LANES = "scalar";
+#elif defined(__AVX2__)
+static const char * const LANES = "avx2";
+#else
+static const char * const LANES = "sse2";
+#endif
+
+
+static int g_failures = 0;
+
+
+#define CHECK(cond) \
+	do { if (!(cond)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); g_failures++; } } while (0)
+
+
+// points which differ less than this are same, values are below 100
+static const double TOLERANCE = 1e-6;
+
+
+static unsigned long g_seed = 12345;
+
+
+static double Random(double range)
+{
+	g_seed = g_seed * 1103515245 + 12345;
+	return (g_seed >> 8 & 0xffffff) / double(0x1000000) * range;
+}
+
+
+// some of coordinates are whole numbers, so there are parallel, axis aligned
+// and touching primitives among random ones
+static double RandomCoord()
+{
+	double value = Random(100);
+	return Random(1) < 0.3 ? floor(value / 10) * 10 : value;
+}
+
+
+struct Primitives
+{
+	vector<double> X1, Y1, X2, Y2;
+	vector<double> CX, CY, R, SX, SY, EX, EY;
+	vector<char> Ccw;
+
+	void Generate(size_t count)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			X1.push_back(RandomCoord());
+			Y1.push_back(RandomCoord());
+			X2.push_back(Random(1) < 0.1 ? X1.back() : RandomCoord());
+			Y2.push_back(Random(1) < 0.1 ? Y1.back() : RandomCoord());
+			CX.push_back(RandomCoord());
+			CY.push_back(RandomCoord());
+			R.push_back(Random(1) < 0.3 ? 10 : 1 + Random(40));
+			double start = Random(2 * M_PI), end = Random(2 * M_PI);
+			SX.push_back(CX.back() + R.back() * cos(start));
+			SY.push_back(CY.back() + R.back() * sin(start));
+			EX.push_back(CX.back() + R.back() * cos(end));
+			EY.push_back(CY.back() + R.back() * sin(end));
+			Ccw.push_back(Random(1) < 0.5);
+		}
+	}
+	LineSpan GetLines() const
+	{
+		LineSpan result = {&X1[0], &Y1[0], &X2[0], &Y2[0], X1.size()};
+		return result;
+	}
+	CircleSpan GetCircles() const
+	{
+		CircleSpan result = {&CX[0], &CY[0], &R[0], CX.size()};
+		return result;
+	}
+	ArcSpan GetArcs() const
+	{
+		ArcSpan result = {&CX[0], &CY[0], &R[0], &SX[0], &SY[0], &EX[0], &EY[0], &Ccw[0], CX.size()};
+		return result;
+	}
+	Line GetLine(size_t i) const { return Line(Point<double>(X1[i], Y1[i]), Point<double>(X2[i], Y2[i])); }
+	Circle GetCircle(size_t i) const
+	{
+		Circle result;
+		result.Center = Point<double>(CX[i], CY[i]);
+		result.Radius = R[i];
+		return result;
+	}
+	CircleArc GetArc(size_t i) const { return GetArcs().GetArc(i); }
+};
+
+
+// near degenerate cases can give different number of points
+// because of rounding, those are counted but not compared
+static bool NearBorder(const Rect<double> & rect, const Point<double> & pt)
+{
+	return fabs(pt.X - rect.Pt1.X) < TOLERANCE || fabs(pt.X - rect.Pt2.X) < TOLERANCE ||
+			fabs(pt.Y - rect.Pt1.Y) < TOLERANCE || fabs(pt.Y - rect.Pt2.Y) < TOLERANCE;
+}
+
+
+static bool NearEnd(const CircleArc & arc, const Point<double> & pt)
+{
+	return (pt - arc.Start).Length() < TOLERANCE || (pt - arc.End).Length() < TOLERANCE;
+}
+
+
+static bool IsAmbiguous(const Line & line, const Point<double> & pt)
+{
+	return NearBorder(line.GetBoundingRect(), pt);
+}
+
+
+static bool IsAmbiguous(const Circle &, const Point<double> &)
+{
+	return false;
+}
+
+
+static bool IsAmbiguous(const CircleArc & arc, const Point<double> & pt)
+{
+	return NearEnd(arc, pt);
+}
+
+
+static bool IsDegenerate(const Line & lhs, const Line & rhs)
+{
+	Point<double> d1 = lhs.Point2 - lhs.Point1, d2 = rhs.Point2 - rhs.Point1;
+	return fabs(d1.X * d2.Y - d1.Y * d2.X) < TOLERANCE * (1 + d1.Length() * d2.Length());
+}
+
+
+static bool IsDegenerate(const Line & line, const Circle & circle)
+{
+	Point<double> d = line.Point2 - line.Point1;
+	if (d.Length() == 0)
+		return true;
+	Point<double> f = circle.Center - line.Point1;
+	double dist = fabs(d.X * f.Y - d.Y * f.X) / d.Length();
+	return fabs(dist - circle.Radius) < TOLERANCE;
+}
+
+
+static bool IsDegenerate(const Circle & lhs, const Circle & rhs)
+{
+	double d = (lhs.Center - rhs.Center).Length();
+	return fabs(d - (lhs.Radius + rhs.Radius)) < TOLERANCE || fabs(d - fabs(lhs.Radius - rhs.Radius)) < TOLERANCE;
+}
+
+
+static bool IsDegenerate(const Circle & circle, const Line & line)
+{
+	return IsDegenerate(line, circle);
+}
+
+
+static const Circle & AsPrimitive(const CircleArc & arc) { return arc; }
+static const Circle & AsPrimitive(const Circle & circle) { return circle; }
+static const Line & AsPrimitive(const Line & line) { return line; }
+
+
+struct Stats
+{
+	size_t Pairs;
+	size_t Points;
+	size_t Ambiguous;
+	Stats() : Pairs(0), Points(0), Ambiguous(0) {}
+};
+
+
+static bool Contains(const vector<Point<double> > & points, const Point<double> & pt)
+{
+	for (size_t i = 0; i < points.size(); i++)
+	{
+		if ((points[i] - pt).Length() < TOLERANCE)
+			return true;
+	}
+	return false;
+}
+
+
+template <class Query, class Other>
+static void ComparePair(const Query & query, const Other & other, const vector<Point<double> > & batch, Stats & stats)
+{
+	IntersectResult scalar = Intersect(query, other);
+	vector<Point<double> > expected(scalar.begin(), scalar.end());
+	stats.Pairs++;
+	stats.Points += expected.size();
+	vector<Point<double> > all(expected);
+	all.insert(all.end(), batch.begin(), batch.end());
+	bool ambiguous = IsDegenerate(AsPrimitive(query), AsPrimitive(other));
+	for (size_t i = 0; i < all.size(); i++)
+		ambiguous = ambiguous || IsAmbiguous(query, all[i]) || IsAmbiguous(other, all[i]);
+	if (ambiguous)
+	{
+		stats.Ambiguous++;
+		return;
+	}
+	bool same = expected.size() == batch.size();
+	for (size_t i = 0; same && i < expected.size(); i++)
+		same = Contains(batch, expected[i]) && Contains(expected, batch[i]);
+	if (!same)
+	{
+		fprintf(stderr, "%s: %lu scalar and %lu batch points\n", LANES,
+				static_cast<unsigned long>(expected.size()), static_cast<unsigned long>(batch.size()));
+		g_failures++;
+	}
+}
+
+
+// span of count primitives, so tails which go through scalar lanes are checked too
+template <class Query, class Span, class Getter>
+static void CompareBatch(const Query & query, const Span & span, Getter get, Stats & stats)
+{
+	vector<BatchIntersection> result(2 * span.Count + 1);
+	size_t found = IntersectBatch(query, span, &result[0]);
+	CHECK(found <= 2 * span.Count);
+	vector<vector<Point<double> > > byIndex(span.Count);
+	for (size_t i = 0; i < found; i++)
+	{
+		CHECK(result[i].Index < span.Count);
+		CHECK(i == 0 || result[i - 1].Index <= result[i].Index);
+		byIndex[result[i].Index].push_back(result[i].Pt);
+	}
+	for (size_t i = 0; i < span.Count; i++)
+		ComparePair(query, get(i), byIndex[i], stats);
+}
+
+
+struct GetLine
+{
+	const Primitives & m_p;
+	explicit GetLine(const Primitives & p) : m_p(p) {}
+	Line operator()(size_t i) const { return m_p.GetLine(i); }
+};
+
+
+struct GetCircle
+{
+	const Primitives & m_p;
+	explicit GetCircle(const Primitives & p) : m_p(p) {}
+	Circle operator()(size_t i) const { return m_p.GetCircle(i); }
+};
+
+
+struct GetArc
+{
+	const Primitives & m_p;
+	explicit GetArc(const Primitives & p) : m_p(p) {}
+	CircleArc operator()(size_t i) const { return m_p.GetArc(i); }
+};
+
+
+template <class Query>
+static void CompareWithAll(const Query & query, const Primitives & spans, Stats & stats)
+{
+	CompareBatch(query, spans.GetLines(), GetLine(spans), stats);
+	CompareBatch(query, spans.GetCircles(), GetCircle(spans), stats);
+	CompareBatch(query, spans.GetArcs(), GetArc(spans), stats);
+}
+
+
+// axis aligned segments touching circle, scalar Intersect gives one point for them
+// and batch should not give two close points or miss it because of rounding
+static void TestTangents()
+{
+	double x1[] = {30, 1.7461419105529785, 63.039177656173706, 10};
+	double y1[] = {60, 70, 10, 50};
+	double x2[] = {30, 50, 18.125045299530029, 10};
+	double y2[] = {89.325755834579468, 70, 10, 24.958258867263794};
+	double cx[] = {20, 20, 27.896499633789062, 20};
+	double cy[] = {60, 60, 20, 39.718133211135864};
+	LineSpan lines = {x1, y1, x2, y2, 4};
+	BatchIntersection result[8];
+	for (size_t i = 0; i < 4; i++)
+	{
+		Circle circle;
+		circle.Center = Point<double>(cx[i], cy[i]);
+		circle.Radius = 10;
+		Line line(Point<double>(x1[i], y1[i]), Point<double>(x2[i], y2[i]));
+		IntersectResult scalar = Intersect(line, circle);
+		CHECK(scalar.size() == 1);
+		size_t found = IntersectBatch(circle, lines, result);
+		size_t count = 0;
+		for (size_t j = 0; j < found; j++)
+		{
+			if (result[j].Index == i)
+			{
+				count++;
+				CHECK(scalar.size() == 1 && (result[j].Pt - scalar[0]).Length() < TOLERANCE);
+			}
+		}
+		CHECK(count == 1);
+		CircleSpan circles = {&cx[i], &cy[i], &circle.Radius, 1};
+		CHECK(IntersectBatch(line, circles, result) == 1);
+	}
+}
+
+
+static void TestAgainstScalar()
+{
+	Primitives queries, spans;
+	queries.Generate(300);
+	// not multiple of any lane width
+	spans.Generate(403);
+	Stats stats;
+	for (size_t i = 0; i < queries.X1.size(); i++)
+	{
+		CompareWithAll(queries.GetLine(i), spans, stats);
+		CompareWithAll(queries.GetCircle(i), spans, stats);
+		CompareWithAll(queries.GetArc(i), spans, stats);
+	}
+	// most pairs should be compared and there should be points to compare
+	CHECK(stats.Ambiguous * 20 < stats.Pairs);
+	CHECK(stats.Points * 10 > stats.Pairs);
+}
+
+
+int main()
+{
+#ifdef __AVX2__
+	if (!__builtin_cpu_supports("avx2"))
+	{
+		printf("intersectbatchtest (%s): skipped, processor has no avx2\n", LANES);
+		return 0;
+	}
+#endif
+	TestTangents();
+	TestAgainstScalar();
+	if (g_failures != 0)
+		return 1;
+	printf("intersectbatchtest (%s): ok\n", LANES);
+	return 0;
+}
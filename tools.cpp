@@ -240,6 +240,7 @@ void DrawPLineTool::Command(const wstring & cmd)
 		{
 			m_result->Closed = true;
 			m_result->Nodes.back().Bulge = 0;
+			g_doc.Update(m_result);
 			InvalidateRect(g_hclientWindow, 0, true);
 			ExitTool();
 		}
@@ -263,6 +264,7 @@ void DrawPLineTool::Command(const wstring & cmd)
 			m_result->Closed = true;
 			*m_fantomArc = ArcFrom2PtAndNormTangent(m_fantomArc->Start, m_arcDir, m_result->Nodes.front().point);
 			m_result->Nodes.back().Bulge = m_fantomArc->CalcBulge();
+			g_doc.Update(m_result);
 			InvalidateRect(g_hclientWindow, 0, true);
 			ExitTool();
 		}
@@ -293,7 +295,7 @@ void DrawPLineTool::Exiting()
 		return;
 	if (m_result->Nodes.size() <= 1)
 	{
-		g_doc.Objects.remove(m_result);
+		g_doc.Remove(m_result);
 		delete m_result;
 	}
 	else
@@ -362,11 +364,11 @@ void DrawPLineTool::FeedFirstPoint(const Point<double> & pt)
 	m_state = StateSelLineSecondPt;
 	SetPrompt();
 	m_result = new CadPolyline;
-	g_doc.Objects.push_back(m_result);
 	CadPolyline::Node node;
 	node.Bulge = 0;
 	node.point = pt;
 	m_result->Nodes.push_back(node);
+	g_doc.Add(m_result);
 	InvalidateRect(g_hclientWindow, 0, true);
 }
 
@@ -383,6 +385,7 @@ void DrawPLineTool::FeedLineSecondPoint(const Point<double> & pt)
 	node.point = pt;
 	m_arcDir = (pt - m_fantomLine->Point1).Normalize();
 	m_result->Nodes.push_back(node);
+	g_doc.Update(m_result);
 	m_fantomLine->Point1 = pt;
 	m_fantomLine->Point2 = g_cursorWrld;
 	InvalidateRect(g_hclientWindow, 0, true);
@@ -408,6 +411,7 @@ void DrawPLineTool::FeedArcEndPoint(const Point<double> & pt)
 	node.Bulge = 0;
 	node.point = pt;
 	m_result->Nodes.push_back(node);
+	g_doc.Update(m_result);
 	m_arcDir = DirVector((m_fantomArc->End - m_fantomArc->Center).Angle() + (m_fantomArc->Ccw ? M_PI/2 : -M_PI/2));
 	*m_fantomArc = ArcFrom2PtAndNormTangent(pt, m_arcDir, g_cursorWrld);
 	m_fantomLine->Point1 = pt;
@@ -1027,15 +1031,10 @@ void MoveTool::FeedBasePoint(const Point<double> & pt)
 void MoveTool::FeedDestPoint(const Point<double> & pt)
 {
 	CalcPositions(pt);
-	auto_ptr<GroupUndoItem> group(new GroupUndoItem);
-	int no = 0;
-	for (list<CadObject*>::iterator i = g_selected.begin();
-		i != g_selected.end(); i++, no++)
-	{
-		group->AddItem(new AssignObjectUndoItem(*i, m_objects[no]));
-		m_objects[no] = 0;
-	}
-	g_undoManager.AddWork(group.release());
+	vector<CadObject *> originals(g_selected.begin(), g_selected.end());
+	auto_ptr<UndoItem> item(new AssignObjectsUndoItem(originals, m_objects));
+	m_objects.assign(m_objects.size(), 0);
+	g_undoManager.AddWork(item.release());
 	ExitTool();
 }
 
@@ -1166,15 +1165,10 @@ void RotateTool::FeedBasePoint(Point<double> pt)
 void RotateTool::FeedAngle(double angle)
 {
 	CalcPositions(angle);
-	auto_ptr<GroupUndoItem> group(new GroupUndoItem);
-	int no = 0;
-	for (list<CadObject*>::iterator i = g_selected.begin();
-		i != g_selected.end(); i++, no++)
-	{
-		group->AddItem(new AssignObjectUndoItem(*i, m_objects[no]));
-		m_objects[no] = 0;
-	}
-	g_undoManager.AddWork(group.release());
+	vector<CadObject *> originals(g_selected.begin(), g_selected.end());
+	auto_ptr<UndoItem> item(new AssignObjectsUndoItem(originals, m_objects));
+	m_objects.assign(m_objects.size(), 0);
+	g_undoManager.AddWork(item.release());
 	ExitTool();
 }
 
@@ -1191,6 +1185,7 @@ void TrimTool::Start()
 void TrimTool::Exiting()
 {
 	g_selected.clear();
+	m_bounds.Clear();
 }
 
 
@@ -1202,7 +1197,11 @@ void TrimTool::SelectedEdgesHandler(CadObject*, size_t)
 		ExitTool();
 		return;
 	}
-	m_bounds.assign(g_selected.begin(), g_selected.end());
+	vector<RTree<CadObject *>::Item> items;
+	items.reserve(g_selected.size());
+	for (SelectionSet::const_iterator i = g_selected.begin(); i != g_selected.end(); i++)
+		items.push_back(make_pair((*i)->GetBoundingRect(), *i));
+	m_bounds.BulkLoad(items);
 	BeginSelecting(L"Select object to trim:", Functor<void, LOKI_TYPELIST_2(CadObject*, size_t)>(this, &TrimTool::SelectedObjectToTrimHandler), false);
 }
 
@@ -1218,10 +1217,26 @@ void TrimTool::SelectedObjectToTrimHandler(CadObject * obj, size_t num)
 
 class TrimVisitor : public ICadObjVisitor
 {
-	const vector<CadObject *> & m_bounds;
+	const RTree<CadObject *> & m_bounds;
+	// scratch buffers owned by tool, their capacity is reused between trims
+	vector<Point<double> > & m_intersections;
+	vector<CadObject *> & m_candidates;
 public:
-	TrimVisitor(const vector<CadObject *> & bounds) : m_bounds(bounds) {}
+	TrimVisitor(const RTree<CadObject *> & bounds, vector<Point<double> > & intersections,
+			vector<CadObject *> & candidates) :
+		m_bounds(bounds), m_intersections(intersections), m_candidates(candidates) {}
 private:
+	// returns cutting edges which bounding rectangles intersect given one
+	const vector<CadObject *> & QueryBounds(const Rect<double> & rect)
+	{
+		// widened since intersections are found with tolerance
+		Rect<double> query(Point<double>(rect.Pt1.X - EPSILON, rect.Pt1.Y - EPSILON),
+				Point<double>(rect.Pt2.X + EPSILON, rect.Pt2.Y + EPSILON));
+		m_candidates.clear();
+		m_bounds.Query(query, m_candidates);
+		return m_candidates;
+	}
+
 	template <class T>
 	struct Comp : binary_function<Point<double>, Point<double>, bool>
 	{
@@ -1233,23 +1248,31 @@ private:
 		const T & m_line;
 	};
 
+	template <class T>
+	struct IsEndPoint : unary_function<Point<double>, bool>
+	{
+		IsEndPoint(const T & line) : m_line(line) {}
+		bool operator()(const Point<double> & pt) const
+		{
+			return EqualsEpsilon(m_line.GetStart(), pt) || EqualsEpsilon(m_line.GetEnd(), pt);
+		}
+		const T & m_line;
+	};
+
 	template <class T>
 	void GenericTrim(T & line)
 	{
-		vector<Point<double> > intersections;
-		for (vector<CadObject*>::const_iterator i = m_bounds.begin();
-			i != m_bounds.end(); i++)
+		vector<Point<double> > & intersections = m_intersections;
+		intersections.clear();
+		const vector<CadObject *> & bounds = QueryBounds(line.GetBoundingRect());
+		for (vector<CadObject*>::const_iterator i = bounds.begin();
+			i != bounds.end(); i++)
 		{
-			vector<Point<double> > res = Intersect2(line, **i);
-			// removing intersections with end points
-			for (vector<Point<double> >::const_iterator i = res.begin();
-				i != res.end(); i++)
-			{
-				if (EqualsEpsilon(line.GetStart(), *i) || EqualsEpsilon(line.GetEnd(), *i))
-					continue;
-				intersections.push_back(*i);
-			}
+			Intersect2(line, **i, intersections);
 		}
+		// removing intersections with end points
+		intersections.erase(remove_if(intersections.begin(), intersections.end(),
+				IsEndPoint<T>(line)), intersections.end());
 		if (intersections.size() == 0)
 			return;
 		// sorting intersection points by distance from first point of line
@@ -1309,12 +1332,13 @@ private:
 
 	virtual void Visit(CadCircle & circle)
 	{
-		vector<Point<double> > intersections;
-		for (vector<CadObject*>::const_iterator i = m_bounds.begin();
-			i != m_bounds.end(); i++)
+		vector<Point<double> > & intersections = m_intersections;
+		intersections.clear();
+		const vector<CadObject *> & bounds = QueryBounds(circle.GetBoundingRect());
+		for (vector<CadObject*>::const_iterator i = bounds.begin();
+			i != bounds.end(); i++)
 		{
-			vector<Point<double> > res = Intersect2(circle, **i);
-			intersections.insert(intersections.end(), res.begin(), res.end());
+			Intersect2(circle, **i, intersections);
 		}
 		if (intersections.size() == 0)
 			return;
@@ -1363,11 +1387,12 @@ private:
 	{
 		CadPolyline2 polyline = polyline1;
 		vector<pair<CadPolyline2::Iterator, Point<double> > > intersections;
-		for (vector<CadObject*>::const_iterator ibound = m_bounds.begin();
-			ibound != m_bounds.end(); ibound++)
+		for (CadPolyline2::Iterator iseg = polyline.Begin();
+			iseg != polyline.End(); iseg++)
 		{
-			for (CadPolyline2::Iterator iseg = polyline.Begin();
-				iseg != polyline.End(); iseg++)
+			const vector<CadObject *> & bounds = QueryBounds((*iseg)->GetBoundingRect());
+			for (vector<CadObject*>::const_iterator ibound = bounds.begin();
+				ibound != bounds.end(); ibound++)
 			{
 				vector<Point<double> > subres = Intersect2(static_cast<const CadObject&>(**iseg), **ibound);
 				for (vector<Point<double> >::const_iterator ipoint = subres.begin();
@@ -1483,12 +1508,17 @@ private:
 			}
 		}
 	}
+
+	virtual void Visit(CadInsert &)
+	{
+		g_console.Log(L"Block references can't be trimmed");
+	}
 };
 
 
 void TrimTool::MakeTrim(CadObject * obj)
 {
-	TrimVisitor trimmer(m_bounds);
+	TrimVisitor trimmer(m_bounds, m_intersections, m_candidates);
 	obj->Accept(trimmer);
 	InvalidateRect(g_hclientWindow, 0, true);
 }
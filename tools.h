@@ -181,7 +181,40 @@ private:
 	void SelectedEdgesHandler(CadObject*, size_t);
 	void SelectedObjectToTrimHandler(CadObject*, size_t);
 	void MakeTrim(CadObject * obj);
-	std::vector<CadObject*> m_bounds;
+	// cutting edges by their bounding rectangles, built once they are selected
+	RTree<CadObject *> m_bounds;
+	std::vector<Point<double> > m_intersections;
+	std::vector<CadObject *> m_candidates;
+};
+
+
+// Benchmark tools are defined in bench.cpp which is built only by Bench
+// configuration, application itself doesn't have these commands.
+
+// compares cloning of objects from pool with cloning on general heap,
+// uses selected objects or generated ones if nothing is selected
+class AllocBenchTool : public Tool
+{
+public:
+	virtual void Start();
+};
+
+
+// writes objects into dxf in memory and reads them back,
+// uses selected objects or generated ones if nothing is selected
+class DxfBenchTool : public Tool
+{
+public:
+	virtual void Start();
+};
+
+
+// compares copy and paste of objects serialized one by one with bulk arrays,
+// uses selected objects or generated ones if nothing is selected
+class ClipBenchTool : public Tool
+{
+public:
+	virtual void Start();
 };
 
 
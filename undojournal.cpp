@@ -0,0 +1,143 @@
+/*
+ * undojournal.cpp
+ *
+ *  Created on: 18.10.2026
+ *      Author: misha
+ */
+#include "undojournal.h"
+#include <cassert>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+
+using namespace std;
+
+
+// file is compacted when it is larger than this and most of it is freed records
+static const unsigned long long COMPACT_SIZE = 16 << 20;
+
+
+static FILE * OpenTempFile()
+{
+#ifdef _WIN32
+	wchar_t dir[MAX_PATH + 1];
+	DWORD len = GetTempPathW(sizeof(dir) / sizeof(dir[0]), dir);
+	if (len == 0 || len > sizeof(dir) / sizeof(dir[0]))
+		return 0;
+	wchar_t path[MAX_PATH + 1];
+	if (GetTempFileNameW(dir, L"gcu", 0, path) == 0)
+		return 0;
+	// D makes file to be deleted when it is closed
+	return _wfopen(path, L"w+bD");
+#else
+	return tmpfile();
+#endif
+}
+
+
+static bool Seek(FILE * file, unsigned long long offset)
+{
+#ifdef _WIN32
+	return fseeko64(file, offset, SEEK_SET) == 0;
+#else
+	return fseeko(file, offset, SEEK_SET) == 0;
+#endif
+}
+
+
+UndoJournal::UndoJournal() : m_file(0), m_fileSize(0), m_liveSize(0)
+{
+}
+
+
+UndoJournal::~UndoJournal()
+{
+	if (m_file != 0)
+		fclose(m_file);
+}
+
+
+bool UndoJournal::Write(const vector<unsigned char> & data, unsigned long & record)
+{
+	if (m_file == 0 && (m_file = OpenTempFile()) == 0)
+		return false;
+	if (m_fileSize > COMPACT_SIZE && m_fileSize - m_liveSize > m_liveSize)
+		Compact();
+	if (!Seek(m_file, m_fileSize))
+		return false;
+	if (!data.empty() && fwrite(&data[0], 1, data.size(), m_file) != data.size())
+		return false;
+	if (m_freeRecords.empty())
+	{
+		record = m_records.size();
+		m_records.push_back(Record());
+	}
+	else
+	{
+		record = m_freeRecords.back();
+		m_freeRecords.pop_back();
+	}
+	m_records[record].Offset = m_fileSize;
+	m_records[record].Size = data.size();
+	m_records[record].Used = true;
+	m_fileSize += data.size();
+	m_liveSize += data.size();
+	return true;
+}
+
+
+bool UndoJournal::Read(unsigned long record, vector<unsigned char> & data)
+{
+	assert(record < m_records.size() && m_records[record].Used);
+	const Record & rec = m_records[record];
+	data.resize(rec.Size);
+	if (rec.Size == 0)
+		return true;
+	if (!Seek(m_file, rec.Offset))
+		return false;
+	return fread(&data[0], 1, rec.Size, m_file) == rec.Size;
+}
+
+
+void UndoJournal::Free(unsigned long record)
+{
+	assert(record < m_records.size() && m_records[record].Used);
+	m_records[record].Used = false;
+	m_liveSize -= m_records[record].Size;
+	m_freeRecords.push_back(record);
+	// everything is freed, file is written from beginning again
+	if (m_liveSize == 0)
+		m_fileSize = 0;
+}
+
+
+// copies live records to new file, returns false if that failed
+// and old file is still used
+bool UndoJournal::Compact()
+{
+	FILE * file = OpenTempFile();
+	if (file == 0)
+		return false;
+	vector<unsigned long long> offsets(m_records.size());
+	unsigned long long size = 0;
+	vector<unsigned char> data;
+	for (size_t i = 0; i < m_records.size(); i++)
+	{
+		if (!m_records[i].Used)
+			continue;
+		if (!Read(i, data) || (!data.empty() && fwrite(&data[0], 1, data.size(), file) != data.size()))
+		{
+			fclose(file);
+			return false;
+		}
+		offsets[i] = size;
+		size += data.size();
+	}
+	for (size_t i = 0; i < m_records.size(); i++)
+		m_records[i].Offset = offsets[i];
+	fclose(m_file);
+	m_file = file;
+	m_fileSize = size;
+	return true;
+}
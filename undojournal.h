@@ -0,0 +1,51 @@
+/*
+ * undojournal.h
+ *
+ *  Created on: 18.10.2026
+ *      Author: misha
+ */
+
+#ifndef UNDOJOURNAL_H_
+#define UNDOJOURNAL_H_
+
+
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+
+
+// Temporary file where undo history keeps data which isn't needed until
+// undo or redo gets to it. File is created on first write and deleted when
+// journal is destroyed. Records are identified by numbers which stay the same
+// when file is compacted.
+class UndoJournal
+{
+public:
+	UndoJournal();
+	~UndoJournal();
+	// returns false if file can't be created or written
+	bool Write(const std::vector<unsigned char> & data, unsigned long & record);
+	// returns false if file can't be read, record stays in journal
+	bool Read(unsigned long record, std::vector<unsigned char> & data);
+	void Free(unsigned long record);
+	unsigned long long GetFileSize() const { return m_fileSize; }
+	unsigned long long GetLiveSize() const { return m_liveSize; }
+private:
+	struct Record
+	{
+		unsigned long long Offset;
+		size_t Size;
+		bool Used;
+	};
+	std::FILE * m_file;
+	std::vector<Record> m_records;
+	std::vector<unsigned long> m_freeRecords;
+	unsigned long long m_fileSize;
+	unsigned long long m_liveSize;
+	bool Compact();
+	UndoJournal(const UndoJournal &);
+	UndoJournal & operator=(const UndoJournal &);
+};
+
+
+#endif /* UNDOJOURNAL_H_ */